@@ -0,0 +1,202 @@
+#include "backend_health.h"
+#include "log.h"
+#include <cstdio>
+
+// 错误率对读取排序的放大系数：错误率 50% 的后端分数约为 6 倍延迟
+static const double ERROR_RATE_WEIGHT = 10.0;
+
+BackendHealth::BackendHealth(int num_backends, const HealthConfig &config)
+    : config_(config)
+{
+    if (config_.ewma_alpha <= 0 || config_.ewma_alpha > 1) config_.ewma_alpha = 0.2;
+    if (config_.failure_threshold == 0) config_.failure_threshold = 1;
+    for (int i = 0; i < num_backends; i++) {
+        auto b = std::make_unique<Backend>();
+        for (int op = 0; op < 2; op++) {
+            std::string labels = "backend=\"" + std::to_string(i) + "\",op=\"" +
+                                 (op == (int)Op::READ ? "read" : "write") + "\"";
+            b->latency[op] = metrics().histogram("cloudraidfs_backend_request_duration_seconds",
+                                                 "后端 chunk 请求延迟", labels);
+            b->bytes[op] = metrics().counter("cloudraidfs_backend_bytes_total",
+                                             "后端 chunk 请求传输的字节数", labels);
+            b->failures[op] = metrics().counter("cloudraidfs_backend_failures_total",
+                                                "后端 chunk 请求失败或超时次数", labels);
+        }
+        backends_.push_back(std::move(b));
+    }
+}
+
+int BackendHealth::update(Backend &b, Op op, double elapsed_ms, uint64_t bytes, bool ok,
+                          bool sample)
+{
+    const double a = config_.ewma_alpha;
+    BackendHealthStats &s = b.s;
+
+    s.requests++;
+    if (!ok) s.failures++;
+    s.error_rate = s.error_rate * (1 - a) + (ok ? 0.0 : a);
+
+    // 延迟与吞吐只统计成功的请求；失败的请求往往立即返回，会把延迟拉低
+    if (ok && sample) {
+        double mbps = elapsed_ms > 0 ? (double)bytes / 1048576.0 / (elapsed_ms / 1000.0) : 0;
+        bool &seen = op == Op::READ ? b.seen_read : b.seen_write;
+        double &latency = op == Op::READ ? s.read_latency_ms : s.write_latency_ms;
+        double &tput = op == Op::READ ? s.read_mbps : s.write_mbps;
+        if (!seen) {
+            latency = elapsed_ms;
+            tput = mbps;
+            seen = true;
+        } else {
+            latency = latency * (1 - a) + elapsed_ms * a;
+            if (bytes) tput = tput * (1 - a) + mbps * a;
+        }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (ok) {
+        b.consecutive_failures = 0;
+        // 熔断中任一请求成功（包括熔断前发出、迟到完成的请求）都说明后端已能正常响应
+        if (s.state != BackendHealthStats::State::CLOSED) {
+            s.state = BackendHealthStats::State::CLOSED;
+            return 1;
+        }
+        return 0;
+    }
+
+    b.consecutive_failures++;
+    if (s.state != BackendHealthStats::State::CLOSED) {
+        // 探测失败：重新开始冷却
+        if (now - b.opened_at >= std::chrono::milliseconds(config_.open_ms)) {
+            b.opened_at = now;
+        }
+    } else if (b.consecutive_failures >= config_.failure_threshold) {
+        s.state = BackendHealthStats::State::OPEN;
+        s.trips++;
+        b.opened_at = now;
+        return -1;
+    }
+    return 0;
+}
+
+void BackendHealth::set_recover_callback(RecoverFn fn)
+{
+    std::lock_guard<std::mutex> lock(cb_mu_);
+    on_recover_ = std::move(fn);
+}
+
+void BackendHealth::report(int backend, int transition)
+{
+    if (transition > 0) {
+        LOG_INFO("BackendHealth: 后端[%d] 恢复\n", backend);
+        std::lock_guard<std::mutex> lock(cb_mu_);
+        if (on_recover_) on_recover_(backend);
+    } else if (transition < 0) {
+        LOG_WARN("BackendHealth: 后端[%d] 连续失败或超时，熔断 %llums\n",
+                 backend, (unsigned long long)config_.open_ms);
+    }
+}
+
+void BackendHealth::observe(Backend &b, Op op, double elapsed_ms, uint64_t bytes, bool ok)
+{
+    int i = (int)op;
+    b.latency[i]->record((uint64_t)(elapsed_ms * 1000));
+    if (bytes) b.bytes[i]->add(bytes);
+    if (!ok) b.failures[i]->add();
+}
+
+void BackendHealth::record(int backend, Op op, double elapsed_ms, uint64_t bytes, bool ok)
+{
+    if (backend < 0 || backend >= (int)backends_.size()) return;
+    Backend &b = *backends_[backend];
+
+    // 成功但过慢的请求同样按超时计入熔断
+    bool slow = config_.slow_request_ms && elapsed_ms > (double)config_.slow_request_ms;
+
+    int transition;
+    {
+        std::lock_guard<std::mutex> lock(b.mu);
+        transition = update(b, op, elapsed_ms, bytes, ok && !slow);
+        if (ok && slow) {
+            // 延迟仍然计入，使读取排序尽快避开该后端
+            double &latency = op == Op::READ ? b.s.read_latency_ms : b.s.write_latency_ms;
+            latency = latency * (1 - config_.ewma_alpha) + elapsed_ms * config_.ewma_alpha;
+        }
+    }
+
+    observe(b, op, elapsed_ms, bytes, ok);
+    report(backend, transition);
+}
+
+void BackendHealth::record_read(int backend, double elapsed_ms, uint64_t bytes,
+                                ChunkStatus status)
+{
+    // 过慢的 NOT_FOUND 同样按超时计入
+    bool slow = config_.slow_request_ms && elapsed_ms > (double)config_.slow_request_ms;
+    if (status != ChunkStatus::NOT_FOUND || slow) {
+        record(backend, Op::READ, elapsed_ms, bytes, status != ChunkStatus::ERROR);
+        return;
+    }
+    if (backend < 0 || backend >= (int)backends_.size()) return;
+    Backend &b = *backends_[backend];
+
+    // 不存在的 chunk 往往立即返回，不计入延迟与吞吐
+    int transition;
+    {
+        std::lock_guard<std::mutex> lock(b.mu);
+        transition = update(b, Op::READ, elapsed_ms, 0, true, false);
+    }
+    observe(b, Op::READ, elapsed_ms, 0, true);
+    report(backend, transition);
+}
+
+void BackendHealth::record_timeout(int backend, Op op, double elapsed_ms)
+{
+    if (backend < 0 || backend >= (int)backends_.size()) return;
+    Backend &b = *backends_[backend];
+
+    int transition;
+    {
+        std::lock_guard<std::mutex> lock(b.mu);
+        transition = update(b, op, elapsed_ms, 0, false);
+        double &latency = op == Op::READ ? b.s.read_latency_ms : b.s.write_latency_ms;
+        latency = latency * (1 - config_.ewma_alpha) + elapsed_ms * config_.ewma_alpha;
+    }
+    observe(b, op, elapsed_ms, 0, false);
+    report(backend, transition);
+}
+
+bool BackendHealth::usable(int backend) const
+{
+    if (backend < 0 || backend >= (int)backends_.size()) return false;
+    const Backend &b = *backends_[backend];
+
+    std::lock_guard<std::mutex> lock(b.mu);
+    if (b.s.state == BackendHealthStats::State::CLOSED) return true;
+    return std::chrono::steady_clock::now() - b.opened_at >=
+           std::chrono::milliseconds(config_.open_ms);
+}
+
+double BackendHealth::read_score(int backend) const
+{
+    if (backend < 0 || backend >= (int)backends_.size()) return 0;
+    const Backend &b = *backends_[backend];
+
+    std::lock_guard<std::mutex> lock(b.mu);
+    return b.s.read_latency_ms * (1 + ERROR_RATE_WEIGHT * b.s.error_rate);
+}
+
+std::vector<BackendHealthStats> BackendHealth::stats() const
+{
+    std::vector<BackendHealthStats> out;
+    auto now = std::chrono::steady_clock::now();
+    for (const auto &b : backends_) {
+        std::lock_guard<std::mutex> lock(b->mu);
+        BackendHealthStats s = b->s;
+        if (s.state != BackendHealthStats::State::CLOSED &&
+            now - b->opened_at >= std::chrono::milliseconds(config_.open_ms)) {
+            s.state = BackendHealthStats::State::PROBING;
+        }
+        out.push_back(s);
+    }
+    return out;
+}
@@ -0,0 +1,110 @@
+#ifndef BACKEND_HEALTH_H
+#define BACKEND_HEALTH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include "metrics.h"
+#include "chunk_store.h"
+
+// 后端健康跟踪
+// - 每个后端按读/写分别维护 EWMA 延迟与吞吐，另有 EWMA 错误率
+// - 熔断：连续 failure_threshold 次失败或超时后打开，期间读取不再优先选择该后端，
+//   降级写跳过该后端；open_ms 之后允许请求作为探测，熔断期间任一请求成功即恢复
+// - chunk 不存在（从未写入的条带）是后端的正常响应，按成功计入，不参与延迟统计
+// - 超过 slow_request_ms 才完成的请求按超时（失败）计入
+// - 每次请求同时记入运行指标：按后端与读写区分的延迟直方图、字节数与失败数
+// 所有方法均可在 I/O 回调中并发调用
+
+struct HealthConfig {
+    double ewma_alpha = 0.2;            // EWMA 平滑系数
+    uint64_t slow_request_ms = 5000;    // 超过此时间的请求视为超时
+    uint32_t failure_threshold = 5;     // 连续失败多少次后熔断
+    uint64_t open_ms = 30000;           // 熔断后多久允许探测
+};
+
+struct BackendHealthStats {
+    enum class State { CLOSED, OPEN, PROBING };
+
+    State state = State::CLOSED;
+    double read_latency_ms = 0;
+    double write_latency_ms = 0;
+    double read_mbps = 0;               // EWMA 读吞吐（MB/s）
+    double write_mbps = 0;
+    double error_rate = 0;              // EWMA 错误率（0~1）
+    uint64_t requests = 0;
+    uint64_t failures = 0;
+    uint64_t trips = 0;                 // 熔断次数
+};
+
+class BackendHealth {
+public:
+    enum class Op { READ, WRITE };
+
+    // 熔断恢复时的回调（参数为后端序号），在 record() 的调用线程中执行
+    using RecoverFn = std::function<void(int backend)>;
+
+    BackendHealth(int num_backends, const HealthConfig &config);
+
+    BackendHealth(const BackendHealth &) = delete;
+    BackendHealth &operator=(const BackendHealth &) = delete;
+
+    // 设置（或以 nullptr 清除）恢复回调；返回后旧回调不会再被调用
+    void set_recover_callback(RecoverFn fn);
+
+    // 记录一次请求的结果；bytes 为传输的字节数（失败时可为 0）
+    void record(int backend, Op op, double elapsed_ms, uint64_t bytes, bool ok);
+
+    // 记录一次 chunk 读取：NOT_FOUND 按成功计入（不更新延迟与吞吐），只有 ERROR 计为失败
+    void record_read(int backend, double elapsed_ms, uint64_t bytes, ChunkStatus status);
+
+    // 记录一次超时（请求已被放弃，迟到的结果不再记录）
+    void record_timeout(int backend, Op op, double elapsed_ms);
+
+    // 是否可以向该后端发送请求：未熔断，或熔断冷却期已过（作为探测）
+    bool usable(int backend) const;
+
+    // 读取排序用的分数（越小越好）：EWMA 读延迟按错误率加权
+    double read_score(int backend) const;
+
+    uint64_t slow_request_ms() const { return config_.slow_request_ms; }
+
+    std::vector<BackendHealthStats> stats() const;
+
+private:
+    struct Backend {
+        mutable std::mutex mu;
+        BackendHealthStats s;
+        bool seen_read = false;         // 第一次样本直接作为 EWMA 初值
+        bool seen_write = false;
+        uint32_t consecutive_failures = 0;
+        std::chrono::steady_clock::time_point opened_at;
+
+        // 运行指标，下标为 Op
+        Histogram *latency[2];
+        Counter *bytes[2];
+        Counter *failures[2];
+    };
+
+    // 记入运行指标（不持有锁）
+    void observe(Backend &b, Op op, double elapsed_ms, uint64_t bytes, bool ok);
+
+    // 更新 EWMA 与熔断状态（持有 b.mu）；sample 为 false 时成功请求不计入延迟与吞吐
+    // 返回 1 表示从熔断中恢复，-1 表示刚刚熔断，0 表示状态未变
+    int update(Backend &b, Op op, double elapsed_ms, uint64_t bytes, bool ok,
+               bool sample = true);
+
+    // 输出状态变化并调用恢复回调（不持有锁）
+    void report(int backend, int transition);
+
+    HealthConfig config_;
+    std::vector<std::unique_ptr<Backend>> backends_;
+    std::mutex cb_mu_;      // 保护 on_recover_，回调执行期间持有
+    RecoverFn on_recover_;
+};
+
+#endif // BACKEND_HEALTH_H
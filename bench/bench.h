@@ -0,0 +1,77 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "metrics.h"
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+
+// 基准测试公共部分：选项、结果记录与计时
+// 每项结果带有参数与指标，文本形式输出到终端，
+// 同时可写成 JSON 文件，便于不同版本之间比较
+
+struct BenchOptions {
+    double min_time = 0.5;          // 每项微基准至少运行的秒数
+    bool quick = false;             // 缩小数据量与运行时间（冒烟测试）
+    std::string kernels = "auto";   // 纠删码内核：auto / all / 逗号分隔的名字
+    std::string trace;              // 缓存回放使用的 trace 文件（为空时使用合成负载）
+};
+
+struct BenchResult {
+    std::string suite;
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> params;
+    std::vector<std::pair<std::string, double>> metrics;
+
+    BenchResult &param(const std::string &key, const std::string &value);
+    BenchResult &param(const std::string &key, int64_t value);
+    BenchResult &metric(const std::string &key, double value);
+};
+
+class Reporter {
+public:
+    // 记录一项结果并立即输出一行文本
+    void add(const BenchResult &r);
+
+    // 写出全部结果；path 为 "-" 时写到标准输出
+    bool write_json(const std::string &path) const;
+
+private:
+    std::vector<BenchResult> results_;
+};
+
+// 反复执行 fn 直到累计时间不少于 min_seconds（预热一次，至少计时一次），
+// 返回每次的平均秒数
+template <typename F>
+double time_per_iter(double min_seconds, F &&fn)
+{
+    fn();
+    uint64_t iters = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+        fn();
+        iters++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < min_seconds);
+    return elapsed / (double)iters;
+}
+
+// 直方图分位数（毫秒），取所在桶的上界
+double quantile_ms(const Histogram::Snapshot &s, double q);
+
+// 吞吐（MB/s）
+inline double mbps(uint64_t bytes, double seconds)
+{
+    return seconds > 0 ? (double)bytes / 1048576.0 / seconds : 0;
+}
+
+// 各部分入口
+void bench_coder(Reporter &r, const BenchOptions &opt);
+void bench_cache(Reporter &r, const BenchOptions &opt);
+void bench_raid(Reporter &r, const BenchOptions &opt);
+void bench_file_manager(Reporter &r, const BenchOptions &opt);
+
+#endif // BENCH_H
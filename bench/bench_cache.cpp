@@ -0,0 +1,314 @@
+#include "bench.h"
+#include "chunk_cache.h"
+#include "file_cache.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+// ------------------------------------------------------------
+// 缓存回放：按访问序列驱动 ChunkCache / FileCache，
+// 比较不同淘汰策略与容量下的命中率与吞吐
+// 未命中时按实际读路径放入数据（ChunkCache 放入整个条带，FileCache 放入整页）
+// ------------------------------------------------------------
+
+// 回放用的 chunk 大小；只影响容量换算，不需要真实的 4MB
+static const size_t CHUNK_BYTES = 64 * 1024;
+
+struct FileAccess {
+    std::string path;
+    uint64_t offset;
+    uint32_t size;
+};
+
+struct Trace {
+    std::string name;
+    std::vector<uint64_t> chunks;     // ChunkCache 访问的 stripe_id
+    std::vector<FileAccess> files;    // FileCache 访问
+    uint64_t chunk_working_set = 0;   // 不同 stripe_id 的个数
+    uint64_t file_working_set = 0;    // 不同页的个数（按默认页大小）
+};
+
+// Zipf 分布采样（预先计算累积分布，二分查找）
+class ZipfGen {
+public:
+    ZipfGen(uint64_t n, double s, uint64_t seed) : rng_(seed), uni_(0.0, 1.0)
+    {
+        cdf_.resize(n);
+        double sum = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            sum += 1.0 / std::pow((double)(i + 1), s);
+            cdf_[i] = sum;
+        }
+        for (auto &c : cdf_) c /= sum;
+    }
+
+    uint64_t next()
+    {
+        double u = uni_(rng_);
+        return (uint64_t)(std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin());
+    }
+
+private:
+    std::vector<double> cdf_;
+    std::mt19937_64 rng_;
+    std::uniform_real_distribution<double> uni_;
+};
+
+// 排名打散成 stripe_id（乘奇数在 2^64 上可逆，不会冲突），避免热点集中在相邻编号
+static uint64_t scatter(uint64_t rank)
+{
+    return (rank + 1) * 0x9E3779B97F4A7C15ULL;
+}
+
+static std::vector<Trace> synthetic_traces(bool quick)
+{
+    const uint64_t ws = quick ? 2000 : 20000;
+    const uint64_t n = ws * 10;
+    const uint64_t page = CacheConfig().page_size;
+    const uint64_t files = 64;
+    const uint64_t pages_per_file = ws / files;
+
+    std::vector<Trace> out;
+
+    // 热点访问
+    {
+        Trace t;
+        t.name = "zipf";
+        ZipfGen z(ws, 0.99, 1);
+        for (uint64_t i = 0; i < n; i++) t.chunks.push_back(scatter(z.next()));
+        t.chunk_working_set = ws;
+
+        ZipfGen zf(ws, 0.99, 2);
+        for (uint64_t i = 0; i < n; i++) {
+            uint64_t r = zf.next();
+            t.files.push_back(FileAccess{ "/f" + std::to_string(r % files),
+                                          (r / files) * page, 4096 });
+        }
+        t.file_working_set = files * pages_per_file;
+        out.push_back(std::move(t));
+    }
+
+    // 热点访问中夹杂一次性的大范围顺序扫描（扫描的数据不会再被访问）
+    {
+        Trace t;
+        t.name = "zipf_scan";
+        ZipfGen z(ws, 0.99, 3);
+        uint64_t scan_next = 1ULL << 40;
+        for (uint64_t i = 0; i < n; i++) {
+            if (i % (ws * 2) < ws / 2) {
+                t.chunks.push_back(scan_next++);
+            } else {
+                t.chunks.push_back(scatter(z.next()));
+            }
+        }
+        t.chunk_working_set = ws;
+
+        ZipfGen zf(ws, 0.99, 4);
+        uint64_t scan_off = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            if (i % (ws * 2) < ws / 2) {
+                t.files.push_back(FileAccess{ "/scan", scan_off, (uint32_t)page });
+                scan_off += page;
+            } else {
+                uint64_t r = zf.next();
+                t.files.push_back(FileAccess{ "/f" + std::to_string(r % files),
+                                              (r / files) * page, 4096 });
+            }
+        }
+        t.file_working_set = files * pages_per_file;
+        out.push_back(std::move(t));
+    }
+
+    // 循环访问整个工作集（大于缓存时 LRU 完全失效）
+    {
+        Trace t;
+        t.name = "loop";
+        for (uint64_t i = 0; i < n; i++) t.chunks.push_back(scatter(i % ws));
+        t.chunk_working_set = ws;
+        for (uint64_t i = 0; i < n; i++) {
+            uint64_t r = i % ws;
+            t.files.push_back(FileAccess{ "/f" + std::to_string(r / pages_per_file),
+                                          (r % pages_per_file) * page, (uint32_t)page });
+        }
+        t.file_working_set = ws;
+        out.push_back(std::move(t));
+    }
+
+    return out;
+}
+
+// trace 文件格式，每行一项：
+//   c <stripe_id>                 ChunkCache 访问
+//   f <path> <offset> <size>      FileCache 访问
+// 空行与 # 开头的行忽略
+static bool load_trace(const std::string &path, Trace &t)
+{
+    std::ifstream in(path);
+    if (!in) return false;
+
+    const uint64_t page = CacheConfig().page_size;
+    std::unordered_set<uint64_t> chunk_keys;
+    std::unordered_set<FilePageKey> page_keys;
+
+    t.name = path;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ls(line);
+        std::string kind;
+        ls >> kind;
+        if (kind == "c") {
+            uint64_t id;
+            if (ls >> id) {
+                t.chunks.push_back(id);
+                chunk_keys.insert(id);
+            }
+        } else if (kind == "f") {
+            FileAccess a;
+            if (ls >> a.path >> a.offset >> a.size && a.size > 0) {
+                for (uint64_t p = a.offset / page; p <= (a.offset + a.size - 1) / page; p++) {
+                    page_keys.insert(FilePageKey{ a.path, p });
+                }
+                t.files.push_back(std::move(a));
+            }
+        }
+    }
+    t.chunk_working_set = chunk_keys.size();
+    t.file_working_set = page_keys.size();
+    return true;
+}
+
+// 回放 [begin, end)，返回命中次数
+static uint64_t replay_chunks(ChunkCache &cache, const std::vector<uint64_t> &trace,
+                              size_t begin, size_t end,
+                              const std::shared_ptr<const std::string> &buf)
+{
+    uint64_t hits = 0;
+    std::shared_ptr<const std::string> out;
+    for (size_t i = begin; i < end; i++) {
+        if (cache.get(trace[i], out)) {
+            hits++;
+        } else {
+            cache.put(trace[i], buf);
+        }
+    }
+    return hits;
+}
+
+static void bench_chunk_cache(Reporter &r, const BenchOptions &opt, const Trace &t)
+{
+    if (t.chunks.empty()) return;
+    auto buf = std::make_shared<const std::string>(CHUNK_BYTES, 'x');
+
+    for (const char *policy : { "s3fifo", "lru" }) {
+        for (double frac : { 0.05, 0.10, 0.25 }) {
+            ChunkCacheConfig cfg;
+            cfg.policy = policy;
+            cfg.cache_ttl_seconds = 3600;
+            cfg.max_cache_size = std::max<uint64_t>(
+                (uint64_t)(t.chunk_working_set * frac) * CHUNK_BYTES, cfg.shards * CHUNK_BYTES);
+
+            // 单线程：命中率与单次操作开销
+            ChunkCache cache(cfg);
+            auto start = std::chrono::steady_clock::now();
+            uint64_t hits = replay_chunks(cache, t.chunks, 0, t.chunks.size(), buf);
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            BenchResult res{ "cache", "chunk_cache", {}, {} };
+            res.param("trace", t.name).param("policy", policy)
+               .param("capacity_pct", (int64_t)std::lround(frac * 100))
+               .metric("hit_ratio", (double)hits / (double)t.chunks.size())
+               .metric("mops", (double)t.chunks.size() / secs / 1e6)
+               .metric("evictions", (double)cache.eviction_count());
+
+            // 多线程：各线程回放序列的不同片段，考察分片锁的扩展性
+            if (!opt.quick) {
+                const size_t threads = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+                ChunkCache shared(cfg);
+                std::vector<std::thread> ts;
+                start = std::chrono::steady_clock::now();
+                for (size_t i = 0; i < threads; i++) {
+                    size_t b = t.chunks.size() * i / threads;
+                    size_t e = t.chunks.size() * (i + 1) / threads;
+                    ts.emplace_back([&, b, e]() { replay_chunks(shared, t.chunks, b, e, buf); });
+                }
+                for (auto &th : ts) th.join();
+                secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                res.param("threads", (int64_t)threads)
+                   .metric("mops_mt", (double)t.chunks.size() / secs / 1e6);
+            }
+            r.add(res);
+        }
+    }
+}
+
+static void bench_file_cache(Reporter &r, const Trace &t)
+{
+    if (t.files.empty()) return;
+
+    for (const char *policy : { "s3fifo", "lru" }) {
+        for (double frac : { 0.05, 0.10, 0.25 }) {
+            CacheConfig cfg;
+            cfg.policy = policy;
+            cfg.cache_ttl_seconds = 3600;
+            cfg.max_file_size = UINT64_MAX;
+            cfg.max_cache_size = std::max<uint64_t>(
+                (uint64_t)(t.file_working_set * frac) * cfg.page_size, cfg.shards * cfg.page_size);
+
+            FileCache cache(cfg);
+            const uint64_t page = cache.page_size();
+            std::string src(page * 2, 'y');
+            std::vector<char> dst;
+
+            uint64_t hits = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (const auto &a : t.files) {
+                if (dst.size() < a.size) dst.resize(a.size);
+                if (cache.read(a.path, a.offset, a.size, dst.data())) {
+                    hits++;
+                    continue;
+                }
+                // 与读路径相同：从后端读回的范围按页对齐放入
+                uint64_t first = a.offset / page * page;
+                uint64_t last = (a.offset + a.size + page - 1) / page * page;
+                uint64_t epoch = cache.epoch();
+                for (uint64_t off = first; off < last; off += page) {
+                    cache.put(a.path, off, src.data(), page, UINT64_MAX / 2, epoch);
+                }
+            }
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            r.add(BenchResult{ "cache", "file_cache", {}, {} }
+                  .param("trace", t.name).param("policy", policy)
+                  .param("capacity_pct", (int64_t)std::lround(frac * 100))
+                  .metric("hit_ratio", (double)hits / (double)t.files.size())
+                  .metric("mops", (double)t.files.size() / secs / 1e6)
+                  .metric("evictions", (double)cache.eviction_count()));
+        }
+    }
+}
+
+void bench_cache(Reporter &r, const BenchOptions &opt)
+{
+    std::vector<Trace> traces;
+    if (!opt.trace.empty()) {
+        Trace t;
+        if (!load_trace(opt.trace, t)) {
+            std::fprintf(stderr, "cache: 无法读取 trace 文件 %s\n", opt.trace.c_str());
+            return;
+        }
+        traces.push_back(std::move(t));
+    } else {
+        traces = synthetic_traces(opt.quick);
+    }
+
+    for (const auto &t : traces) {
+        bench_chunk_cache(r, opt, t);
+        bench_file_cache(r, t);
+    }
+}
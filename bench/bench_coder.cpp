@@ -0,0 +1,132 @@
+#include "bench.h"
+#include "rs_coder.h"
+#include "gf256.h"
+#include <cstring>
+#include <random>
+#include <sstream>
+
+// ------------------------------------------------------------
+// 纠删码微基准：不同 k/m、丢失模式与 GF 内核下的编码 / 解码 / 重建吞吐
+// 吞吐按条带（原始数据）字节数计算
+// ------------------------------------------------------------
+
+static const size_t STRIPE_BYTES = 4ULL * 1024 * 1024;
+
+struct ErasurePattern {
+    const char *name;
+    // 返回要丢弃的位置
+    std::vector<int> (*lost)(int k, int m);
+};
+
+static const ErasurePattern PATTERNS[] = {
+    { "none",        [](int, int) { return std::vector<int>(); } },
+    { "parity1",     [](int k, int) { return std::vector<int>{ k }; } },
+    { "data1",       [](int, int) { return std::vector<int>{ 0 }; } },
+    { "data_max",    [](int, int m) {
+        std::vector<int> v;
+        for (int i = 0; i < m; i++) v.push_back(i);
+        return v;
+    } },
+};
+
+static std::vector<std::string> select_kernels(const std::string &spec)
+{
+    static const char *ALL[] = { "scalar", "ssse3", "avx2", "avx512", "neon" };
+
+    std::vector<std::string> out;
+    if (spec == "auto") {
+        out.push_back(gf_kernel_name());
+    } else if (spec == "all") {
+        for (const char *k : ALL) {
+            if (gf_set_kernel(k)) out.push_back(k);
+        }
+    } else {
+        std::stringstream ss(spec);
+        std::string k;
+        while (std::getline(ss, k, ',')) {
+            if (gf_set_kernel(k.c_str())) {
+                out.push_back(k);
+            } else {
+                std::fprintf(stderr, "coder: 内核 %s 不可用，跳过\n", k.c_str());
+            }
+        }
+    }
+    return out;
+}
+
+void bench_coder(Reporter &r, const BenchOptions &opt)
+{
+    gf_init();
+    const std::string auto_kernel = gf_kernel_name();
+
+    static const int KM[][2] = { { 2, 1 }, { 4, 2 }, { 6, 3 }, { 10, 4 } };
+
+    std::string data(opt.quick ? STRIPE_BYTES / 4 : STRIPE_BYTES, '\0');
+    std::mt19937_64 rng(1);
+    for (size_t i = 0; i + 8 <= data.size(); i += 8) {
+        uint64_t v = rng();
+        std::memcpy(&data[i], &v, 8);
+    }
+
+    for (const std::string &kernel : select_kernels(opt.kernels)) {
+        gf_set_kernel(kernel.c_str());
+
+        for (const auto &km : KM) {
+            int k = km[0], m = km[1];
+
+            for (auto layout : { RSCoder::Layout::SYSTEMATIC, RSCoder::Layout::VANDERMONDE }) {
+                const char *layout_name =
+                    layout == RSCoder::Layout::SYSTEMATIC ? "systematic" : "vandermonde";
+                RSCoder coder(layout);
+
+                std::vector<std::string> chunks;
+                double t = time_per_iter(opt.min_time, [&]() {
+                    coder.encode(data, k, m, chunks);
+                });
+                r.add(BenchResult{ "coder", "encode", {}, {} }
+                      .param("kernel", kernel).param("layout", layout_name)
+                      .param("k", k).param("m", m).param("bytes", (int64_t)data.size())
+                      .metric("mbps", mbps(data.size(), t))
+                      .metric("us_per_op", t * 1e6));
+
+                for (const auto &p : PATTERNS) {
+                    std::vector<std::string> input = chunks;
+                    for (int pos : p.lost(k, m)) input[pos].clear();
+
+                    std::string out;
+                    bool ok = true;
+                    t = time_per_iter(opt.min_time, [&]() {
+                        ok = coder.decode(input, k, m, out) && ok;
+                    });
+                    if (!ok || out != data) {
+                        std::fprintf(stderr, "coder: decode 结果错误 k=%d m=%d pattern=%s\n",
+                                     k, m, p.name);
+                    }
+                    r.add(BenchResult{ "coder", "decode", {}, {} }
+                          .param("kernel", kernel).param("layout", layout_name)
+                          .param("k", k).param("m", m).param("lost", p.name)
+                          .metric("mbps", mbps(data.size(), t))
+                          .metric("us_per_op", t * 1e6));
+                }
+
+                // 重建一个数据 chunk（修复路径）
+                std::vector<std::string> input = chunks;
+                input[0].clear();
+                std::vector<std::string> rebuilt;
+                t = time_per_iter(opt.min_time, [&]() {
+                    coder.reconstruct(input, k, m, { 0 }, rebuilt);
+                });
+                if (rebuilt.size() != chunks.size() || rebuilt[0] != chunks[0]) {
+                    std::fprintf(stderr, "coder: reconstruct 结果错误 k=%d m=%d\n", k, m);
+                }
+                r.add(BenchResult{ "coder", "reconstruct", {}, {} }
+                      .param("kernel", kernel).param("layout", layout_name)
+                      .param("k", k).param("m", m).param("lost", "data1")
+                      .metric("mbps", mbps(data.size(), t))
+                      .metric("us_per_op", t * 1e6));
+            }
+        }
+    }
+
+    gf_set_kernel(auto_kernel.c_str());
+}
@@ -0,0 +1,184 @@
+#include "bench.h"
+#include "gf256.h"
+#include "log.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#ifndef _DM_VERSION
+#define _DM_VERSION "unknown"
+#endif
+
+// ------------------------------------------------------------
+// 结果记录
+// ------------------------------------------------------------
+BenchResult &BenchResult::param(const std::string &key, const std::string &value)
+{
+    params.emplace_back(key, value);
+    return *this;
+}
+
+BenchResult &BenchResult::param(const std::string &key, int64_t value)
+{
+    params.emplace_back(key, std::to_string(value));
+    return *this;
+}
+
+BenchResult &BenchResult::metric(const std::string &key, double value)
+{
+    metrics.emplace_back(key, value);
+    return *this;
+}
+
+void Reporter::add(const BenchResult &r)
+{
+    results_.push_back(r);
+
+    std::string line = r.suite + "/" + r.name;
+    for (const auto &p : r.params) line += " " + p.first + "=" + p.second;
+    line += " :";
+    char buf[64];
+    for (const auto &m : r.metrics) {
+        snprintf(buf, sizeof(buf), " %s=%.4g", m.first.c_str(), m.second);
+        line += buf;
+    }
+    // 文本写到 stderr，标准输出留给 --json -
+    std::fprintf(stderr, "%s\n", line.c_str());
+}
+
+static std::string json_escape(const std::string &s)
+{
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+bool Reporter::write_json(const std::string &path) const
+{
+    std::ostringstream os;
+    os << "{\n  \"version\": \"" << json_escape(_DM_VERSION) << "\",\n"
+       << "  \"gf_kernel\": \"" << gf_kernel_name() << "\",\n"
+       << "  \"results\": [";
+    for (size_t i = 0; i < results_.size(); i++) {
+        const BenchResult &r = results_[i];
+        os << (i ? ",\n" : "\n") << "    {\"suite\": \"" << json_escape(r.suite)
+           << "\", \"name\": \"" << json_escape(r.name) << "\", \"params\": {";
+        for (size_t j = 0; j < r.params.size(); j++) {
+            os << (j ? ", " : "") << "\"" << json_escape(r.params[j].first) << "\": \""
+               << json_escape(r.params[j].second) << "\"";
+        }
+        os << "}, \"metrics\": {";
+        for (size_t j = 0; j < r.metrics.size(); j++) {
+            double v = r.metrics[j].second;
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%.6g", std::isfinite(v) ? v : 0.0);
+            os << (j ? ", " : "") << "\"" << json_escape(r.metrics[j].first) << "\": " << buf;
+        }
+        os << "}}";
+    }
+    os << "\n  ]\n}\n";
+
+    if (path == "-") {
+        std::fputs(os.str().c_str(), stdout);
+        return true;
+    }
+    std::ofstream f(path);
+    f << os.str();
+    return (bool)f;
+}
+
+double quantile_ms(const Histogram::Snapshot &s, double q)
+{
+    if (s.count == 0) return 0;
+    uint64_t target = (uint64_t)std::ceil(q * (double)s.count);
+    if (target == 0) target = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < s.buckets.size(); i++) {
+        seen += s.buckets[i];
+        if (seen >= target) return (double)Histogram::upper_bound((int)i) / 1000.0;
+    }
+    return (double)Histogram::upper_bound((int)s.buckets.size() - 1) / 1000.0;
+}
+
+// ------------------------------------------------------------
+// main
+// ------------------------------------------------------------
+static void usage(const char *prog)
+{
+    std::fprintf(stderr,
+        "用法: %s [选项] [coder] [cache] [raid] [fm]\n"
+        "  不指定测试项时全部运行\n"
+        "  --quick            缩小数据量与运行时间\n"
+        "  --min-time <秒>    每项微基准的最少运行时间，默认 0.5\n"
+        "  --kernels <列表>   纠删码内核：auto（默认）/ all / 如 scalar,avx2\n"
+        "  --trace <文件>     缓存回放使用的 trace 文件\n"
+        "  --json <文件>      结果写成 JSON（- 表示标准输出）\n",
+        prog);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions opt;
+    std::string json_path;
+    std::vector<std::string> suites;
+
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if (a == "--quick") {
+            opt.quick = true;
+            opt.min_time = 0.05;
+        } else if (a == "--min-time") {
+            opt.min_time = std::stod(next());
+        } else if (a == "--kernels") {
+            opt.kernels = next();
+        } else if (a == "--trace") {
+            opt.trace = next();
+        } else if (a == "--json") {
+            json_path = next();
+        } else if (a == "coder" || a == "cache" || a == "raid" || a == "fm") {
+            suites.push_back(a);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (suites.empty()) suites = { "coder", "cache", "raid", "fm" };
+
+    // 基准中会注入故障，只保留错误日志
+    set_log_level(LOG_LEVEL_ERROR);
+
+    Reporter reporter;
+    for (const auto &s : suites) {
+        if (s == "coder") bench_coder(reporter, opt);
+        else if (s == "cache") bench_cache(reporter, opt);
+        else if (s == "raid") bench_raid(reporter, opt);
+        else if (s == "fm") bench_file_manager(reporter, opt);
+    }
+
+    if (!json_path.empty() && !reporter.write_json(json_path)) {
+        std::fprintf(stderr, "无法写入 %s\n", json_path.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,446 @@
+#include "bench.h"
+#include "mem_chunk_store.h"
+#include "raid_chunk_store.h"
+#include "rs_coder.h"
+#include "file_manager.h"
+#include "metadata_manager.h"
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <thread>
+
+// ------------------------------------------------------------
+// 端到端基准：RAIDChunkStore / FileManager 运行在内存后端（MemChunkStore）上，
+// 注入延迟、慢节点、宕机与随机失败，测量吞吐与尾延迟
+// ------------------------------------------------------------
+
+static const int K = 4;
+static const int M = 2;
+
+struct Scenario {
+    const char *name;
+    bool hedged;
+    // 写入完成后、读取开始前对后端施加的变化
+    void (*degrade)(std::vector<std::shared_ptr<MemChunkStore>> &mem, const MemChunkStoreConfig &base);
+};
+
+static const Scenario SCENARIOS[] = {
+    { "healthy", true, [](auto &, const auto &) {} },
+    { "one_slow", true, [](auto &mem, const auto &base) {
+        MemChunkStoreConfig c = base;
+        c.latency_ms = base.latency_ms * 20 + 20;
+        mem[0]->set_config(c);
+    } },
+    { "one_slow_nohedge", false, [](auto &mem, const auto &base) {
+        MemChunkStoreConfig c = base;
+        c.latency_ms = base.latency_ms * 20 + 20;
+        mem[0]->set_config(c);
+    } },
+    { "one_down", true, [](auto &mem, const auto &) { mem[0]->set_down(true); } },
+    { "flaky", true, [](auto &mem, const auto &base) {
+        MemChunkStoreConfig c = base;
+        c.failure_rate = 0.05;
+        for (auto &s : mem) s->set_config(c);
+    } },
+};
+
+static MemChunkStoreConfig base_config(bool quick)
+{
+    MemChunkStoreConfig c;
+    c.latency_ms = quick ? 0.5 : 2;
+    c.jitter_ms = quick ? 0.5 : 2;
+    c.bandwidth_mbps = 200;
+    return c;
+}
+
+static std::string random_data(size_t size, uint64_t seed)
+{
+    std::string s(size, '\0');
+    std::mt19937_64 rng(seed);
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        uint64_t v = rng();
+        std::memcpy(&s[i], &v, 8);
+    }
+    return s;
+}
+
+// 以 threads 个线程并发执行 fn(i)，i 取遍 [0, n)，每次的耗时记入 hist
+// 返回总耗时（秒）与失败次数
+static double run_parallel(size_t threads, uint64_t n, Histogram &hist, uint64_t &failures,
+                           const std::function<bool(uint64_t)> &fn)
+{
+    std::atomic<uint64_t> next{0};
+    std::atomic<uint64_t> failed{0};
+    std::vector<std::thread> ts;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; t++) {
+        ts.emplace_back([&]() {
+            uint64_t i;
+            while ((i = next.fetch_add(1)) < n) {
+                auto op_start = std::chrono::steady_clock::now();
+                if (!fn(i)) failed++;
+                hist.record_since(op_start);
+            }
+        });
+    }
+    for (auto &t : ts) t.join();
+    failures = failed;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void add_latency(BenchResult &res, const char *prefix, const Histogram &h)
+{
+    Histogram::Snapshot s = h.snapshot();
+    std::string p = prefix;
+    res.metric(p + "_p50_ms", quantile_ms(s, 0.50))
+       .metric(p + "_p99_ms", quantile_ms(s, 0.99));
+}
+
+void bench_raid(Reporter &r, const BenchOptions &opt)
+{
+    const uint64_t stripes = opt.quick ? 16 : 64;
+    const size_t threads = 4;
+    const MemChunkStoreConfig base = base_config(opt.quick);
+    const std::string data = random_data(FileManager::STRIPE_SIZE, 7);
+
+    for (const auto &sc : SCENARIOS) {
+        std::vector<std::shared_ptr<MemChunkStore>> mem;
+        std::vector<std::shared_ptr<ChunkStore>> backends;
+        for (int i = 0; i < K + M; i++) {
+            mem.push_back(std::make_shared<MemChunkStore>(base));
+            backends.push_back(mem.back());
+        }
+
+        RAIDConfig cfg;
+        cfg.hedged_read = sc.hedged;
+        cfg.hedge_delay_ms = 20;
+        auto raid = std::make_shared<RAIDChunkStore>(backends, K, M,
+                                                     std::make_shared<RSCoder>(), cfg);
+
+        Histogram write_hist, read_hist;
+        uint64_t write_failed = 0, read_failed = 0;
+
+        double wsecs = run_parallel(threads, stripes, write_hist, write_failed, [&](uint64_t i) {
+            return raid->write_chunk(100 + i, 0, data);
+        });
+
+        sc.degrade(mem, base);
+
+        double rsecs = run_parallel(threads, stripes, read_hist, read_failed, [&](uint64_t i) {
+            std::string out;
+            return raid->read_chunk(100 + i, 0, out) && out == data;
+        });
+
+        BenchResult res{ "raid", "stripe_io", {}, {} };
+        res.param("scenario", sc.name).param("k", K).param("m", M)
+           .param("stripes", (int64_t)stripes).param("threads", (int64_t)threads)
+           .metric("write_mbps", mbps(stripes * data.size(), wsecs))
+           .metric("read_mbps", mbps(stripes * data.size(), rsecs));
+        add_latency(res, "write", write_hist);
+        add_latency(res, "read", read_hist);
+        res.metric("write_failures", (double)write_failed)
+           .metric("read_failures", (double)read_failed);
+        r.add(res);
+    }
+
+    // 增量更新写入中途失败：依次让每个后端的写请求失败，更新跨两个数据块的两个区间，
+    // 随后模拟重启（新的 RAIDChunkStore，内存中的过期集合丢失）并解除故障，
+    // 逐个停掉一个后端读取，条带必须解码出新内容
+    // mixed：未改写的两个数据块所在后端不支持范围读写，增量更新必须拒绝（条带保持原内容），
+    // 否则写入失败后这两个位置无法写入新代号，重启后新代号不足 k 个
+    for (bool mixed : { false, true }) {
+        std::vector<std::shared_ptr<MemChunkStore>> mem;
+        std::vector<std::shared_ptr<ChunkStore>> backends;
+        for (int i = 0; i < K + M; i++) {
+            MemChunkStoreConfig c;
+            // 条带 id 为 K+M 的倍数时位置 i 位于后端 i
+            c.range_io = !(mixed && (i == 1 || i == 3));
+            mem.push_back(std::make_shared<MemChunkStore>(c));
+            backends.push_back(mem.back());
+        }
+        const uint64_t chunk_span = data.size() / K;
+        std::vector<std::pair<uint64_t, std::string>> pieces{
+            { 0, random_data(4096, 11) },
+            { 2 * chunk_span + 4096, random_data(4096, 12) },
+        };
+        std::string expect = data;
+        if (!mixed) {
+            for (const auto &p : pieces) expect.replace((size_t)p.first, p.second.size(), p.second);
+        }
+
+        int failed_updates = 0;
+        bool decode_ok = true;
+        for (int f = 0; f < K + M; f++) {
+            const uint64_t stripe = 600 + (uint64_t)f * (K + M);
+            {
+                auto raid = std::make_shared<RAIDChunkStore>(backends, K, M,
+                                                             std::make_shared<RSCoder>(),
+                                                             RAIDConfig());
+                decode_ok = raid->write_chunk(stripe, 0, data) && decode_ok;
+                mem[f]->set_fail_writes(true);
+                if (!raid->update_ranges(stripe, data.size(), pieces)) failed_updates++;
+            }
+            mem[f]->set_fail_writes(false);
+
+            auto raid = std::make_shared<RAIDChunkStore>(backends, K, M,
+                                                         std::make_shared<RSCoder>(),
+                                                         RAIDConfig());
+            for (int d = 0; d < K + M; d++) {
+                mem[d]->set_down(true);
+                std::string out;
+                decode_ok = raid->read_chunk(stripe, 0, out) && out == expect && decode_ok;
+                mem[d]->set_down(false);
+            }
+        }
+
+        BenchResult res{ "raid", "partial_update_fault", {}, {} };
+        res.param("k", K).param("m", M).param("pool", mixed ? "mixed" : "range")
+           .metric("failed_updates", failed_updates)
+           .metric("decode_ok", decode_ok ? 1 : 0);
+        r.add(res);
+    }
+}
+
+// ------------------------------------------------------------
+// FileManager：顺序写、冷启动后的顺序读、随机小块读、随机小块覆盖写、小文件创建、挂载
+// ------------------------------------------------------------
+struct FmStack {
+    std::shared_ptr<MetadataManager> meta;
+    std::shared_ptr<FileManager> fm;
+};
+
+// 与 main.cpp 的挂载流程一致：加载元数据，首次使用时初始化
+static FmStack mount(const std::shared_ptr<RAIDChunkStore> &raid,
+                     const LayoutConfig &layout = LayoutConfig())
+{
+    FmStack s;
+    s.meta = std::make_shared<MetadataManager>();
+    s.fm = std::make_shared<FileManager>(raid, s.meta,
+                                         std::make_shared<FileCache>(),
+                                         std::make_shared<ChunkCache>(),
+                                         WriteBufferConfig(), ReadaheadConfig(), nullptr,
+                                         DataPipelineConfig(), layout);
+    if (!s.meta->load_from_backend(s.fm.get())) {
+        s.meta->save_to_backend(s.fm.get());
+    }
+    raid->set_next_stripe_id(std::max<uint64_t>(100, s.meta->next_stripe_id()));
+    return s;
+}
+
+void bench_file_manager(Reporter &r, const BenchOptions &opt)
+{
+    const uint64_t file_size = (opt.quick ? 32ULL : 256ULL) * 1024 * 1024;
+    const size_t block = 1024 * 1024;
+    const uint64_t random_reads = opt.quick ? 200 : 2000;
+    const uint64_t small_files = opt.quick ? 200 : 2000;
+    const uint64_t random_writes = opt.quick ? 200 : 2000;
+    const MemChunkStoreConfig base = base_config(opt.quick);
+
+    std::vector<std::shared_ptr<MemChunkStore>> mem;
+    std::vector<std::shared_ptr<ChunkStore>> backends;
+    for (int i = 0; i < K + M; i++) {
+        mem.push_back(std::make_shared<MemChunkStore>(base));
+        backends.push_back(mem.back());
+    }
+    auto raid = std::make_shared<RAIDChunkStore>(backends, K, M, std::make_shared<RSCoder>());
+
+    const std::string buf = random_data(block, 9);
+    const std::string path = "/bench.bin";
+
+    // 顺序写（经写回缓冲），计入最后的 flush_all
+    double write_secs;
+    {
+        FmStack s = mount(raid);
+        s.meta->create_file(path);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t off = 0; off < file_size; off += block) {
+            s.fm->write(path, off, buf.data(), block);
+        }
+        s.fm->flush_all();
+        write_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        s.meta->commit();
+    }
+
+    // 小文件创建：每个文件 4KB 写入后关闭，最后整体落盘（如解压归档后 sync），
+    // 分别测试每个文件写入自己的条带与合并写入打包条带，单线程顺序创建（如 tar x）与 4 线程并发创建
+    for (size_t threads : { (size_t)1, (size_t)4 })
+    for (uint64_t pack_max : { (uint64_t)0, (uint64_t)64 * 1024 }) {
+        LayoutConfig layout;
+        layout.pack_max = pack_max;
+        FmStack s = mount(raid, layout);
+
+        std::string dir = "/small" + std::to_string(pack_max / 1024) + "_" +
+                          std::to_string(threads);
+        s.meta->create_dir(dir);
+        uint64_t writes_before = 0;
+        for (const auto &b : mem) writes_before += b->write_count();
+
+        Histogram hist;
+        uint64_t failed = 0;
+        auto start = std::chrono::steady_clock::now();
+        run_parallel(threads, small_files, hist, failed, [&](uint64_t i) {
+            std::string p = dir + "/" + std::to_string(i);
+            s.meta->create_file(p);
+            return s.fm->write(p, 0, buf.data(), 4096) && s.fm->close_flush(p);
+        });
+        bool ok = s.fm->flush_all() && s.meta->commit();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t writes = 0;
+        for (const auto &b : mem) writes += b->write_count();
+        writes -= writes_before;
+
+        // 重新挂载后读回校验
+        s = FmStack();
+        s = mount(raid, layout);
+        for (uint64_t i = 0; i < small_files; i++) {
+            std::string out;
+            ok = s.fm->read(dir + "/" + std::to_string(i), 0, 4096, out) &&
+                 out == buf.substr(0, 4096) && ok;
+        }
+
+        BenchResult res{ "fm", "small_create", {}, {} };
+        res.param("files", (int64_t)small_files).param("size", 4096)
+           .param("threads", (int64_t)threads).param("pack_max", (int64_t)pack_max)
+           .metric("files_per_sec", (double)small_files / secs)
+           .metric("backend_writes", (double)writes);
+        add_latency(res, "op", hist);
+        res.metric("failures", (double)failed).metric("ok", ok ? 1 : 0);
+        r.add(res);
+    }
+    // 挂载：多个目录的命名空间写入检查点，再追加一批日志记录后重新挂载，
+    // 分别测量挂载耗时与随后列出全部目录的耗时（分片按需加载 / 后台预加载）
+    {
+        const uint64_t dirs = opt.quick ? 500 : 5000;
+        const uint64_t per_dir = 20;
+        std::vector<std::shared_ptr<ChunkStore>> meta_backends;
+        for (int i = 0; i < K + M; i++) {
+            meta_backends.push_back(std::make_shared<MemChunkStore>(base));
+        }
+        auto meta_raid = std::make_shared<RAIDChunkStore>(meta_backends, K, M,
+                                                          std::make_shared<RSCoder>());
+        {
+            FmStack s = mount(meta_raid);
+            for (uint64_t d = 0; d < dirs; d++) {
+                std::string dir = "/d" + std::to_string(d);
+                s.meta->create_dir(dir);
+                for (uint64_t f = 0; f < per_dir; f++) {
+                    s.meta->create_file(dir + "/" + std::to_string(f));
+                }
+            }
+            s.meta->save_to_backend(s.fm.get());
+            for (uint64_t d = 0; d < dirs; d += 10) {
+                s.meta->create_file("/d" + std::to_string(d) + "/late");
+            }
+            s.meta->commit();
+        }
+
+        for (bool preload : { false, true }) {
+            auto start = std::chrono::steady_clock::now();
+            FmStack s = mount(meta_raid);
+            if (preload) s.meta->start_preload();
+            double mount_secs = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+
+            uint64_t entries = 0;
+            for (uint64_t d = 0; d < dirs; d++) {
+                entries += s.meta->list_dir("/d" + std::to_string(d)).size();
+            }
+            double walk_secs = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count() - mount_secs;
+
+            r.add(BenchResult{ "fm", "mount", {}, {} }
+                  .param("dirs", (int64_t)dirs).param("files", (int64_t)(dirs * per_dir))
+                  .param("preload", preload ? "on" : "off")
+                  .metric("mount_ms", mount_secs * 1000)
+                  .metric("list_all_ms", walk_secs * 1000)
+                  .metric("ok", entries == dirs * per_dir + (dirs + 9) / 10 ? 1 : 0));
+        }
+    }
+
+    r.add(BenchResult{ "fm", "seq_write", {}, {} }
+          .param("bytes", (int64_t)file_size).param("block", (int64_t)block)
+          .metric("mbps", mbps(file_size, write_secs)));
+
+    // 冷读：重新挂载（新的元数据与缓存），从头顺序读，预读生效
+    {
+        FmStack s = mount(raid);
+        uint64_t fh = s.fm->open_handle(path);
+        std::vector<char> out(block);
+        bool ok = true;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t off = 0; off < file_size; off += block) {
+            size_t n = 0;
+            ok = s.fm->read_into(path, off, block, out.data(), n, fh) && n == block && ok;
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        s.fm->close_handle(fh);
+        r.add(BenchResult{ "fm", "seq_read_cold", {}, {} }
+              .param("bytes", (int64_t)file_size).param("block", (int64_t)block)
+              .metric("mbps", mbps(file_size, secs))
+              .metric("ok", ok ? 1 : 0));
+    }
+
+    // 随机 4K 读：重新挂载后从冷缓存开始
+    {
+        FmStack s = mount(raid);
+        Histogram hist;
+        uint64_t failed = 0;
+        double secs = run_parallel(4, random_reads, hist, failed, [&](uint64_t i) {
+            uint64_t off = (i * 0x9E3779B97F4A7C15ULL) % (file_size / 4096) * 4096;
+            char out[4096];
+            size_t n = 0;
+            return s.fm->read_into(path, off, sizeof(out), out, n) && n == sizeof(out);
+        });
+        BenchResult res{ "fm", "rand_read_4k", {}, {} };
+        res.param("reads", (int64_t)random_reads)
+           .metric("iops", (double)random_reads / secs);
+        add_latency(res, "op", hist);
+        res.metric("failures", (double)failed);
+        r.add(res);
+    }
+
+    // 随机 4K 覆盖写，每次写入后 flush（相当于 fsync）：
+    // 后端支持范围读写时走校验块增量更新，否则整条带重写
+    // 写入内容只取决于偏移，结束后停掉一个后端整文件降级读取，校验数据与校验块一致
+    std::string expect;
+    for (bool range_io : { true, false }) {
+        MemChunkStoreConfig c = base;
+        c.range_io = range_io;
+        for (auto &b : mem) b->set_config(c);
+
+        FmStack s = mount(raid);
+        Histogram hist;
+        uint64_t failed = 0;
+        double secs = run_parallel(4, random_writes, hist, failed, [&](uint64_t i) {
+            uint64_t off = ((i + 1) * 0x9E3779B97F4A7C15ULL) % (file_size / 4096) * 4096;
+            std::string block4k = random_data(4096, off);
+            return s.fm->write(path, off, block4k.data(), block4k.size()) && s.fm->flush(path);
+        });
+        s.meta->commit();
+
+        BenchResult res{ "fm", "rand_write_4k", {}, {} };
+        res.param("writes", (int64_t)random_writes).param("range_io", range_io ? "on" : "off")
+           .metric("iops", (double)random_writes / secs);
+        add_latency(res, "op", hist);
+        res.metric("failures", (double)failed);
+
+        if (expect.empty()) {
+            for (uint64_t off = 0; off < file_size; off += block) expect += buf;
+        }
+        for (uint64_t i = 0; i < random_writes; i++) {
+            uint64_t off = ((i + 1) * 0x9E3779B97F4A7C15ULL) % (file_size / 4096) * 4096;
+            expect.replace((size_t)off, 4096, random_data(4096, off));
+        }
+
+        mem[0]->set_down(true);
+        FmStack v = mount(raid);
+        std::string got(file_size, '\0');
+        size_t n = 0;
+        bool ok = v.fm->read_into(path, 0, file_size, &got[0], n) && n == file_size &&
+                  got == expect;
+        mem[0]->set_down(false);
+        res.metric("degraded_read_ok", ok ? 1 : 0);
+        r.add(res);
+    }
+}
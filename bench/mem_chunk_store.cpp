@@ -0,0 +1,181 @@
+#include "mem_chunk_store.h"
+#include <random>
+#include <thread>
+#include <chrono>
+
+MemChunkStore::MemChunkStore(const MemChunkStoreConfig &config)
+    : config_(config)
+{
+}
+
+void MemChunkStore::set_config(const MemChunkStoreConfig &config)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    config_ = config;
+}
+
+void MemChunkStore::clear()
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    chunks_.clear();
+}
+
+bool MemChunkStore::simulate(size_t bytes, bool write)
+{
+    MemChunkStoreConfig c;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        c = config_;
+    }
+    if (down_ || (write && fail_writes_)) return false;
+
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    std::uniform_real_distribution<double> uni(0.0, 1.0);
+
+    double delay_ms = c.latency_ms;
+    if (c.jitter_ms > 0) delay_ms += uni(rng) * c.jitter_ms;
+    if (c.bandwidth_mbps > 0) delay_ms += (double)bytes / 1048576.0 / c.bandwidth_mbps * 1000.0;
+    if (delay_ms > 0) {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(delay_ms));
+    }
+
+    return !(c.failure_rate > 0 && uni(rng) < c.failure_rate);
+}
+
+bool MemChunkStore::read_chunk(uint64_t stripe_id, uint32_t chunk_id, std::string &out)
+{
+    return read_chunk_status(stripe_id, chunk_id, out) == ChunkStatus::OK;
+}
+
+ChunkStatus MemChunkStore::read_chunk_status(uint64_t stripe_id, uint32_t chunk_id,
+                                             std::string &out)
+{
+    reads_++;
+    size_t bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = chunks_.find(key_of(stripe_id, chunk_id));
+        if (it != chunks_.end()) bytes = it->second.size();
+    }
+    if (!simulate(bytes)) {
+        failures_++;
+        return ChunkStatus::ERROR;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = chunks_.find(key_of(stripe_id, chunk_id));
+    if (it == chunks_.end()) return ChunkStatus::NOT_FOUND;
+    out = it->second;
+    return ChunkStatus::OK;
+}
+
+bool MemChunkStore::write_chunk(uint64_t stripe_id, uint32_t chunk_id, const std::string &data)
+{
+    writes_++;
+    if (!simulate(data.size(), true)) {
+        failures_++;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    chunks_[key_of(stripe_id, chunk_id)] = data;
+    return true;
+}
+
+bool MemChunkStore::delete_chunk(uint64_t stripe_id, uint32_t chunk_id)
+{
+    if (!simulate(0)) {
+        failures_++;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    chunks_.erase(key_of(stripe_id, chunk_id));
+    return true;
+}
+
+bool MemChunkStore::supports_range() const
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    return config_.range_io;
+}
+
+bool MemChunkStore::read_range(uint64_t stripe_id, uint32_t chunk_id,
+                               uint64_t offset, size_t len, std::string &out)
+{
+    reads_++;
+    if (!simulate(len)) {
+        failures_++;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = chunks_.find(key_of(stripe_id, chunk_id));
+    if (it == chunks_.end() || offset + len > it->second.size()) return false;
+    out.assign(it->second, (size_t)offset, len);
+    return true;
+}
+
+bool MemChunkStore::write_range(uint64_t stripe_id, uint32_t chunk_id,
+                                uint64_t offset, const std::string &data)
+{
+    writes_++;
+    if (!simulate(data.size(), true)) {
+        failures_++;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = chunks_.find(key_of(stripe_id, chunk_id));
+    if (it == chunks_.end() || offset + data.size() > it->second.size()) return false;
+    it->second.replace((size_t)offset, data.size(), data);
+    return true;
+}
+
+bool MemChunkStore::read_ranges(uint64_t stripe_id, uint32_t chunk_id,
+                                const std::vector<RangeRef> &ranges,
+                                std::vector<std::string> &out)
+{
+    out.assign(ranges.size(), std::string());
+    size_t bytes = 0;
+    for (const auto &r : ranges) bytes += r.len;
+
+    reads_++;
+    if (!simulate(bytes)) {
+        failures_++;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = chunks_.find(key_of(stripe_id, chunk_id));
+    if (it == chunks_.end()) return false;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (ranges[i].offset + ranges[i].len > it->second.size()) return false;
+        out[i].assign(it->second, (size_t)ranges[i].offset, ranges[i].len);
+    }
+    return true;
+}
+
+bool MemChunkStore::write_ranges(uint64_t stripe_id, uint32_t chunk_id,
+                                 const std::vector<RangeWrite> &writes)
+{
+    size_t bytes = 0;
+    for (const auto &w : writes) bytes += w.data->size();
+
+    writes_++;
+    if (!simulate(bytes, true)) {
+        failures_++;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = chunks_.find(key_of(stripe_id, chunk_id));
+    if (it == chunks_.end()) return false;
+    for (const auto &w : writes) {
+        if (w.offset + w.data->size() > it->second.size()) return false;
+    }
+    for (const auto &w : writes) {
+        it->second.replace((size_t)w.offset, w.data->size(), *w.data);
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef MEM_CHUNK_STORE_H
+#define MEM_CHUNK_STORE_H
+
+#include "chunk_store.h"
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+// 内存中的 ChunkStore，只用于基准测试
+// 可注入固定延迟、随机抖动、带宽限制与随机失败，
+// 用来模拟慢后端 / 故障后端，端到端驱动 RAIDChunkStore 与 FileManager
+
+struct MemChunkStoreConfig {
+    double latency_ms = 0;        // 每个请求的固定延迟
+    double jitter_ms = 0;         // 额外的随机延迟（均匀分布于 [0, jitter_ms)）
+    double bandwidth_mbps = 0;    // 传输带宽（MB/s），0 表示不限
+    double failure_rate = 0;      // 请求失败的概率
+    bool range_io = true;         // 支持范围读写（关闭时模拟只能整块读写的对象存储）
+};
+
+class MemChunkStore : public ChunkStore {
+public:
+    explicit MemChunkStore(const MemChunkStoreConfig &config = MemChunkStoreConfig());
+
+    bool read_chunk(uint64_t stripe_id, uint32_t chunk_id, std::string &out) override;
+    ChunkStatus read_chunk_status(uint64_t stripe_id, uint32_t chunk_id,
+                                  std::string &out) override;
+    bool write_chunk(uint64_t stripe_id, uint32_t chunk_id, const std::string &data) override;
+    bool delete_chunk(uint64_t stripe_id, uint32_t chunk_id) override;
+
+    bool supports_range() const override;
+    bool read_range(uint64_t stripe_id, uint32_t chunk_id,
+                    uint64_t offset, size_t len, std::string &out) override;
+    bool write_range(uint64_t stripe_id, uint32_t chunk_id,
+                     uint64_t offset, const std::string &data) override;
+
+    // 多区间读写按一次请求模拟延迟
+    bool read_ranges(uint64_t stripe_id, uint32_t chunk_id,
+                     const std::vector<RangeRef> &ranges,
+                     std::vector<std::string> &out) override;
+    bool write_ranges(uint64_t stripe_id, uint32_t chunk_id,
+                      const std::vector<RangeWrite> &writes) override;
+
+    // 运行中修改注入参数
+    void set_config(const MemChunkStoreConfig &config);
+
+    // 整个后端不可用（所有请求立即失败）
+    void set_down(bool down) { down_ = down; }
+
+    // 只有写请求失败（读取照常），模拟写入中途出错
+    void set_fail_writes(bool fail) { fail_writes_ = fail; }
+
+    // 清空已存数据
+    void clear();
+
+    uint64_t read_count() const { return reads_; }
+    uint64_t write_count() const { return writes_; }
+    uint64_t failure_count() const { return failures_; }
+
+private:
+    mutable std::mutex mu_;
+    MemChunkStoreConfig config_;
+    std::unordered_map<uint64_t, std::string> chunks_;   // (stripe_id << 8 | chunk_id) -> data
+
+    std::atomic<bool> down_{false};
+    std::atomic<bool> fail_writes_{false};
+    std::atomic<uint64_t> reads_{0};
+    std::atomic<uint64_t> writes_{0};
+    std::atomic<uint64_t> failures_{0};
+
+    static uint64_t key_of(uint64_t stripe_id, uint32_t chunk_id) {
+        return (stripe_id << 8) | (chunk_id & 0xff);
+    }
+
+    // 按配置等待并决定本次请求是否失败；返回 false 表示失败
+    bool simulate(size_t bytes, bool write = false);
+};
+
+#endif // MEM_CHUNK_STORE_H
@@ -42,6 +42,50 @@ else
     exit 1
 fi
 
+# -----------------------------
+# 检查 liblz4 / libzstd（可选，条带压缩）
+# -----------------------------
+COMPRESS_CFLAGS=""
+COMPRESS_LIBS=""
+if pkg-config --exists liblz4; then
+    COMPRESS_CFLAGS="$COMPRESS_CFLAGS -DHAVE_LZ4 $(pkg-config --cflags liblz4)"
+    COMPRESS_LIBS="$COMPRESS_LIBS $(pkg-config --libs liblz4)"
+    echo -e "${GREEN}检测到 liblz4，支持 lz4 压缩${NC}"
+else
+    echo -e "${YELLOW}未检测到 liblz4，不支持 lz4 压缩（Ubuntu: sudo apt install liblz4-dev）${NC}"
+fi
+if pkg-config --exists libzstd; then
+    COMPRESS_CFLAGS="$COMPRESS_CFLAGS -DHAVE_ZSTD $(pkg-config --cflags libzstd)"
+    COMPRESS_LIBS="$COMPRESS_LIBS $(pkg-config --libs libzstd)"
+    echo -e "${GREEN}检测到 libzstd，支持 zstd 压缩${NC}"
+else
+    echo -e "${YELLOW}未检测到 libzstd，不支持 zstd 压缩（Ubuntu: sudo apt install libzstd-dev）${NC}"
+fi
+
+# -----------------------------
+# 基准测试（不依赖 FUSE / 云存储 SDK）
+# -----------------------------
+if [ "$MODE" = "bench" ]; then
+    BENCH_SRC="bench/*.cpp rs_coder.cpp gf256.cpp chunk_cache.cpp file_cache.cpp disk_cache.cpp \
+        raid_chunk_store.cpp io_thread_pool.cpp repair_queue.cpp backend_health.cpp metrics.cpp \
+        file_manager.cpp metadata_manager.cpp path_trie.cpp data_pipeline.cpp"
+    echo -e "${GREEN}开始构建基准测试...${NC}"
+    $CXX -O3 -DNDEBUG -I. \
+        $COMPRESS_CFLAGS \
+        -D_DM_VERSION="\"${VERSION}\"" \
+        $BENCH_SRC \
+        -o cloudraidfs-bench \
+        $COMPRESS_LIBS \
+        -lcrypto \
+        -lpthread \
+        -std=c++20
+    echo -e "${GREEN}✓ 构建成功${NC}"
+    echo "输出文件: ./cloudraidfs-bench"
+    echo "  ./cloudraidfs-bench --quick              # 冒烟测试"
+    echo "  ./cloudraidfs-bench --json result.json   # 完整运行并输出 JSON"
+    exit 0
+fi
+
 # -----------------------------
 # 检查 FUSE3
 # -----------------------------
@@ -54,6 +98,19 @@ else
     exit 1
 fi
 
+# -----------------------------
+# 检查 liburing（可选，本地后端批量读写）
+# -----------------------------
+if pkg-config --exists liburing; then
+    URING_CFLAGS="-DHAVE_LIBURING $(pkg-config --cflags liburing)"
+    URING_LIBS=$(pkg-config --libs liburing)
+    echo -e "${GREEN}检测到 liburing，本地后端启用 io_uring${NC}"
+else
+    URING_CFLAGS=""
+    URING_LIBS=""
+    echo -e "${YELLOW}未检测到 liburing，本地后端使用 pread/pwrite（Ubuntu: sudo apt install liburing-dev）${NC}"
+fi
+
 # -----------------------------
 # vcpkg 自动检测
 # -----------------------------
@@ -113,13 +170,13 @@ case "$MODE" in
 
     clean)
         echo -e "${GREEN}清理构建文件...${NC}"
-        rm -f "$OUT"
+        rm -f "$OUT" cloudraidfs-bench
         exit 0
         ;;
 
     *)
         echo -e "${RED}未知构建模式: $MODE${NC}"
-        echo "可用模式: debug / release / musl / clang / clean"
+        echo "可用模式: debug / release / musl / clang / bench / clean"
         exit 1
         ;;
 esac
@@ -131,11 +188,15 @@ echo -e "${GREEN}开始构建...${NC}"
 
 $CXX $CXXFLAGS \
     $FUSE_CFLAGS \
+    $URING_CFLAGS \
+    $COMPRESS_CFLAGS \
     $VCPKG_INC \
     -D_DM_VERSION="\"${VERSION}\"" \
     $SRC \
     -o "$OUT" \
     $FUSE_LIBS \
+    $URING_LIBS \
+    $COMPRESS_LIBS \
     $VCPKG_LIB \
     -lminiocpp \
     -lpugixml -lINIReader -lcurlpp -lcurl -linih \
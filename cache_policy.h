@@ -0,0 +1,241 @@
+#ifndef CACHE_POLICY_H
+#define CACHE_POLICY_H
+
+#include <cstdint>
+#include <string>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+// 缓存淘汰策略
+// - 只记录 key 的顺序与访问频率，数据本身由缓存持有
+// - 所有操作均为 O(1)（S3-FIFO 的 evict 为均摊 O(1)）
+// - 非线程安全，由调用方的分片锁保护
+//
+// 可选策略：
+//   lru    : 经典 LRU，访问时移到队首
+//   s3fifo : S3-FIFO（小 FIFO + 主 FIFO + 幽灵队列），
+//            只访问过一次的条目停留在小队列中很快被淘汰，
+//            大范围顺序扫描不会冲掉热点数据
+
+template <typename Key>
+class CachePolicy {
+public:
+    virtual ~CachePolicy() = default;
+
+    virtual const char *name() const = 0;
+
+    // 新条目放入缓存
+    virtual void on_insert(const Key &key, uint64_t size) = 0;
+
+    // 条目被访问（命中）
+    virtual void on_access(const Key &key) = 0;
+
+    // 条目被主动移除（失效 / 过期），不进入幽灵队列
+    virtual void on_remove(const Key &key) = 0;
+
+    // 选出一个淘汰对象并从策略中移除，返回 false 表示没有可淘汰的条目
+    virtual bool evict(Key &victim) = 0;
+};
+
+// ------------------------------------------------------------
+// LRU
+// ------------------------------------------------------------
+template <typename Key>
+class LRUPolicy : public CachePolicy<Key> {
+public:
+    const char *name() const override { return "lru"; }
+
+    void on_insert(const Key &key, uint64_t size) override {
+        (void)size;
+        on_remove(key);
+        list_.push_front(key);
+        map_[key] = list_.begin();
+    }
+
+    void on_access(const Key &key) override {
+        auto it = map_.find(key);
+        if (it != map_.end()) {
+            // splice 不会使迭代器失效
+            list_.splice(list_.begin(), list_, it->second);
+        }
+    }
+
+    void on_remove(const Key &key) override {
+        auto it = map_.find(key);
+        if (it != map_.end()) {
+            list_.erase(it->second);
+            map_.erase(it);
+        }
+    }
+
+    bool evict(Key &victim) override {
+        if (list_.empty()) return false;
+        victim = list_.back();
+        map_.erase(victim);
+        list_.pop_back();
+        return true;
+    }
+
+private:
+    // 最近访问的在前面
+    std::list<Key> list_;
+    std::unordered_map<Key, typename std::list<Key>::iterator> map_;
+};
+
+// ------------------------------------------------------------
+// S3-FIFO
+// ------------------------------------------------------------
+// - 新条目进入小队列 S（约占容量 10%）
+// - S 满时淘汰队尾：访问次数 > 1 的移入主队列 M，否则淘汰并记入幽灵队列 G
+// - 在 G 中命中的 key 再次放入时直接进入 M
+// - M 淘汰队尾：访问次数 > 0 的减一后重新放回队首，否则淘汰
+// 访问次数上限为 3，因此每个条目最多被重新放回 3 次，evict 均摊 O(1)
+template <typename Key>
+class S3FIFOPolicy : public CachePolicy<Key> {
+public:
+    explicit S3FIFOPolicy(uint64_t capacity)
+        : small_target_(capacity / 10) {}
+
+    const char *name() const override { return "s3fifo"; }
+
+    void on_insert(const Key &key, uint64_t size) override {
+        on_remove(key);
+
+        Node node;
+        node.size = size;
+
+        auto git = ghost_map_.find(key);
+        if (git != ghost_map_.end()) {
+            // 近期被淘汰过又再次访问：直接进入主队列
+            ghost_.erase(git->second);
+            ghost_map_.erase(git);
+            main_.push_front(key);
+            node.it = main_.begin();
+            node.in_main = true;
+            main_bytes_ += size;
+        } else {
+            small_.push_front(key);
+            node.it = small_.begin();
+            small_bytes_ += size;
+        }
+        nodes_.emplace(key, node);
+    }
+
+    void on_access(const Key &key) override {
+        auto it = nodes_.find(key);
+        if (it != nodes_.end() && it->second.freq < 3) {
+            it->second.freq++;
+        }
+    }
+
+    void on_remove(const Key &key) override {
+        auto it = nodes_.find(key);
+        if (it == nodes_.end()) return;
+
+        Node &node = it->second;
+        if (node.in_main) {
+            main_.erase(node.it);
+            main_bytes_ -= node.size;
+        } else {
+            small_.erase(node.it);
+            small_bytes_ -= node.size;
+        }
+        nodes_.erase(it);
+    }
+
+    bool evict(Key &victim) override {
+        for (;;) {
+            if (!small_.empty() && (small_bytes_ > small_target_ || main_.empty())) {
+                auto it = nodes_.find(small_.back());
+                Node &node = it->second;
+
+                if (node.freq > 1) {
+                    // 在小队列中被多次访问：移入主队列
+                    main_.splice(main_.begin(), small_, node.it);
+                    node.in_main = true;
+                    node.freq = 0;
+                    small_bytes_ -= node.size;
+                    main_bytes_ += node.size;
+                    continue;
+                }
+
+                victim = it->first;
+                small_.pop_back();
+                small_bytes_ -= node.size;
+                nodes_.erase(it);
+                add_ghost(victim);
+                return true;
+            }
+
+            if (main_.empty()) return false;
+
+            auto it = nodes_.find(main_.back());
+            Node &node = it->second;
+
+            if (node.freq > 0) {
+                node.freq--;
+                main_.splice(main_.begin(), main_, node.it);
+                continue;
+            }
+
+            victim = it->first;
+            main_.pop_back();
+            main_bytes_ -= node.size;
+            nodes_.erase(it);
+            return true;
+        }
+    }
+
+private:
+    struct Node {
+        typename std::list<Key>::iterator it;
+        uint64_t size = 0;
+        uint8_t freq = 0;
+        bool in_main = false;
+    };
+
+    // 幽灵队列只记录 key，条目数不超过当前缓存条目数
+    void add_ghost(const Key &key) {
+        if (ghost_map_.count(key)) return;
+        ghost_.push_front(key);
+        ghost_map_[key] = ghost_.begin();
+
+        size_t limit = nodes_.size() > 16 ? nodes_.size() : 16;
+        while (ghost_.size() > limit) {
+            ghost_map_.erase(ghost_.back());
+            ghost_.pop_back();
+        }
+    }
+
+    uint64_t small_target_;
+    uint64_t small_bytes_ = 0;
+    uint64_t main_bytes_ = 0;
+
+    // 队首为最新放入
+    std::list<Key> small_;
+    std::list<Key> main_;
+    std::unordered_map<Key, Node> nodes_;
+
+    std::list<Key> ghost_;
+    std::unordered_map<Key, typename std::list<Key>::iterator> ghost_map_;
+};
+
+// 策略名是否有效
+inline bool is_valid_cache_policy(const std::string &name)
+{
+    return name == "lru" || name == "s3fifo";
+}
+
+// 按名称创建策略，capacity 为所属分片的容量（字节）
+// 未知名称时使用 s3fifo
+template <typename Key>
+std::unique_ptr<CachePolicy<Key>> make_cache_policy(const std::string &name, uint64_t capacity)
+{
+    if (name == "lru") {
+        return std::make_unique<LRUPolicy<Key>>();
+    }
+    return std::make_unique<S3FIFOPolicy<Key>>(capacity);
+}
+
+#endif // CACHE_POLICY_H
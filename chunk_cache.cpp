@@ -1,17 +1,48 @@
 #include "chunk_cache.h"
-#include <algorithm>
 #include <vector>
 
+// 每个分片至少容纳的字节数（约 16 个 4MB stripe），缓存较小时减少分片数，
+// 避免单个分片容量过小导致频繁淘汰（S3-FIFO 小队列约占 10%，至少要放得下一个 stripe）
+static const uint64_t MIN_SHARD_BYTES = 64ULL * 1024 * 1024;
+
 ChunkCache::ChunkCache(const ChunkCacheConfig& config)
     : config_(config)
 {
+    size_t n = config_.shards ? config_.shards : 1;
+    while (n > 1 && config_.max_cache_size / n < MIN_SHARD_BYTES) {
+        n /= 2;
+    }
+
+    shard_capacity_ = config_.max_cache_size / n;
+    for (size_t i = 0; i < n; i++) {
+        auto shard = std::make_unique<Shard>();
+        shard->policy = make_cache_policy<uint64_t>(config_.policy, shard_capacity_);
+        shards_.push_back(std::move(shard));
+    }
+}
+
+ChunkCache::Shard& ChunkCache::shard_for(uint64_t stripe_id) const {
+    // stripe_id 通常连续分配，乘以奇数常量打散后取高位
+    uint64_t h = stripe_id * 0x9E3779B97F4A7C15ULL;
+    return *shards_[(size_t)((h >> 32) % shards_.size())];
 }
 
 bool ChunkCache::get(uint64_t stripe_id, std::string& out) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<const std::string> data;
+    if (!get(stripe_id, data)) {
+        return false;
+    }
+    out = *data;
+    return true;
+}
 
-    auto it = cache_.find(stripe_id);
-    if (it == cache_.end()) {
+bool ChunkCache::get(uint64_t stripe_id, std::shared_ptr<const std::string>& out,
+                     bool record_access) {
+    Shard& shard = shard_for(stripe_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.cache.find(stripe_id);
+    if (it == shard.cache.end()) {
         misses_++;
         return false;
     }
@@ -22,177 +53,163 @@ bool ChunkCache::get(uint64_t stripe_id, std::string& out) {
     auto now = std::chrono::steady_clock::now();
     if (now > entry.expire_time) {
         // 过期，移除
-        remove_entry(stripe_id);
+        remove_entry(shard, stripe_id);
         misses_++;
         return false;
     }
 
     // 命中：延长过期时间
     entry.expire_time = now + std::chrono::seconds(config_.cache_ttl_seconds);
-    entry.access_count++;
 
-    // 更新 LRU
-    touch_lru(stripe_id);
+    if (record_access) {
+        shard.policy->on_access(stripe_id);
+    }
+
+    if (entry.prefetched) {
+        entry.prefetched = false;
+        prefetch_hits_++;
+    }
 
     out = entry.data;
     hits_++;
     return true;
 }
 
+bool ChunkCache::put_prefetched(uint64_t stripe_id, std::shared_ptr<const std::string> data,
+                                uint64_t epoch) {
+    Shard& shard = shard_for(stripe_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // 预读期间发生过失效，或已被正常读取放入
+    // invalidate 在分片锁内递增 epoch_，同一条带的检查与失效由分片锁串行化
+    if (epoch != epoch_ || shard.cache.count(stripe_id)) {
+        return false;
+    }
+
+    if (!make_room(shard, data->size())) {
+        return false;
+    }
+
+    insert_entry(shard, stripe_id, std::move(data), true);
+    prefetches_++;
+    return true;
+}
+
+bool ChunkCache::contains(uint64_t stripe_id) const {
+    Shard& shard = shard_for(stripe_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.cache.count(stripe_id) > 0;
+}
+
 void ChunkCache::put(uint64_t stripe_id, const std::string& data) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    put(stripe_id, std::make_shared<const std::string>(data));
+}
 
-    uint64_t data_size = data.size();
+void ChunkCache::put(uint64_t stripe_id, std::shared_ptr<const std::string> data) {
+    Shard& shard = shard_for(stripe_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
 
     // 如果已存在，先移除旧条目
-    auto existing = cache_.find(stripe_id);
-    if (existing != cache_.end()) {
-        current_size_ -= existing->second.data.size();
-        lru_list_.erase(lru_map_[stripe_id]);
-        lru_map_.erase(stripe_id);
-        cache_.erase(existing);
-    }
+    remove_entry(shard, stripe_id);
 
     // 尝试腾出空间
-    if (!make_room(data_size)) {
+    if (!make_room(shard, data->size())) {
         // 无法腾出足够空间，放弃缓存
         return;
     }
 
-    // 创建新条目
-    ChunkCacheEntry entry;
-    entry.stripe_id = stripe_id;
-    entry.data = data;
-    entry.expire_time = std::chrono::steady_clock::now() + 
-                        std::chrono::seconds(config_.cache_ttl_seconds);
-    entry.access_count = 1;
-
-    cache_[stripe_id] = std::move(entry);
-    current_size_ += data_size;
-
-    // 添加到 LRU 列表前面
-    lru_list_.push_front(stripe_id);
-    lru_map_[stripe_id] = lru_list_.begin();
+    insert_entry(shard, stripe_id, std::move(data), false);
 }
 
 void ChunkCache::invalidate(uint64_t stripe_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    remove_entry(stripe_id);
+    Shard& shard = shard_for(stripe_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    epoch_++;
+    remove_entry(shard, stripe_id);
 }
 
 void ChunkCache::cleanup_expired() {
-    std::lock_guard<std::mutex> lock(mutex_);
-
     auto now = std::chrono::steady_clock::now();
-    std::vector<uint64_t> expired_ids;
 
-    for (const auto& kv : cache_) {
-        if (now > kv.second.expire_time) {
-            expired_ids.push_back(kv.first);
+    for (auto& sp : shards_) {
+        Shard& shard = *sp;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        std::vector<uint64_t> expired_ids;
+        for (const auto& kv : shard.cache) {
+            if (now > kv.second.expire_time) {
+                expired_ids.push_back(kv.first);
+            }
         }
-    }
 
-    for (uint64_t id : expired_ids) {
-        remove_entry(id);
+        for (uint64_t id : expired_ids) {
+            remove_entry(shard, id);
+        }
     }
 }
 
 uint64_t ChunkCache::current_size() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return current_size_;
-}
-
-void ChunkCache::touch_lru(uint64_t stripe_id) {
-    // 假设已持有锁
-    auto it = lru_map_.find(stripe_id);
-    if (it != lru_map_.end()) {
-        lru_list_.erase(it->second);
-        lru_list_.push_front(stripe_id);
-        lru_map_[stripe_id] = lru_list_.begin();
+    uint64_t total = 0;
+    for (const auto& sp : shards_) {
+        std::lock_guard<std::mutex> lock(sp->mutex);
+        total += sp->current_size;
     }
+    return total;
 }
 
-bool ChunkCache::make_room(uint64_t needed_size) {
-    // 假设已持有锁
-
-    // 如果需要的空间超过最大缓存大小，无法缓存
-    if (needed_size > config_.max_cache_size) {
+bool ChunkCache::make_room(Shard& shard, uint64_t needed_size) {
+    // 如果需要的空间超过分片容量，无法缓存
+    if (needed_size > shard_capacity_) {
         return false;
     }
 
-    // 清理过期条目
-    auto now = std::chrono::steady_clock::now();
-    std::vector<uint64_t> expired_ids;
-    for (const auto& kv : cache_) {
-        if (now > kv.second.expire_time) {
-            expired_ids.push_back(kv.first);
+    // 由淘汰策略逐个选出淘汰对象，直到空间足够
+    // 过期条目在访问时或 cleanup_expired 中移除，这里不做全量扫描
+    while (shard.current_size + needed_size > shard_capacity_) {
+        uint64_t victim;
+        if (!shard.policy->evict(victim)) {
+            break;
         }
-    }
-    for (uint64_t id : expired_ids) {
-        remove_entry(id);
+        erase_entry(shard, victim);
+        evictions_++;
     }
 
-    // 如果空间足够，返回
-    if (current_size_ + needed_size <= config_.max_cache_size) {
-        return true;
-    }
+    return shard.current_size + needed_size <= shard_capacity_;
+}
 
-    // 按热度排序，移除热度最低的条目
-    std::vector<std::pair<uint64_t, double>> scored_entries;
-    for (const auto& kv : cache_) {
-        double score = calc_heat_score(kv.second);
-        scored_entries.push_back({kv.first, score});
-    }
+void ChunkCache::insert_entry(Shard& shard, uint64_t stripe_id,
+                              std::shared_ptr<const std::string> data, bool prefetched) {
+    uint64_t data_size = data->size();
 
-    // 按热度升序排序（热度低的在前面）
-    std::sort(scored_entries.begin(), scored_entries.end(),
-              [](const auto& a, const auto& b) {
-                  return a.second < b.second;
-              });
+    ChunkCacheEntry entry;
+    entry.stripe_id = stripe_id;
+    entry.data = std::move(data);
+    entry.expire_time = std::chrono::steady_clock::now() +
+                        std::chrono::seconds(config_.cache_ttl_seconds);
+    entry.prefetched = prefetched;
 
-    // 移除热度最低的条目，直到空间足够
-    for (const auto& entry : scored_entries) {
-        if (current_size_ + needed_size <= config_.max_cache_size) {
-            break;
-        }
-        remove_entry(entry.first);
-    }
+    shard.cache[stripe_id] = std::move(entry);
+    shard.current_size += data_size;
 
-    return current_size_ + needed_size <= config_.max_cache_size;
+    shard.policy->on_insert(stripe_id, data_size);
 }
 
-void ChunkCache::remove_entry(uint64_t stripe_id) {
-    // 假设已持有锁
-    auto it = cache_.find(stripe_id);
-    if (it == cache_.end()) {
-        return;
-    }
-
-    current_size_ -= it->second.data.size();
-    cache_.erase(it);
-
-    auto lru_it = lru_map_.find(stripe_id);
-    if (lru_it != lru_map_.end()) {
-        lru_list_.erase(lru_it->second);
-        lru_map_.erase(lru_it);
+void ChunkCache::remove_entry(Shard& shard, uint64_t stripe_id) {
+    if (shard.cache.count(stripe_id)) {
+        shard.policy->on_remove(stripe_id);
+        erase_entry(shard, stripe_id);
     }
 }
 
-double ChunkCache::calc_heat_score(const ChunkCacheEntry& entry) const {
-    // 热度分数计算：
-    // - 访问次数越多，热度越高
-    // - 距离过期时间越近，热度越低（即将过期的优先移除）
-
-    auto now = std::chrono::steady_clock::now();
-    auto time_to_expire = std::chrono::duration_cast<std::chrono::seconds>(
-        entry.expire_time - now).count();
-    
-    if (time_to_expire < 0) {
-        return -1.0;  // 已过期，最低热度
+void ChunkCache::erase_entry(Shard& shard, uint64_t stripe_id) {
+    auto it = shard.cache.find(stripe_id);
+    if (it == shard.cache.end()) {
+        return;
     }
 
-    // 热度 = access_count * (time_to_expire + 1)
-    double score = (double)entry.access_count * (double)(time_to_expire + 1);
-
-    return score;
+    shard.current_size -= it->second.data->size();
+    if (it->second.prefetched) {
+        prefetch_wasted_++;
+    }
+    shard.cache.erase(it);
 }
@@ -1,29 +1,34 @@
 #ifndef CHUNK_CACHE_H
 #define CHUNK_CACHE_H
 
+#include "cache_policy.h"
 #include <string>
+#include <memory>
 #include <unordered_map>
-#include <list>
 #include <mutex>
+#include <atomic>
+#include <vector>
 #include <chrono>
 #include <cstdint>
 
 // Chunk 内存缓存
 // - 缓存 stripe/chunk 数据（通常为 4MB）
-// - 使用 LRU + 过期时间策略
+// - 淘汰策略可选（见 cache_policy.h），默认 S3-FIFO，另有过期时间
 // - 访问时自动延长过期时间
-// - 缓存区满时移除热度最低的 chunk
+// - 条目数据为不可变的共享缓冲区，命中时只增加引用计数，不复制数据
 
 struct ChunkCacheEntry {
     uint64_t stripe_id;
-    std::string data;
+    std::shared_ptr<const std::string> data;
     std::chrono::steady_clock::time_point expire_time;
-    uint64_t access_count;  // 访问次数，用于热度计算
+    bool prefetched = false; // 由预读放入且尚未被读取
 };
 
 struct ChunkCacheConfig {
     uint64_t max_cache_size = 256ULL * 1024 * 1024;  // 最大缓存大小，默认 256MB
     uint64_t cache_ttl_seconds = 60;                  // 缓存过期时间，默认 60 秒
+    size_t shards = 16;                               // 分片数，默认 16
+    std::string policy = "s3fifo";                    // 淘汰策略：s3fifo / lru
 };
 
 class ChunkCache {
@@ -32,13 +37,34 @@ public:
 
     // 尝试从缓存获取 chunk 内容
     // 如果命中，自动延长过期时间
-    // 返回 true 表示命中，out 填充数据
+    // 返回 true 表示命中，out 指向缓存中的数据（长度可能小于一个 stripe）
+    // record_access=false 时不计入淘汰策略的访问频率
+    // （同一次顺序读在条带内的后续访问不应让条带显得更“热”）
+    bool get(uint64_t stripe_id, std::shared_ptr<const std::string>& out,
+             bool record_access = true);
+
+    // 同上，但复制一份数据到 out
     bool get(uint64_t stripe_id, std::string& out);
 
-    // 将 chunk 放入缓存
+    // 将 chunk 放入缓存（共享 data，不复制）
     // 如果缓存已满（且无法腾出空间），则不缓存
+    void put(uint64_t stripe_id, std::shared_ptr<const std::string> data);
+
+    // 同上，复制一份 data 放入缓存
     void put(uint64_t stripe_id, const std::string& data);
 
+    // 预读放入：仅当自 epoch 以来没有发生过失效时才放入，
+    // 避免预读读到的旧数据覆盖并发写入后的新内容
+    // 返回 true 表示已放入
+    bool put_prefetched(uint64_t stripe_id, std::shared_ptr<const std::string> data,
+                        uint64_t epoch);
+
+    // 失效计数，预读开始前记录，放入时校验
+    uint64_t epoch() const { return epoch_; }
+
+    // 是否已缓存（不计入命中统计，不延长过期时间）
+    bool contains(uint64_t stripe_id) const;
+
     // 使缓存失效（chunk 被修改或删除时调用）
     void invalidate(uint64_t stripe_id);
 
@@ -51,37 +77,58 @@ public:
     // 获取缓存命中统计
     uint64_t hit_count() const { return hits_; }
     uint64_t miss_count() const { return misses_; }
+    uint64_t eviction_count() const { return evictions_; }
+
+    // 当前使用的淘汰策略名
+    const char* policy_name() const { return shards_[0]->policy->name(); }
+
+    // 预读统计：放入次数 / 被读取命中次数 / 未被读取即被移除的次数
+    uint64_t prefetch_count() const { return prefetches_; }
+    uint64_t prefetch_hit_count() const { return prefetch_hits_; }
+    uint64_t prefetch_wasted_count() const { return prefetch_wasted_; }
 
 private:
+    // 按 stripe_id 分片，每个分片独立加锁、独立 LRU 与容量（总容量 / 分片数）
+    struct Shard {
+        // stripe_id -> ChunkCacheEntry
+        std::unordered_map<uint64_t, ChunkCacheEntry> cache;
+
+        std::unique_ptr<CachePolicy<uint64_t>> policy;
+
+        uint64_t current_size = 0;
+        mutable std::mutex mutex;
+    };
+
     ChunkCacheConfig config_;
-    
-    // stripe_id -> ChunkCacheEntry
-    std::unordered_map<uint64_t, ChunkCacheEntry> cache_;
-    
-    // LRU 列表：最近访问的在前面
-    std::list<uint64_t> lru_list_;
-    
-    // stripe_id -> lru_list_ 中的迭代器（用于快速移动到前面）
-    std::unordered_map<uint64_t, std::list<uint64_t>::iterator> lru_map_;
-    
-    uint64_t current_size_ = 0;
-    uint64_t hits_ = 0;
-    uint64_t misses_ = 0;
-    
-    mutable std::mutex mutex_;
-
-    // 移动到 LRU 列表前面
-    void touch_lru(uint64_t stripe_id);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    uint64_t shard_capacity_ = 0;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+    std::atomic<uint64_t> prefetches_{0};
+    std::atomic<uint64_t> prefetch_hits_{0};
+    std::atomic<uint64_t> prefetch_wasted_{0};
+    std::atomic<uint64_t> epoch_{0};
+
+    Shard& shard_for(uint64_t stripe_id) const;
+
+    // 以下函数假设已持有 shard.mutex
 
     // 腾出空间以容纳 needed_size 字节
     // 返回 true 表示成功腾出空间
-    bool make_room(uint64_t needed_size);
+    bool make_room(Shard& shard, uint64_t needed_size);
+
+    // 放入新条目（调用方已确保不存在且空间足够）
+    void insert_entry(Shard& shard, uint64_t stripe_id,
+                      std::shared_ptr<const std::string> data, bool prefetched);
 
-    // 移除一个条目
-    void remove_entry(uint64_t stripe_id);
+    // 移除一个条目（同时从淘汰策略中移除）
+    void remove_entry(Shard& shard, uint64_t stripe_id);
 
-    // 计算条目热度分数（越低越容易被移除）
-    double calc_heat_score(const ChunkCacheEntry& entry) const;
+    // 只删除条目数据（淘汰策略已自行移除）
+    void erase_entry(Shard& shard, uint64_t stripe_id);
 };
 
 #endif // CHUNK_CACHE_H
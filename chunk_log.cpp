@@ -0,0 +1,593 @@
+#include "chunk_log.h"
+#include "log.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cinttypes>
+#include <chrono>
+#include <deque>
+#include <algorithm>
+
+// O_DIRECT 要求缓冲区地址、偏移和长度都按块对齐，记录也按此对齐
+static const size_t DIO_ALIGN = 4096;
+
+// 扫描段文件时每次读取的窗口大小
+static const size_t SCAN_WINDOW = 1 << 20;
+
+// 一次回收复制的最大字节数
+static const uint64_t COMPACT_BATCH_BYTES = 64ULL << 20;
+
+static const uint32_t RECORD_MAGIC = 0x474C4352;   // "RCLG"
+
+enum : uint32_t {
+    RECORD_PUT = 1,
+    RECORD_DELETE = 2,
+};
+
+// 记录头，固定 64 字节，数据紧随其后
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t stripe_id;
+    uint32_t chunk_id;
+    uint32_t length;
+    uint64_t seq;
+    uint32_t data_crc;
+    uint32_t header_crc;    // 本字段之前各字段的 CRC
+    char reserved[24];
+};
+static_assert(sizeof(RecordHeader) == 64, "RecordHeader 必须为 64 字节");
+
+static size_t align_up(size_t n)
+{
+    return (n + DIO_ALIGN - 1) / DIO_ALIGN * DIO_ALIGN;
+}
+
+static uint64_t record_size(uint32_t length)
+{
+    return align_up(sizeof(RecordHeader) + length);
+}
+
+// CRC32C（slicing-by-8），数据校验在每次读取的热路径上，逐字节查表太慢
+static uint32_t crc32c(const char *data, size_t len)
+{
+    static uint32_t table[8][256];
+    static bool init = [] {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int j = 0; j < 8; j++) {
+                c = (c & 1) ? (0x82F63B78u ^ (c >> 1)) : (c >> 1);
+            }
+            table[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int t = 1; t < 8; t++) {
+                table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+            }
+        }
+        return true;
+    }();
+    (void)init;
+
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        v ^= crc;
+        crc = table[7][v & 0xFF] ^ table[6][(v >> 8) & 0xFF] ^
+              table[5][(v >> 16) & 0xFF] ^ table[4][(v >> 24) & 0xFF] ^
+              table[3][(v >> 32) & 0xFF] ^ table[2][(v >> 40) & 0xFF] ^
+              table[1][(v >> 48) & 0xFF] ^ table[0][v >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static uint32_t header_crc(const RecordHeader &h)
+{
+    return crc32c(reinterpret_cast<const char *>(&h), offsetof(RecordHeader, header_crc));
+}
+
+static bool header_valid(const RecordHeader &h, uint64_t offset, uint64_t seg_size)
+{
+    if (h.magic != RECORD_MAGIC || h.header_crc != header_crc(h)) return false;
+    if (h.type != RECORD_PUT && h.type != RECORD_DELETE) return false;
+    return offset + record_size(h.length) <= seg_size;
+}
+
+// 对齐的临时缓冲区
+struct AlignedBuffer {
+    char *ptr = nullptr;
+
+    explicit AlignedBuffer(size_t size) {
+        if (posix_memalign((void **)&ptr, DIO_ALIGN, size) != 0) {
+            ptr = nullptr;
+        }
+    }
+    ~AlignedBuffer() { free(ptr); }
+
+    AlignedBuffer(const AlignedBuffer &) = delete;
+    AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+};
+
+static bool pread_full(int fd, char *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::pread(fd, buf + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+static bool pwrite_full(int fd, const char *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::pwrite(fd, buf + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+ChunkLog::Segment::~Segment()
+{
+    if (fd >= 0) ::close(fd);
+}
+
+ChunkLog::ChunkLog(const std::string &dir, const ChunkLogConfig &config)
+    : dir_(dir), config_(config)
+{
+    if (!dir_.empty() && dir_.back() != '/') {
+        dir_ += '/';
+    }
+    config_.segment_size = align_up(config_.segment_size);
+}
+
+ChunkLog::~ChunkLog()
+{
+    if (!opened_) return;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    compact_cv_.notify_all();
+    if (compactor_.joinable()) compactor_.join();
+}
+
+std::shared_ptr<ChunkLog::Segment> ChunkLog::open_segment(uint32_t id, bool create,
+                                                          uint64_t size)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%08" PRIu32 ".seg", id);
+
+    auto seg = std::make_shared<Segment>();
+    seg->id = id;
+    seg->path = dir_ + name;
+
+    int flags = O_RDWR | (create ? O_CREAT | O_EXCL : 0);
+    if (config_.direct_io) {
+        seg->fd = ::open(seg->path.c_str(), flags | O_DIRECT, 0644);
+    }
+    if (seg->fd < 0) {
+        seg->fd = ::open(seg->path.c_str(), flags, 0644);
+    }
+    if (seg->fd < 0) {
+        LOG_ERROR("ChunkLog: 无法打开 %s: %s\n",
+                  seg->path.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    if (create) {
+        // 预分配整个段，写入时不再分配块，也不会因磁盘写满写到一半
+        int err = posix_fallocate(seg->fd, 0, (off_t)size);
+        if (err != 0 && ftruncate(seg->fd, (off_t)size) != 0) {
+            LOG_ERROR("ChunkLog: 无法分配 %s: %s\n",
+                      seg->path.c_str(), strerror(err));
+            ::unlink(seg->path.c_str());
+            return nullptr;
+        }
+        seg->size = size;
+    } else {
+        struct stat st;
+        if (fstat(seg->fd, &st) != 0) return nullptr;
+        seg->size = (uint64_t)st.st_size / DIO_ALIGN * DIO_ALIGN;
+    }
+    return seg;
+}
+
+template <typename F>
+uint64_t ChunkLog::scan_segment(Segment &seg, F &&fn)
+{
+    AlignedBuffer window(SCAN_WINDOW);
+    if (!window.ptr) return 0;
+
+    uint64_t win_base = 0, win_len = 0;
+    uint64_t offset = 0, end = 0;
+
+    while (offset + DIO_ALIGN <= seg.size) {
+        if (offset < win_base || offset + sizeof(RecordHeader) > win_base + win_len) {
+            win_base = offset;
+            win_len = std::min<uint64_t>(SCAN_WINDOW, seg.size - offset);
+            if (!pread_full(seg.fd, window.ptr, (size_t)win_len, win_base)) break;
+        }
+
+        RecordHeader h;
+        memcpy(&h, window.ptr + (offset - win_base), sizeof(h));
+        if (header_valid(h, offset, seg.size)) {
+            fn(h, offset);
+            offset += record_size(h.length);
+            end = offset;
+        } else {
+            // 预分配的空白区域，或崩溃时没有写完的记录：
+            // 并发批次可能已经写完了后面的区间，继续按对齐粒度向后查找
+            offset += DIO_ALIGN;
+        }
+    }
+    return end;
+}
+
+bool ChunkLog::open()
+{
+    if (mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR("ChunkLog: 无法创建目录 %s: %s\n",
+                  dir_.c_str(), strerror(errno));
+        return false;
+    }
+
+    DIR *d = opendir(dir_.c_str());
+    if (!d) return false;
+    std::vector<uint32_t> ids;
+    while (struct dirent *ent = readdir(d)) {
+        uint32_t id;
+        char tail[8];
+        if (sscanf(ent->d_name, "%" SCNu32 ".%4s", &id, tail) == 2 &&
+            strcmp(tail, "seg") == 0) {
+            ids.push_back(id);
+        }
+    }
+    closedir(d);
+
+    std::lock_guard<std::mutex> lock(mu_);
+    uint32_t max_id = 0;
+    for (uint32_t id : ids) {
+        auto seg = open_segment(id, false, 0);
+        if (!seg) return false;
+        segments_[id] = seg;
+
+        seg->used = scan_segment(*seg, [&](const RecordHeader &h, uint64_t offset) {
+            Key key{h.stripe_id, h.chunk_id};
+            uint64_t bytes = record_size(h.length);
+            auto it = index_.find(key);
+            if (it == index_.end()) {
+                it = index_.emplace(key, Entry()).first;
+            } else if (it->second.seq >= h.seq) {
+                it->second.copies++;
+                return;
+            } else {
+                drop_live(it->second);
+            }
+            Entry &e = it->second;
+            e.segment = id;
+            e.offset = offset;
+            e.length = h.length;
+            e.seq = h.seq;
+            e.deleted = h.type == RECORD_DELETE;
+            e.copies++;
+            seg->live += bytes;
+            if (h.seq >= next_seq_) next_seq_ = h.seq + 1;
+        });
+        // 已有的段一律封存，新写入进入新段，旧段由后台回收
+        seg->sealed = true;
+        if (id > max_id) max_id = id;
+    }
+
+    opened_ = true;
+    compactor_ = std::thread(&ChunkLog::compactor_loop, this);
+
+    LOG_INFO("ChunkLog: %s, %zu 个段，%zu 个 chunk%s\n",
+             dir_.c_str(), segments_.size(), index_.size(),
+             config_.direct_io ? "（O_DIRECT）" : "");
+    return true;
+}
+
+void ChunkLog::drop_live(const Entry &e)
+{
+    auto it = segments_.find(e.segment);
+    if (it == segments_.end()) return;
+    Segment &seg = *it->second;
+    uint64_t bytes = record_size(e.length);
+    seg.live = seg.live > bytes ? seg.live - bytes : 0;
+    if (seg.sealed && seg.live * 2 < seg.used) {
+        compact_cv_.notify_one();
+    }
+}
+
+std::shared_ptr<ChunkLog::Segment> ChunkLog::reserve(uint64_t bytes, uint64_t &offset)
+{
+    if (!active_ || active_->used + bytes > active_->size) {
+        if (active_) active_->sealed = true;
+        uint32_t id = segments_.empty() ? 1 : segments_.rbegin()->first + 1;
+        auto seg = open_segment(id, true, std::max(config_.segment_size, bytes));
+        if (!seg) return nullptr;
+        segments_[id] = seg;
+        active_ = seg;
+    }
+    offset = active_->used;
+    active_->used += bytes;
+    return active_;
+}
+
+bool ChunkLog::write_batch(std::vector<Pending> &batch,
+                           const std::vector<std::pair<uint32_t, uint64_t>> *expect)
+{
+    if (batch.empty()) return true;
+
+    uint64_t total = 0;
+    for (const auto &p : batch) {
+        total += record_size(p.data ? (uint32_t)p.data->size() : 0);
+    }
+
+    std::shared_ptr<Segment> seg;
+    uint64_t base = 0;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        seg = reserve(total, base);
+        if (!seg) return false;
+        seg->writers++;
+        for (auto &p : batch) {
+            if (p.seq == 0) p.seq = next_seq_++;
+        }
+    }
+
+    // 整批记录组装到一块对齐缓冲区，一次 pwrite 写入
+    AlignedBuffer buf((size_t)total);
+    bool ok = buf.ptr != nullptr;
+    uint64_t pos = 0;
+    for (auto &p : batch) {
+        if (!ok) break;
+        uint32_t length = p.data ? (uint32_t)p.data->size() : 0;
+        uint64_t bytes = record_size(length);
+
+        RecordHeader h;
+        memset(&h, 0, sizeof(h));
+        h.magic = RECORD_MAGIC;
+        h.type = p.data ? RECORD_PUT : RECORD_DELETE;
+        h.stripe_id = p.key.stripe_id;
+        h.chunk_id = p.key.chunk_id;
+        h.length = length;
+        h.seq = p.seq;
+        h.data_crc = p.data ? crc32c(p.data->data(), length) : 0;
+        h.header_crc = header_crc(h);
+
+        char *dst = buf.ptr + pos;
+        memcpy(dst, &h, sizeof(h));
+        if (length) memcpy(dst + sizeof(h), p.data->data(), length);
+        memset(dst + sizeof(h) + length, 0, (size_t)(bytes - sizeof(h) - length));
+
+        p.offset = base + pos;
+        pos += bytes;
+    }
+
+    // 回收复制总是落盘后才删除旧段
+    ok = ok && pwrite_full(seg->fd, buf.ptr, (size_t)total, base);
+    if (ok && (config_.sync || expect)) {
+        ok = fdatasync(seg->fd) == 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+    seg->writers--;
+    if (!ok) {
+        LOG_ERROR("ChunkLog: 写入 %s 失败: %s\n",
+                  seg->path.c_str(), strerror(errno));
+        return false;
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        const Pending &p = batch[i];
+        uint32_t length = p.data ? (uint32_t)p.data->size() : 0;
+        auto it = index_.find(p.key);
+
+        bool current;
+        if (expect) {
+            const auto &old = (*expect)[i];
+            current = it != index_.end() && it->second.segment == old.first &&
+                      it->second.offset == old.second;
+        } else {
+            // 并发批次可能乱序完成，只有序号更大的记录才生效
+            current = it == index_.end() || it->second.seq < p.seq;
+        }
+
+        if (it == index_.end()) {
+            it = index_.emplace(p.key, Entry()).first;
+        }
+        Entry &e = it->second;
+        e.copies++;
+        if (!current) continue;
+
+        drop_live(e);
+        e.segment = seg->id;
+        e.offset = p.offset;
+        e.length = length;
+        e.seq = p.seq;
+        e.deleted = p.data == nullptr;
+        seg->live += record_size(length);
+    }
+    return true;
+}
+
+ChunkStatus ChunkLog::read(uint64_t stripe_id, uint32_t chunk_id, std::string &out)
+{
+    std::shared_ptr<Segment> seg;
+    Entry e;
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = index_.find(Key{stripe_id, chunk_id});
+        if (it == index_.end() || it->second.deleted) return ChunkStatus::NOT_FOUND;
+        e = it->second;
+        auto sit = segments_.find(e.segment);
+        if (sit == segments_.end()) return ChunkStatus::ERROR;
+        seg = sit->second;
+    }
+
+    // 持有段的引用，即使段随后被回收删除，文件描述符仍然有效
+    size_t bytes = (size_t)record_size(e.length);
+    AlignedBuffer buf(bytes);
+    if (!buf.ptr || !pread_full(seg->fd, buf.ptr, bytes, e.offset)) return ChunkStatus::ERROR;
+
+    RecordHeader h;
+    memcpy(&h, buf.ptr, sizeof(h));
+    const char *data = buf.ptr + sizeof(h);
+    if (!header_valid(h, e.offset, seg->size) || h.type != RECORD_PUT ||
+        h.stripe_id != stripe_id || h.chunk_id != chunk_id ||
+        h.seq != e.seq || h.length != e.length ||
+        h.data_crc != crc32c(data, h.length)) {
+        LOG_ERROR("ChunkLog: 记录损坏 stripe=%" PRIu64 " chunk=%" PRIu32 "\n",
+                  stripe_id, chunk_id);
+        return ChunkStatus::ERROR;
+    }
+
+    out.assign(data, h.length);
+    return ChunkStatus::OK;
+}
+
+bool ChunkLog::append(const std::vector<ChunkWrite> &writes)
+{
+    std::vector<Pending> batch;
+    batch.reserve(writes.size());
+    for (const auto &w : writes) {
+        batch.push_back(Pending{Key{w.stripe_id, w.chunk_id}, w.data, 0, 0});
+    }
+    return write_batch(batch, nullptr);
+}
+
+bool ChunkLog::remove(uint64_t stripe_id, uint32_t chunk_id)
+{
+    Key key{stripe_id, chunk_id};
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = index_.find(key);
+        if (it == index_.end() || it->second.deleted) return false;
+    }
+    std::vector<Pending> batch{Pending{key, nullptr, 0, 0}};
+    return write_batch(batch, nullptr);
+}
+
+void ChunkLog::compactor_loop()
+{
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!stop_) {
+        compact_cv_.wait_for(lock, std::chrono::seconds(10));
+        if (stop_) break;
+
+        // 选有效数据比例最低的可回收段
+        std::shared_ptr<Segment> victim;
+        for (const auto &kv : segments_) {
+            const Segment &seg = *kv.second;
+            if (!seg.sealed || seg.writers > 0 || seg.live * 2 >= seg.used) continue;
+            if (!victim || seg.live * victim->used < victim->live * seg.used) {
+                victim = kv.second;
+            }
+        }
+        if (!victim) continue;
+
+        lock.unlock();
+        bool ok = compact(victim);
+        lock.lock();
+        if (!ok) {
+            LOG_ERROR("ChunkLog: 回收段 %s 失败\n", victim->path.c_str());
+        }
+    }
+}
+
+bool ChunkLog::compact(std::shared_ptr<Segment> seg)
+{
+    // 段内全部记录（有效的与过期的），删除段后要从对应键的 copies 中扣除
+    std::vector<std::pair<Key, uint64_t>> records;
+    scan_segment(*seg, [&](const RecordHeader &h, uint64_t offset) {
+        records.push_back({Key{h.stripe_id, h.chunk_id}, offset});
+    });
+
+    std::vector<Pending> batch;
+    std::deque<std::string> bufs;
+    std::vector<std::pair<uint32_t, uint64_t>> expect;
+    uint64_t batch_bytes = 0;
+
+    auto flush = [&]() {
+        bool ok = write_batch(batch, &expect);
+        batch.clear();
+        bufs.clear();
+        expect.clear();
+        batch_bytes = 0;
+        return ok;
+    };
+
+    for (const auto &r : records) {
+        Entry e;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            auto it = index_.find(r.first);
+            if (it == index_.end() || it->second.segment != seg->id ||
+                it->second.offset != r.second) {
+                continue;   // 已被覆盖的旧记录
+            }
+            if (it->second.deleted && it->second.copies <= 1) {
+                // 删除记录已没有要遮盖的旧记录，随段一起丢弃
+                drop_live(it->second);
+                index_.erase(it);
+                continue;
+            }
+            e = it->second;
+        }
+
+        bufs.emplace_back();
+        if (!e.deleted &&
+            read(r.first.stripe_id, r.first.chunk_id, bufs.back()) != ChunkStatus::OK) {
+            // 读取期间被覆盖则不再需要复制；损坏的记录不复制，交给 RAID 层修复
+            bufs.pop_back();
+            continue;
+        }
+        // 保留原序号：复制后若又被新写入覆盖，重新打开时仍以新写入为准
+        batch.push_back(Pending{r.first, e.deleted ? nullptr : &bufs.back(), e.seq, 0});
+        expect.push_back({e.segment, e.offset});
+        batch_bytes += record_size(e.length);
+        if (batch_bytes >= COMPACT_BATCH_BYTES && !flush()) return false;
+    }
+    if (!batch.empty() && !flush()) return false;
+
+    std::lock_guard<std::mutex> lock(mu_);
+    // 仍有记录指向本段（读取失败未复制），保留该段
+    if (seg->writers > 0 || seg->live > 0) return false;
+    if (::unlink(seg->path.c_str()) != 0) return false;
+    segments_.erase(seg->id);
+
+    for (const auto &r : records) {
+        auto it = index_.find(r.first);
+        if (it == index_.end()) continue;
+        Entry &e = it->second;
+        if (e.copies > 0) e.copies--;
+        if (e.deleted && e.copies <= 1) {
+            drop_live(e);
+            index_.erase(it);
+        }
+    }
+
+    LOG_INFO("ChunkLog: 回收段 %s（%zu 条记录）\n",
+             seg->path.c_str(), records.size());
+    return true;
+}
@@ -0,0 +1,130 @@
+#ifndef CHUNK_LOG_H
+#define CHUNK_LOG_H
+
+#include "chunk_store.h"
+#include <string>
+#include <memory>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+// 日志式 chunk 存储（本地后端的 log 布局）
+// - 所有 chunk 追加写入少量大的段文件 <dir>/<段号>.seg，段文件创建时预分配，
+//   不会因为条带数增长而产生数百万个小文件
+// - 每条记录 = 64 字节记录头（含键、序号、长度、数据 CRC）+ 数据，按 4KB 对齐，
+//   可以使用 O_DIRECT；一批写入只需一次 pwrite 与一次 fdatasync
+// - 覆盖写追加新记录，删除追加删除记录；索引常驻内存，打开时扫描各段的记录头重建，
+//   同一个键以序号最大的记录为准
+// - 读取时校验数据 CRC，损坏的记录（崩溃时写了一半）视为不存在，由 RAID 层修复
+// - 后台线程回收有效数据不足一半的已封存段：把仍然有效的记录复制到当前段后删除该段
+
+struct ChunkLogConfig {
+    uint64_t segment_size = 1ULL << 30;   // 段文件大小，默认 1GB
+    bool sync = true;                     // 每批写入后 fdatasync
+    bool direct_io = false;               // 使用 O_DIRECT
+};
+
+class ChunkLog {
+public:
+    ChunkLog(const std::string &dir, const ChunkLogConfig &config);
+    ~ChunkLog();
+
+    ChunkLog(const ChunkLog &) = delete;
+    ChunkLog &operator=(const ChunkLog &) = delete;
+
+    // 创建目录、扫描已有段重建索引，失败返回 false
+    bool open();
+
+    // 索引中没有该 chunk（或已删除）时返回 NOT_FOUND，记录损坏或读取失败时返回 ERROR
+    ChunkStatus read(uint64_t stripe_id, uint32_t chunk_id, std::string &out);
+
+    // 一批记录一次写入（与其他批次并发写入不同的区间）
+    bool append(const std::vector<ChunkWrite> &writes);
+
+    // 删除 chunk，不存在时返回 false
+    bool remove(uint64_t stripe_id, uint32_t chunk_id);
+
+private:
+    struct Segment {
+        uint32_t id = 0;
+        int fd = -1;
+        std::string path;
+        uint64_t size = 0;      // 预分配大小
+        uint64_t used = 0;      // 已分配给记录的字节数
+        uint64_t live = 0;      // 当前有效记录占用的字节数
+        uint32_t writers = 0;   // 正在写入本段的批次数，非 0 时不回收
+        bool sealed = false;
+        ~Segment();
+    };
+
+    struct Entry {
+        uint32_t segment = 0;
+        uint64_t offset = 0;
+        uint32_t length = 0;
+        uint64_t seq = 0;
+        bool deleted = false;
+        uint32_t copies = 0;    // 磁盘上该键的记录数（含旧记录）
+    };
+
+    struct Key {
+        uint64_t stripe_id;
+        uint32_t chunk_id;
+        bool operator==(const Key &o) const {
+            return stripe_id == o.stripe_id && chunk_id == o.chunk_id;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key &k) const {
+            return (size_t)(k.stripe_id * 0x9E3779B97F4A7C15ULL) ^ k.chunk_id;
+        }
+    };
+
+    // 一条待写入的记录
+    struct Pending {
+        Key key;
+        const std::string *data;   // 删除记录为 nullptr
+        uint64_t seq;
+        uint64_t offset;           // 在段内的偏移（相对本批起点在 write_batch 中换算）
+    };
+
+    std::string dir_;
+    ChunkLogConfig config_;
+
+    std::unordered_map<Key, Entry, KeyHash> index_;
+    std::map<uint32_t, std::shared_ptr<Segment>> segments_;
+    std::shared_ptr<Segment> active_;
+    uint64_t next_seq_ = 1;
+    mutable std::mutex mu_;
+
+    std::thread compactor_;
+    std::condition_variable compact_cv_;
+    bool stop_ = false;
+    bool opened_ = false;
+
+    // 打开或创建段文件（create 时预分配 size 字节）
+    std::shared_ptr<Segment> open_segment(uint32_t id, bool create, uint64_t size);
+
+    // 扫描一个段的记录头，回调 fn(header, offset)；返回扫描到的末尾
+    template <typename F>
+    uint64_t scan_segment(Segment &seg, F &&fn);
+
+    // 写入一批记录，seqs 为 0 的项分配新序号；成功后更新索引
+    // expect 非空时（回收复制），只在索引仍指向 expect 所示位置时更新
+    bool write_batch(std::vector<Pending> &batch,
+                     const std::vector<std::pair<uint32_t, uint64_t>> *expect);
+
+    // 为 bytes 字节预留空间（持有 mu_），必要时封存当前段并新建段
+    std::shared_ptr<Segment> reserve(uint64_t bytes, uint64_t &offset);
+
+    // 记录被覆盖或删除后从原段的有效数据中扣除（持有 mu_）
+    void drop_live(const Entry &e);
+
+    void compactor_loop();
+    bool compact(std::shared_ptr<Segment> seg);
+};
+
+#endif // CHUNK_LOG_H
@@ -3,11 +3,40 @@
 
 #include <string>
 #include <cstdint>
+#include <vector>
 
 // 统一的 4MB 块访问接口
 // 给出 stripe_id + chunk_id 就能读写一个完整的数据块
 // 屏蔽底层实现（本地盘 / S3 / WebDAV / SMB / 多云纠删码）
 
+// 单个 chunk 的读取结果
+// NOT_FOUND 表示 chunk 不存在（从未写入或已删除），首次挂载、稀疏条带时是正常情况，
+// 调用方不应把它计为后端故障；ERROR 为 I/O 错误或数据损坏
+enum class ChunkStatus { OK, NOT_FOUND, ERROR };
+
+// 批量读写中的一项
+struct ChunkRef {
+    uint64_t stripe_id;
+    uint32_t chunk_id;
+};
+
+struct ChunkWrite {
+    uint64_t stripe_id;
+    uint32_t chunk_id;
+    const std::string *data;
+};
+
+// 同一 chunk 内多区间读写中的一项
+struct RangeRef {
+    uint64_t offset;
+    size_t len;
+};
+
+struct RangeWrite {
+    uint64_t offset;
+    const std::string *data;
+};
+
 class ChunkStore {
 public:
     // 读取一个 chunk（通常为 4MB）
@@ -16,6 +45,14 @@ public:
                             uint32_t chunk_id,
                             std::string &out) = 0;
 
+    // 读取一个 chunk，并区分"不存在"与 I/O 错误
+    // 默认实现调用 read_chunk，失败一律按 ERROR 计；能识别不存在的后端覆盖此方法
+    virtual ChunkStatus read_chunk_status(uint64_t stripe_id,
+                                          uint32_t chunk_id,
+                                          std::string &out) {
+        return read_chunk(stripe_id, chunk_id, out) ? ChunkStatus::OK : ChunkStatus::ERROR;
+    }
+
     // 写入一个 chunk（通常为 4MB）
     virtual bool write_chunk(uint64_t stripe_id,
                              uint32_t chunk_id,
@@ -25,6 +62,85 @@ public:
     virtual bool delete_chunk(uint64_t stripe_id,
                               uint32_t chunk_id) = 0;
 
+    // ---------------- 批量接口 ----------------
+    // 一次读写多个条带的 chunk（通常为连续分配的条带）
+    // 默认实现逐个调用单 chunk 接口；能把多个 chunk 合并为一次请求的后端
+    // （如 S3 打包对象）覆盖这些方法并令 supports_batch() 返回 true，
+    // 调用方据此决定是整批提交还是拆成单个 chunk 并发执行
+
+    virtual bool supports_batch() const { return false; }
+
+    // 全部写入成功才返回 true
+    virtual bool write_chunks(const std::vector<ChunkWrite> &writes) {
+        bool ok = true;
+        for (const auto &w : writes) {
+            if (!write_chunk(w.stripe_id, w.chunk_id, *w.data)) ok = false;
+        }
+        return ok;
+    }
+
+    // out 与 refs 一一对应，读取失败的项为空字符串；全部成功才返回 true
+    // status 非空时同样一一对应，给出每一项的读取结果
+    virtual bool read_chunks(const std::vector<ChunkRef> &refs,
+                             std::vector<std::string> &out,
+                             std::vector<ChunkStatus> *status = nullptr) {
+        out.assign(refs.size(), std::string());
+        if (status) status->assign(refs.size(), ChunkStatus::OK);
+        bool ok = true;
+        for (size_t i = 0; i < refs.size(); i++) {
+            ChunkStatus st = read_chunk_status(refs[i].stripe_id, refs[i].chunk_id, out[i]);
+            if (st != ChunkStatus::OK) {
+                out[i].clear();
+                ok = false;
+            }
+            if (status) (*status)[i] = st;
+        }
+        return ok;
+    }
+
+    // ---------------- 范围读写 ----------------
+    // 读写已存在 chunk 内 [offset, offset+len) 的字节，写入不改变 chunk 长度
+    // 用于小范围覆盖写的校验块增量更新；能原地读写部分内容的后端
+    // （如本地单文件布局）覆盖这些方法并令 supports_range() 返回 true
+
+    virtual bool supports_range() const { return false; }
+
+    // 范围超出 chunk 长度时返回 false
+    virtual bool read_range(uint64_t stripe_id, uint32_t chunk_id,
+                            uint64_t offset, size_t len, std::string &out) {
+        (void)stripe_id; (void)chunk_id; (void)offset; (void)len; (void)out;
+        return false;
+    }
+
+    virtual bool write_range(uint64_t stripe_id, uint32_t chunk_id,
+                             uint64_t offset, const std::string &data) {
+        (void)stripe_id; (void)chunk_id; (void)offset; (void)data;
+        return false;
+    }
+
+    // 同一 chunk 的多个区间作为一次请求读写（如打开文件一次、只同步一次）
+    // out 与 ranges 一一对应；全部成功才返回 true，写入失败时已写的区间不回退
+    // 默认实现逐个调用 read_range / write_range
+    virtual bool read_ranges(uint64_t stripe_id, uint32_t chunk_id,
+                             const std::vector<RangeRef> &ranges,
+                             std::vector<std::string> &out) {
+        out.assign(ranges.size(), std::string());
+        for (size_t i = 0; i < ranges.size(); i++) {
+            if (!read_range(stripe_id, chunk_id, ranges[i].offset, ranges[i].len, out[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    virtual bool write_ranges(uint64_t stripe_id, uint32_t chunk_id,
+                              const std::vector<RangeWrite> &writes) {
+        for (const auto &w : writes) {
+            if (!write_range(stripe_id, chunk_id, w.offset, *w.data)) return false;
+        }
+        return true;
+    }
+
     virtual ~ChunkStore() = default;
 };
 
@@ -0,0 +1,149 @@
+#include "data_pipeline.h"
+#include <openssl/evp.h>
+#include <cstring>
+#include <memory>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// 存储对象头部：magic(3) + 压缩算法(1) + 原始长度(4)
+static const char FRAME_MAGIC[3] = { 'C', 'R', 'Z' };
+static const size_t FRAME_HEADER_SIZE = 8;
+
+DataPipeline::DataPipeline(const DataPipelineConfig &config)
+    : config_(config)
+{
+    if (config_.compression == "lz4") {
+        codec_ = CODEC_LZ4;
+    } else if (config_.compression == "zstd") {
+        codec_ = CODEC_ZSTD;
+    }
+}
+
+bool DataPipeline::codec_available(const std::string &name)
+{
+    if (name == "none") return true;
+#ifdef HAVE_LZ4
+    if (name == "lz4") return true;
+#endif
+#ifdef HAVE_ZSTD
+    if (name == "zstd") return true;
+#endif
+    return false;
+}
+
+bool DataPipeline::is_zero(const char *data, size_t len)
+{
+    // 先逐 8 字节比较，剩余部分逐字节
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        std::memcpy(&v, data + i, 8);
+        if (v) return false;
+    }
+    for (; i < len; i++) {
+        if (data[i]) return false;
+    }
+    return true;
+}
+
+std::string DataPipeline::content_hash(const char *data, size_t len)
+{
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int md_len = 0;
+    EVP_Digest(data, len, md, &md_len, EVP_sha256(), nullptr);
+    return std::string(reinterpret_cast<const char *>(md), md_len);
+}
+
+std::string DataPipeline::encode(const std::string &raw) const
+{
+    std::string out(FRAME_HEADER_SIZE, '\0');
+    std::memcpy(&out[0], FRAME_MAGIC, 3);
+    uint32_t raw_len = static_cast<uint32_t>(raw.size());
+    std::memcpy(&out[4], &raw_len, 4);
+
+    uint8_t codec = CODEC_NONE;
+    size_t packed = 0;
+
+#ifdef HAVE_LZ4
+    if (codec_ == CODEC_LZ4) {
+        int bound = LZ4_compressBound((int)raw.size());
+        out.resize(FRAME_HEADER_SIZE + (size_t)bound);
+        int n = LZ4_compress_default(raw.data(), &out[FRAME_HEADER_SIZE], (int)raw.size(), bound);
+        if (n > 0) {
+            codec = CODEC_LZ4;
+            packed = (size_t)n;
+        }
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (codec_ == CODEC_ZSTD) {
+        // 每个线程复用一个压缩上下文
+        struct CCtxFree {
+            void operator()(ZSTD_CCtx *c) const { ZSTD_freeCCtx(c); }
+        };
+        thread_local std::unique_ptr<ZSTD_CCtx, CCtxFree> cctx(ZSTD_createCCtx());
+
+        size_t bound = ZSTD_compressBound(raw.size());
+        out.resize(FRAME_HEADER_SIZE + bound);
+        size_t n = ZSTD_compressCCtx(cctx.get(), &out[FRAME_HEADER_SIZE], bound,
+                                     raw.data(), raw.size(), config_.zstd_level);
+        if (!ZSTD_isError(n)) {
+            codec = CODEC_ZSTD;
+            packed = n;
+        }
+    }
+#endif
+
+    if (codec == CODEC_NONE || packed > raw.size() - raw.size() / 16) {
+        out.resize(FRAME_HEADER_SIZE);
+        out.append(raw);
+        out[3] = (char)CODEC_NONE;
+        return out;
+    }
+
+    out.resize(FRAME_HEADER_SIZE + packed);
+    out[3] = (char)codec;
+    return out;
+}
+
+bool DataPipeline::decode(const std::string &stored, std::string &raw)
+{
+    if (stored.size() < FRAME_HEADER_SIZE || std::memcmp(stored.data(), FRAME_MAGIC, 3) != 0) {
+        return false;
+    }
+    uint8_t codec = (uint8_t)stored[3];
+    uint32_t raw_len = 0;
+    std::memcpy(&raw_len, stored.data() + 4, 4);
+
+    const char *src = stored.data() + FRAME_HEADER_SIZE;
+    size_t src_len = stored.size() - FRAME_HEADER_SIZE;
+
+    switch (codec) {
+    case CODEC_NONE:
+        if (src_len != raw_len) return false;
+        raw.assign(src, src_len);
+        return true;
+#ifdef HAVE_LZ4
+    case CODEC_LZ4: {
+        raw.resize(raw_len);
+        int n = LZ4_decompress_safe(src, &raw[0], (int)src_len, (int)raw_len);
+        return n >= 0 && (uint32_t)n == raw_len;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case CODEC_ZSTD: {
+        raw.resize(raw_len);
+        size_t n = ZSTD_decompress(&raw[0], raw_len, src, src_len);
+        return !ZSTD_isError(n) && n == raw_len;
+    }
+#endif
+    default:
+        // 未知算法，或写入时支持而本次编译不支持的算法
+        return false;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef DATA_PIPELINE_H
+#define DATA_PIPELINE_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// 条带数据管线：位于 FileManager 与 RAIDChunkStore 之间（可选）
+// - 去重：条带内容哈希（SHA-256），相同内容只存一份，全零条带不存储，
+//   文件条带到存储对象的引用记录在元数据的内容索引中（带引用计数）
+// - 压缩：编码前用 LZ4 / zstd 压缩，压缩收益不足时按原样存储
+// 启用后新写入的条带写到新分配的存储对象（写时复制），旧对象在元数据提交后释放；
+// 关闭后已有的引用仍然可以读取
+
+struct DataPipelineConfig {
+    bool dedup = false;                 // 内容去重（含全零条带）
+    std::string compression = "none";   // 压缩算法：none / lz4 / zstd
+    int zstd_level = 3;                 // zstd 压缩级别
+};
+
+class DataPipeline {
+public:
+    explicit DataPipeline(const DataPipelineConfig &config = DataPipelineConfig());
+
+    // 新写入的条带是否经过管线
+    bool enabled() const { return config_.dedup || codec_ != CODEC_NONE; }
+    bool dedup() const { return config_.dedup; }
+
+    // 条带内容是否全为 0
+    static bool is_zero(const char *data, size_t len);
+
+    // 内容哈希（32 字节二进制）
+    static std::string content_hash(const char *data, size_t len);
+
+    // 编码为存储对象：头部（magic、压缩算法、原始长度）+ 数据
+    // 压缩后节省不足 1/16 时按原样存储
+    std::string encode(const std::string &raw) const;
+
+    // 解码存储对象，格式错误或解压失败时返回 false
+    static bool decode(const std::string &stored, std::string &raw);
+
+    // 编译时是否支持该压缩算法
+    static bool codec_available(const std::string &name);
+
+private:
+    enum : uint8_t {
+        CODEC_NONE = 0,
+        CODEC_LZ4  = 1,
+        CODEC_ZSTD = 2,
+    };
+
+    DataPipelineConfig config_;
+    uint8_t codec_ = CODEC_NONE;
+};
+
+#endif // DATA_PIPELINE_H
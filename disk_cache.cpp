@@ -0,0 +1,386 @@
+#include "disk_cache.h"
+#include "log.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cinttypes>
+
+// O_DIRECT 要求缓冲区地址、偏移和长度都按块对齐
+static const size_t DIO_ALIGN = 4096;
+
+static const char INDEX_MAGIC[8] = {'R', 'F', 'S', 'D', 'C', 'I', 'D', 'X'};
+static const uint32_t INDEX_VERSION = 1;
+
+// 索引文件：IndexHeader + num_entries 个 IndexEntry
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t clean;         // 1 = 正常关闭
+    uint64_t slot_size;
+    uint64_t num_slots;
+    uint64_t num_entries;
+};
+
+struct IndexEntry {
+    uint64_t stripe_id;
+    uint32_t slot;
+    uint32_t length;
+};
+
+static size_t align_up(size_t n)
+{
+    return (n + DIO_ALIGN - 1) / DIO_ALIGN * DIO_ALIGN;
+}
+
+// 对齐的临时缓冲区
+struct AlignedBuffer {
+    char *ptr = nullptr;
+
+    explicit AlignedBuffer(size_t size) {
+        if (posix_memalign((void **)&ptr, DIO_ALIGN, size) != 0) {
+            ptr = nullptr;
+        }
+    }
+    ~AlignedBuffer() { free(ptr); }
+
+    AlignedBuffer(const AlignedBuffer &) = delete;
+    AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+};
+
+static bool pread_full(int fd, char *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::pread(fd, buf + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+static bool pwrite_full(int fd, const char *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::pwrite(fd, buf + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+DiskCache::DiskCache(const DiskCacheConfig& config)
+    : config_(config)
+{
+    if (!config_.path.empty() && config_.path.back() != '/') {
+        config_.path += '/';
+    }
+    num_slots_ = config_.max_size / SLOT_SIZE;
+}
+
+DiskCache::~DiskCache()
+{
+    close();
+}
+
+bool DiskCache::open()
+{
+    if (num_slots_ == 0) {
+        LOG_ERROR("DiskCache: 容量过小（至少 %" PRIu64 "MB）\n",
+                  SLOT_SIZE / 1024 / 1024);
+        return false;
+    }
+
+    if (mkdir(config_.path.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR("DiskCache: 无法创建目录 %s: %s\n",
+                  config_.path.c_str(), strerror(errno));
+        return false;
+    }
+
+    std::string slab_path = config_.path + "slab.dat";
+    int flags = O_RDWR | O_CREAT;
+    if (config_.direct_io) {
+        slab_fd_ = ::open(slab_path.c_str(), flags | O_DIRECT, 0644);
+        if (slab_fd_ >= 0) {
+            direct_ = true;
+        } else {
+            // 部分文件系统（如 tmpfs）不支持 O_DIRECT
+            LOG_WARN("DiskCache: O_DIRECT 不可用 (%s)，改用普通 I/O\n",
+                     strerror(errno));
+        }
+    }
+    if (slab_fd_ < 0) {
+        slab_fd_ = ::open(slab_path.c_str(), flags, 0644);
+    }
+    if (slab_fd_ < 0) {
+        LOG_ERROR("DiskCache: 无法打开 %s: %s\n",
+                  slab_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    // 预分配 slab 空间，避免运行中因磁盘写满而失败
+    uint64_t slab_size = num_slots_ * SLOT_SIZE;
+    struct stat st;
+    if (fstat(slab_fd_, &st) == 0 && (uint64_t)st.st_size < slab_size) {
+        int err = posix_fallocate(slab_fd_, 0, (off_t)slab_size);
+        if (err != 0 && ftruncate(slab_fd_, (off_t)slab_size) != 0) {
+            LOG_ERROR("DiskCache: 无法分配 %" PRIu64 "MB: %s\n",
+                      slab_size / 1024 / 1024, strerror(err));
+            ::close(slab_fd_);
+            slab_fd_ = -1;
+            return false;
+        }
+    }
+
+    slots_.assign((size_t)num_slots_, Slot());
+    policy_ = make_cache_policy<uint64_t>("s3fifo", slab_size);
+
+    if (!load_index()) {
+        LOG_INFO("DiskCache: 索引不存在或上次未正常关闭，从空缓存开始\n");
+        index_.clear();
+        slots_.assign((size_t)num_slots_, Slot());
+        policy_ = make_cache_policy<uint64_t>("s3fifo", slab_size);
+    }
+
+    free_.clear();
+    for (uint64_t i = num_slots_; i > 0; i--) {
+        if (!slots_[i - 1].used) {
+            free_.push_back((uint32_t)(i - 1));
+        }
+    }
+
+    // 运行期间标记为未正常关闭
+    if (!write_index(false)) {
+        LOG_ERROR("DiskCache: 无法写入索引文件\n");
+        ::close(slab_fd_);
+        slab_fd_ = -1;
+        return false;
+    }
+
+    writer_ = std::make_unique<IOThreadPool>(config_.write_threads, 16);
+    opened_ = true;
+
+    LOG_INFO("DiskCache: %s, %" PRIu64 " 个 slot，已缓存 %zu 个 stripe%s\n",
+             config_.path.c_str(), num_slots_, index_.size(),
+             direct_ ? "（O_DIRECT）" : "");
+    return true;
+}
+
+void DiskCache::close()
+{
+    if (!opened_) return;
+
+    // 等待排队中的异步写入完成
+    writer_.reset();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fdatasync(slab_fd_) != 0 || !write_index(true)) {
+        LOG_ERROR("DiskCache: 保存索引失败，下次挂载将丢弃缓存\n");
+    }
+    ::close(slab_fd_);
+    slab_fd_ = -1;
+    opened_ = false;
+}
+
+bool DiskCache::load_index()
+{
+    std::string index_path = config_.path + "index.dat";
+    FILE *fp = fopen(index_path.c_str(), "rb");
+    if (!fp) return false;
+
+    IndexHeader h;
+    bool ok = fread(&h, sizeof(h), 1, fp) == 1 &&
+              memcmp(h.magic, INDEX_MAGIC, sizeof(h.magic)) == 0 &&
+              h.version == INDEX_VERSION &&
+              h.clean == 1 &&
+              h.slot_size == SLOT_SIZE &&
+              h.num_slots == num_slots_ &&
+              h.num_entries <= num_slots_;
+
+    for (uint64_t i = 0; ok && i < h.num_entries; i++) {
+        IndexEntry e;
+        if (fread(&e, sizeof(e), 1, fp) != 1 ||
+            e.slot >= num_slots_ || e.length == 0 || e.length > SLOT_SIZE ||
+            slots_[e.slot].used || index_.count(e.stripe_id)) {
+            ok = false;
+            break;
+        }
+
+        Slot &s = slots_[e.slot];
+        s.stripe_id = e.stripe_id;
+        s.length = e.length;
+        s.gen = next_gen_++;
+        s.used = true;
+        index_[e.stripe_id] = e.slot;
+        policy_->on_insert(e.stripe_id, SLOT_SIZE);
+    }
+
+    fclose(fp);
+    return ok;
+}
+
+// 写入 index.tmp 后 rename 覆盖 index.dat（假设已持有锁或尚未开始服务）
+// clean=false 时只写文件头，表示缓存正在使用中
+bool DiskCache::write_index(bool clean)
+{
+    std::string index_path = config_.path + "index.dat";
+    std::string tmp_path = index_path + ".tmp";
+
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (!fp) return false;
+
+    IndexHeader h;
+    memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+    h.version = INDEX_VERSION;
+    h.clean = clean ? 1 : 0;
+    h.slot_size = SLOT_SIZE;
+    h.num_slots = num_slots_;
+    h.num_entries = clean ? index_.size() : 0;
+
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    if (clean) {
+        for (const auto &kv : index_) {
+            if (!ok) break;
+            IndexEntry e;
+            e.stripe_id = kv.first;
+            e.slot = kv.second;
+            e.length = slots_[kv.second].length;
+            ok = fwrite(&e, sizeof(e), 1, fp) == 1;
+        }
+    }
+
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    fclose(fp);
+
+    return ok && rename(tmp_path.c_str(), index_path.c_str()) == 0;
+}
+
+bool DiskCache::get(uint64_t stripe_id, std::string& out)
+{
+    uint32_t slot;
+    uint32_t length;
+    uint64_t gen;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = opened_ ? index_.find(stripe_id) : index_.end();
+        if (it == index_.end()) {
+            misses_++;
+            return false;
+        }
+        slot = it->second;
+        length = slots_[slot].length;
+        gen = slots_[slot].gen;
+        policy_->on_access(stripe_id);
+    }
+
+    // 在锁外读取；读取期间 slot 可能被淘汰并重新分配，读完后校验 gen
+    size_t io_len = align_up(length);
+    AlignedBuffer buf(io_len);
+    bool ok = buf.ptr && pread_full(slab_fd_, buf.ptr, io_len, (uint64_t)slot * SLOT_SIZE);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ok || slots_[slot].gen != gen) {
+            misses_++;
+            return false;
+        }
+    }
+
+    out.assign(buf.ptr, length);
+    hits_++;
+    return true;
+}
+
+bool DiskCache::put(uint64_t stripe_id, const std::string& data, uint64_t epoch)
+{
+    if (data.empty() || data.size() > SLOT_SIZE) return false;
+
+    uint32_t slot;
+    uint64_t gen;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!opened_ || epoch != epoch_) return false;
+        if (index_.count(stripe_id)) return true;
+
+        if (free_.empty()) {
+            uint64_t victim;
+            if (!policy_->evict(victim)) return false;
+            free_slot(victim);
+            evictions_++;
+        }
+
+        // slot 在写入期间既不在空闲列表也不在索引中
+        slot = free_.back();
+        free_.pop_back();
+        gen = next_gen_++;
+        slots_[slot].gen = gen;
+        slots_[slot].used = false;
+    }
+
+    size_t io_len = align_up(data.size());
+    AlignedBuffer buf(io_len);
+    bool ok = buf.ptr != nullptr;
+    if (ok) {
+        memcpy(buf.ptr, data.data(), data.size());
+        memset(buf.ptr + data.size(), 0, io_len - data.size());
+        ok = pwrite_full(slab_fd_, buf.ptr, io_len, (uint64_t)slot * SLOT_SIZE);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 写入期间发生过失效，或同一 stripe 已被其他线程放入
+    if (!ok || epoch != epoch_ || index_.count(stripe_id)) {
+        free_.push_back(slot);
+        return false;
+    }
+
+    Slot &s = slots_[slot];
+    s.stripe_id = stripe_id;
+    s.length = (uint32_t)data.size();
+    s.used = true;
+    index_[stripe_id] = slot;
+    policy_->on_insert(stripe_id, SLOT_SIZE);
+    return true;
+}
+
+void DiskCache::put_async(uint64_t stripe_id, std::shared_ptr<const std::string> data,
+                          uint64_t epoch)
+{
+    if (!writer_) return;
+
+    writer_->try_submit([this, stripe_id, data, epoch]() {
+        put(stripe_id, *data, epoch);
+    });
+}
+
+void DiskCache::invalidate(uint64_t stripe_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    epoch_++;
+    if (index_.count(stripe_id)) {
+        policy_->on_remove(stripe_id);
+        free_slot(stripe_id);
+    }
+}
+
+void DiskCache::free_slot(uint64_t stripe_id)
+{
+    auto it = index_.find(stripe_id);
+    if (it == index_.end()) return;
+
+    slots_[it->second].used = false;
+    free_.push_back(it->second);
+    index_.erase(it);
+}
+
+uint64_t DiskCache::used_slots() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.size();
+}
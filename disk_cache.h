@@ -0,0 +1,104 @@
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include "cache_policy.h"
+#include "io_thread_pool.h"
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+// SSD 持久缓存（位于 ChunkCache 与 RAID 后端之间的第二级缓存）
+// - 缓存解码后的 stripe，存放在预分配的 slab 文件中，每个 slot 固定 4MB
+// - 索引常驻内存，正常关闭时写入索引文件，重新挂载后继续使用
+// - 运行期间索引文件标记为“未正常关闭”，崩溃后重启会丢弃全部缓存，
+//   保证不会读到崩溃前已失效的数据
+// - 默认使用 O_DIRECT 读写，避免与内核页缓存重复占用内存
+// - 淘汰策略使用 S3-FIFO（见 cache_policy.h）
+
+struct DiskCacheConfig {
+    bool enabled = false;
+    std::string path;                                  // 缓存目录
+    uint64_t max_size = 10ULL * 1024 * 1024 * 1024;    // 缓存容量，默认 10GB
+    bool direct_io = true;                             // 是否使用 O_DIRECT
+    size_t write_threads = 1;                          // 异步写入线程数
+};
+
+class DiskCache {
+public:
+    static const uint64_t SLOT_SIZE = 4ULL * 1024 * 1024;  // 与 stripe 大小一致
+
+    explicit DiskCache(const DiskCacheConfig& config);
+    ~DiskCache();
+
+    DiskCache(const DiskCache&) = delete;
+    DiskCache& operator=(const DiskCache&) = delete;
+
+    // 打开（或创建）slab 文件与索引，失败返回 false
+    bool open();
+
+    // 等待异步写入完成，保存索引并标记正常关闭（可重复调用，析构时自动调用）
+    void close();
+
+    // 读取缓存的 stripe，命中返回 true
+    bool get(uint64_t stripe_id, std::string& out);
+
+    // 失效计数：从后端读取前记录，放入时校验，避免读取期间被写入的旧数据进入缓存
+    uint64_t epoch() const { return epoch_; }
+
+    // 同步放入；自 epoch 以来发生过失效时放弃
+    bool put(uint64_t stripe_id, const std::string& data, uint64_t epoch);
+
+    // 异步放入（写入队列满时直接放弃）
+    void put_async(uint64_t stripe_id, std::shared_ptr<const std::string> data,
+                   uint64_t epoch);
+
+    // 使缓存失效（stripe 被写入或截断时调用）
+    void invalidate(uint64_t stripe_id);
+
+    uint64_t hit_count() const { return hits_; }
+    uint64_t miss_count() const { return misses_; }
+    uint64_t eviction_count() const { return evictions_; }
+    uint64_t num_slots() const { return num_slots_; }
+    uint64_t used_slots() const;
+
+private:
+    struct Slot {
+        uint64_t stripe_id = 0;
+        uint32_t length = 0;
+        uint64_t gen = 0;       // 每次重新分配时递增，读取完成后校验
+        bool used = false;
+    };
+
+    bool load_index();
+    bool write_index(bool clean);
+
+    // 释放 slot（假设已持有锁）
+    void free_slot(uint64_t stripe_id);
+
+    DiskCacheConfig config_;
+    uint64_t num_slots_ = 0;
+
+    int slab_fd_ = -1;
+    bool direct_ = false;
+    bool opened_ = false;
+
+    std::vector<Slot> slots_;
+    std::unordered_map<uint64_t, uint32_t> index_;   // stripe_id -> slot
+    std::vector<uint32_t> free_;
+    std::unique_ptr<CachePolicy<uint64_t>> policy_;
+    uint64_t next_gen_ = 1;
+
+    std::atomic<uint64_t> epoch_{0};
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+
+    mutable std::mutex mutex_;
+    std::unique_ptr<IOThreadPool> writer_;
+};
+
+#endif // DISK_CACHE_H
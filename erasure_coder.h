@@ -25,6 +25,80 @@ public:
     virtual bool decode(const std::vector<std::string> &chunks,
                         int k, int m,
                         std::string &out_data) = 0;
+
+    // 重建：输入同 decode，只重建 wanted 列出的（缺失）位置
+    // 输出 k+m 个位置，仅 wanted 位置被填充
+    // 重建出的 chunk 必须与该条带现存 chunk 的格式一致
+    // 默认实现：解码后整体重新编码
+    virtual bool reconstruct(const std::vector<std::string> &chunks,
+                             int k, int m,
+                             const std::vector<int> &wanted,
+                             std::vector<std::string> &out_chunks) {
+        std::string data;
+        std::vector<std::string> encoded;
+        if (!decode(chunks, k, m, data) || !encode(data, k, m, encoded)) {
+            return false;
+        }
+        out_chunks.assign(k + m, std::string());
+        for (int i : wanted) {
+            if (i >= 0 && i < (int)encoded.size()) out_chunks[i] = std::move(encoded[i]);
+        }
+        return true;
+    }
+
+    // 是否为系统码（chunk 0..k-1 即原始数据，健康读无需解码）
+    virtual bool is_systematic() const { return false; }
+
+    // ---------------- 写入代号 ----------------
+    // 整条带写入时给全部 chunk 打上同一个递增的代号并随 chunk 持久化：
+    // 降级写跳过或写入失败的位置保留旧代号，重启后读取时据此识别过期 chunk
+    // 默认实现不支持（set_generation 返回 false，代号恒为 0）
+
+    // 给 encode 输出的 chunks 写入代号 gen
+    virtual bool set_generation(std::vector<std::string> &chunks, uint64_t gen) {
+        (void)chunks; (void)gen;
+        return false;
+    }
+
+    // chunk 的写入代号（无法识别时为 0）
+    virtual uint64_t generation(const std::string &chunk) const {
+        (void)chunk;
+        return 0;
+    }
+
+    // ---------------- 增量更新（小范围覆盖写） ----------------
+    // 只改写一个数据块的一段字节时，校验块的同一区间按差值增量更新，
+    // 无需读取其余数据块、重新编码整个条带；默认实现不支持
+
+    // 每个 chunk 开头的头部长度（数据块内的原始数据从此处开始）
+    virtual size_t chunk_header_size() const { return 0; }
+
+    // header 为某个 chunk 开头的 chunk_header_size() 字节：
+    // 该条带是否可以增量更新，且原始长度为 stripe_size
+    virtual bool check_update_header(const std::string &header,
+                                     int k, int m, uint64_t stripe_size) const {
+        (void)header; (void)k; (void)m; (void)stripe_size;
+        return false;
+    }
+
+    // 原始长度为 stripe_size 的条带中 [offset, offset+len) 所在的数据块与块内偏移
+    // （含头部）；范围跨越两个数据块时返回 false
+    virtual bool locate_range(uint64_t stripe_size, int k, uint64_t offset, size_t len,
+                              int &data_index, uint64_t &chunk_offset) const {
+        (void)stripe_size; (void)k; (void)offset; (void)len;
+        (void)data_index; (void)chunk_offset;
+        return false;
+    }
+
+    // 数据块 data_index 的一段由 old_data 改为 new_data（等长）：
+    // parity 为 m 个校验块同一区间的当前内容，原地更新为新内容
+    virtual bool update_parity(int k, int m, int data_index,
+                               const std::string &old_data,
+                               const std::string &new_data,
+                               std::vector<std::string> &parity) {
+        (void)k; (void)m; (void)data_index; (void)old_data; (void)new_data; (void)parity;
+        return false;
+    }
 };
 
 #endif // ERASURE_CODER_H
@@ -1,213 +1,268 @@
 #include "file_cache.h"
 #include <algorithm>
-#include <iostream>
+#include <cstring>
 #include <chrono>
 #include <vector>
 
+// 每个分片至少容纳的页数，缓存较小时减少分片数
+static const uint64_t MIN_SHARD_PAGES = 64;
+
 FileCache::FileCache(const CacheConfig& config)
     : config_(config)
 {
-}
+    if (config_.page_size == 0) {
+        config_.page_size = 128ULL * 1024;
+    }
 
-bool FileCache::get(const std::string& path, std::string& out) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    size_t n = config_.shards ? config_.shards : 1;
+    while (n > 1 && config_.max_cache_size / n < config_.page_size * MIN_SHARD_PAGES) {
+        n /= 2;
+    }
 
-    auto it = cache_.find(path);
-    if (it == cache_.end()) {
-        misses_++;
-        return false;
+    shard_capacity_ = config_.max_cache_size / n;
+    for (size_t i = 0; i < n; i++) {
+        auto shard = std::make_unique<Shard>();
+        shard->policy = make_cache_policy<FilePageKey>(config_.policy, shard_capacity_);
+        shards_.push_back(std::move(shard));
     }
+}
 
-    CacheEntry& entry = it->second;
+FileCache::Shard& FileCache::shard_for(const FilePageKey& key) const {
+    return *shards_[std::hash<FilePageKey>()(key) % shards_.size()];
+}
 
-    // 检查是否过期
-    auto now = std::chrono::steady_clock::now();
-    if (now > entry.expire_time) {
-        // 过期，移除
-        remove_entry(path);
-        misses_++;
-        return false;
+bool FileCache::read(const std::string& path, uint64_t offset, size_t size, char* dst) {
+    if (size == 0) {
+        return true;
     }
 
-    // 命中：延长过期时间
-    entry.expire_time = now + std::chrono::seconds(config_.cache_ttl_seconds);
-    entry.access_count++;
+    const uint64_t ps = config_.page_size;
+    uint64_t first = offset / ps;
+    uint64_t last = (offset + size - 1) / ps;
 
-    // 更新 LRU
-    touch_lru(path);
+    // 先在锁内取出所有页的引用，再在锁外复制
+    std::vector<std::shared_ptr<const std::string>> pages;
+    pages.reserve((size_t)(last - first + 1));
 
-    out = entry.data;
-    hits_++;
-    return true;
-}
+    auto now = std::chrono::steady_clock::now();
+    FilePageKey key{path, 0};
+    for (uint64_t idx = first; idx <= last; idx++) {
+        key.index = idx;
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.pages.find(key);
+        if (it == shard.pages.end()) {
+            misses_++;
+            return false;
+        }
 
-void FileCache::put(const std::string& path, const std::string& data) {
-    std::lock_guard<std::mutex> lock(mutex_);
+        // 检查是否过期
+        CachePage& page = it->second;
+        if (now > page.expire_time) {
+            remove_page(shard, key);
+            misses_++;
+            return false;
+        }
 
-    uint64_t data_size = data.size();
+        // 不完整的页只能是文件末尾，读取范围超出时视为未命中
+        uint64_t need_end = std::min<uint64_t>(offset + size, (idx + 1) * ps) - idx * ps;
+        if (page.data->size() < need_end) {
+            misses_++;
+            return false;
+        }
 
-    // 文件太大，不缓存
-    if (data_size > config_.max_file_size) {
-        return;
+        // 命中：延长过期时间
+        page.expire_time = now + std::chrono::seconds(config_.cache_ttl_seconds);
+        shard.policy->on_access(key);
+        pages.push_back(page.data);
     }
 
-    // 如果已存在，先移除旧条目
-    auto existing = cache_.find(path);
-    if (existing != cache_.end()) {
-        current_size_ -= existing->second.data.size();
-        lru_list_.erase(lru_map_[path]);
-        lru_map_.erase(path);
-        cache_.erase(existing);
+    uint64_t pos = offset;
+    for (size_t i = 0; i < pages.size(); i++) {
+        uint64_t page_off = pos % ps;
+        size_t n = (size_t)std::min<uint64_t>(offset + size - pos, ps - page_off);
+        std::memcpy(dst + (pos - offset), pages[i]->data() + page_off, n);
+        pos += n;
     }
 
-    // 尝试腾出空间
-    if (!make_room(data_size)) {
-        // 无法腾出足够空间，放弃缓存
+    hits_++;
+    return true;
+}
+
+void FileCache::put(const std::string& path, uint64_t offset, const char* data, size_t size,
+                    uint64_t file_size, uint64_t epoch) {
+    // 文件太大，不缓存
+    if (!cacheable(file_size) || size == 0) {
         return;
     }
 
-    // 创建新条目
-    CacheEntry entry;
-    entry.path = path;
-    entry.data = data;
-    entry.file_size = data_size;
-    entry.expire_time = std::chrono::steady_clock::now() + 
-                        std::chrono::seconds(config_.cache_ttl_seconds);
-    entry.access_count = 1;
+    const uint64_t ps = config_.page_size;
+    uint64_t end = std::min<uint64_t>(offset + size, file_size);
 
-    cache_[path] = std::move(entry);
-    current_size_ += data_size;
+    // 只缓存被 data 完整覆盖的页；文件最后一页允许不满一页
+    for (uint64_t idx = (offset + ps - 1) / ps; idx * ps < end; idx++) {
+        uint64_t page_start = idx * ps;
+        uint64_t page_end = std::min<uint64_t>(page_start + ps, file_size);
+        if (page_end > end) {
+            break;
+        }
 
-    // 添加到 LRU 列表前面
-    lru_list_.push_front(path);
-    lru_map_[path] = lru_list_.begin();
-}
+        // 在锁外复制数据
+        auto page_data = std::make_shared<const std::string>(
+            data + (page_start - offset), (size_t)(page_end - page_start));
 
-void FileCache::invalidate(const std::string& path) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    remove_entry(path);
-}
+        FilePageKey key{path, idx};
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
 
-void FileCache::cleanup_expired() {
-    std::lock_guard<std::mutex> lock(mutex_);
+        // 读取期间文件被修改，放弃缓存
+        if (epoch != epoch_) {
+            return;
+        }
 
-    auto now = std::chrono::steady_clock::now();
-    std::vector<std::string> expired_paths;
+        // 如果已存在，先移除旧页
+        remove_page(shard, key);
 
-    for (const auto& kv : cache_) {
-        if (now > kv.second.expire_time) {
-            expired_paths.push_back(kv.first);
+        // 尝试腾出空间
+        if (!make_room(shard, page_data->size())) {
+            // 无法腾出足够空间，放弃缓存
+            return;
         }
-    }
 
-    for (const auto& path : expired_paths) {
-        remove_entry(path);
+        uint64_t page_size = page_data->size();
+
+        CachePage page;
+        page.data = std::move(page_data);
+        page.expire_time = std::chrono::steady_clock::now() +
+                           std::chrono::seconds(config_.cache_ttl_seconds);
+
+        shard.pages[key] = std::move(page);
+        shard.by_path[path].insert(idx);
+        shard.current_size += page_size;
+
+        shard.policy->on_insert(key, page_size);
     }
 }
 
-uint64_t FileCache::current_size() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return current_size_;
-}
+void FileCache::invalidate(const std::string& path) {
+    // 先递增失效计数，之后开始的 put 都会被拒绝
+    epoch_++;
 
-void FileCache::touch_lru(const std::string& path) {
-    // 假设已持有锁
-    auto it = lru_map_.find(path);
-    if (it != lru_map_.end()) {
-        lru_list_.erase(it->second);
-        lru_list_.push_front(path);
-        lru_map_[path] = lru_list_.begin();
+    for (auto& sp : shards_) {
+        Shard& shard = *sp;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.by_path.find(path);
+        if (it == shard.by_path.end()) {
+            continue;
+        }
+
+        std::vector<uint64_t> indices(it->second.begin(), it->second.end());
+        FilePageKey key{path, 0};
+        for (uint64_t idx : indices) {
+            key.index = idx;
+            remove_page(shard, key);
+        }
     }
 }
 
-bool FileCache::make_room(uint64_t needed_size) {
-    // 假设已持有锁
+void FileCache::invalidate_range(const std::string& path, uint64_t offset, uint64_t size) {
+    epoch_++;
 
-    // 如果需要的空间超过最大缓存大小，无法缓存
-    if (needed_size > config_.max_cache_size) {
-        return false;
+    if (size == 0) {
+        return;
     }
 
-    // 清理过期条目
-    auto now = std::chrono::steady_clock::now();
-    std::vector<std::string> expired_paths;
-    for (const auto& kv : cache_) {
-        if (now > kv.second.expire_time) {
-            expired_paths.push_back(kv.first);
-        }
-    }
-    for (const auto& path : expired_paths) {
-        remove_entry(path);
+    const uint64_t ps = config_.page_size;
+    uint64_t first = offset / ps;
+    uint64_t last = (offset + size - 1) / ps;
+
+    // 范围很大时按文件整体失效，避免逐页查找
+    if (last - first >= MIN_SHARD_PAGES * shards_.size()) {
+        invalidate(path);
+        return;
     }
 
-    // 如果空间足够，返回
-    if (current_size_ + needed_size <= config_.max_cache_size) {
-        return true;
+    FilePageKey key{path, 0};
+    for (uint64_t idx = first; idx <= last; idx++) {
+        key.index = idx;
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        remove_page(shard, key);
     }
+}
 
-    // 按热度排序，移除热度最低的条目
-    // 热度 = access_count / (time_since_last_access + 1)
-    // 简化：使用 access_count 和 LRU 位置综合考虑
+void FileCache::cleanup_expired() {
+    auto now = std::chrono::steady_clock::now();
 
-    // 收集所有条目并计算热度分数
-    std::vector<std::pair<std::string, double>> scored_entries;
-    for (const auto& kv : cache_) {
-        double score = calc_heat_score(kv.second);
-        scored_entries.push_back({kv.first, score});
-    }
+    for (auto& sp : shards_) {
+        Shard& shard = *sp;
+        std::lock_guard<std::mutex> lock(shard.mutex);
 
-    // 按热度升序排序（热度低的在前面）
-    std::sort(scored_entries.begin(), scored_entries.end(),
-              [](const auto& a, const auto& b) {
-                  return a.second < b.second;
-              });
+        std::vector<FilePageKey> expired;
+        for (const auto& kv : shard.pages) {
+            if (now > kv.second.expire_time) {
+                expired.push_back(kv.first);
+            }
+        }
 
-    // 移除热度最低的条目，直到空间足够
-    for (const auto& entry : scored_entries) {
-        if (current_size_ + needed_size <= config_.max_cache_size) {
-            break;
+        for (const auto& key : expired) {
+            remove_page(shard, key);
         }
-        remove_entry(entry.first);
     }
-
-    return current_size_ + needed_size <= config_.max_cache_size;
 }
 
-void FileCache::remove_entry(const std::string& path) {
-    // 假设已持有锁
-    auto it = cache_.find(path);
-    if (it == cache_.end()) {
-        return;
+uint64_t FileCache::current_size() const {
+    uint64_t total = 0;
+    for (const auto& sp : shards_) {
+        std::lock_guard<std::mutex> lock(sp->mutex);
+        total += sp->current_size;
     }
+    return total;
+}
 
-    current_size_ -= it->second.data.size();
-    cache_.erase(it);
+bool FileCache::make_room(Shard& shard, uint64_t needed_size) {
+    // 如果需要的空间超过分片容量，无法缓存
+    if (needed_size > shard_capacity_) {
+        return false;
+    }
 
-    auto lru_it = lru_map_.find(path);
-    if (lru_it != lru_map_.end()) {
-        lru_list_.erase(lru_it->second);
-        lru_map_.erase(lru_it);
+    // 由淘汰策略逐个选出淘汰对象，直到空间足够
+    // 过期页在访问时或 cleanup_expired 中移除，这里不做全量扫描
+    while (shard.current_size + needed_size > shard_capacity_) {
+        FilePageKey victim;
+        if (!shard.policy->evict(victim)) {
+            break;
+        }
+        erase_page(shard, victim);
+        evictions_++;
     }
+
+    return shard.current_size + needed_size <= shard_capacity_;
 }
 
-double FileCache::calc_heat_score(const CacheEntry& entry) const {
-    // 热度分数计算：
-    // - 访问次数越多，热度越高
-    // - 距离过期时间越近，热度越低（即将过期的优先移除）
-    // - 文件越小，热度越高（保留小文件更划算）
+void FileCache::remove_page(Shard& shard, const FilePageKey& key) {
+    if (shard.pages.count(key)) {
+        shard.policy->on_remove(key);
+        erase_page(shard, key);
+    }
+}
 
-    auto now = std::chrono::steady_clock::now();
-    auto time_to_expire = std::chrono::duration_cast<std::chrono::seconds>(
-        entry.expire_time - now).count();
-    
-    if (time_to_expire < 0) {
-        return -1.0;  // 已过期，最低热度
+void FileCache::erase_page(Shard& shard, const FilePageKey& key) {
+    auto it = shard.pages.find(key);
+    if (it == shard.pages.end()) {
+        return;
     }
 
-    // 热度 = access_count * (time_to_expire + 1) / (file_size + 1)
-    double score = (double)entry.access_count * 
-                   (double)(time_to_expire + 1) / 
-                   (double)(entry.file_size / 1024 + 1);  // 以 KB 为单位
+    shard.current_size -= it->second.data->size();
+    shard.pages.erase(it);
 
-    return score;
+    auto pit = shard.by_path.find(key.path);
+    if (pit != shard.by_path.end()) {
+        pit->second.erase(key.index);
+        if (pit->second.empty()) {
+            shard.by_path.erase(pit);
+        }
+    }
 }
@@ -1,49 +1,88 @@
 #ifndef FILE_CACHE_H
 #define FILE_CACHE_H
 
+#include "cache_policy.h"
 #include <string>
+#include <memory>
 #include <unordered_map>
-#include <list>
+#include <unordered_set>
+#include <functional>
 #include <mutex>
+#include <atomic>
+#include <vector>
 #include <chrono>
 #include <cstdint>
 
 // 文件内存缓存
-// - 缓存小于 max_file_size 的文件
-// - 使用 LRU + 过期时间策略
+// - 按固定大小的页缓存文件内容（默认 128KB），由普通读取填充，
+//   不再要求一次读取整个文件
+// - 只缓存不超过 max_file_size 的文件
+// - 淘汰策略可选（见 cache_policy.h），默认 S3-FIFO，另有过期时间
 // - 访问时自动延长过期时间
-// - 缓存区满时移除热度最低的文件
+// - 页数据为不可变的共享缓冲区，命中时只复制请求的范围
 
-struct CacheEntry {
+// 缓存页的 key：文件路径 + 页号
+struct FilePageKey {
     std::string path;
-    std::string data;
-    uint64_t file_size;
+    uint64_t index;
+
+    bool operator==(const FilePageKey& o) const {
+        return index == o.index && path == o.path;
+    }
+};
+
+namespace std {
+template <>
+struct hash<FilePageKey> {
+    size_t operator()(const FilePageKey& k) const {
+        return std::hash<std::string>()(k.path) ^
+               (size_t)(k.index * 0x9E3779B97F4A7C15ULL);
+    }
+};
+}
+
+struct CachePage {
+    std::shared_ptr<const std::string> data;
     std::chrono::steady_clock::time_point expire_time;
-    uint64_t access_count;  // 访问次数，用于热度计算
 };
 
 struct CacheConfig {
     uint64_t max_cache_size = 256ULL * 1024 * 1024;  // 最大缓存大小，默认 256MB
     uint64_t max_file_size = 32ULL * 1024 * 1024;    // 最大可缓存文件大小，默认 32MB
     uint64_t cache_ttl_seconds = 60;                  // 缓存过期时间，默认 60 秒
+    size_t shards = 16;                               // 分片数，默认 16
+    std::string policy = "s3fifo";                    // 淘汰策略：s3fifo / lru
+    uint64_t page_size = 128ULL * 1024;               // 页大小，默认 128KB
 };
 
 class FileCache {
 public:
     explicit FileCache(const CacheConfig& config = CacheConfig());
 
-    // 尝试从缓存获取文件内容
-    // 如果命中，自动延长过期时间
-    // 返回 true 表示命中，out 填充数据
-    bool get(const std::string& path, std::string& out);
+    uint64_t page_size() const { return config_.page_size; }
 
-    // 将文件放入缓存
-    // 如果文件太大或缓存已满（且无法腾出空间），则不缓存
-    void put(const std::string& path, const std::string& data);
+    // 该大小的文件是否会被缓存
+    bool cacheable(uint64_t file_size) const { return file_size <= config_.max_file_size; }
 
-    // 使缓存失效（文件被修改或删除时调用）
+    // 读取 [offset, offset+size) 到 dst
+    // 范围内的页全部命中才返回 true，并自动延长过期时间
+    bool read(const std::string& path, uint64_t offset, size_t size, char* dst);
+
+    // 失效计数：读取后端前记录，放入时校验
+    uint64_t epoch() const { return epoch_; }
+
+    // 放入 data 覆盖的完整页（以及文件末尾的不完整页）
+    // data 为文件 [offset, offset+size) 的内容，file_size 为当前文件大小
+    // 自 epoch 以来发生过失效，或文件太大、缓存已满时不缓存
+    void put(const std::string& path, uint64_t offset, const char* data, size_t size,
+             uint64_t file_size, uint64_t epoch);
+
+    // 使整个文件的缓存失效（截断、删除、重命名时调用）
     void invalidate(const std::string& path);
 
+    // 使 [offset, offset+size) 所在的页失效（写入时调用）
+    void invalidate_range(const std::string& path, uint64_t offset, uint64_t size);
+
     // 清理过期条目
     void cleanup_expired();
 
@@ -53,37 +92,48 @@ public:
     // 获取缓存命中统计
     uint64_t hit_count() const { return hits_; }
     uint64_t miss_count() const { return misses_; }
+    uint64_t eviction_count() const { return evictions_; }
+
+    // 当前使用的淘汰策略名
+    const char* policy_name() const { return shards_[0]->policy->name(); }
 
 private:
+    // 按 (路径, 页号) 哈希分片，每个分片独立加锁、独立淘汰策略与容量（总容量 / 分片数）
+    struct Shard {
+        std::unordered_map<FilePageKey, CachePage> pages;
+
+        // 路径 -> 该分片中缓存的页号（用于按文件失效）
+        std::unordered_map<std::string, std::unordered_set<uint64_t>> by_path;
+
+        std::unique_ptr<CachePolicy<FilePageKey>> policy;
+
+        uint64_t current_size = 0;
+        mutable std::mutex mutex;
+    };
+
     CacheConfig config_;
-    
-    // path -> CacheEntry
-    std::unordered_map<std::string, CacheEntry> cache_;
-    
-    // LRU 列表：最近访问的在前面
-    std::list<std::string> lru_list_;
-    
-    // path -> lru_list_ 中的迭代器（用于快速移动到前面）
-    std::unordered_map<std::string, std::list<std::string>::iterator> lru_map_;
-    
-    uint64_t current_size_ = 0;
-    uint64_t hits_ = 0;
-    uint64_t misses_ = 0;
-    
-    mutable std::mutex mutex_;
-
-    // 移动到 LRU 列表前面
-    void touch_lru(const std::string& path);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    uint64_t shard_capacity_ = 0;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+    std::atomic<uint64_t> epoch_{0};
+
+    Shard& shard_for(const FilePageKey& key) const;
+
+    // 以下函数假设已持有 shard.mutex
 
     // 腾出空间以容纳 needed_size 字节
     // 返回 true 表示成功腾出空间
-    bool make_room(uint64_t needed_size);
+    bool make_room(Shard& shard, uint64_t needed_size);
 
-    // 移除一个条目
-    void remove_entry(const std::string& path);
+    // 移除一页（同时从淘汰策略中移除）
+    void remove_page(Shard& shard, const FilePageKey& key);
 
-    // 计算条目热度分数（越低越容易被移除）
-    double calc_heat_score(const CacheEntry& entry) const;
+    // 只删除页数据（淘汰策略已自行移除）
+    void erase_page(Shard& shard, const FilePageKey& key);
 };
 
 #endif // FILE_CACHE_H
@@ -1,18 +1,100 @@
 #include "file_manager.h"
+#include "log.h"
+#include "metrics.h"
 #include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <cinttypes>
+#include <functional>
 #include <iostream>
+#include <iterator>
+
+// 文件读写的耗时与字节数（经由缓存或后端）
+static Histogram *const g_read_time = metrics().histogram(
+    "cloudraidfs_file_duration_seconds", "FileManager 读写耗时", "op=\"read\"");
+static Histogram *const g_write_time = metrics().histogram(
+    "cloudraidfs_file_duration_seconds", "FileManager 读写耗时", "op=\"write\"");
+static Counter *const g_read_bytes = metrics().counter(
+    "cloudraidfs_file_bytes_total", "FileManager 读写的字节数", "op=\"read\"");
+static Counter *const g_write_bytes = metrics().counter(
+    "cloudraidfs_file_bytes_total", "FileManager 读写的字节数", "op=\"write\"");
+
+// 数据管线：写入的条带按结果分类，以及写入前后的字节数
+static Counter *const g_pipeline_zero = metrics().counter(
+    "cloudraidfs_pipeline_stripes_total", "经数据管线写入的条带数", "result=\"zero\"");
+static Counter *const g_pipeline_dedup = metrics().counter(
+    "cloudraidfs_pipeline_stripes_total", "经数据管线写入的条带数", "result=\"dedup\"");
+static Counter *const g_pipeline_stored = metrics().counter(
+    "cloudraidfs_pipeline_stripes_total", "经数据管线写入的条带数", "result=\"stored\"");
+static Counter *const g_pipeline_logical = metrics().counter(
+    "cloudraidfs_pipeline_bytes_total", "经数据管线写入的字节数", "stage=\"logical\"");
+static Counter *const g_pipeline_stored_bytes = metrics().counter(
+    "cloudraidfs_pipeline_bytes_total", "经数据管线写入的字节数", "stage=\"stored\"");
+
+// 部分覆盖写回时的增量更新：成功次数与退回整条带写入的次数
+static Counter *const g_partial_ok = metrics().counter(
+    "cloudraidfs_partial_update_total", "按脏区间增量更新条带的次数", "result=\"ok\"");
+static Counter *const g_partial_fallback = metrics().counter(
+    "cloudraidfs_partial_update_total", "按脏区间增量更新条带的次数", "result=\"fallback\"");
+
+// 小文件打包：写入打包条带的文件数，以及打包后再次写入、拆回自身条带的文件数
+static Counter *const g_pack_files = metrics().counter(
+    "cloudraidfs_pack_files_total", "小文件打包与拆包的文件数", "op=\"pack\"");
+static Counter *const g_unpack_files = metrics().counter(
+    "cloudraidfs_pack_files_total", "小文件打包与拆包的文件数", "op=\"unpack\"");
+
+// 一次增量更新最多包含的脏区间数，更零散的写入整条带重写更便宜
+static const size_t PARTIAL_UPDATE_MAX_RANGES = 4;
+
+// 后台打包连续这么多次未能获取文件的布局锁后改为照常写回
+static const uint32_t PACK_LOCK_MISSES = 3;
 
 FileManager::FileManager(std::shared_ptr<RAIDChunkStore> raid_store,
                          std::shared_ptr<MetadataManager> meta_mgr,
                          std::shared_ptr<FileCache> file_cache,
-                         std::shared_ptr<ChunkCache> chunk_cache)
+                         std::shared_ptr<ChunkCache> chunk_cache,
+                         const WriteBufferConfig &wb_config,
+                         const ReadaheadConfig &ra_config,
+                         std::shared_ptr<DiskCache> disk_cache,
+                         const DataPipelineConfig &dp_config,
+                         const LayoutConfig &layout_config)
     : raid(std::move(raid_store)),
       meta(std::move(meta_mgr)),
       file_cache_(std::move(file_cache)),
-      chunk_cache_(std::move(chunk_cache))
+      chunk_cache_(std::move(chunk_cache)),
+      disk_cache_(std::move(disk_cache)),
+      pipeline_(dp_config),
+      layout_(layout_config),
+      wb_config_(wb_config),
+      ra_config_(ra_config)
+{
+    if (wb_config_.enabled) {
+        flusher_ = std::thread([this]() { flusher_loop(); });
+    }
+
+    // 预读结果放入 chunk 缓存，没有 chunk 缓存时预读没有意义
+    if (ra_config_.enabled && chunk_cache_) {
+        // 队列深度为线程数 × 最大窗口，超出的预读直接放弃
+        prefetch_pool_ = std::make_unique<IOThreadPool>(
+            ra_config_.threads, ra_config_.threads * (size_t)ra_config_.max_window);
+    }
+}
+
+FileManager::~FileManager()
 {
+    flush_all();
+
+    {
+        std::lock_guard<std::mutex> lock(dirty_mu_);
+        stop_flusher_ = true;
+    }
+    dirty_cv_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+
+    // 等待进行中的预读结束
+    prefetch_pool_.reset();
 }
 
 // ------------------------------------------------------------
@@ -22,59 +104,212 @@ uint64_t FileManager::get_size(const std::string &path) {
     return meta->get_size(path);
 }
 
+// ------------------------------------------------------------
+// 文件布局
+// ------------------------------------------------------------
+bool FileManager::valid_stripe_size(uint64_t stripe_size) {
+    return stripe_size >= MIN_STRIPE_SIZE && stripe_size <= MAX_STRIPE_SIZE &&
+           stripe_size % MIN_STRIPE_SIZE == 0;
+}
+
+void FileManager::init_layout(const std::string &path) {
+    // 最长的匹配前缀优先；前缀须在路径分隔处结束，"/a" 不匹配 "/ab"
+    uint64_t size = layout_.stripe_size;
+    size_t best = 0;
+    for (const auto &rule : layout_.rules) {
+        const std::string &prefix = rule.first;
+        bool match = prefix == "/" ||
+                     (path.compare(0, prefix.size(), prefix) == 0 &&
+                      (path.size() == prefix.size() || path[prefix.size()] == '/'));
+        if (match && prefix.size() >= best) {
+            best = prefix.size();
+            size = rule.second;
+        }
+    }
+
+    if (size != 0 && size != STRIPE_SIZE) {
+        set_stripe_size(path, size);
+    }
+}
+
+uint64_t FileManager::stripe_size(const std::string &path) {
+    uint32_t size = meta->stripe_size(path);
+    return size ? size : STRIPE_SIZE;
+}
+
+bool FileManager::set_stripe_size(const std::string &path, uint64_t stripe_size) {
+    if (!valid_stripe_size(stripe_size)) {
+        return false;
+    }
+    // 与写入互斥：写入按旧条带大小计算条带位置后才分配条带
+    std::unique_lock<std::shared_mutex> lock(layout_mu_[layout_slot(path)]);
+    return meta->set_stripe_size(path, stripe_size == STRIPE_SIZE ? 0 : (uint32_t)stripe_size);
+}
+
+size_t FileManager::layout_slot(const std::string &path) const {
+    return std::hash<std::string>()(path) % LAYOUT_LOCKS;
+}
+
+bool FileManager::unpack(const std::string &path) {
+    uint64_t pack_id = 0;
+    uint32_t pack_offset = 0, pack_length = 0;
+    if (!meta->get_pack(path, pack_id, pack_offset, pack_length)) {
+        return true;
+    }
+
+    // 直接写入新分配的条带而不经写回缓冲：打包位置可能已经提交，
+    // 条带写入成功后才切换，崩溃时不会丢失已同步的数据
+    if (pack_length > 0) {
+        std::shared_ptr<const std::string> pack = read_stripe_shared(pack_id);
+        if (pack->size() < (uint64_t)pack_offset + pack_length) {
+            LOG_ERROR("FileManager: 读取 %s 的打包条带失败, pack_id=%" PRIu64 "\n",
+                      path.c_str(), pack_id);
+            return false;
+        }
+        uint64_t stripe_id = ensure_stripe(path, 0);
+        if (!write_stripe(stripe_id, pack->substr(pack_offset, pack_length))) {
+            LOG_ERROR("FileManager: 拆包 %s 失败, stripe_id=%" PRIu64 "\n",
+                      path.c_str(), stripe_id);
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(dirty_mu_);
+        clear_fresh(stripe_id);
+    }
+
+    meta->set_pack(path, 0, 0, 0);
+    g_unpack_files->add(1);
+    return true;
+}
+
 // ------------------------------------------------------------
 // 截断文件
 // ------------------------------------------------------------
 bool FileManager::truncate(const std::string &path, uint64_t new_size) {
-    // 使文件缓存失效
-    if (file_cache_) {
-        file_cache_->invalidate(path);
+    // 打包内容由元数据一并截短，不能与打包、拆包交错
+    std::shared_lock<std::shared_mutex> layout_guard(layout_mu_[layout_slot(path)]);
+
+    // 先写回脏数据，避免写回缓冲中的旧数据在截断后重新出现
+    if (!flush(path)) {
+        return false;
     }
-    
-    // 使相关 chunk 缓存失效
-    if (chunk_cache_) {
-        const auto &stripes = meta->get_stripes(path);
-        for (uint64_t stripe_id : stripes) {
-            chunk_cache_->invalidate(stripe_id);
+
+    // 使相关 chunk 缓存与 SSD 缓存失效
+    if (chunk_cache_ || disk_cache_) {
+        for (const Extent &e : meta->get_extents(path)) {
+            for (uint64_t stripe_id = e.first; stripe_id < e.first + e.count; stripe_id++) {
+                if (chunk_cache_) chunk_cache_->invalidate(stripe_id);
+                if (disk_cache_) disk_cache_->invalidate(stripe_id);
+            }
         }
     }
     
     meta->set_size(path, new_size);
+
+    // 大小更新后再使文件缓存失效，之前开始的读取不会再放入旧页
+    if (file_cache_) {
+        file_cache_->invalidate(path);
+    }
     return true;
 }
 
 // ------------------------------------------------------------
 // 读取单个 stripe（带 chunk 缓存）
 // ------------------------------------------------------------
-bool FileManager::read_stripe(uint64_t stripe_id, std::string &out) {
+bool FileManager::read_stripe(uint64_t stripe_id, uint64_t stripe_size, std::string &out) {
+    std::shared_ptr<const std::string> data = read_stripe_shared(stripe_id);
+
+    out.assign(*data);
+
+    // 确保长度至少为一个 stripe
+    if (out.size() < stripe_size) {
+        out.resize((size_t)stripe_size, 0);
+    }
+    return true;
+}
+
+std::shared_ptr<const std::string> FileManager::read_stripe_shared(uint64_t stripe_id,
+                                                                   bool record_access) {
+    std::shared_ptr<const std::string> data;
+
     // 先尝试从 chunk 缓存读取
     if (chunk_cache_) {
-        if (chunk_cache_->get(stripe_id, out)) {
-            // chunk 缓存命中
-            if (out.size() < STRIPE_SIZE) {
-                out.resize((size_t)STRIPE_SIZE, 0);
-            }
-            return true;
+        if (chunk_cache_->get(stripe_id, data, record_access)) {
+            return data;
         }
     }
 
-    // chunk 缓存未命中，从 RAID 读取
-    if (!raid->read_chunk(stripe_id, 0, out)) {
-        // stripe 不存在或解码失败 → 视为全 0
-        out.assign((size_t)STRIPE_SIZE, 0);
-        return true;
+    // 该条带正在预读：等待预读完成后再查一次缓存
+    if (chunk_cache_ && prefetch_pool_) {
+        std::unique_lock<std::mutex> lock(prefetch_mu_);
+        if (inflight_.count(stripe_id)) {
+            prefetch_cv_.wait(lock, [&] { return inflight_.count(stripe_id) == 0; });
+            lock.unlock();
+            if (chunk_cache_->get(stripe_id, data)) {
+                return data;
+            }
+        }
     }
 
-    // 确保长度至少为一个 stripe
-    if (out.size() < STRIPE_SIZE) {
-        out.resize((size_t)STRIPE_SIZE, 0);
+    // chunk 缓存未命中，从 SSD 缓存或 RAID 读取
+    data = fetch_stripe(stripe_id);
+    if (!data) {
+        // stripe 不存在或解码失败 → 视为全 0（不缓存）
+        return std::make_shared<const std::string>();
     }
 
-    // 放入 chunk 缓存
+    // 放入 chunk 缓存（与调用方共享同一缓冲区）
     if (chunk_cache_) {
-        chunk_cache_->put(stripe_id, out);
+        chunk_cache_->put(stripe_id, data);
+    }
+
+    return data;
+}
+
+std::shared_ptr<const std::string> FileManager::fetch_stripe(uint64_t stripe_id) {
+    uint64_t disk_epoch = 0;
+    if (disk_cache_) {
+        // 读取前记录失效计数，读取期间条带被写入则不写入 SSD 缓存
+        disk_epoch = disk_cache_->epoch();
+
+        std::string cached;
+        if (disk_cache_->get(stripe_id, cached)) {
+            return std::make_shared<const std::string>(std::move(cached));
+        }
+    }
+
+    std::string out;
+    if (!read_stored_stripe(stripe_id, out)) {
+        return nullptr;
+    }
+
+    auto data = std::make_shared<const std::string>(std::move(out));
+    if (disk_cache_) {
+        disk_cache_->put_async(stripe_id, data, disk_epoch);
+    }
+    return data;
+}
+
+bool FileManager::read_stored_stripe(uint64_t stripe_id, std::string &out) {
+    uint64_t phys = 0;
+    if (!meta->stripe_ref(stripe_id, phys)) {
+        return raid->read_chunk(stripe_id, 0, out);
+    }
+
+    // 全零条带不存储，空内容即视为全 0
+    out.clear();
+    if (phys == 0) {
+        return true;
     }
 
+    std::string stored;
+    if (!raid->read_chunk(phys, 0, stored)) {
+        return false;
+    }
+    if (!DataPipeline::decode(stored, out)) {
+        LOG_ERROR("FileManager: 条带 %" PRIu64 " 的存储对象 %" PRIu64 " 无法解码\n",
+                  stripe_id, phys);
+        return false;
+    }
     return true;
 }
 
@@ -82,12 +317,23 @@ bool FileManager::read_stripe(uint64_t stripe_id, std::string &out) {
 // 写入单个 stripe（同时更新 chunk 缓存）
 // ------------------------------------------------------------
 bool FileManager::write_stripe(uint64_t stripe_id, const std::string &data) {
-    // 写入时使 chunk 缓存失效
+    // 写入时使 chunk 缓存与 SSD 缓存失效
     if (chunk_cache_) {
         chunk_cache_->invalidate(stripe_id);
     }
+    if (disk_cache_) {
+        disk_cache_->invalidate(stripe_id);
+    }
 
-    bool result = raid->write_chunk(stripe_id, 0, data);
+    bool result;
+    if (pipeline_.enabled()) {
+        result = store_stripes({ stripe_id }, { &data });
+    } else {
+        result = raid->write_chunk(stripe_id, 0, data);
+        if (result) {
+            meta->clear_stripe_ref(stripe_id);
+        }
+    }
 
     // 写入成功后，更新 chunk 缓存
     if (result && chunk_cache_) {
@@ -97,52 +343,267 @@ bool FileManager::write_stripe(uint64_t stripe_id, const std::string &data) {
     return result;
 }
 
+bool FileManager::write_stripes(const std::vector<uint64_t> &stripe_ids,
+                                const std::vector<const std::string *> &data) {
+    for (uint64_t id : stripe_ids) {
+        if (chunk_cache_) {
+            chunk_cache_->invalidate(id);
+        }
+        if (disk_cache_) {
+            disk_cache_->invalidate(id);
+        }
+    }
+
+    bool result;
+    if (pipeline_.enabled()) {
+        result = store_stripes(stripe_ids, data);
+    } else {
+        result = raid->write_stripes(stripe_ids, data);
+        if (result) {
+            for (uint64_t id : stripe_ids) {
+                meta->clear_stripe_ref(id);
+            }
+        }
+    }
+
+    if (result && chunk_cache_) {
+        for (size_t i = 0; i < stripe_ids.size(); i++) {
+            chunk_cache_->put(stripe_ids[i], *data[i]);
+        }
+    }
+
+    return result;
+}
+
+bool FileManager::store_stripes(const std::vector<uint64_t> &stripe_ids,
+                                const std::vector<const std::string *> &data) {
+    // 需要上传的条带：下标、内容哈希、编码后的存储对象
+    std::vector<size_t> upload;
+    std::vector<std::string> hashes;
+    std::vector<std::string> encoded;
+
+    // 条带号自身可能存有管线之前写入的数据（新分配的条带没有）
+    std::vector<bool> raw_written(stripe_ids.size());
+    for (size_t i = 0; i < stripe_ids.size(); i++) {
+        raw_written[i] = !is_fresh(stripe_ids[i]);
+    }
+
+    for (size_t i = 0; i < stripe_ids.size(); i++) {
+        const std::string &d = *data[i];
+        g_pipeline_logical->add(d.size());
+
+        std::string hash;
+        if (pipeline_.dedup()) {
+            if (DataPipeline::is_zero(d.data(), d.size())) {
+                meta->set_stripe_ref(stripe_ids[i], 0, std::string(), raw_written[i]);
+                g_pipeline_zero->add(1);
+                continue;
+            }
+            hash = DataPipeline::content_hash(d.data(), d.size());
+            if (meta->ref_existing(stripe_ids[i], hash, raw_written[i])) {
+                g_pipeline_dedup->add(1);
+                continue;
+            }
+        }
+        upload.push_back(i);
+        hashes.push_back(std::move(hash));
+        encoded.push_back(pipeline_.encode(d));
+    }
+
+    if (upload.empty()) {
+        return true;
+    }
+
+    // 写时复制：写入新分配的连续条带，引用在写入成功后才切换
+    uint64_t first = raid->allocate_stripes(upload.size());
+    std::vector<uint64_t> phys(upload.size());
+    std::vector<const std::string *> ptrs(upload.size());
+    for (size_t j = 0; j < upload.size(); j++) {
+        phys[j] = first + j;
+        ptrs[j] = &encoded[j];
+    }
+
+    bool ok = phys.size() == 1 ? raid->write_chunk(phys[0], 0, encoded[0])
+                               : raid->write_stripes(phys, ptrs);
+    if (!ok) {
+        // 未被引用的对象，尽量删除已写入的部分
+        for (uint64_t id : phys) {
+            raid->delete_chunk(id, 0);
+        }
+        return false;
+    }
+
+    for (size_t j = 0; j < upload.size(); j++) {
+        size_t i = upload[j];
+        meta->set_stripe_ref(stripe_ids[i], phys[j], hashes[j], raw_written[i]);
+        g_pipeline_stored->add(1);
+        g_pipeline_stored_bytes->add(encoded[j].size());
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// 原地增量更新：每个区间只读写所在数据块与校验块的对应字节
+// ------------------------------------------------------------
+bool FileManager::update_stripe(uint64_t stripe_id, uint64_t length,
+                                const std::vector<std::pair<uint64_t, std::string>> &pieces) {
+    if (pieces.empty() || pieces.size() > PARTIAL_UPDATE_MAX_RANGES) {
+        return false;
+    }
+    // 管线写入的条带是压缩 / 去重后的存储对象，无法按字节原地修改
+    uint64_t phys = 0;
+    if (pipeline_.enabled() || meta->stripe_ref(stripe_id, phys)) {
+        return false;
+    }
+    for (const auto &p : pieces) {
+        if (p.first + p.second.size() > length) {
+            return false;
+        }
+    }
+
+    // 先取出缓存中的旧内容（修补后放回），再使缓存失效
+    std::shared_ptr<const std::string> cached;
+    if (chunk_cache_) {
+        chunk_cache_->get(stripe_id, cached, false);
+        chunk_cache_->invalidate(stripe_id);
+    }
+    if (disk_cache_) {
+        disk_cache_->invalidate(stripe_id);
+    }
+
+    // 写入中途失败时条带仍可解码（失败的位置已标记过期），由调用方随后的整条带写入覆盖
+    if (!raid->update_ranges(stripe_id, length, pieces)) {
+        g_partial_fallback->add(1);
+        return false;
+    }
+    g_partial_ok->add(1);
+
+    if (cached && chunk_cache_ && cached->size() == length) {
+        auto data = std::make_shared<std::string>(*cached);
+        for (const auto &p : pieces) {
+            data->replace((size_t)p.first, p.second.size(), p.second);
+        }
+        chunk_cache_->put(stripe_id, std::shared_ptr<const std::string>(std::move(data)));
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// 元数据保留条带
+// ------------------------------------------------------------
+bool FileManager::read_meta_stripe(uint64_t stripe_id, std::string &out) {
+    return raid->read_chunk(stripe_id, 0, out);
+}
+
+bool FileManager::read_meta_stripes(const std::vector<uint64_t> &stripe_ids,
+                                    std::vector<std::string> &out) {
+    return raid->read_stripes(stripe_ids, out);
+}
+
+bool FileManager::write_meta_stripe(uint64_t stripe_id, const std::string &data) {
+    // 旧格式的元数据文件经由 chunk / SSD 缓存读写过，一并失效
+    if (chunk_cache_) {
+        chunk_cache_->invalidate(stripe_id);
+    }
+    if (disk_cache_) {
+        disk_cache_->invalidate(stripe_id);
+    }
+    return raid->write_chunk(stripe_id, 0, data);
+}
+
+uint64_t FileManager::allocate_meta_stripe(uint64_t min_id) {
+    raid->set_next_stripe_id(min_id);
+    uint64_t id = raid->allocate_new_stripe();
+    if (disk_cache_) {
+        disk_cache_->invalidate(id);
+    }
+    return id;
+}
+
+bool FileManager::delete_meta_stripe(uint64_t stripe_id) {
+    if (chunk_cache_) {
+        chunk_cache_->invalidate(stripe_id);
+    }
+    if (disk_cache_) {
+        disk_cache_->invalidate(stripe_id);
+    }
+    return raid->delete_chunk(stripe_id, 0);
+}
+
+bool FileManager::delete_data_stripe(uint64_t stripe_id) {
+    // 缓存按文件条带号保存解码后的内容，与存储对象无关；
+    // 管线之前写入的同号条带此时已指向新的对象，缓存中的内容仍然有效
+    return raid->delete_chunk(stripe_id, 0);
+}
+
 // ------------------------------------------------------------
 // 确保 stripe 存在，不存在则分配
 // ------------------------------------------------------------
 uint64_t FileManager::ensure_stripe(const std::string &path, uint64_t stripe_index) {
-    const auto &stripes = meta->get_stripes(path);
+    uint64_t stripe_id = 0;
 
     // stripe 已存在
-    if (stripe_index < stripes.size()) {
-        return stripes[stripe_index];
+    if (meta->get_stripe(path, stripe_index, stripe_id)) {
+        return stripe_id;
     }
 
     // stripe 不存在 → 分配新 stripe_id 并添加到文件
-    // 注意：可能需要填充中间的 stripe
-    while (meta->get_stripes(path).size() <= stripe_index) {
-        uint64_t new_id = raid->allocate_new_stripe();
-        meta->add_stripe(path, new_id);
+    // 中间缺少的 stripe 一并分配，作为一段连续条带
+    extend_stripes(path, stripe_index + 1);
+    meta->get_stripe(path, stripe_index, stripe_id);
+    return stripe_id;
+}
+
+void FileManager::extend_stripes(const std::string &path, uint64_t count) {
+    for (;;) {
+        uint64_t have = meta->stripe_count(path);
+        if (have >= count) {
+            return;
+        }
+
+        uint64_t n = count - have;
+        uint64_t first = raid->allocate_stripes(n);
+
+        // 重启后 stripe_id 可能复用已删除文件的编号，丢弃 SSD 缓存中的旧内容
+        if (disk_cache_) {
+            for (uint64_t id = first; id < first + n; id++) {
+                disk_cache_->invalidate(id);
+            }
+        }
+
+        // 先标记为新条带再加入文件：加入后其他线程可能立即写入
+        {
+            std::lock_guard<std::mutex> lock(dirty_mu_);
+            fresh_stripes_[first] = first + n;
+        }
+
+        if (meta->add_stripes(path, have, first, n)) {
+            return;
+        }
+
+        // 其他线程先扩展了该文件：放弃这次分配的条带号，重新检查
+        std::lock_guard<std::mutex> lock(dirty_mu_);
+        fresh_stripes_.erase(first);
     }
-    return meta->get_stripes(path)[stripe_index];
 }
 
 // ------------------------------------------------------------
-// 从后端读取完整文件（用于文件缓存）
+// 预分配
 // ------------------------------------------------------------
-bool FileManager::read_full_file(const std::string &path, std::string &out) {
-    uint64_t file_size = meta->get_size(path);
-    
-    if (file_size == 0) {
-        out.clear();
+bool FileManager::fallocate(const std::string &path, uint64_t offset, uint64_t length,
+                            bool keep_size) {
+    if (length == 0) {
         return true;
     }
-    
-    out.clear();
-    out.reserve(file_size);
-    
-    const auto &stripes = meta->get_stripes(path);
-    uint64_t remaining = file_size;
-    
-    for (size_t i = 0; i < stripes.size() && remaining > 0; ++i) {
-        std::string stripe_data;
-        read_stripe(stripes[i], stripe_data);
-        
-        size_t to_copy = std::min<uint64_t>(remaining, STRIPE_SIZE);
-        out.append(stripe_data.data(), to_copy);
-        remaining -= to_copy;
+
+    std::shared_lock<std::shared_mutex> layout_guard(layout_mu_[layout_slot(path)]);
+    uint64_t end = offset + length;
+    uint64_t ss = stripe_size(path);
+    extend_stripes(path, (end + ss - 1) / ss);
+
+    if (!keep_size) {
+        meta->extend_size(path, end);
     }
-    
     return true;
 }
 
@@ -152,7 +613,8 @@ bool FileManager::read_full_file(const std::string &path, std::string &out) {
 bool FileManager::read(const std::string &path,
                        uint64_t offset,
                        size_t size,
-                       std::string &out)
+                       std::string &out,
+                       uint64_t fh)
 {
     uint64_t file_size = meta->get_size(path);
 
@@ -165,72 +627,103 @@ bool FileManager::read(const std::string &path,
         size = (size_t)(file_size - offset);
     }
 
-    // 尝试从文件缓存读取（仅当读取整个文件或从头开始读取时）
-    if (file_cache_ && offset == 0 && size == file_size) {
-        std::string cached_data;
-        if (file_cache_->get(path, cached_data)) {
-            // 文件缓存命中
-            out = cached_data;
-            return true;
-        }
-        
-        // 文件缓存未命中，从后端读取完整文件
-        if (read_full_file(path, out)) {
-            // 放入文件缓存
-            file_cache_->put(path, out);
-            return true;
-        }
+    out.resize(size);
+    size_t bytes_read = 0;
+    if (!read_into(path, offset, size, &out[0], bytes_read, fh)) {
         return false;
     }
-    
-    // 尝试从文件缓存读取部分数据
-    if (file_cache_) {
-        std::string cached_data;
-        if (file_cache_->get(path, cached_data)) {
-            // 文件缓存命中，提取需要的部分
-            if (offset + size <= cached_data.size()) {
-                out = cached_data.substr(offset, size);
-                return true;
-            }
-        }
+    out.resize(bytes_read);
+    return true;
+}
+
+bool FileManager::read_into(const std::string &path,
+                            uint64_t offset,
+                            size_t size,
+                            char *buf,
+                            size_t &bytes_read,
+                            uint64_t fh)
+{
+    ScopedTimer timer(g_read_time);
+
+    bytes_read = 0;
+    uint64_t file_size = meta->get_size(path);
+
+    if (offset >= file_size) {
+        return true; // EOF
     }
 
-    // 文件缓存未命中，逐 stripe 读取（会使用 chunk 缓存）
-    out.clear();
-    out.reserve(size);
+    if (offset + size > file_size) {
+        size = (size_t)(file_size - offset);
+    }
+    g_read_bytes->add(size);
 
-    uint64_t pos = offset;
-    size_t remaining = size;
+    // 打包存放的小文件：从共享的打包条带中复制（打包条带经 chunk 缓存）
+    if (copy_packed(path, offset, size, buf)) {
+        bytes_read = size;
+        return true;
+    }
 
-    while (remaining > 0) {
-        uint64_t stripe_index = pos / STRIPE_SIZE;
-        uint64_t stripe_offset = pos % STRIPE_SIZE;
-        size_t to_read = std::min<uint64_t>(remaining, STRIPE_SIZE - stripe_offset);
+    // 先发起预读，使后续条带的读取与本次读取重叠
+    bool sequential = false;
+    if (fh) {
+        sequential = readahead(path, fh, offset, size);
+    }
 
-        const auto &stripes = meta->get_stripes(path);
+    if (file_cache_ && file_cache_->cacheable(file_size)) {
+        // 文件缓存命中，只复制需要的部分
+        if (file_cache_->read(path, offset, size, buf)) {
+            bytes_read = size;
+            return true;
+        }
 
-        std::string stripe_data;
+        // 未命中：把读取范围扩展到页边界，读取后放入文件缓存
+        uint64_t fc_epoch = file_cache_->epoch();
+        uint64_t ps = file_cache_->page_size();
+        uint64_t start = offset / ps * ps;
+        uint64_t end = std::min<uint64_t>((offset + size + ps - 1) / ps * ps, file_size);
 
-        if (stripe_index < stripes.size()) {
-            uint64_t stripe_id = stripes[stripe_index];
-            read_stripe(stripe_id, stripe_data);
+        if (start == offset && end == offset + size) {
+            read_stripes(path, offset, size, buf, sequential);
+            file_cache_->put(path, offset, buf, size, file_size, fc_epoch);
         } else {
-            // stripe 不存在 → 全 0
-            stripe_data.assign((size_t)STRIPE_SIZE, 0);
+            std::string data((size_t)(end - start), '\0');
+            read_stripes(path, start, data.size(), &data[0], sequential);
+            std::memcpy(buf, data.data() + (offset - start), size);
+            file_cache_->put(path, start, data.data(), data.size(), file_size, fc_epoch);
         }
 
-        out.append(stripe_data.data() + stripe_offset, to_read);
+        bytes_read = size;
+        return true;
+    }
+
+    // 逐 stripe 读取（会使用 chunk 缓存）
+    read_stripes(path, offset, size, buf, sequential);
+    bytes_read = size;
+    return true;
+}
+
+void FileManager::read_stripes(const std::string &path, uint64_t offset, size_t size,
+                               char *buf, bool sequential)
+{
+    uint64_t ss = stripe_size(path);
+    uint64_t pos = offset;
+    size_t remaining = size;
+
+    while (remaining > 0) {
+        uint64_t stripe_index = pos / ss;
+        uint64_t stripe_offset = pos % ss;
+        size_t to_read = std::min<uint64_t>(remaining, ss - stripe_offset);
+
+        // 顺序读在同一条带内的后续访问不计入淘汰策略的访问频率，
+        // 否则大文件顺序扫描的每个条带都会显得很“热”
+        bool record_access = !(sequential && pos == offset && stripe_offset != 0);
+
+        copy_stripe_range(path, stripe_index, ss, stripe_offset, to_read,
+                          buf + (pos - offset), record_access);
 
         pos       += to_read;
         remaining -= to_read;
     }
-
-    // 如果读取的是完整文件，放入文件缓存
-    if (file_cache_ && offset == 0 && size == file_size) {
-        file_cache_->put(path, out);
-    }
-
-    return true;
 }
 
 // ------------------------------------------------------------
@@ -241,34 +734,49 @@ bool FileManager::write(const std::string &path,
                         const char *data,
                         size_t size)
 {
-    // 写入时使文件缓存失效
-    if (file_cache_) {
-        file_cache_->invalidate(path);
-    }
-
-    uint64_t pos = offset;
-    size_t remaining = size;
+    ScopedTimer timer(g_write_time);
+
+    for (;;) {
+        {
+            std::shared_lock<std::shared_mutex> lock(layout_mu_[layout_slot(path)]);
+            uint64_t pack_id = 0;
+            uint32_t pack_offset = 0, pack_length = 0;
+            if (!meta->get_pack(path, pack_id, pack_offset, pack_length)) {
+                return write_striped(path, offset, data, size);
+            }
+        }
+
+        // 打包存放的文件被再次写入：先拆回自己的条带，再按条带写入
+        std::unique_lock<std::shared_mutex> lock(layout_mu_[layout_slot(path)]);
+        if (!unpack(path)) {
+            return false;
+        }
+    }
+}
+
+bool FileManager::write_striped(const std::string &path,
+                                uint64_t offset,
+                                const char *data,
+                                size_t size)
+{
+    uint64_t ss = stripe_size(path);
+    uint64_t pos = offset;
+    size_t remaining = size;
 
     while (remaining > 0) {
-        uint64_t stripe_index = pos / STRIPE_SIZE;
-        uint64_t stripe_offset = pos % STRIPE_SIZE;
-        size_t to_write = std::min<uint64_t>(remaining, STRIPE_SIZE - stripe_offset);
+        uint64_t stripe_index = pos / ss;
+        uint64_t stripe_offset = pos % ss;
+        size_t to_write = std::min<uint64_t>(remaining, ss - stripe_offset);
 
         // 确保 stripe 存在
         uint64_t stripe_id = ensure_stripe(path, stripe_index);
 
-        // 读取旧 stripe
-        std::string stripe_data;
-        read_stripe(stripe_id, stripe_data);
-
-        // 覆盖写入
-        std::memcpy(&stripe_data[(size_t)stripe_offset], data, to_write);
-
-        // 写回 RAID（同时更新 chunk 缓存）
-        if (!write_stripe(stripe_id, stripe_data)) {
-            fprintf(stderr,
-                    "FileManager::write: write_chunk 失败, stripe_id=%" PRIu64 "\n",
-                    stripe_id);
+        bool ok = wb_config_.enabled
+            ? buffer_write(path, stripe_index, stripe_id, ss, stripe_offset, data, to_write)
+            : write_through(path, stripe_index, stripe_id, ss, stripe_offset, data, to_write);
+        if (!ok) {
+            LOG_ERROR("FileManager::write: write_chunk 失败, stripe_id=%" PRIu64 "\n",
+                      stripe_id);
             return false;
         }
 
@@ -277,11 +785,1089 @@ bool FileManager::write(const std::string &path,
         remaining -= to_write;
     }
 
+    // 数据落入写回缓冲 / 后端后再使写入范围内的缓存页失效，
+    // 避免并发读取在写入完成前把旧数据重新放入缓存
+    if (file_cache_) {
+        file_cache_->invalidate_range(path, offset, size);
+    }
+
     // 更新文件大小
-    uint64_t end_pos = offset + size;
-    if (end_pos > meta->get_size(path)) {
-        meta->set_size(path, end_pos);
+    meta->extend_size(path, offset + size);
+
+    // 脏数据超过上限时由写入方同步写回（背压）
+    if (wb_config_.enabled) {
+        std::unique_lock<std::mutex> lock(dirty_mu_);
+        if (!enforce_dirty_limit(lock)) {
+            return false;
+        }
+    }
+
+    g_write_bytes->add(size);
+    return true;
+}
+
+// ------------------------------------------------------------
+// 直接写穿：读旧条带 → 覆盖 → 写回
+// 新条带或整条带覆盖时跳过读取
+// ------------------------------------------------------------
+bool FileManager::write_through(const std::string &path, uint64_t stripe_index,
+                                uint64_t stripe_id, uint64_t stripe_size,
+                                uint64_t stripe_offset, const char *data, size_t size)
+{
+    uint64_t end = stripe_offset + size;
+    uint64_t length = stripe_write_length(path, stripe_index, stripe_size, end);
+
+    std::string stripe_data;
+    if (end >= length && stripe_offset == 0) {
+        // 覆盖条带的全部有效内容，旧内容无关紧要
+        stripe_data.assign(data, size);
+    } else if (!is_fresh(stripe_id) &&
+               update_stripe(stripe_id, length, { { stripe_offset, std::string(data, size) } })) {
+        // 小范围覆盖：已原地增量更新
+        return true;
+    } else {
+        if (is_fresh(stripe_id)) {
+            stripe_data.assign((size_t)length, 0);
+        } else {
+            read_stripe(stripe_id, stripe_size, stripe_data);
+        }
+        stripe_data.resize((size_t)length, 0);
+
+        // 覆盖写入
+        std::memcpy(&stripe_data[(size_t)stripe_offset], data, size);
+    }
+
+    // 写回 RAID（同时更新 chunk 缓存）
+    if (!write_stripe(stripe_id, stripe_data)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(dirty_mu_);
+    clear_fresh(stripe_id);
+    return true;
+}
+
+uint64_t FileManager::stripe_write_length(const std::string &path, uint64_t stripe_index,
+                                          uint64_t stripe_size, uint64_t min_length)
+{
+    uint64_t stripe_start = stripe_index * stripe_size;
+    uint64_t file_size = meta->get_size(path);
+    uint64_t length = file_size > stripe_start ? file_size - stripe_start : 0;
+    length = std::max(length, min_length);
+    return std::min<uint64_t>(length, stripe_size);
+}
+
+bool FileManager::is_fresh(uint64_t stripe_id)
+{
+    std::lock_guard<std::mutex> lock(dirty_mu_);
+    return is_fresh_locked(stripe_id);
+}
+
+bool FileManager::is_fresh_locked(uint64_t stripe_id) const
+{
+    auto it = fresh_stripes_.upper_bound(stripe_id);
+    if (it == fresh_stripes_.begin()) return false;
+    --it;
+    return stripe_id < it->second;
+}
+
+void FileManager::clear_fresh(uint64_t stripe_id)
+{
+    auto it = fresh_stripes_.upper_bound(stripe_id);
+    if (it == fresh_stripes_.begin()) return;
+    --it;
+    uint64_t first = it->first, end = it->second;
+    if (stripe_id >= end) return;
+
+    // 从区间中挖掉 stripe_id，两侧剩余部分仍为新条带
+    fresh_stripes_.erase(it);
+    if (first < stripe_id) fresh_stripes_[first] = stripe_id;
+    if (stripe_id + 1 < end) fresh_stripes_[stripe_id + 1] = end;
+}
+
+// ------------------------------------------------------------
+// 写回缓冲
+// ------------------------------------------------------------
+
+// 把 [b, e) 并入有序不重叠的区间列表
+static void add_range(std::vector<std::pair<uint64_t, uint64_t>> &ranges,
+                      uint64_t b, uint64_t e)
+{
+    std::vector<std::pair<uint64_t, uint64_t>> out;
+    out.reserve(ranges.size() + 1);
+    bool placed = false;
+    for (const auto &r : ranges) {
+        if (r.second < b) {
+            out.push_back(r);
+        } else if (e < r.first) {
+            if (!placed) {
+                out.emplace_back(b, e);
+                placed = true;
+            }
+            out.push_back(r);
+        } else {
+            b = std::min(b, r.first);
+            e = std::max(e, r.second);
+        }
+    }
+    if (!placed) out.emplace_back(b, e);
+    ranges.swap(out);
+}
+
+bool FileManager::covers_full_stripe(const DirtyStripe &ds)
+{
+    return ds.ranges.size() == 1 &&
+           ds.ranges[0].first == 0 && ds.ranges[0].second >= ds.stripe_size;
+}
+
+// 把脏条带的内容叠加到 dst（dst 为后端读出的完整条带）
+static void overlay_dirty(const std::string &data,
+                          const std::vector<std::pair<uint64_t, uint64_t>> &ranges,
+                          bool base_merged,
+                          std::string &dst)
+{
+    if (dst.size() < data.size()) dst.resize(data.size(), 0);
+    if (base_merged) {
+        std::memcpy(&dst[0], data.data(), data.size());
+        return;
+    }
+    for (const auto &r : ranges) {
+        std::memcpy(&dst[(size_t)r.first], data.data() + r.first,
+                    (size_t)(r.second - r.first));
+    }
+}
+
+void FileManager::load_stripe(const std::string &path, uint64_t stripe_index,
+                              uint64_t stripe_size, std::string &out)
+{
+    // 先在锁内取脏数据快照，再读后端：
+    // 若先读后端，写回可能恰好在两步之间完成，导致读到旧内容且没有脏数据可叠加
+    bool dirty = false;
+    std::string data;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    bool base_merged = false;
+
+    if (wb_config_.enabled) {
+        std::lock_guard<std::mutex> lock(dirty_mu_);
+        auto fit = dirty_.find(path);
+        if (fit != dirty_.end()) {
+            auto sit = fit->second.find(stripe_index);
+            if (sit != fit->second.end()) {
+                const DirtyStripe &ds = sit->second;
+                if (ds.base_merged || covers_full_stripe(ds)) {
+                    out = ds.data;
+                    out.resize((size_t)stripe_size, 0);
+                    return;
+                }
+                dirty = true;
+                data = ds.data;
+                ranges = ds.ranges;
+                base_merged = ds.base_merged;
+            }
+        }
+    }
+
+    uint64_t stripe_id = 0;
+    bool exists = meta->get_stripe(path, stripe_index, stripe_id);
+    if (exists && !is_fresh(stripe_id)) {
+        read_stripe(stripe_id, stripe_size, out);
+    } else {
+        // stripe 不存在 → 全 0；文件可能刚刚打包，内容在打包条带中
+        out.assign((size_t)stripe_size, 0);
+        if (!exists && stripe_index == 0) {
+            copy_packed(path, 0, out.size(), &out[0]);
+        }
+    }
+
+    if (dirty) {
+        overlay_dirty(data, ranges, base_merged, out);
+    }
+}
+
+// 从 src 复制 [offset, offset+len) 到 dst，超出 src 的部分填 0
+static void copy_range(const std::string &src, uint64_t offset, size_t len, char *dst)
+{
+    size_t avail = offset < src.size() ? std::min<size_t>(len, src.size() - offset) : 0;
+    if (avail > 0) {
+        std::memcpy(dst, src.data() + offset, avail);
+    }
+    if (avail < len) {
+        std::memset(dst + avail, 0, len - avail);
+    }
+}
+
+bool FileManager::copy_packed(const std::string &path, uint64_t offset, size_t len, char *dst)
+{
+    uint64_t pack_id = 0;
+    uint32_t pack_offset = 0, pack_length = 0;
+    if (!meta->get_pack(path, pack_id, pack_offset, pack_length)) {
+        return false;
+    }
+
+    // 打包内容之后到文件末尾为 0（截断后又扩大的部分）
+    size_t avail = offset < pack_length ? std::min<size_t>(len, pack_length - offset) : 0;
+    if (avail > 0) {
+        std::shared_ptr<const std::string> pack = read_stripe_shared(pack_id);
+        copy_range(*pack, pack_offset + offset, avail, dst);
+    }
+    if (avail < len) {
+        std::memset(dst + avail, 0, len - avail);
+    }
+    return true;
+}
+
+void FileManager::copy_stripe_range(const std::string &path, uint64_t stripe_index,
+                                    uint64_t stripe_size, uint64_t stripe_offset, size_t len,
+                                    char *dst, bool record_access)
+{
+    // 脏条带：内容完整时直接从写回缓冲复制，否则需要叠加后端数据
+    if (wb_config_.enabled) {
+        std::unique_lock<std::mutex> lock(dirty_mu_);
+        auto fit = dirty_.find(path);
+        if (fit != dirty_.end()) {
+            auto sit = fit->second.find(stripe_index);
+            if (sit != fit->second.end()) {
+                const DirtyStripe &ds = sit->second;
+                if (ds.base_merged || covers_full_stripe(ds)) {
+                    copy_range(ds.data, stripe_offset, len, dst);
+                    return;
+                }
+                lock.unlock();
+
+                std::string merged;
+                load_stripe(path, stripe_index, stripe_size, merged);
+                std::memcpy(dst, merged.data() + stripe_offset, len);
+                return;
+            }
+        }
+    }
+
+    uint64_t stripe_id = 0;
+    if (!meta->get_stripe(path, stripe_index, stripe_id)) {
+        // stripe 不存在 → 全 0；文件可能在查找脏条带之后刚刚打包，内容在打包条带中
+        if (stripe_index != 0 || !copy_packed(path, stripe_offset, len, dst)) {
+            std::memset(dst, 0, len);
+        }
+        return;
+    }
+    if (is_fresh(stripe_id)) {
+        std::memset(dst, 0, len);
+        return;
+    }
+
+    std::shared_ptr<const std::string> data =
+        read_stripe_shared(stripe_id, record_access);
+    copy_range(*data, stripe_offset, len, dst);
+}
+
+bool FileManager::buffer_write(const std::string &path, uint64_t stripe_index,
+                               uint64_t stripe_id, uint64_t stripe_size, uint64_t stripe_offset,
+                               const char *data, size_t size)
+{
+    std::unique_lock<std::mutex> lock(dirty_mu_);
+
+    auto &stripes = dirty_[path];
+    auto it = stripes.find(stripe_index);
+    if (it == stripes.end()) {
+        it = stripes.emplace(stripe_index, DirtyStripe()).first;
+        it->second.stripe_id = stripe_id;
+        it->second.stripe_size = stripe_size;
+        it->second.dirty_since = std::chrono::steady_clock::now();
+    }
+    DirtyStripe &ds = it->second;
+
+    uint64_t end = stripe_offset + size;
+    if (ds.data.size() < end) {
+        dirty_bytes_ += end - ds.data.size();
+        ds.data.resize((size_t)end, 0);
+    }
+    std::memcpy(&ds.data[(size_t)stripe_offset], data, size);
+    add_range(ds.ranges, stripe_offset, end);
+    ds.generation++;
+
+    // 条带已被完整覆盖：无需读取旧内容，可以写回
+    if (!covers_full_stripe(ds) || ds.flushing) {
+        return true;
+    }
+    if (wb_config_.batch_stripes <= 1) {
+        return flush_stripe(path, stripe_index, lock);
+    }
+
+    // 顺序大写入：向前数以本条带结尾、连续写满的条带，攒够一批再一起写回
+    std::vector<uint64_t> run;
+    run.push_back(stripe_index);
+    auto rit = std::make_reverse_iterator(it);
+    uint64_t expect = stripe_index;
+    for (; rit != stripes.rend() && run.size() < wb_config_.batch_stripes; ++rit) {
+        if (rit->first + 1 != expect) break;
+        if (rit->second.flushing || !covers_full_stripe(rit->second)) break;
+        expect = rit->first;
+        run.push_back(expect);
+    }
+    if (run.size() < wb_config_.batch_stripes) {
+        return true;
+    }
+    std::reverse(run.begin(), run.end());
+    return flush_batch(path, run, lock);
+}
+
+void FileManager::begin_flush(DirtyStripe &ds, uint64_t stripe_index, FlushJob &job)
+{
+    ds.flushing = true;
+    job.stripe_index = stripe_index;
+    job.generation = ds.generation;
+    job.stripe_id = ds.stripe_id;
+    job.stripe_size = ds.stripe_size;
+    job.fresh = is_fresh_locked(ds.stripe_id);
+    job.complete = ds.base_merged || covers_full_stripe(ds);
+    job.data = ds.data;
+    job.ranges = ds.ranges;
+}
+
+bool FileManager::flush_partial(const std::string &path, FlushJob &job)
+{
+    if (job.complete || job.fresh) {
+        return false;
+    }
+    uint64_t length = stripe_write_length(path, job.stripe_index, job.stripe_size,
+                                          job.data.size());
+
+    std::vector<std::pair<uint64_t, std::string>> pieces;
+    for (const auto &r : job.ranges) {
+        pieces.emplace_back(r.first, job.data.substr((size_t)r.first,
+                                                     (size_t)(r.second - r.first)));
+    }
+    job.partial = update_stripe(job.stripe_id, length, pieces);
+    return job.partial;
+}
+
+void FileManager::build_flush(const std::string &path, FlushJob &job)
+{
+    // 只写到文件在该条带内的末尾（尾条带不补齐）
+    uint64_t length = stripe_write_length(path, job.stripe_index, job.stripe_size,
+                                          job.data.size());
+
+    // 脏区间已覆盖 [0, length) 时同样无需旧内容
+    if (!job.complete && job.ranges.size() == 1 && job.ranges[0].first == 0 &&
+        job.ranges[0].second >= length) {
+        job.complete = true;
     }
 
+    if (!job.complete && !job.fresh) {
+        // 部分覆盖：读取旧内容后叠加脏数据
+        // 整条带覆盖或新条带时旧内容为全 0 或无关，跳过读取
+        std::string stripe_data;
+        read_stripe(job.stripe_id, job.stripe_size, stripe_data);
+        overlay_dirty(job.data, job.ranges, false, stripe_data);
+        job.data = std::move(stripe_data);
+    }
+    job.data.resize((size_t)length, 0);
+}
+
+void FileManager::end_flush(const std::string &path, FlushJob &job, bool ok)
+{
+    if (ok) {
+        clear_fresh(job.stripe_id);
+    }
+    // flushing 期间 discard 会等待，条目一定仍然存在
+    auto &stripes = dirty_[path];
+    DirtyStripe &cur = stripes[job.stripe_index];
+    cur.flushing = false;
+
+    if (ok) {
+        if (cur.generation == job.generation) {
+            dirty_bytes_ -= cur.data.size();
+            stripes.erase(job.stripe_index);
+            if (stripes.empty()) dirty_.erase(path);
+        } else if (job.partial) {
+            // 增量更新没有完整的条带内容可作底：保留脏条带原样，
+            // 已写回的区间仍在其中，下次随新数据一起写回
+            cur.dirty_since = std::chrono::steady_clock::now();
+        } else {
+            // 写回期间有新写入：以刚写回的内容为底合并新数据，条带仍为脏
+            overlay_dirty(cur.data, cur.ranges, cur.base_merged, job.data);
+            dirty_bytes_ += job.data.size() - cur.data.size();
+            cur.data = std::move(job.data);
+            cur.base_merged = true;
+            cur.dirty_since = std::chrono::steady_clock::now();
+        }
+    } else {
+        LOG_ERROR("FileManager::flush_stripe: 写回失败, stripe_id=%" PRIu64 "\n",
+                  job.stripe_id);
+    }
+}
+
+bool FileManager::flush_stripe(const std::string &path, uint64_t stripe_index,
+                               std::unique_lock<std::mutex> &lock)
+{
+    // 同一条带同时只允许一个写回，避免新旧两次写回乱序落盘
+    DirtyStripe *ds = nullptr;
+    for (;;) {
+        auto fit = dirty_.find(path);
+        if (fit == dirty_.end()) return true;
+        auto sit = fit->second.find(stripe_index);
+        if (sit == fit->second.end()) return true;
+        ds = &sit->second;
+        if (!ds->flushing) break;
+        dirty_cv_.wait(lock);
+    }
+
+    FlushJob job;
+    begin_flush(*ds, stripe_index, job);
+    lock.unlock();
+
+    bool ok = flush_partial(path, job);
+    if (!ok) {
+        build_flush(path, job);
+        ok = write_stripe(job.stripe_id, job.data);
+    }
+
+    lock.lock();
+    end_flush(path, job, ok);
+    dirty_cv_.notify_all();
+    return ok;
+}
+
+bool FileManager::flush_batch(const std::string &path, const std::vector<uint64_t> &indices,
+                              std::unique_lock<std::mutex> &lock)
+{
+    auto fit = dirty_.find(path);
+    if (fit == dirty_.end()) return true;
+
+    // 不等待正在写回的条带：调用方可能正持有同一批中其他条带的写回
+    std::vector<FlushJob> jobs;
+    jobs.reserve(indices.size());
+    for (uint64_t idx : indices) {
+        auto sit = fit->second.find(idx);
+        if (sit == fit->second.end() || sit->second.flushing) continue;
+        jobs.emplace_back();
+        begin_flush(sit->second, idx, jobs.back());
+    }
+    if (jobs.empty()) return true;
+    lock.unlock();
+
+    std::vector<uint64_t> ids;
+    std::vector<const std::string *> data;
+    for (FlushJob &job : jobs) {
+        if (flush_partial(path, job)) continue;
+        build_flush(path, job);
+        ids.push_back(job.stripe_id);
+        data.push_back(&job.data);
+    }
+    bool ok = ids.empty() || write_stripes(ids, data);
+
+    lock.lock();
+    for (FlushJob &job : jobs) {
+        end_flush(path, job, job.partial || ok);
+    }
+    dirty_cv_.notify_all();
+    return ok;
+}
+
+bool FileManager::enforce_dirty_limit(std::unique_lock<std::mutex> &lock)
+{
+    while (dirty_bytes_ > wb_config_.max_dirty_bytes) {
+        // 找最早变脏且未在写回的条带
+        const std::string *victim_path = nullptr;
+        uint64_t victim_index = 0;
+        std::chrono::steady_clock::time_point oldest = std::chrono::steady_clock::time_point::max();
+        for (const auto &f : dirty_) {
+            for (const auto &st : f.second) {
+                if (!st.second.flushing && st.second.dirty_since < oldest) {
+                    oldest = st.second.dirty_since;
+                    victim_path = &f.first;
+                    victim_index = st.first;
+                }
+            }
+        }
+
+        if (!victim_path) {
+            // 全部都在写回，等待其完成
+            dirty_cv_.wait(lock);
+            continue;
+        }
+
+        std::string path = *victim_path;
+        if (!flush_stripe(path, victim_index, lock)) {
+            return false;
+        }
+    }
     return true;
 }
+
+bool FileManager::flush(const std::string &path)
+{
+    if (!wb_config_.enabled) return true;
+
+    std::unique_lock<std::mutex> lock(dirty_mu_);
+    auto fit = dirty_.find(path);
+    if (fit == dirty_.end()) return true;
+
+    std::vector<uint64_t> indices;
+    for (const auto &st : fit->second) {
+        indices.push_back(st.first);
+    }
+
+    bool ok = true;
+    if (wb_config_.batch_stripes > 1) {
+        for (size_t i = 0; i < indices.size(); i += wb_config_.batch_stripes) {
+            size_t n = std::min<size_t>(wb_config_.batch_stripes, indices.size() - i);
+            std::vector<uint64_t> group(indices.begin() + i, indices.begin() + i + n);
+            if (!flush_batch(path, group, lock)) ok = false;
+        }
+    }
+    // 逐个写回剩余条带（批量写回时正在写回而被跳过的、期间又被写入的）
+    for (uint64_t idx : indices) {
+        if (!flush_stripe(path, idx, lock)) ok = false;
+    }
+    return ok;
+}
+
+bool FileManager::fsync(const std::string &path)
+{
+    if (layout_.pack_max > 0) {
+        std::unique_lock<std::mutex> lock(dirty_mu_);
+        if (pack_pending_.count(path) && !pack_pending(lock, true)) {
+            return false;
+        }
+    }
+    return flush(path);
+}
+
+bool FileManager::close_flush(const std::string &path)
+{
+    if (layout_.pack_max == 0 || meta->get_size(path) > layout_.pack_max) {
+        return flush(path);
+    }
+
+    std::unique_lock<std::mutex> lock(dirty_mu_);
+    if (!packable_locked(path)) {
+        lock.unlock();
+        return flush(path);
+    }
+
+    if (!pack_pending_.count(path)) {
+        uint64_t size = dirty_[path][0].data.size();
+        pack_pending_[path] = PendingPack{ std::chrono::steady_clock::now(), size };
+        pack_pending_bytes_ += size;
+    }
+    // 凑满一个打包条带时立即写入；失败的文件留在写回缓冲中由后台写回重试
+    if (pack_pending_bytes_ >= STRIPE_SIZE) {
+        pack_pending(lock, true);
+    }
+    return true;
+}
+
+bool FileManager::pack_pending(std::unique_lock<std::mutex> &lock, bool force)
+{
+    if (pack_pending_.empty()) return true;
+    if (!force) {
+        auto deadline = std::chrono::steady_clock::now() -
+                        std::chrono::milliseconds(layout_.pack_delay_ms);
+        bool due = false;
+        for (const auto &p : pack_pending_) {
+            if (p.second.closed <= deadline) {
+                due = true;
+                break;
+            }
+        }
+        if (!due) return true;
+    }
+
+    // 有文件到期时全部等待的文件一起打包
+    std::unordered_map<std::string, PendingPack> batch;
+    batch.swap(pack_pending_);
+    pack_pending_bytes_ = 0;
+    std::vector<std::pair<std::string, uint64_t>> stripes;
+    for (const auto &p : batch) {
+        stripes.emplace_back(p.first, 0);
+    }
+
+    std::vector<std::string> deferred;
+    pack_small_files(stripes, lock, force ? nullptr : &deferred);
+    for (const auto &p : deferred) {
+        pack_pending_[p] = batch[p];
+        pack_pending_bytes_ += batch[p].size;
+    }
+
+    // 未打包的文件（只有一个、打包失败或未能获取布局锁）照常写回自己的条带
+    bool ok = true;
+    for (const auto &st : stripes) {
+        if (pack_pending_.count(st.first)) continue;
+        auto fit = dirty_.find(st.first);
+        if (fit == dirty_.end()) continue;
+        std::vector<uint64_t> indices;
+        for (const auto &ds : fit->second) {
+            indices.push_back(ds.first);
+        }
+        for (uint64_t idx : indices) {
+            if (!flush_stripe(st.first, idx, lock)) ok = false;
+        }
+    }
+    return ok;
+}
+
+bool FileManager::flush_all()
+{
+    return flush_dirty(layout_.pack_max > 0);
+}
+
+bool FileManager::flush_dirty(bool pack)
+{
+    if (!wb_config_.enabled) return true;
+
+    std::vector<std::string> paths;
+    {
+        std::unique_lock<std::mutex> lock(dirty_mu_);
+        if (pack) {
+            // 等待打包的文件与其他脏文件一起打包
+            pack_pending_.clear();
+            pack_pending_bytes_ = 0;
+            std::vector<std::pair<std::string, uint64_t>> stripes;
+            for (const auto &f : dirty_) {
+                stripes.emplace_back(f.first, 0);
+            }
+            pack_small_files(stripes, lock);
+        }
+        for (const auto &f : dirty_) {
+            paths.push_back(f.first);
+        }
+    }
+
+    bool ok = true;
+    for (const auto &p : paths) {
+        if (!flush(p)) ok = false;
+    }
+    return ok;
+}
+
+int FileManager::rename(const std::string &old_path, const std::string &new_path, bool is_dir,
+                        const std::function<int()> &rename_meta)
+{
+    // 按槽位顺序加锁，与其他改名不会互等
+    std::vector<size_t> slots;
+    if (is_dir) {
+        for (size_t i = 0; i < LAYOUT_LOCKS; i++) slots.push_back(i);
+    } else {
+        slots = { layout_slot(old_path), layout_slot(new_path) };
+        std::sort(slots.begin(), slots.end());
+        slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+    }
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    for (size_t slot : slots) {
+        locks.emplace_back(layout_mu_[slot]);
+    }
+
+    // 写回缓冲按路径索引，改名前先写回源路径的脏数据
+    // 已持有布局锁，不能再打包（打包要尝试获取布局锁）
+    if (!(is_dir ? flush_dirty(false) : flush(old_path))) {
+        return -EIO;
+    }
+
+    int res = rename_meta();
+    if (res != 0) {
+        return res;
+    }
+
+    // 文件缓存按路径索引，两个路径上的旧页都不再有效（脏数据已在上面写回）
+    discard(old_path);
+    discard(new_path);
+    return 0;
+}
+
+void FileManager::discard(const std::string &path)
+{
+    if (file_cache_) {
+        file_cache_->invalidate(path);
+    }
+
+    if (!wb_config_.enabled) return;
+
+    std::unique_lock<std::mutex> lock(dirty_mu_);
+    auto pit = pack_pending_.find(path);
+    if (pit != pack_pending_.end()) {
+        pack_pending_bytes_ -= pit->second.size;
+        pack_pending_.erase(pit);
+    }
+    for (;;) {
+        auto fit = dirty_.find(path);
+        if (fit == dirty_.end()) return;
+
+        bool busy = false;
+        for (const auto &st : fit->second) {
+            if (st.second.flushing) busy = true;
+        }
+        if (!busy) {
+            for (const auto &st : fit->second) {
+                dirty_bytes_ -= st.second.data.size();
+                clear_fresh(st.second.stripe_id);
+            }
+            dirty_.erase(fit);
+            dirty_cv_.notify_all();
+            return;
+        }
+        dirty_cv_.wait(lock);
+    }
+}
+
+// 后台写回：定期写回停留超过 flush_timeout_ms 的脏条带
+void FileManager::flusher_loop()
+{
+    auto timeout = std::chrono::milliseconds(wb_config_.flush_timeout_ms);
+    auto interval = std::max<std::chrono::milliseconds>(timeout / 4,
+                                                        std::chrono::milliseconds(100));
+    // 关闭的小文件最多等待 pack_delay_ms 后打包
+    if (layout_.pack_max > 0) {
+        interval = std::min(interval, std::max<std::chrono::milliseconds>(
+            std::chrono::milliseconds(layout_.pack_delay_ms / 2), std::chrono::milliseconds(10)));
+    }
+
+    std::unique_lock<std::mutex> lock(dirty_mu_);
+    while (!stop_flusher_) {
+        dirty_cv_.wait_for(lock, interval, [this] { return stop_flusher_; });
+        if (stop_flusher_) break;
+
+        pack_pending(lock, false);
+
+        auto now = std::chrono::steady_clock::now();
+        std::vector<std::pair<std::string, uint64_t>> expired;
+        for (const auto &f : dirty_) {
+            for (const auto &st : f.second) {
+                if (!st.second.flushing && now - st.second.dirty_since >= timeout) {
+                    expired.emplace_back(f.first, st.first);
+                }
+            }
+        }
+
+        // 先把其中的小文件合并写入打包条带，已打包的不再是脏条带；
+        // 未能获取布局锁的小文件留到下一轮重试，多次失败后不再打包（见 packable_locked）
+        std::vector<std::string> deferred;
+        if (layout_.pack_max > 0) {
+            pack_small_files(expired, lock, &deferred);
+        }
+        for (const auto &e : expired) {
+            if (std::find(deferred.begin(), deferred.end(), e.first) != deferred.end()) continue;
+            flush_stripe(e.first, e.second, lock);
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// 小文件打包
+// ------------------------------------------------------------
+bool FileManager::packable_locked(const std::string &path) const
+{
+    if (!wb_config_.enabled) return false;
+    auto fit = dirty_.find(path);
+    if (fit == dirty_.end() || fit->second.size() != 1) return false;
+    auto sit = fit->second.find(0);
+    if (sit == fit->second.end()) return false;
+    const DirtyStripe &ds = sit->second;
+    // 条带尚未写入后端：文件没有已持久化的内容需要保留；
+    // 多次未能获取布局锁的文件照常写回，脏数据停留时间不超过 PACK_LOCK_MISSES 轮后台写回
+    return !ds.flushing && ds.pack_misses < PACK_LOCK_MISSES &&
+           ds.data.size() <= layout_.pack_max && is_fresh_locked(ds.stripe_id);
+}
+
+void FileManager::pack_small_files(const std::vector<std::pair<std::string, uint64_t>> &stripes,
+                                   std::unique_lock<std::mutex> &lock,
+                                   std::vector<std::string> *deferred)
+{
+    std::vector<std::string> paths;
+    for (const auto &st : stripes) {
+        if (st.second == 0 && packable_locked(st.first)) {
+            paths.push_back(st.first);
+        }
+    }
+    // 只有一个文件时打包与直接写回的代价相同
+    if (paths.size() < 2) return;
+    lock.unlock();
+
+    // 按打包条带的容量分组（文件大小可能因截断而大于脏数据）
+    std::vector<std::string> group;
+    std::vector<std::string> missed;
+    uint64_t total = 0;
+    for (const auto &p : paths) {
+        uint64_t size = meta->get_size(p);
+        if (size > layout_.pack_max) continue;
+        if (total + size > STRIPE_SIZE) {
+            pack_group(group, missed);
+            group.clear();
+            total = 0;
+        }
+        group.push_back(p);
+        total += size;
+    }
+    if (group.size() >= 2) {
+        pack_group(group, missed);
+    }
+
+    lock.lock();
+    // 记录未能获取布局锁的次数，仍可打包的文件交给调用方下次重试
+    for (const auto &p : missed) {
+        auto fit = dirty_.find(p);
+        if (fit == dirty_.end()) continue;
+        auto sit = fit->second.find(0);
+        if (sit == fit->second.end()) continue;
+        sit->second.pack_misses++;
+        if (deferred && packable_locked(p)) {
+            deferred->push_back(p);
+        }
+    }
+}
+
+void FileManager::pack_group(const std::vector<std::string> &paths,
+                             std::vector<std::string> &missed)
+{
+    // 独占持有各文件的布局锁，打包期间文件不会被写入、截断或扩展；
+    // 只尝试加锁：持有布局锁的写入可能正在等待 dirty_mu_ 或写回
+    std::vector<size_t> held;
+    std::vector<std::string> locked;
+    for (const auto &p : paths) {
+        size_t slot = layout_slot(p);
+        if (std::find(held.begin(), held.end(), slot) == held.end()) {
+            if (!layout_mu_[slot].try_lock()) {
+                missed.push_back(p);
+                continue;
+            }
+            held.push_back(slot);
+        }
+        locked.push_back(p);
+    }
+
+    std::vector<std::pair<std::string, FlushJob>> jobs;
+    {
+        std::lock_guard<std::mutex> lock(dirty_mu_);
+        for (const auto &p : locked) {
+            if (packable_locked(p)) {
+                jobs.emplace_back(p, FlushJob());
+            }
+        }
+        if (jobs.size() < 2) {
+            jobs.clear();
+        }
+        for (auto &job : jobs) {
+            begin_flush(dirty_[job.first][0], 0, job.second);
+        }
+    }
+
+    if (!jobs.empty()) {
+        // 各文件内容首尾相连写入一个新条带
+        std::string pack;
+        std::vector<uint32_t> offsets;
+        for (auto &job : jobs) {
+            build_flush(job.first, job.second);
+            offsets.push_back((uint32_t)pack.size());
+            pack.append(job.second.data);
+        }
+
+        uint64_t pack_id = raid->allocate_stripes(1);
+        if (disk_cache_) {
+            disk_cache_->invalidate(pack_id);
+        }
+        bool ok = raid->write_chunk(pack_id, 0, pack);
+        if (ok) {
+            if (chunk_cache_) {
+                chunk_cache_->put(pack_id, pack);
+            }
+            // 先记录打包位置再移除脏条带：读取在两者之间都能找到内容
+            for (size_t i = 0; i < jobs.size(); i++) {
+                meta->set_pack(jobs[i].first, pack_id, offsets[i],
+                               (uint32_t)jobs[i].second.data.size());
+            }
+            g_pack_files->add(jobs.size());
+        } else {
+            LOG_ERROR("FileManager: 写入打包条带失败, pack_id=%" PRIu64 "\n", pack_id);
+        }
+
+        std::lock_guard<std::mutex> lock(dirty_mu_);
+        for (auto &job : jobs) {
+            auto &stripes = dirty_[job.first];
+            DirtyStripe &cur = stripes[0];
+            cur.flushing = false;
+            if (!ok) continue;
+            // 持有布局锁期间没有新的写入，脏条带即为刚打包的内容；
+            // 原条带已从文件中移除，不会再被写入
+            dirty_bytes_ -= cur.data.size();
+            clear_fresh(cur.stripe_id);
+            dirty_.erase(job.first);
+        }
+        dirty_cv_.notify_all();
+    }
+
+    for (size_t slot : held) {
+        layout_mu_[slot].unlock();
+    }
+}
+
+// ------------------------------------------------------------
+// 顺序预读
+// ------------------------------------------------------------
+uint64_t FileManager::open_handle(const std::string &path)
+{
+    (void)path;
+
+    std::lock_guard<std::mutex> lock(handles_mu_);
+    uint64_t fh = next_handle_++;
+    handles_[fh] = ReadState();
+    return fh;
+}
+
+void FileManager::close_handle(uint64_t fh)
+{
+    std::lock_guard<std::mutex> lock(handles_mu_);
+    handles_.erase(fh);
+}
+
+// 连续两次顺序读后触发预读；之后每读入一个新条带窗口翻倍，直到 max_window，
+// 出现非顺序读时窗口回到 1
+bool FileManager::readahead(const std::string &path, uint64_t fh,
+                            uint64_t offset, size_t size)
+{
+    if (size == 0) return false;
+
+    // 窗口上限按 4MB 条带配置，其他条带大小的文件换算为相同的字节数
+    uint64_t ss = stripe_size(path);
+    uint64_t max_window = std::max<uint64_t>(1, ra_config_.max_window * STRIPE_SIZE / ss);
+
+    uint64_t last_index = (offset + size - 1) / ss;
+    uint64_t from = 0;
+    uint64_t to = 0;
+    bool sequential = false;
+    {
+        std::lock_guard<std::mutex> lock(handles_mu_);
+        auto it = handles_.find(fh);
+        if (it == handles_.end()) return false;
+        ReadState &st = it->second;
+
+        sequential = offset == st.next_offset;
+        if (sequential) {
+            st.seq_count++;
+        } else {
+            st.seq_count = 0;
+            st.window = 1;
+            st.ra_next = 0;
+        }
+        st.next_offset = offset + size;
+
+        if (!prefetch_pool_ || st.seq_count < 2) return sequential;
+
+        if (last_index != st.cur_index) {
+            st.cur_index = last_index;
+            st.window = std::min<uint64_t>(st.window * 2, max_window);
+        }
+
+        from = std::max(last_index + 1, st.ra_next);
+        to = last_index + st.window;
+        if (from > to) return sequential;
+        st.ra_next = to + 1;
+    }
+
+    // 只预读文件范围内、已写入后端的条带
+    uint64_t file_size = meta->get_size(path);
+    uint64_t end_index = (file_size + ss - 1) / ss;
+    if (from >= end_index) return sequential;
+    std::vector<uint64_t> ids =
+        meta->get_stripe_ids(path, from, std::min(to + 1, end_index) - from);
+
+    std::vector<uint64_t> wanted;
+    for (uint64_t id : ids) {
+        if (!is_fresh(id)) {
+            wanted.push_back(id);
+        }
+    }
+    prefetch_stripes(wanted);
+
+    return sequential;
+}
+
+void FileManager::prefetch_stripes(const std::vector<uint64_t> &stripe_ids)
+{
+    std::vector<uint64_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(prefetch_mu_);
+        for (uint64_t id : stripe_ids) {
+            if (inflight_.count(id) || chunk_cache_->contains(id)) continue;
+            inflight_.insert(id);
+            ids.push_back(id);
+        }
+    }
+    if (ids.empty()) return;
+
+    // 读取前记录失效计数，读取期间条带被写入则放弃放入缓存
+    uint64_t epoch = chunk_cache_->epoch();
+
+    bool queued = prefetch_pool_->try_submit([this, ids, epoch]() {
+        // SSD 缓存命中的条带直接放入，其余一次从 RAID 批量读取
+        uint64_t disk_epoch = disk_cache_ ? disk_cache_->epoch() : 0;
+        std::vector<uint64_t> misses;
+        for (uint64_t id : ids) {
+            std::string cached;
+            if (disk_cache_ && disk_cache_->get(id, cached)) {
+                chunk_cache_->put_prefetched(
+                    id, std::make_shared<const std::string>(std::move(cached)), epoch);
+            } else {
+                misses.push_back(id);
+            }
+        }
+
+        if (!misses.empty()) {
+            // 按内容索引换成存储对象的条带号；全零条带不需要读取
+            std::vector<uint64_t> read_ids;
+            std::vector<size_t> read_of;
+            std::vector<int> kind(misses.size(), 0);   // 0 原样存储，1 存储对象，2 全零
+            for (size_t i = 0; i < misses.size(); i++) {
+                uint64_t phys = 0;
+                if (meta->stripe_ref(misses[i], phys)) {
+                    kind[i] = phys == 0 ? 2 : 1;
+                    if (phys == 0) continue;
+                } else {
+                    phys = misses[i];
+                }
+                read_ids.push_back(phys);
+                read_of.push_back(i);
+            }
+
+            std::vector<std::string> stored;
+            if (!read_ids.empty()) {
+                raid->read_stripes(read_ids, stored);
+            }
+            std::vector<std::string> out(misses.size());
+            std::vector<bool> valid(misses.size(), false);
+            for (size_t j = 0; j < read_ids.size(); j++) {
+                size_t i = read_of[j];
+                if (stored[j].empty()) continue;
+                if (kind[i] == 1) {
+                    valid[i] = DataPipeline::decode(stored[j], out[i]);
+                } else {
+                    out[i].swap(stored[j]);
+                    valid[i] = true;
+                }
+            }
+
+            for (size_t i = 0; i < misses.size(); i++) {
+                if (kind[i] == 2) {
+                    chunk_cache_->put_prefetched(
+                        misses[i], std::make_shared<const std::string>(), epoch);
+                    continue;
+                }
+                if (!valid[i]) continue;
+                auto data = std::make_shared<const std::string>(std::move(out[i]));
+                if (disk_cache_) {
+                    disk_cache_->put_async(misses[i], data, disk_epoch);
+                }
+                chunk_cache_->put_prefetched(misses[i], std::move(data), epoch);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(prefetch_mu_);
+        for (uint64_t id : ids) inflight_.erase(id);
+        prefetch_cv_.notify_all();
+    });
+
+    if (!queued) {
+        std::lock_guard<std::mutex> lock(prefetch_mu_);
+        for (uint64_t id : ids) inflight_.erase(id);
+        prefetch_cv_.notify_all();
+    }
+}
@@ -5,24 +5,103 @@
 #include "metadata_manager.h"
 #include "file_cache.h"
 #include "chunk_cache.h"
+#include "disk_cache.h"
+#include "data_pipeline.h"
+#include "io_thread_pool.h"
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+
+// 写回缓冲配置
+struct WriteBufferConfig {
+    bool enabled = true;                               // 是否启用写回缓冲
+    uint64_t max_dirty_bytes = 256ULL * 1024 * 1024;   // 全局脏数据上限，默认 256MB
+    uint64_t flush_timeout_ms = 5000;                  // 脏条带最长停留时间，默认 5 秒
+    uint64_t batch_stripes = 8;                        // 连续写满的条带攒够该数目后批量写回，1 为逐条带写回
+};
+
+// 顺序预读配置
+struct ReadaheadConfig {
+    bool enabled = true;       // 是否启用顺序预读
+    uint64_t max_window = 8;   // 最大预读窗口（4MB 条带数），默认 8 × 4MB，其他条带大小按字节数换算
+    size_t threads = 4;        // 预读线程数
+};
+
+// 文件布局配置：新文件的条带大小与小文件打包
+// 条带大小在创建文件时确定并记录在元数据中，之后不随配置变化
+struct LayoutConfig {
+    uint64_t stripe_size = 0;      // 新文件的默认条带大小（字节），0 为 FileManager::STRIPE_SIZE
+    // 按路径前缀指定新文件的条带大小（前缀, 字节），最长的匹配前缀优先
+    std::vector<std::pair<std::string, uint64_t>> rules;
+    // 不超过此大小的新文件关闭后留在写回缓冲中，与同期关闭的小文件合并写入共享的打包条带，
+    // 0 关闭（需启用写回缓冲）
+    uint64_t pack_max = 0;
+    // 关闭的小文件等待打包的最长时间（毫秒），等待的文件凑满一个打包条带或 fsync 时立即写入
+    uint64_t pack_delay_ms = 1000;
+};
 
 class FileManager {
 public:
+    // 未设置条带大小的文件（包括此前创建的所有文件）使用的条带大小
     static const uint64_t STRIPE_SIZE = 4ULL * 1024 * 1024; // 4 MiB
 
+    // 可配置的条带大小范围，须为 MIN_STRIPE_SIZE 的整数倍
+    static const uint64_t MIN_STRIPE_SIZE = 64ULL * 1024;          // 64 KiB
+    static const uint64_t MAX_STRIPE_SIZE = 64ULL * 1024 * 1024;   // 64 MiB
+    static const uint64_t MAX_PACK_FILE_SIZE = MIN_STRIPE_SIZE;    // pack_max 上限（一个条带内）
+
+    static bool valid_stripe_size(uint64_t stripe_size);
+
     FileManager(std::shared_ptr<RAIDChunkStore> raid_store,
                 std::shared_ptr<MetadataManager> meta_mgr,
                 std::shared_ptr<FileCache> file_cache = nullptr,
-                std::shared_ptr<ChunkCache> chunk_cache = nullptr);
+                std::shared_ptr<ChunkCache> chunk_cache = nullptr,
+                const WriteBufferConfig &wb_config = WriteBufferConfig(),
+                const ReadaheadConfig &ra_config = ReadaheadConfig(),
+                std::shared_ptr<DiskCache> disk_cache = nullptr,
+                const DataPipelineConfig &dp_config = DataPipelineConfig(),
+                const LayoutConfig &layout_config = LayoutConfig());
+    ~FileManager();
+
+    // 新建文件后调用：按配置规则设置条带大小
+    void init_layout(const std::string &path);
+
+    // 文件的条带大小
+    uint64_t stripe_size(const std::string &path);
+
+    // 修改条带大小（如经由 xattr）：文件已有数据时返回 false
+    bool set_stripe_size(const std::string &path, uint64_t stripe_size);
+
+    // 打开文件句柄（用于按句柄识别顺序读），返回非 0 句柄号
+    uint64_t open_handle(const std::string &path);
+    void close_handle(uint64_t fh);
 
     // 读取 [offset, offset+size)
+    // fh: open_handle 返回的句柄，非 0 时参与顺序读识别与预读
     bool read(const std::string &path,
               uint64_t offset,
               size_t size,
-              std::string &out);
+              std::string &out,
+              uint64_t fh = 0);
+
+    // 读取 [offset, offset+size) 直接写入 buf（至少 size 字节）
+    // 缓存命中时只复制一次请求的范围；bytes_read 返回实际读取长度
+    bool read_into(const std::string &path,
+                   uint64_t offset,
+                   size_t size,
+                   char *buf,
+                   size_t &bytes_read,
+                   uint64_t fh = 0);
 
     // 写入 [offset, offset+size)
     bool write(const std::string &path,
@@ -36,23 +115,277 @@ public:
     // 截断文件
     bool truncate(const std::string &path, uint64_t new_size);
 
+    // 预分配 [offset, offset+length) 所需的条带（一次分配为一段连续条带）
+    // keep_size 为 false 时把文件大小扩展到 offset+length
+    bool fallocate(const std::string &path, uint64_t offset, uint64_t length, bool keep_size);
+
+    // 把文件的脏条带写回 RAID（fsync、改名与截断前调用）
+    bool flush(const std::string &path);
+
+    // 同步文件（fsync 时调用）：文件在等待打包时先把全部等待的小文件写入打包条带，再同 flush
+    bool fsync(const std::string &path);
+
+    // 关闭文件时写回（flush / release 时调用）：可以打包的小文件留在写回缓冲中，
+    // 最多等待 pack_delay_ms 后与同期关闭的小文件一起写入打包条带，其余文件同 flush
+    bool close_flush(const std::string &path);
+
+    // 写回所有文件的脏条带（卸载前调用）
+    bool flush_all();
+
+    // 元数据保留条带（0-99）的直接读写，不经过写回缓冲与各级缓存
+    bool read_meta_stripe(uint64_t stripe_id, std::string &out);
+    // 并发读取多个条带，out 与 stripe_ids 一一对应，失败的项为空字符串；全部成功才返回 true
+    bool read_meta_stripes(const std::vector<uint64_t> &stripe_ids, std::vector<std::string> &out);
+    bool write_meta_stripe(uint64_t stripe_id, const std::string &data);
+
+    // 为元数据检查点分配 / 释放普通条带
+    // 分配的条带号不小于 min_id（元数据中已使用的最大条带号 + 1）
+    uint64_t allocate_meta_stripe(uint64_t min_id);
+    bool delete_meta_stripe(uint64_t stripe_id);
+
+    // 删除不再被引用的数据条带（内容索引释放的存储对象）
+    bool delete_data_stripe(uint64_t stripe_id);
+
+    // 丢弃文件的脏条带与文件缓存（文件被删除、路径被覆盖时调用）
+    void discard(const std::string &path);
+
+    // 改名：先写回源路径（目录则写回全部）的脏数据，再由 rename_meta 修改元数据
+    // （返回 0 或负的 errno），最后丢弃两个路径的缓存
+    // 整个过程独占两个路径（目录则全部路径）的布局锁，期间的写入等待改名完成，
+    // 不会在写回之后写入缓冲、又被丢弃
+    int rename(const std::string &old_path, const std::string &new_path, bool is_dir,
+               const std::function<int()> &rename_meta);
+
 private:
     std::shared_ptr<RAIDChunkStore> raid;
     std::shared_ptr<MetadataManager> meta;
     std::shared_ptr<FileCache> file_cache_;
     std::shared_ptr<ChunkCache> chunk_cache_;
+    std::shared_ptr<DiskCache> disk_cache_;
+
+    // 条带数据管线（去重 / 压缩）
+    DataPipeline pipeline_;
+
+    LayoutConfig layout_;
+
+    // 布局锁：打包、拆包与修改条带大小时独占持有，写入、截断与预分配时共享持有；
+    // 读取不持有：打包与拆包都先写入新位置、再切换元数据，读取总能看到完整内容
+    // 按路径哈希分成多把锁，打包只阻塞同一组路径上的写入
+    static const size_t LAYOUT_LOCKS = 64;
+    std::shared_mutex layout_mu_[LAYOUT_LOCKS];
+
+    size_t layout_slot(const std::string &path) const;
+
+    // 写回全部脏数据，pack 为 true 时先合并打包小文件
+    bool flush_dirty(bool pack);
+
+    // 小文件打包：只有一个尚未写入后端的脏条带、大小不超过 pack_max 的文件
+    // 在后台写回时合并写入一个新的打包条带，之后文件不再有自己的条带
+    // 调用方持有 dirty_mu_（期间会释放），stripes 为待写回的脏条带，未打包的留给调用方写回
+    // deferred 非空时收集因未能获取布局锁而跳过、仍可在下次重试打包的文件
+    void pack_small_files(const std::vector<std::pair<std::string, uint64_t>> &stripes,
+                          std::unique_lock<std::mutex> &lock,
+                          std::vector<std::string> *deferred = nullptr);
+
+    // 把等待打包的小文件合并写入打包条带，未打包的照常写回
+    // 调用方持有 dirty_mu_（期间会释放）；force 为 false 时只在有文件等待超过
+    // pack_delay_ms 时执行，未能获取布局锁的文件留到下次重试
+    bool pack_pending(std::unique_lock<std::mutex> &lock, bool force);
+
+    // 把一组文件写入同一个打包条带（不持有 dirty_mu_），未能获取布局锁的文件追加到 missed
+    void pack_group(const std::vector<std::string> &paths, std::vector<std::string> &missed);
+
+    // dirty_mu_ 下判断文件是否可以打包（不检查文件大小）
+    bool packable_locked(const std::string &path) const;
+
+    // 把打包存放的文件写回自己的条带并清除打包位置（调用方独占持有布局锁）
+    bool unpack(const std::string &path);
+
+    // 文件打包存放时把 [offset, offset+len) 复制到 dst 并返回 true
+    bool copy_packed(const std::string &path, uint64_t offset, size_t len, char *dst);
+
+    // 按条带写入 [offset, offset+size)（调用方共享持有布局锁）
+    bool write_striped(const std::string &path, uint64_t offset,
+                       const char *data, size_t size);
 
     // 根据 offset 找到 stripe_id（不存在则自动扩展）
     uint64_t ensure_stripe(const std::string &path, uint64_t stripe_index);
 
-    // 读取单个 stripe（带 chunk 缓存）
-    bool read_stripe(uint64_t stripe_id, std::string &out);
+    // 把文件的条带数扩展到至少 count 个，新条带为一段连续条带
+    // 并发扩展同一文件时不会重复分配
+    void extend_stripes(const std::string &path, uint64_t count);
+
+    // 读取单个 stripe（带 chunk 缓存），out 至少补齐到 stripe_size
+    bool read_stripe(uint64_t stripe_id, uint64_t stripe_size, std::string &out);
+
+    // 读取单个 stripe，返回与 chunk 缓存共享的缓冲区
+    // 长度可能小于条带大小（尾部条带 / 读取失败），超出部分视为 0
+    // record_access: 命中时是否计入缓存淘汰策略的访问频率
+    std::shared_ptr<const std::string> read_stripe_shared(uint64_t stripe_id,
+                                                          bool record_access = true);
+
+    // 绕过内存缓存读取 stripe：先查 SSD 缓存，未命中再读 RAID 并异步写入 SSD 缓存
+    // 读取失败返回 nullptr
+    std::shared_ptr<const std::string> fetch_stripe(uint64_t stripe_id);
+
+    // 从 RAID 读取条带内容：按内容索引找到存储对象并解码，没有引用时直接读取同号条带
+    bool read_stored_stripe(uint64_t stripe_id, std::string &out);
+
+    // 经数据管线写入一批条带：全零与重复内容只记录引用，其余编码后写入新分配的存储对象
+    bool store_stripes(const std::vector<uint64_t> &stripe_ids,
+                       const std::vector<const std::string *> &data);
 
     // 写入单个 stripe（同时更新 chunk 缓存）
     bool write_stripe(uint64_t stripe_id, const std::string &data);
 
-    // 从后端读取完整文件（用于文件缓存）
-    bool read_full_file(const std::string &path, std::string &out);
+    // 原地增量更新条带中的若干区间（条带长度 length 不变，同时修补 chunk 缓存）
+    // 经数据管线存储的条带、区间过多或 RAID 层不支持时返回 false，调用方改为整条带写入
+    bool update_stripe(uint64_t stripe_id, uint64_t length,
+                       const std::vector<std::pair<uint64_t, std::string>> &pieces);
+
+    // 批量写入多个 stripe（同时更新 chunk 缓存）
+    bool write_stripes(const std::vector<uint64_t> &stripe_ids,
+                       const std::vector<const std::string *> &data);
+
+    // 逐条带读取 [offset, offset+size) 到 buf（范围须在文件大小以内）
+    // sequential: 是否为顺序读（影响缓存访问频率的记录）
+    void read_stripes(const std::string &path, uint64_t offset, size_t size,
+                      char *buf, bool sequential);
+
+    // 读取文件第 stripe_index 个条带的当前内容（叠加未写回的脏数据）
+    void load_stripe(const std::string &path, uint64_t stripe_index,
+                     uint64_t stripe_size, std::string &out);
+
+    // 把第 stripe_index 个条带的 [stripe_offset, stripe_offset+len) 复制到 dst
+    void copy_stripe_range(const std::string &path, uint64_t stripe_index,
+                           uint64_t stripe_size, uint64_t stripe_offset, size_t len,
+                           char *dst, bool record_access = true);
+
+    // 直接写穿：读旧条带 → 覆盖 → 写回（未启用写回缓冲时使用）
+    bool write_through(const std::string &path, uint64_t stripe_index,
+                       uint64_t stripe_id, uint64_t stripe_size, uint64_t stripe_offset,
+                       const char *data, size_t size);
+
+    // 条带实际需要写入的长度：不超过文件在该条带内的末尾，尾条带不补齐到条带大小
+    uint64_t stripe_write_length(const std::string &path, uint64_t stripe_index,
+                                 uint64_t stripe_size, uint64_t min_length);
+
+    // 新分配、尚未写入后端的条带：内容必然全 0，读写时无需读取后端
+    // 按连续区间记录 first -> end，由 dirty_mu_ 保护
+    std::map<uint64_t, uint64_t> fresh_stripes_;
+
+    bool is_fresh(uint64_t stripe_id);
+
+    // 以下两个函数假设已持有 dirty_mu_
+    bool is_fresh_locked(uint64_t stripe_id) const;
+    void clear_fresh(uint64_t stripe_id);
+
+    // ---------------- 写回缓冲 ----------------
+    // 一个脏条带：data 从条带起点开始，长度为已写入的最大结束位置
+    // ranges 记录已写入的区间 [begin, end)（有序、不重叠），区间外的内容以后端为准
+    struct DirtyStripe {
+        uint64_t stripe_id = 0;
+        uint64_t stripe_size = 0;
+        std::string data;
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+        bool base_merged = false;  // data 已合并后端旧内容，区间外也有效
+        uint64_t generation = 0;   // 每次写入递增，用于识别写回期间的新写入
+        bool flushing = false;
+        uint32_t pack_misses = 0;  // 后台打包时未能获取布局锁的次数
+        std::chrono::steady_clock::time_point dirty_since;
+    };
+
+    WriteBufferConfig wb_config_;
+
+    // path -> (stripe_index -> 脏条带)
+    std::unordered_map<std::string, std::map<uint64_t, DirtyStripe>> dirty_;
+    uint64_t dirty_bytes_ = 0;
+    std::mutex dirty_mu_;
+    std::condition_variable dirty_cv_;
+
+    std::thread flusher_;
+    bool stop_flusher_ = false;
+
+    // 已关闭、等待打包的小文件（dirty_mu_ 保护）
+    struct PendingPack {
+        std::chrono::steady_clock::time_point closed;
+        uint64_t size = 0;
+    };
+    std::unordered_map<std::string, PendingPack> pack_pending_;
+    uint64_t pack_pending_bytes_ = 0;
+
+    void flusher_loop();
+
+    // 把数据写入脏条带，条带被完整覆盖时立即写回
+    bool buffer_write(const std::string &path, uint64_t stripe_index,
+                      uint64_t stripe_id, uint64_t stripe_size, uint64_t stripe_offset,
+                      const char *data, size_t size);
+
+    // 一次写回：开始时从脏条带取出的快照，整理为最终写入的条带内容
+    struct FlushJob {
+        uint64_t stripe_index = 0;
+        uint64_t stripe_id = 0;
+        uint64_t stripe_size = 0;
+        uint64_t generation = 0;
+        bool fresh = false;
+        bool complete = false;
+        bool partial = false;      // 已按脏区间增量更新，data 不是完整条带内容
+        std::string data;
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    };
+
+    // 标记脏条带为写回中并取快照（持有 dirty_mu_）
+    void begin_flush(DirtyStripe &ds, uint64_t stripe_index, FlushJob &job);
+    // 部分覆盖的条带先尝试增量更新（不持有 dirty_mu_），成功时置 job.partial
+    bool flush_partial(const std::string &path, FlushJob &job);
+    // 补齐旧内容、截到写入长度（不持有 dirty_mu_）
+    void build_flush(const std::string &path, FlushJob &job);
+    // 写回结束：清除或保留脏条带（持有 dirty_mu_）
+    void end_flush(const std::string &path, FlushJob &job, bool ok);
+
+    // 写回一个脏条带（调用方持有 dirty_mu_，期间会临时释放）
+    bool flush_stripe(const std::string &path, uint64_t stripe_index,
+                      std::unique_lock<std::mutex> &lock);
+
+    // 把多个脏条带作为一批写回（调用方持有 dirty_mu_，期间会临时释放）
+    // 正在写回的条带被跳过，由调用方决定是否再逐个写回
+    bool flush_batch(const std::string &path, const std::vector<uint64_t> &indices,
+                     std::unique_lock<std::mutex> &lock);
+
+    // 脏数据超过上限时，从最旧的条带开始写回
+    bool enforce_dirty_limit(std::unique_lock<std::mutex> &lock);
+
+    static bool covers_full_stripe(const DirtyStripe &ds);
+
+    // ---------------- 顺序预读 ----------------
+    // 每个句柄的顺序读状态
+    struct ReadState {
+        uint64_t next_offset = 0;   // 期望的下一次读取位置
+        uint32_t seq_count = 0;     // 连续顺序读次数
+        uint64_t window = 1;        // 当前预读窗口（条带数）
+        uint64_t cur_index = 0;     // 最近一次读取所在的条带
+        uint64_t ra_next = 0;       // 下一个尚未发起预读的条带
+    };
+
+    ReadaheadConfig ra_config_;
+
+    std::unordered_map<uint64_t, ReadState> handles_;
+    uint64_t next_handle_ = 1;
+    std::mutex handles_mu_;
+
+    // 预读中的条带，正常读取遇到时等待预读完成而不是重复读取
+    std::unordered_set<uint64_t> inflight_;
+    std::mutex prefetch_mu_;
+    std::condition_variable prefetch_cv_;
+    std::unique_ptr<IOThreadPool> prefetch_pool_;
+
+    // 顺序读识别：触发后异步预读后续窗口内的条带
+    // 返回本次读取是否紧接上一次读取（顺序读）
+    bool readahead(const std::string &path, uint64_t fh,
+                   uint64_t offset, size_t size);
+
+    // 预读一组条带：跳过已缓存 / 预读中的条带，其余作为一个任务批量读取
+    void prefetch_stripes(const std::vector<uint64_t> &stripe_ids);
 };
 
 #endif // FILE_MANAGER_H
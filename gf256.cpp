@@ -0,0 +1,289 @@
+#include "gf256.h"
+#include <cstring>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GF_HAVE_X86 1
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define GF_HAVE_NEON 1
+#endif
+
+// 完整乘法表（64KB，仅用于单字节乘法和标量尾部）
+static uint8_t gf_mul_table[256][256];
+static uint8_t gf_inv_table[256];
+
+// 拆分表：c * x = lo[c][x & 0xF] ^ hi[c][x >> 4]
+alignas(64) static uint8_t gf_lo_table[256][16];
+alignas(64) static uint8_t gf_hi_table[256][16];
+
+// 区域内核：accumulate = true 时结果异或进 dst
+typedef void (*gf_region_fn)(uint8_t c, const uint8_t *src, uint8_t *dst,
+                             size_t len, bool accumulate);
+
+static gf_region_fn gf_region_kernel = nullptr;
+static const char *gf_region_kernel_name = "scalar";
+static std::once_flag gf_once;
+
+// ------------------------------------------------------------
+// 标量内核
+// ------------------------------------------------------------
+static void gf_region_scalar(uint8_t c, const uint8_t *src, uint8_t *dst,
+                             size_t len, bool accumulate)
+{
+    const uint8_t *row = gf_mul_table[c];
+    if (accumulate) {
+        for (size_t i = 0; i < len; i++) dst[i] ^= row[src[i]];
+    } else {
+        for (size_t i = 0; i < len; i++) dst[i] = row[src[i]];
+    }
+}
+
+// ------------------------------------------------------------
+// x86 SIMD 内核（通过 target 属性编译，运行时按 CPU 特性分发）
+// ------------------------------------------------------------
+#ifdef GF_HAVE_X86
+
+__attribute__((target("ssse3")))
+static void gf_region_ssse3(uint8_t c, const uint8_t *src, uint8_t *dst,
+                            size_t len, bool accumulate)
+{
+    const __m128i tlo  = _mm_load_si128((const __m128i *)gf_lo_table[c]);
+    const __m128i thi  = _mm_load_si128((const __m128i *)gf_hi_table[c]);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i l = _mm_and_si128(s, mask);
+        __m128i h = _mm_and_si128(_mm_srli_epi64(s, 4), mask);
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(tlo, l),
+                                  _mm_shuffle_epi8(thi, h));
+        if (accumulate) {
+            p = _mm_xor_si128(p, _mm_loadu_si128((const __m128i *)(dst + i)));
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), p);
+    }
+    gf_region_scalar(c, src + i, dst + i, len - i, accumulate);
+}
+
+__attribute__((target("avx2")))
+static void gf_region_avx2(uint8_t c, const uint8_t *src, uint8_t *dst,
+                           size_t len, bool accumulate)
+{
+    const __m256i tlo = _mm256_broadcastsi128_si256(
+        _mm_load_si128((const __m128i *)gf_lo_table[c]));
+    const __m256i thi = _mm256_broadcastsi128_si256(
+        _mm_load_si128((const __m128i *)gf_hi_table[c]));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i l = _mm256_and_si256(s, mask);
+        __m256i h = _mm256_and_si256(_mm256_srli_epi64(s, 4), mask);
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, l),
+                                     _mm256_shuffle_epi8(thi, h));
+        if (accumulate) {
+            p = _mm256_xor_si256(p, _mm256_loadu_si256((const __m256i *)(dst + i)));
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i), p);
+    }
+    gf_region_scalar(c, src + i, dst + i, len - i, accumulate);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void gf_region_avx512(uint8_t c, const uint8_t *src, uint8_t *dst,
+                             size_t len, bool accumulate)
+{
+    // broadcast / 移位使用全 1 掩码的零掩码版本：结果相同，而 GCC 的无掩码版本
+    // 以未初始化向量为合并源，-Wall 下报 -Wmaybe-uninitialized
+    const __m512i tlo = _mm512_maskz_broadcast_i32x4((__mmask16)0xFFFF,
+        _mm_load_si128((const __m128i *)gf_lo_table[c]));
+    const __m512i thi = _mm512_maskz_broadcast_i32x4((__mmask16)0xFFFF,
+        _mm_load_si128((const __m128i *)gf_hi_table[c]));
+    const __m512i mask = _mm512_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i s = _mm512_loadu_si512((const void *)(src + i));
+        __m512i l = _mm512_and_si512(s, mask);
+        __m512i h = _mm512_and_si512(_mm512_maskz_srli_epi64((__mmask8)0xFF, s, 4), mask);
+        __m512i p = _mm512_xor_si512(_mm512_shuffle_epi8(tlo, l),
+                                     _mm512_shuffle_epi8(thi, h));
+        if (accumulate) {
+            p = _mm512_xor_si512(p, _mm512_loadu_si512((const void *)(dst + i)));
+        }
+        _mm512_storeu_si512((void *)(dst + i), p);
+    }
+    gf_region_scalar(c, src + i, dst + i, len - i, accumulate);
+}
+
+#endif // GF_HAVE_X86
+
+// ------------------------------------------------------------
+// ARM NEON 内核（aarch64 上 NEON 必然可用，无需运行时检测）
+// ------------------------------------------------------------
+#ifdef GF_HAVE_NEON
+
+static void gf_region_neon(uint8_t c, const uint8_t *src, uint8_t *dst,
+                           size_t len, bool accumulate)
+{
+    const uint8x16_t tlo  = vld1q_u8(gf_lo_table[c]);
+    const uint8x16_t thi  = vld1q_u8(gf_hi_table[c]);
+    const uint8x16_t mask = vdupq_n_u8(0x0F);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t s = vld1q_u8(src + i);
+        uint8x16_t p = veorq_u8(vqtbl1q_u8(tlo, vandq_u8(s, mask)),
+                                vqtbl1q_u8(thi, vshrq_n_u8(s, 4)));
+        if (accumulate) {
+            p = veorq_u8(p, vld1q_u8(dst + i));
+        }
+        vst1q_u8(dst + i, p);
+    }
+    gf_region_scalar(c, src + i, dst + i, len - i, accumulate);
+}
+
+#endif // GF_HAVE_NEON
+
+// ------------------------------------------------------------
+// 初始化
+// ------------------------------------------------------------
+static void gf_init_once()
+{
+    for (int a = 0; a < 256; a++) {
+        for (int b = 0; b < 256; b++) {
+            uint8_t x = 0;
+            uint8_t aa = (uint8_t)a;
+            uint8_t bb = (uint8_t)b;
+            while (bb) {
+                if (bb & 1U) x ^= aa;
+                bool hi = (aa & 0x80U) != 0;
+                aa <<= 1;
+                if (hi) aa ^= 0x1D; // x^8 + x^4 + x^3 + x^2 + 1
+                bb >>= 1;
+            }
+            gf_mul_table[a][b] = x;
+        }
+    }
+
+    gf_inv_table[0] = 0;
+    for (int a = 1; a < 256; a++) {
+        for (int b = 1; b < 256; b++) {
+            if (gf_mul_table[a][b] == 1) {
+                gf_inv_table[a] = (uint8_t)b;
+                break;
+            }
+        }
+    }
+
+    for (int c = 0; c < 256; c++) {
+        for (int x = 0; x < 16; x++) {
+            gf_lo_table[c][x] = gf_mul_table[c][x];
+            gf_hi_table[c][x] = gf_mul_table[c][x << 4];
+        }
+    }
+
+    gf_region_kernel = gf_region_scalar;
+    gf_region_kernel_name = "scalar";
+
+#ifdef GF_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        gf_region_kernel = gf_region_avx512;
+        gf_region_kernel_name = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        gf_region_kernel = gf_region_avx2;
+        gf_region_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("ssse3")) {
+        gf_region_kernel = gf_region_ssse3;
+        gf_region_kernel_name = "ssse3";
+    }
+#endif
+
+#ifdef GF_HAVE_NEON
+    gf_region_kernel = gf_region_neon;
+    gf_region_kernel_name = "neon";
+#endif
+}
+
+void gf_init()
+{
+    std::call_once(gf_once, gf_init_once);
+}
+
+uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+    return gf_mul_table[a][b];
+}
+
+uint8_t gf_inv(uint8_t a)
+{
+    return gf_inv_table[a];
+}
+
+void gf_mul_region(uint8_t c, const uint8_t *src, uint8_t *dst, size_t len)
+{
+    gf_init();
+    if (c == 0) {
+        std::memset(dst, 0, len);
+        return;
+    }
+    if (c == 1) {
+        if (dst != src) std::memmove(dst, src, len);
+        return;
+    }
+    gf_region_kernel(c, src, dst, len, false);
+}
+
+void gf_mul_add_region(uint8_t c, const uint8_t *src, uint8_t *dst, size_t len)
+{
+    gf_init();
+    if (c == 0) return;
+    gf_region_kernel(c, src, dst, len, true);
+}
+
+const char *gf_kernel_name()
+{
+    gf_init();
+    return gf_region_kernel_name;
+}
+
+bool gf_set_kernel(const char *name)
+{
+    gf_init();
+
+    gf_region_fn fn = nullptr;
+    if (!std::strcmp(name, "scalar")) {
+        fn = gf_region_scalar;
+        name = "scalar";
+    }
+#ifdef GF_HAVE_X86
+    else if (!std::strcmp(name, "avx512") && __builtin_cpu_supports("avx512bw")) {
+        fn = gf_region_avx512;
+        name = "avx512";
+    } else if (!std::strcmp(name, "avx2") && __builtin_cpu_supports("avx2")) {
+        fn = gf_region_avx2;
+        name = "avx2";
+    } else if (!std::strcmp(name, "ssse3") && __builtin_cpu_supports("ssse3")) {
+        fn = gf_region_ssse3;
+        name = "ssse3";
+    }
+#endif
+#ifdef GF_HAVE_NEON
+    else if (!std::strcmp(name, "neon")) {
+        fn = gf_region_neon;
+        name = "neon";
+    }
+#endif
+    if (!fn) return false;
+
+    gf_region_kernel = fn;
+    gf_region_kernel_name = name;
+    return true;
+}
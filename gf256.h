@@ -0,0 +1,35 @@
+#ifndef GF256_H
+#define GF256_H
+
+#include <cstdint>
+#include <cstddef>
+
+// GF(256) 运算
+// 本原多项式 x^8 + x^4 + x^3 + x^2 + 1 (0x11D)
+//
+// 除单字节乘法/求逆外，提供按区域（整块内存）批量运算的内核：
+//   - 标量：按常数取 256 字节乘法表行查表
+//   - SSSE3 / AVX2 / AVX-512BW / NEON：高低半字节拆表 + pshufb/tbl
+// 首次调用 gf_init() 时按运行时 CPU 特性选择最快的内核
+
+// 初始化乘法表与内核选择（线程安全，可重复调用）
+// 区域运算会自行初始化；单字节 gf_mul / gf_inv 之前须调用过一次
+void gf_init();
+
+uint8_t gf_mul(uint8_t a, uint8_t b);
+uint8_t gf_inv(uint8_t a);
+
+// dst[i] = c * src[i]
+void gf_mul_region(uint8_t c, const uint8_t *src, uint8_t *dst, size_t len);
+
+// dst[i] ^= c * src[i]
+void gf_mul_add_region(uint8_t c, const uint8_t *src, uint8_t *dst, size_t len);
+
+// 当前使用的内核名称（"avx512" / "avx2" / "ssse3" / "neon" / "scalar"）
+const char *gf_kernel_name();
+
+// 强制使用指定内核（用于基准测试对比），CPU 不支持或未编译时返回 false
+// 不能与正在进行的区域运算并发调用
+bool gf_set_kernel(const char *name);
+
+#endif // GF256_H
@@ -0,0 +1,218 @@
+#include "inode_table.h"
+#include <vector>
+#include <mutex>
+
+InodeTable::InodeTable() {
+    Node root;
+    root.parent = ROOT;
+    nodes_[ROOT] = root;
+}
+
+uint64_t InodeTable::lookup(uint64_t parent, const std::string& name) {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+
+    auto pit = nodes_.find(parent);
+    if (pit == nodes_.end()) {
+        return 0;
+    }
+
+    auto& kids = children_[parent];
+    auto it = kids.find(name);
+    if (it != kids.end()) {
+        nodes_[it->second].nlookup++;
+        return it->second;
+    }
+
+    uint64_t ino = next_ino_++;
+    Node node;
+    node.parent = parent;
+    node.name = name;
+    node.nlookup = 1;
+    nodes_[ino] = std::move(node);
+    kids[name] = ino;
+    return ino;
+}
+
+uint64_t InodeTable::find(uint64_t parent, const std::string& name) const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+
+    auto pit = children_.find(parent);
+    if (pit == children_.end()) {
+        return 0;
+    }
+    auto it = pit->second.find(name);
+    return it == pit->second.end() ? 0 : it->second;
+}
+
+void InodeTable::forget(uint64_t ino, uint64_t n) {
+    if (ino == ROOT) {
+        return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mu_);
+
+    auto it = nodes_.find(ino);
+    if (it == nodes_.end()) {
+        return;
+    }
+    it->second.nlookup = n >= it->second.nlookup ? 0 : it->second.nlookup - n;
+    try_release(ino);
+}
+
+bool InodeTable::path(uint64_t ino, std::string& out) const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    return path_nolock(ino, out);
+}
+
+bool InodeTable::child_path(uint64_t parent, const std::string& name, std::string& out) const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+
+    if (!path_nolock(parent, out)) {
+        return false;
+    }
+    if (out.size() > 1) {
+        out += '/';
+    }
+    out += name;
+    return true;
+}
+
+void InodeTable::rename(uint64_t parent, const std::string& name,
+                        uint64_t new_parent, const std::string& new_name) {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+
+    auto pit = children_.find(parent);
+    if (pit == children_.end()) {
+        return;
+    }
+    auto it = pit->second.find(name);
+    if (it == pit->second.end()) {
+        // 源路径从未被 lookup，只需摘除目标位置的旧 inode
+        auto npit = children_.find(new_parent);
+        if (npit != children_.end()) {
+            auto nit = npit->second.find(new_name);
+            if (nit != npit->second.end()) {
+                detach(nit->second);
+            }
+        }
+        return;
+    }
+
+    uint64_t ino = it->second;
+    pit->second.erase(it);
+    if (pit->second.empty()) {
+        children_.erase(pit);
+    }
+
+    auto& kids = children_[new_parent];
+    auto nit = kids.find(new_name);
+    if (nit != kids.end()) {
+        uint64_t old = nit->second;
+        kids.erase(nit);
+        Node& o = nodes_[old];
+        o.parent = 0;
+        try_release(old);
+    }
+
+    Node& node = nodes_[ino];
+    node.parent = new_parent;
+    node.name = new_name;
+    children_[new_parent][new_name] = ino;
+
+    // 源目录可能因此不再有子节点
+    try_release(parent);
+}
+
+void InodeTable::unlink(uint64_t parent, const std::string& name) {
+    std::unique_lock<std::shared_mutex> lock(mu_);
+
+    auto pit = children_.find(parent);
+    if (pit == children_.end()) {
+        return;
+    }
+    auto it = pit->second.find(name);
+    if (it == pit->second.end()) {
+        return;
+    }
+    detach(it->second);
+}
+
+size_t InodeTable::size() const {
+    std::shared_lock<std::shared_mutex> lock(mu_);
+    return nodes_.size();
+}
+
+// ------------------------------------------------------------
+// 内部函数
+// ------------------------------------------------------------
+
+void InodeTable::detach(uint64_t ino) {
+    auto it = nodes_.find(ino);
+    if (it == nodes_.end() || it->second.parent == 0) {
+        return;
+    }
+
+    uint64_t parent = it->second.parent;
+    auto pit = children_.find(parent);
+    if (pit != children_.end()) {
+        pit->second.erase(it->second.name);
+        if (pit->second.empty()) {
+            children_.erase(pit);
+        }
+    }
+    it->second.parent = 0;
+
+    try_release(ino);
+    try_release(parent);
+}
+
+void InodeTable::try_release(uint64_t ino) {
+    // 释放一个表项后其父目录也可能满足释放条件
+    while (ino != ROOT) {
+        auto it = nodes_.find(ino);
+        if (it == nodes_.end() || it->second.nlookup > 0 || children_.count(ino)) {
+            return;
+        }
+
+        uint64_t parent = it->second.parent;
+        if (parent != 0) {
+            auto pit = children_.find(parent);
+            if (pit != children_.end()) {
+                pit->second.erase(it->second.name);
+                if (pit->second.empty()) {
+                    children_.erase(pit);
+                }
+            }
+        }
+        nodes_.erase(it);
+
+        if (parent == 0) {
+            return;
+        }
+        ino = parent;
+    }
+}
+
+bool InodeTable::path_nolock(uint64_t ino, std::string& out) const {
+    out.clear();
+    if (ino == ROOT) {
+        out = "/";
+        return true;
+    }
+
+    std::vector<const std::string*> names;
+    while (ino != ROOT) {
+        auto it = nodes_.find(ino);
+        if (it == nodes_.end() || it->second.parent == 0) {
+            return false;
+        }
+        names.push_back(&it->second.name);
+        ino = it->second.parent;
+    }
+
+    for (auto rit = names.rbegin(); rit != names.rend(); ++rit) {
+        out += '/';
+        out += **rit;
+    }
+    return true;
+}
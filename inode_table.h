@@ -0,0 +1,67 @@
+#ifndef INODE_TABLE_H
+#define INODE_TABLE_H
+
+#include <string>
+#include <unordered_map>
+#include <shared_mutex>
+#include <cstdint>
+
+// inode 号表（低层 FUSE 接口使用）
+// - 根目录固定为 1，其余 inode 号在内核首次 lookup 时分配，单调递增不复用，
+//   因此同一次挂载中 st_ino 稳定，generation 恒为 0
+// - 每个 inode 只记录父 inode 与自身名字，路径由逐级向上拼接得到；
+//   重命名只修改一个表项，子孙节点随之生效
+// - nlookup 为内核持有的引用数，由 forget 递减，归零且没有已知子节点时释放表项
+// - 元数据仍按路径索引，本表只负责 inode 号与路径之间的转换
+class InodeTable {
+public:
+    static constexpr uint64_t ROOT = 1;
+
+    InodeTable();
+
+    // 查找或分配 parent 下 name 的 inode 号，并增加一次引用（对应内核的 lookup 回复）
+    // parent 未知时返回 0
+    uint64_t lookup(uint64_t parent, const std::string& name);
+
+    // 只查询已分配的 inode 号，不增加引用；未分配时返回 0
+    uint64_t find(uint64_t parent, const std::string& name) const;
+
+    // 内核释放 n 次引用
+    void forget(uint64_t ino, uint64_t n);
+
+    // inode 对应的完整路径；inode 未知或已被删除时返回 false
+    bool path(uint64_t ino, std::string& out) const;
+
+    // parent 下名为 name 的子项路径
+    bool child_path(uint64_t parent, const std::string& name, std::string& out) const;
+
+    // 重命名：目标位置已有的 inode 被摘除
+    void rename(uint64_t parent, const std::string& name,
+                uint64_t new_parent, const std::string& new_name);
+
+    // 删除目录项：inode 仍可能被打开的文件引用，但之后无法再解析出路径
+    void unlink(uint64_t parent, const std::string& name);
+
+    // 当前表项数（包括根目录）
+    size_t size() const;
+
+private:
+    struct Node {
+        uint64_t parent = 0;       // 0 表示已从目录树摘除
+        std::string name;
+        uint64_t nlookup = 0;
+    };
+
+    // 以下函数假设已独占持有 mu_
+    void detach(uint64_t ino);
+    void try_release(uint64_t ino);
+    bool path_nolock(uint64_t ino, std::string& out) const;
+
+    std::unordered_map<uint64_t, Node> nodes_;
+    std::unordered_map<uint64_t, std::unordered_map<std::string, uint64_t>> children_;
+    uint64_t next_ino_ = ROOT + 1;
+
+    mutable std::shared_mutex mu_;
+};
+
+#endif
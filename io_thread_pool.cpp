@@ -0,0 +1,73 @@
+#include "io_thread_pool.h"
+
+IOThreadPool::IOThreadPool(size_t num_threads, size_t max_queue)
+    : max_queue_(max_queue ? max_queue : 1)
+{
+    if (num_threads == 0) num_threads = 1;
+    workers_.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+IOThreadPool::~IOThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stopping_ = true;
+    }
+    not_empty_.notify_all();
+    not_full_.notify_all();
+
+    for (auto &t : workers_) {
+        t.join();
+    }
+}
+
+bool IOThreadPool::submit(std::function<void()> task)
+{
+    std::unique_lock<std::mutex> lock(mu_);
+    not_full_.wait(lock, [this] { return stopping_ || queue_.size() < max_queue_; });
+    if (stopping_) return false;
+
+    queue_.push_back(std::move(task));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+}
+
+bool IOThreadPool::try_submit(std::function<void()> task)
+{
+    std::unique_lock<std::mutex> lock(mu_);
+    if (stopping_ || queue_.size() >= max_queue_) return false;
+
+    queue_.push_back(std::move(task));
+    lock.unlock();
+    not_empty_.notify_one();
+    return true;
+}
+
+size_t IOThreadPool::queue_size() const
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    return queue_.size();
+}
+
+void IOThreadPool::worker_loop()
+{
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            not_empty_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            // 关闭时先把剩余任务执行完
+            if (queue_.empty()) return;
+
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        not_full_.notify_one();
+
+        task();
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef IO_THREAD_POOL_H
+#define IO_THREAD_POOL_H
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+// 常驻 I/O 线程池
+// - 固定数量的工作线程，避免每次读写都创建/销毁线程
+// - 有界任务队列：队列满时 submit 阻塞调用方（背压），
+//   try_submit 直接返回 false，由调用方决定丢弃或稍后重试
+// - 析构时执行完队列中剩余任务再退出
+
+class IOThreadPool {
+public:
+    IOThreadPool(size_t num_threads, size_t max_queue);
+    ~IOThreadPool();
+
+    IOThreadPool(const IOThreadPool &) = delete;
+    IOThreadPool &operator=(const IOThreadPool &) = delete;
+
+    // 提交任务，队列满时阻塞等待空位
+    // 线程池已关闭时返回 false
+    bool submit(std::function<void()> task);
+
+    // 提交任务，队列满时立即返回 false
+    bool try_submit(std::function<void()> task);
+
+    // 当前排队（未开始执行）的任务数
+    size_t queue_size() const;
+
+private:
+    void worker_loop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> queue_;
+    size_t max_queue_;
+    bool stopping_ = false;
+
+    mutable std::mutex mu_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+};
+
+// 等待一组异步操作全部完成
+class WaitGroup {
+public:
+    explicit WaitGroup(int count = 0) : count_(count) {}
+
+    void add(int n = 1) {
+        std::lock_guard<std::mutex> lock(mu_);
+        count_ += n;
+    }
+
+    void done() {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (--count_ <= 0) cv_.notify_all();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [this] { return count_ <= 0; });
+    }
+
+private:
+    int count_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+};
+
+#endif // IO_THREAD_POOL_H
@@ -1,18 +1,192 @@
 #include "local_chunk_store.h"
+#include "log.h"
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <cerrno>
 #include <cinttypes>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#include <algorithm>
+#endif
+
+// O_DIRECT 要求缓冲区地址、偏移和长度都按块对齐
+static const size_t DIO_ALIGN = 4096;
+
+static size_t align_up(size_t n)
+{
+    return (n + DIO_ALIGN - 1) / DIO_ALIGN * DIO_ALIGN;
+}
+
+// 对齐的临时缓冲区
+struct AlignedBuffer {
+    char *ptr = nullptr;
+
+    explicit AlignedBuffer(size_t size) {
+        if (posix_memalign((void **)&ptr, DIO_ALIGN, size ? size : DIO_ALIGN) != 0) {
+            ptr = nullptr;
+        }
+    }
+    ~AlignedBuffer() { free(ptr); }
+
+    AlignedBuffer(const AlignedBuffer &) = delete;
+    AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+};
+
+// 读取 [offset, offset+len)，到达文件末尾时停止；返回读到的字节数，出错返回 -1
+// O_DIRECT 读取按对齐长度发起，文件末尾的短读是正常的
+static ssize_t pread_upto(int fd, char *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::pread(fd, buf + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+static bool pwrite_full(int fd, const char *buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = ::pwrite(fd, buf + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+#ifdef HAVE_LIBURING
+// 一次 io_uring 最多同时提交的请求数
+static const unsigned URING_DEPTH = 64;
+
+struct UringOp {
+    enum Kind { READ, WRITE, FSYNC } kind;
+    int fd;
+    char *buf;
+    size_t len;         // 提交的长度
+    size_t need;        // 读取时至少要读到的字节数（文件大小）
+    bool ok = false;
+};
+
+// 补完短读写（io_uring 与 pread/pwrite 一样可能只完成一部分）
+static bool uring_finish(UringOp &op, int res)
+{
+    if (res < 0) return false;
+    size_t done = (size_t)res;
+    if (op.kind == UringOp::FSYNC) return true;
+    if (op.kind == UringOp::WRITE) {
+        return done >= op.len || pwrite_full(op.fd, op.buf + done, op.len - done, done);
+    }
+    if (done < op.need) {
+        ssize_t n = pread_upto(op.fd, op.buf + done, op.len - done, done);
+        if (n < 0) return false;
+        done += (size_t)n;
+    }
+    return done >= op.need;
+}
+
+// 把一组请求通过 io_uring 提交，全部完成后返回
+// 每批新建一个 ring：初始化开销相对数 MB 的 I/O 可以忽略，也避免 I/O 线程争用同一个 ring
+static void uring_run(std::vector<UringOp> &ops)
+{
+    if (ops.empty()) return;
+
+    struct io_uring ring;
+    unsigned depth = (unsigned)std::min<size_t>(ops.size(), URING_DEPTH);
+    if (io_uring_queue_init(depth, &ring, 0) < 0) {
+        // 内核不支持或被禁用，逐个同步执行
+        for (auto &op : ops) {
+            int res;
+            if (op.kind == UringOp::FSYNC) {
+                res = fdatasync(op.fd) == 0 ? 0 : -errno;
+            } else {
+                res = 0;
+            }
+            op.ok = uring_finish(op, res);
+        }
+        return;
+    }
+
+    size_t next = 0, inflight = 0;
+    while (next < ops.size() || inflight > 0) {
+        while (next < ops.size() && inflight < depth) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+            if (!sqe) break;
+            UringOp &op = ops[next++];
+            switch (op.kind) {
+            case UringOp::READ:
+                io_uring_prep_read(sqe, op.fd, op.buf, (unsigned)op.len, 0);
+                break;
+            case UringOp::WRITE:
+                io_uring_prep_write(sqe, op.fd, op.buf, (unsigned)op.len, 0);
+                break;
+            case UringOp::FSYNC:
+                io_uring_prep_fsync(sqe, op.fd, IORING_FSYNC_DATASYNC);
+                break;
+            }
+            io_uring_sqe_set_data(sqe, &op);
+            inflight++;
+        }
+
+        int ret = io_uring_submit_and_wait(&ring, 1);
+        if (ret < 0 && ret != -EINTR) break;
+
+        struct io_uring_cqe *cqe;
+        while (inflight > 0 && io_uring_peek_cqe(&ring, &cqe) == 0) {
+            UringOp *op = static_cast<UringOp *>(io_uring_cqe_get_data(cqe));
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            inflight--;
+            op->ok = uring_finish(*op, res);
+        }
+    }
+    io_uring_queue_exit(&ring);
+}
+#endif
 
 // 构造函数
-LocalChunkStore::LocalChunkStore(const std::string &root_dir)
-    : root(root_dir)
+LocalChunkStore::LocalChunkStore(const std::string &root_dir,
+                                 const LocalChunkStoreConfig &config)
+    : root(root_dir), config_(config)
 {
     if (!root.empty() && root.back() != '/')
         root += '/';
+    direct_ = config_.direct_io;
+}
+
+bool LocalChunkStore::open()
+{
+    if (mkdir(root.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR("LocalChunkStore: 无法创建目录 %s: %s\n",
+                  root.c_str(), strerror(errno));
+        return false;
+    }
+
+    if (config_.layout == "log") {
+        ChunkLogConfig log_config;
+        log_config.segment_size = config_.segment_size;
+        log_config.sync = config_.sync;
+        log_config.direct_io = config_.direct_io;
+        log_ = std::make_unique<ChunkLog>(root + "log", log_config);
+        return log_->open();
+    }
+
+    std::string stripes = root + "stripes";
+    if (mkdir(stripes.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR("LocalChunkStore: 无法创建目录 %s: %s\n",
+                  stripes.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
 }
 
 // 生成路径：root/stripes/<stripe_id>/<chunk_id>.chunk
@@ -21,71 +195,461 @@ std::string LocalChunkStore::make_path(uint64_t stripe_id,
 {
     char buf[256];
     snprintf(buf, sizeof(buf),
-             "%sstripes/%08lu/%02u.chunk",
+             "%sstripes/%08" PRIu64 "/%02u.chunk",
              root.c_str(), stripe_id, chunk_id);
     return std::string(buf);
 }
 
 // 确保目录存在：root/stripes/<stripe_id>/
-bool LocalChunkStore::ensure_dir(uint64_t stripe_id) const
+// root/stripes 在 open() 中创建；已知存在的条带目录不再调用 mkdir
+bool LocalChunkStore::ensure_dir(uint64_t stripe_id)
 {
+    {
+        std::lock_guard<std::mutex> lock(dirs_mu_);
+        if (known_dirs_.count(stripe_id)) return true;
+    }
+
     char dirbuf[256];
     snprintf(dirbuf, sizeof(dirbuf),
-             "%sstripes/%08lu",
+             "%sstripes/%08" PRIu64,
              root.c_str(), stripe_id);
+    if (mkdir(dirbuf, 0755) != 0 && errno != EEXIST)
+        return false;
 
-    // 逐级创建目录
-    std::string path = root + "stripes";
-    mkdir(path.c_str(), 0755);
+    std::lock_guard<std::mutex> lock(dirs_mu_);
+    known_dirs_.insert(stripe_id);
+    return true;
+}
 
-    path = std::string(dirbuf);
-    mkdir(path.c_str(), 0755);
+int LocalChunkStore::open_file(const std::string &path, int flags, bool &direct)
+{
+    direct = false;
+    if (direct_) {
+        int fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        if (fd >= 0) {
+            direct = true;
+            return fd;
+        }
+        if (errno != EINVAL) return -1;
+        // 部分文件系统（如 tmpfs）不支持 O_DIRECT
+        if (direct_.exchange(false)) {
+            LOG_WARN("LocalChunkStore: %s 不支持 O_DIRECT，改用普通 I/O\n",
+                     root.c_str());
+        }
+    }
+    return ::open(path.c_str(), flags, 0644);
+}
 
+void LocalChunkStore::sync_dir(uint64_t stripe_id)
+{
+    char dirbuf[256];
+    snprintf(dirbuf, sizeof(dirbuf),
+             "%sstripes/%08" PRIu64,
+             root.c_str(), stripe_id);
+    int fd = ::open(dirbuf, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return;
+    fsync(fd);
+    ::close(fd);
+}
+
+int LocalChunkStore::create_tmp(uint64_t stripe_id, uint32_t chunk_id,
+                                size_t size, std::string &tmp_path, bool &direct)
+{
+    if (!ensure_dir(stripe_id))
+        return -1;
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp%" PRIu64, tmp_seq_++);
+    tmp_path = make_path(stripe_id, chunk_id) + suffix;
+
+    int fd = open_file(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, direct);
+    if (fd < 0)
+        return -1;
+
+    // 一次分配好全部块，避免写入过程中逐块扩展文件；不支持时忽略
+    if (size > 0)
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)align_up(size));
+    return fd;
+}
+
+bool LocalChunkStore::install_tmp(int fd, const std::string &tmp_path,
+                                  uint64_t stripe_id, uint32_t chunk_id)
+{
+    ::close(fd);
+    if (rename(tmp_path.c_str(), make_path(stripe_id, chunk_id).c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    if (config_.sync)
+        sync_dir(stripe_id);
     return true;
 }
 
-// 读取 chunk
+bool LocalChunkStore::commit_tmp(int fd, const std::string &tmp_path, bool direct,
+                                 size_t size, uint64_t stripe_id, uint32_t chunk_id)
+{
+    // O_DIRECT 按对齐长度写入，截掉末尾填充
+    bool ok = !direct || ftruncate(fd, (off_t)size) == 0;
+    if (ok && config_.sync)
+        ok = fdatasync(fd) == 0;
+    if (!ok) {
+        ::close(fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return install_tmp(fd, tmp_path, stripe_id, chunk_id);
+}
+
 bool LocalChunkStore::read_chunk(uint64_t stripe_id,
                                  uint32_t chunk_id,
                                  std::string &out)
 {
-    auto path = make_path(stripe_id, chunk_id);
-    FILE *fp = fopen(path.c_str(), "rb");
-    if (!fp)
-        return false;
+    return read_chunk_status(stripe_id, chunk_id, out) == ChunkStatus::OK;
+}
+
+// 读取 chunk：按文件大小一次 pread 进预分配的缓冲区
+ChunkStatus LocalChunkStore::read_chunk_status(uint64_t stripe_id,
+                                               uint32_t chunk_id,
+                                               std::string &out)
+{
+    if (log_)
+        return log_->read(stripe_id, chunk_id, out);
 
-    out.clear();
-    char buf[4096];
-    size_t n;
-    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
-        out.append(buf, n);
+    bool direct;
+    int fd = open_file(make_path(stripe_id, chunk_id), O_RDONLY, direct);
+    if (fd < 0)
+        return errno == ENOENT ? ChunkStatus::NOT_FOUND : ChunkStatus::ERROR;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return ChunkStatus::ERROR;
     }
+    size_t size = (size_t)st.st_size;
 
-    fclose(fp);
-    return true;
+    bool ok;
+    if (direct) {
+        AlignedBuffer buf(align_up(size));
+        ok = buf.ptr && pread_upto(fd, buf.ptr, align_up(size), 0) == (ssize_t)size;
+        if (ok)
+            out.assign(buf.ptr, size);
+    } else {
+        out.resize(size);
+        ok = pread_upto(fd, &out[0], size, 0) == (ssize_t)size;
+    }
+
+    ::close(fd);
+    return ok ? ChunkStatus::OK : ChunkStatus::ERROR;
 }
 
-// 写入 chunk
+// 写入 chunk：写临时文件，落盘后 rename 覆盖，崩溃时不会留下写了一半的 chunk
 bool LocalChunkStore::write_chunk(uint64_t stripe_id,
                                   uint32_t chunk_id,
                                   const std::string &data)
 {
-    ensure_dir(stripe_id);
+    if (log_) {
+        std::vector<ChunkWrite> writes{ChunkWrite{stripe_id, chunk_id, &data}};
+        return log_->append(writes);
+    }
 
-    auto path = make_path(stripe_id, chunk_id);
-    FILE *fp = fopen(path.c_str(), "wb");
-    if (!fp)
+    std::string tmp_path;
+    bool direct;
+    int fd = create_tmp(stripe_id, chunk_id, data.size(), tmp_path, direct);
+    if (fd < 0)
         return false;
 
-    fwrite(data.data(), 1, data.size(), fp);
-    fclose(fp);
-    return true;
+    bool ok;
+    if (direct) {
+        size_t len = align_up(data.size());
+        AlignedBuffer buf(len);
+        ok = buf.ptr != nullptr;
+        if (ok) {
+            memcpy(buf.ptr, data.data(), data.size());
+            memset(buf.ptr + data.size(), 0, len - data.size());
+            ok = pwrite_full(fd, buf.ptr, len, 0);
+        }
+    } else {
+        ok = pwrite_full(fd, data.data(), data.size(), 0);
+    }
+
+    if (!ok) {
+        ::close(fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return commit_tmp(fd, tmp_path, direct, data.size(), stripe_id, chunk_id);
 }
 
 // 删除 chunk
 bool LocalChunkStore::delete_chunk(uint64_t stripe_id,
                                    uint32_t chunk_id)
 {
+    if (log_)
+        return log_->remove(stripe_id, chunk_id);
+
     auto path = make_path(stripe_id, chunk_id);
     return unlink(path.c_str()) == 0;
 }
+
+// 打开已存在的 chunk 文件，确认 [offset, offset+len) 在文件范围内
+static int open_range(const std::string &path, int flags, uint64_t offset, size_t len)
+{
+    int fd = ::open(path.c_str(), flags);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || offset + len > (uint64_t)st.st_size) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 范围读取
+bool LocalChunkStore::read_range(uint64_t stripe_id, uint32_t chunk_id,
+                                 uint64_t offset, size_t len, std::string &out)
+{
+    if (log_)
+        return false;
+
+    int fd = open_range(make_path(stripe_id, chunk_id), O_RDONLY, offset, len);
+    if (fd < 0)
+        return false;
+
+    out.resize(len);
+    bool ok = pread_upto(fd, &out[0], len, offset) == (ssize_t)len;
+    ::close(fd);
+    return ok;
+}
+
+// 范围写入：原地覆盖，不经过临时文件
+bool LocalChunkStore::write_range(uint64_t stripe_id, uint32_t chunk_id,
+                                  uint64_t offset, const std::string &data)
+{
+    if (log_)
+        return false;
+
+    int fd = open_range(make_path(stripe_id, chunk_id), O_WRONLY, offset, data.size());
+    if (fd < 0)
+        return false;
+
+    bool ok = pwrite_full(fd, data.data(), data.size(), offset);
+    if (ok && config_.sync)
+        ok = fdatasync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+// 多区间读取：只打开一次文件
+bool LocalChunkStore::read_ranges(uint64_t stripe_id, uint32_t chunk_id,
+                                  const std::vector<RangeRef> &ranges,
+                                  std::vector<std::string> &out)
+{
+    out.assign(ranges.size(), std::string());
+    if (log_)
+        return false;
+
+    uint64_t end = 0;
+    for (const auto &r : ranges)
+        end = std::max(end, r.offset + r.len);
+
+    int fd = open_range(make_path(stripe_id, chunk_id), O_RDONLY, 0, end);
+    if (fd < 0)
+        return false;
+
+    bool ok = true;
+    for (size_t i = 0; i < ranges.size() && ok; i++) {
+        out[i].resize(ranges[i].len);
+        ok = pread_upto(fd, &out[i][0], ranges[i].len, ranges[i].offset) ==
+             (ssize_t)ranges[i].len;
+    }
+    ::close(fd);
+    return ok;
+}
+
+// 多区间写入：只打开、同步一次文件
+bool LocalChunkStore::write_ranges(uint64_t stripe_id, uint32_t chunk_id,
+                                   const std::vector<RangeWrite> &writes)
+{
+    if (log_)
+        return false;
+
+    uint64_t end = 0;
+    for (const auto &w : writes)
+        end = std::max(end, w.offset + w.data->size());
+
+    int fd = open_range(make_path(stripe_id, chunk_id), O_WRONLY, 0, end);
+    if (fd < 0)
+        return false;
+
+    bool ok = true;
+    for (size_t i = 0; i < writes.size() && ok; i++)
+        ok = pwrite_full(fd, writes[i].data->data(), writes[i].data->size(), writes[i].offset);
+    if (ok && config_.sync)
+        ok = fdatasync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+bool LocalChunkStore::supports_batch() const
+{
+#ifdef HAVE_LIBURING
+    return true;
+#else
+    return log_ != nullptr;
+#endif
+}
+
+// 批量写入：log 布局整批一次追加；files 布局通过 io_uring 一次提交全部写入与 fdatasync
+bool LocalChunkStore::write_chunks(const std::vector<ChunkWrite> &writes)
+{
+    if (log_)
+        return log_->append(writes);
+
+#ifdef HAVE_LIBURING
+    struct Tmp {
+        int fd = -1;
+        bool direct = false;
+        std::string path;
+        std::unique_ptr<AlignedBuffer> buf;
+    };
+    std::vector<Tmp> tmps(writes.size());
+    std::vector<UringOp> ops;
+    std::vector<size_t> op_index;
+    bool ok = true;
+
+    for (size_t i = 0; i < writes.size(); i++) {
+        const ChunkWrite &w = writes[i];
+        Tmp &t = tmps[i];
+        t.fd = create_tmp(w.stripe_id, w.chunk_id, w.data->size(), t.path, t.direct);
+        if (t.fd < 0) {
+            ok = false;
+            continue;
+        }
+
+        char *src = const_cast<char *>(w.data->data());
+        size_t len = w.data->size();
+        if (t.direct) {
+            len = align_up(len);
+            t.buf = std::make_unique<AlignedBuffer>(len);
+            if (!t.buf->ptr) {
+                ::close(t.fd);
+                unlink(t.path.c_str());
+                t.fd = -1;
+                ok = false;
+                continue;
+            }
+            memcpy(t.buf->ptr, w.data->data(), w.data->size());
+            memset(t.buf->ptr + w.data->size(), 0, len - w.data->size());
+            src = t.buf->ptr;
+        }
+        ops.push_back(UringOp{UringOp::WRITE, t.fd, src, len, 0});
+        op_index.push_back(i);
+    }
+    uring_run(ops);
+
+    // 截掉 O_DIRECT 的对齐填充后整批 fdatasync
+    std::vector<UringOp> syncs;
+    std::vector<size_t> sync_index;
+    for (size_t j = 0; j < ops.size(); j++) {
+        Tmp &t = tmps[op_index[j]];
+        if (!ops[j].ok ||
+            (t.direct && ftruncate(t.fd, (off_t)writes[op_index[j]].data->size()) != 0)) {
+            ::close(t.fd);
+            unlink(t.path.c_str());
+            t.fd = -1;
+            ok = false;
+            continue;
+        }
+        if (config_.sync) {
+            syncs.push_back(UringOp{UringOp::FSYNC, t.fd, nullptr, 0, 0});
+            sync_index.push_back(op_index[j]);
+        }
+    }
+    uring_run(syncs);
+    for (size_t j = 0; j < syncs.size(); j++) {
+        Tmp &t = tmps[sync_index[j]];
+        if (!syncs[j].ok) {
+            ::close(t.fd);
+            unlink(t.path.c_str());
+            t.fd = -1;
+            ok = false;
+        }
+    }
+
+    for (size_t i = 0; i < writes.size(); i++) {
+        if (tmps[i].fd < 0) continue;
+        if (!install_tmp(tmps[i].fd, tmps[i].path, writes[i].stripe_id, writes[i].chunk_id))
+            ok = false;
+    }
+    return ok;
+#else
+    return ChunkStore::write_chunks(writes);
+#endif
+}
+
+// 批量读取：files 布局打开并 fstat 全部文件后通过 io_uring 一次提交全部读取
+bool LocalChunkStore::read_chunks(const std::vector<ChunkRef> &refs,
+                                  std::vector<std::string> &out,
+                                  std::vector<ChunkStatus> *status)
+{
+#ifdef HAVE_LIBURING
+    if (!log_) {
+        out.assign(refs.size(), std::string());
+        if (status) status->assign(refs.size(), ChunkStatus::OK);
+        std::vector<int> fds(refs.size(), -1);
+        std::vector<std::unique_ptr<AlignedBuffer>> bufs(refs.size());
+        std::vector<UringOp> ops;
+        std::vector<size_t> op_index;
+        bool ok = true;
+
+        for (size_t i = 0; i < refs.size(); i++) {
+            bool direct;
+            fds[i] = open_file(make_path(refs[i].stripe_id, refs[i].chunk_id),
+                               O_RDONLY, direct);
+            struct stat st;
+            if (fds[i] < 0 || fstat(fds[i], &st) != 0) {
+                if (status) {
+                    (*status)[i] = fds[i] < 0 && errno == ENOENT ? ChunkStatus::NOT_FOUND
+                                                                  : ChunkStatus::ERROR;
+                }
+                ok = false;
+                continue;
+            }
+            size_t size = (size_t)st.st_size;
+            if (direct) {
+                bufs[i] = std::make_unique<AlignedBuffer>(align_up(size));
+                if (!bufs[i]->ptr) {
+                    if (status) (*status)[i] = ChunkStatus::ERROR;
+                    ok = false;
+                    continue;
+                }
+                ops.push_back(UringOp{UringOp::READ, fds[i], bufs[i]->ptr,
+                                      align_up(size), size});
+            } else {
+                out[i].resize(size);
+                ops.push_back(UringOp{UringOp::READ, fds[i], &out[i][0], size, size});
+            }
+            op_index.push_back(i);
+        }
+        uring_run(ops);
+
+        for (size_t j = 0; j < ops.size(); j++) {
+            size_t i = op_index[j];
+            if (!ops[j].ok) {
+                out[i].clear();
+                if (status) (*status)[i] = ChunkStatus::ERROR;
+                ok = false;
+            } else if (bufs[i]) {
+                out[i].assign(bufs[i]->ptr, ops[j].need);
+            }
+        }
+        for (int fd : fds) {
+            if (fd >= 0) ::close(fd);
+        }
+        return ok;
+    }
+#endif
+    return ChunkStore::read_chunks(refs, out, status);
+}
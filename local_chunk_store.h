@@ -2,21 +2,48 @@
 #define LOCAL_CHUNK_STORE_H
 
 #include "chunk_store.h"
+#include "chunk_log.h"
 #include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_set>
 #include <cstdint>
 
-// 本地目录实现的 ChunkStore
-// 每个 chunk 对应一个文件：
-//   <root>/stripes/<stripe_id>/<chunk_id>.chunk
+// 本地目录实现的 ChunkStore，两种布局：
+// - files（默认）：每个 chunk 对应一个文件
+//     <root>/stripes/<stripe_id>/<chunk_id>.chunk
+//   写入先写临时文件再 rename，sync 时 fdatasync 文件与目录；已创建的条带目录
+//   缓存在内存中；读取按 fstat 得到的大小一次 pread 进预分配好的缓冲区；
+//   编译时启用 liburing（HAVE_LIBURING）时批量读写通过 io_uring 一次提交；
+//   支持原地范围读写（校验块增量更新）
+// - log：所有 chunk 追加写入 <root>/log/ 下的少量段文件（见 chunk_log.h），
+//   条带再多也只有少量大文件，一批写入只需一次 pwrite 与一次 fdatasync
+
+struct LocalChunkStoreConfig {
+    std::string layout = "files";           // files / log
+    bool sync = true;                       // 写入后 fdatasync
+    bool direct_io = false;                 // 使用 O_DIRECT（不支持时自动回退）
+    uint64_t segment_size = 1ULL << 30;     // log 布局的段文件大小
+};
 
 class LocalChunkStore : public ChunkStore {
 public:
-    explicit LocalChunkStore(const std::string &root_dir);
+    LocalChunkStore(const std::string &root_dir,
+                    const LocalChunkStoreConfig &config = LocalChunkStoreConfig());
+
+    // 创建目录；log 布局时扫描段文件重建索引。失败返回 false
+    bool open();
 
     bool read_chunk(uint64_t stripe_id,
                     uint32_t chunk_id,
                     std::string &out) override;
 
+    // chunk 文件不存在（ENOENT）或 log 索引中没有该 chunk 时返回 NOT_FOUND
+    ChunkStatus read_chunk_status(uint64_t stripe_id,
+                                  uint32_t chunk_id,
+                                  std::string &out) override;
+
     bool write_chunk(uint64_t stripe_id,
                      uint32_t chunk_id,
                      const std::string &data) override;
@@ -24,15 +51,72 @@ public:
     bool delete_chunk(uint64_t stripe_id,
                       uint32_t chunk_id) override;
 
+    // log 布局，或 files 布局且启用了 io_uring 时整批提交
+    bool supports_batch() const override;
+
+    bool write_chunks(const std::vector<ChunkWrite> &writes) override;
+
+    bool read_chunks(const std::vector<ChunkRef> &refs,
+                     std::vector<std::string> &out,
+                     std::vector<ChunkStatus> *status = nullptr) override;
+
+    // files 布局支持范围读写：原地 pread / pwrite（不使用 O_DIRECT）
+    // log 布局的 chunk 只追加写入，不支持
+    bool supports_range() const override { return log_ == nullptr; }
+
+    bool read_range(uint64_t stripe_id, uint32_t chunk_id,
+                    uint64_t offset, size_t len, std::string &out) override;
+
+    bool write_range(uint64_t stripe_id, uint32_t chunk_id,
+                     uint64_t offset, const std::string &data) override;
+
+    bool read_ranges(uint64_t stripe_id, uint32_t chunk_id,
+                     const std::vector<RangeRef> &ranges,
+                     std::vector<std::string> &out) override;
+
+    bool write_ranges(uint64_t stripe_id, uint32_t chunk_id,
+                      const std::vector<RangeWrite> &writes) override;
+
 private:
     std::string root;
+    LocalChunkStoreConfig config_;
+
+    std::unique_ptr<ChunkLog> log_;
+
+    // O_DIRECT 在当前文件系统上不可用时置 false
+    std::atomic<bool> direct_{false};
+
+    // 已确认存在的条带目录
+    std::unordered_set<uint64_t> known_dirs_;
+    std::mutex dirs_mu_;
+
+    // 临时文件名序号，避免并发写同一 chunk 时冲突
+    std::atomic<uint64_t> tmp_seq_{0};
 
     // 生成 chunk 文件路径
     std::string make_path(uint64_t stripe_id,
                           uint32_t chunk_id) const;
 
-    // 确保目录存在
-    bool ensure_dir(uint64_t stripe_id) const;
+    // 确保目录存在（已知目录不再 mkdir）
+    bool ensure_dir(uint64_t stripe_id);
+
+    // 打开 chunk 文件，优先使用 O_DIRECT
+    int open_file(const std::string &path, int flags, bool &direct);
+
+    // 写临时文件的前半部分：创建、预分配，返回 fd 与临时文件路径
+    int create_tmp(uint64_t stripe_id, uint32_t chunk_id,
+                   size_t size, std::string &tmp_path, bool &direct);
+
+    // 写临时文件的后半部分：截断对齐填充、落盘，再 install_tmp
+    bool commit_tmp(int fd, const std::string &tmp_path, bool direct,
+                    size_t size, uint64_t stripe_id, uint32_t chunk_id);
+
+    // 关闭已落盘的临时文件并 rename 到正式路径
+    bool install_tmp(int fd, const std::string &tmp_path,
+                     uint64_t stripe_id, uint32_t chunk_id);
+
+    // 同步目录项，使 rename 在崩溃后依然有效
+    void sync_dir(uint64_t stripe_id);
 };
 
 #endif // LOCAL_CHUNK_STORE_H
@@ -0,0 +1,53 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+// stderr 日志按级别过滤（配置项 log_level，默认 info）
+// - error：操作失败（数据未能写入、元数据损坏等）
+// - warn：可恢复的异常（单次重试失败、降级写、熔断）
+// - info：启动配置与状态变化
+// - debug：逐请求的细节
+// 级别检查只是一次原子读，被过滤掉的日志不会格式化参数
+
+enum LogLevel {
+    LOG_LEVEL_ERROR = 0,
+    LOG_LEVEL_WARN  = 1,
+    LOG_LEVEL_INFO  = 2,
+    LOG_LEVEL_DEBUG = 3,
+};
+
+inline std::atomic<int> g_log_level{LOG_LEVEL_INFO};
+
+inline bool log_enabled(LogLevel level)
+{
+    return (int)level <= g_log_level.load(std::memory_order_relaxed);
+}
+
+inline void set_log_level(LogLevel level)
+{
+    g_log_level.store((int)level, std::memory_order_relaxed);
+}
+
+// 解析级别名（error / warn / info / debug），未知名称返回 false
+inline bool parse_log_level(const std::string &name, LogLevel &out)
+{
+    if (name == "error") out = LOG_LEVEL_ERROR;
+    else if (name == "warn") out = LOG_LEVEL_WARN;
+    else if (name == "info") out = LOG_LEVEL_INFO;
+    else if (name == "debug") out = LOG_LEVEL_DEBUG;
+    else return false;
+    return true;
+}
+
+#define LOG_AT(level, ...) \
+    do { if (log_enabled(level)) std::fprintf(stderr, __VA_ARGS__); } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif // LOG_H
@@ -0,0 +1,576 @@
+#define FUSE_USE_VERSION 35
+#include <fuse3/fuse.h>
+#include <fuse3/fuse_lowlevel.h>
+
+#include "lowlevel_fuse.h"
+#include "inode_table.h"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+static const struct fuse_operations* g_ops = nullptr;
+static FuseConfig g_config;
+static InodeTable g_inodes;
+
+// readdir 中未分配 inode 号的目录项（与 libfuse 高层接口一致）
+static const ino_t UNKNOWN_INO = 0xffffffff;
+
+static double entry_timeout() { return g_config.entry_timeout_ms / 1000.0; }
+static double attr_timeout() { return g_config.attr_timeout_ms / 1000.0; }
+
+// ------------------------------------------------------------
+// 辅助：inode -> 路径
+// ------------------------------------------------------------
+static bool resolve(fuse_ino_t ino, std::string& path) {
+    return g_inodes.path(ino, path);
+}
+
+// ------------------------------------------------------------
+// 辅助：查询子项属性并登记 inode（每次成功回复 entry 都计一次引用）
+// ------------------------------------------------------------
+static int make_entry(fuse_ino_t parent, const char* name, struct fuse_entry_param* e) {
+    std::string path;
+    if (!g_inodes.child_path(parent, name, path))
+        return ENOENT;
+
+    memset(e, 0, sizeof(*e));
+    int res = g_ops->getattr(path.c_str(), &e->attr, nullptr);
+    if (res != 0)
+        return -res;
+
+    e->ino = g_inodes.lookup(parent, name);
+    if (e->ino == 0)
+        return ENOENT;
+
+    e->attr.st_ino = e->ino;
+    e->attr_timeout = attr_timeout();
+    e->entry_timeout = entry_timeout();
+    return 0;
+}
+
+// 回复当前属性（setattr 之后使用）
+static void reply_attr(fuse_req_t req, fuse_ino_t ino, const std::string& path) {
+    struct stat st;
+    int res = g_ops->getattr(path.c_str(), &st, nullptr);
+    if (res != 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+    st.st_ino = ino;
+    fuse_reply_attr(req, &st, attr_timeout());
+}
+
+// ------------------------------------------------------------
+// init
+// ------------------------------------------------------------
+static void ll_init(void* userdata, struct fuse_conn_info* conn) {
+    (void)userdata;
+
+    // 写回缓存：小写入在内核页缓存中合并，文件大小与时间戳由内核维护
+    if (g_config.writeback_cache && (conn->capable & FUSE_CAP_WRITEBACK_CACHE)) {
+        conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+    }
+}
+
+// ------------------------------------------------------------
+// lookup / forget
+// ------------------------------------------------------------
+static void ll_lookup(fuse_req_t req, fuse_ino_t parent, const char* name) {
+    struct fuse_entry_param e;
+    int err = make_entry(parent, name, &e);
+    if (err != 0) {
+        fuse_reply_err(req, err);
+        return;
+    }
+    fuse_reply_entry(req, &e);
+}
+
+static void ll_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup) {
+    g_inodes.forget(ino, nlookup);
+    fuse_reply_none(req);
+}
+
+static void ll_forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data* forgets) {
+    for (size_t i = 0; i < count; i++) {
+        g_inodes.forget(forgets[i].ino, forgets[i].nlookup);
+    }
+    fuse_reply_none(req);
+}
+
+// ------------------------------------------------------------
+// getattr / setattr
+// ------------------------------------------------------------
+static void ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    (void)fi;
+
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    reply_attr(req, ino, path);
+}
+
+static void ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat* attr, int to_set,
+                       struct fuse_file_info* fi) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int res = 0;
+    if (to_set & FUSE_SET_ATTR_MODE) {
+        res = g_ops->chmod(path.c_str(), attr->st_mode, fi);
+    }
+    if (res == 0 && (to_set & (FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID))) {
+        uid_t uid = (to_set & FUSE_SET_ATTR_UID) ? attr->st_uid : (uid_t)-1;
+        gid_t gid = (to_set & FUSE_SET_ATTR_GID) ? attr->st_gid : (gid_t)-1;
+        res = g_ops->chown(path.c_str(), uid, gid, fi);
+    }
+    if (res == 0 && (to_set & FUSE_SET_ATTR_SIZE)) {
+        res = g_ops->truncate(path.c_str(), attr->st_size, fi);
+    }
+    if (res == 0 && (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME |
+                                FUSE_SET_ATTR_ATIME_NOW | FUSE_SET_ATTR_MTIME_NOW))) {
+        struct timespec ts[2];
+        ts[0].tv_sec = 0;
+        ts[1].tv_sec = 0;
+        ts[0].tv_nsec = UTIME_OMIT;
+        ts[1].tv_nsec = UTIME_OMIT;
+        if (to_set & FUSE_SET_ATTR_ATIME_NOW) ts[0].tv_nsec = UTIME_NOW;
+        else if (to_set & FUSE_SET_ATTR_ATIME) ts[0] = attr->st_atim;
+        if (to_set & FUSE_SET_ATTR_MTIME_NOW) ts[1].tv_nsec = UTIME_NOW;
+        else if (to_set & FUSE_SET_ATTR_MTIME) ts[1] = attr->st_mtim;
+        res = g_ops->utimens(path.c_str(), ts, fi);
+    }
+
+    if (res != 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+    reply_attr(req, ino, path);
+}
+
+// ------------------------------------------------------------
+// mkdir / unlink / rmdir / rename
+// ------------------------------------------------------------
+static void ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char* name, mode_t mode) {
+    std::string path;
+    if (!g_inodes.child_path(parent, name, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int res = g_ops->mkdir(path.c_str(), mode);
+    if (res != 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+
+    struct fuse_entry_param e;
+    int err = make_entry(parent, name, &e);
+    if (err != 0) {
+        fuse_reply_err(req, err);
+        return;
+    }
+    fuse_reply_entry(req, &e);
+}
+
+static void ll_unlink(fuse_req_t req, fuse_ino_t parent, const char* name) {
+    std::string path;
+    if (!g_inodes.child_path(parent, name, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int res = g_ops->unlink(path.c_str());
+    if (res == 0) {
+        g_inodes.unlink(parent, name);
+    }
+    fuse_reply_err(req, -res);
+}
+
+static void ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char* name) {
+    std::string path;
+    if (!g_inodes.child_path(parent, name, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int res = g_ops->rmdir(path.c_str());
+    if (res == 0) {
+        g_inodes.unlink(parent, name);
+    }
+    fuse_reply_err(req, -res);
+}
+
+static void ll_rename(fuse_req_t req, fuse_ino_t parent, const char* name,
+                      fuse_ino_t new_parent, const char* new_name, unsigned int flags) {
+    std::string from, to;
+    if (!g_inodes.child_path(parent, name, from) ||
+        !g_inodes.child_path(new_parent, new_name, to)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int res = g_ops->rename(from.c_str(), to.c_str(), flags);
+    if (res == 0) {
+        g_inodes.rename(parent, name, new_parent, new_name);
+    }
+    fuse_reply_err(req, -res);
+}
+
+// ------------------------------------------------------------
+// create / open / read / write
+// ------------------------------------------------------------
+static void ll_create(fuse_req_t req, fuse_ino_t parent, const char* name, mode_t mode,
+                      struct fuse_file_info* fi) {
+    std::string path;
+    if (!g_inodes.child_path(parent, name, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int res = g_ops->create(path.c_str(), mode, fi);
+    if (res != 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+
+    struct fuse_entry_param e;
+    int err = make_entry(parent, name, &e);
+    if (err != 0) {
+        g_ops->release(path.c_str(), fi);
+        fuse_reply_err(req, err);
+        return;
+    }
+    fuse_reply_create(req, &e, fi);
+}
+
+static void ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int res = g_ops->open(path.c_str(), fi);
+    if (res != 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+    fuse_reply_open(req, fi);
+}
+
+static void ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                    struct fuse_file_info* fi) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    // 每个 FUSE 线程复用一块读缓冲
+    thread_local std::vector<char> buf;
+    if (buf.size() < size) {
+        buf.resize(size);
+    }
+
+    int res = g_ops->read(path.c_str(), buf.data(), size, off, fi);
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+    fuse_reply_buf(req, buf.data(), (size_t)res);
+}
+
+static void ll_write(fuse_req_t req, fuse_ino_t ino, const char* buf, size_t size,
+                     off_t off, struct fuse_file_info* fi) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int res = g_ops->write(path.c_str(), buf, size, off, fi);
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+    fuse_reply_write(req, (size_t)res);
+}
+
+// ------------------------------------------------------------
+// flush / release / fsync / fallocate
+// ------------------------------------------------------------
+static void ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        // 文件已被删除，没有需要写回的数据
+        fuse_reply_err(req, 0);
+        return;
+    }
+    fuse_reply_err(req, -g_ops->flush(path.c_str(), fi));
+}
+
+static void ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    // 文件已被删除时仍需释放句柄，路径为空
+    std::string path;
+    resolve(ino, path);
+    fuse_reply_err(req, -g_ops->release(path.c_str(), fi));
+}
+
+static void ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info* fi) {
+    std::string path;
+    resolve(ino, path);
+    fuse_reply_err(req, -g_ops->fsync(path.c_str(), datasync, fi));
+}
+
+static void ll_fallocate(fuse_req_t req, fuse_ino_t ino, int mode, off_t offset,
+                         off_t length, struct fuse_file_info* fi) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    fuse_reply_err(req, -g_ops->fallocate(path.c_str(), mode, offset, length, fi));
+}
+
+// ------------------------------------------------------------
+// 扩展属性
+// ------------------------------------------------------------
+static void ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char* name, const char* value,
+                        size_t size, int flags) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    fuse_reply_err(req, -g_ops->setxattr(path.c_str(), name, value, size, flags));
+}
+
+// size 为 0 时只回复所需长度，否则回复内容
+static void reply_xattr(fuse_req_t req, size_t size, int res, const std::vector<char>& buf) {
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+    } else if (size == 0) {
+        fuse_reply_xattr(req, (size_t)res);
+    } else {
+        fuse_reply_buf(req, buf.data(), (size_t)res);
+    }
+}
+
+static void ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char* name, size_t size) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    std::vector<char> buf(size);
+    int res = g_ops->getxattr(path.c_str(), name, buf.data(), size);
+    reply_xattr(req, size, res, buf);
+}
+
+static void ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    std::vector<char> buf(size);
+    int res = g_ops->listxattr(path.c_str(), buf.data(), size);
+    reply_xattr(req, size, res, buf);
+}
+
+// ------------------------------------------------------------
+// opendir / readdir / releasedir
+// ------------------------------------------------------------
+// readdir 回复缓冲：路径接口的 readdir 逐项填入，放不下时停止
+struct DirBuffer {
+    fuse_req_t req;
+    fuse_ino_t ino;
+    std::vector<char> data;
+    size_t pos = 0;
+};
+
+static int add_direntry(void* buf, const char* name, const struct stat* st, off_t off,
+                        enum fuse_fill_dir_flags flags) {
+    (void)st;
+    (void)flags;
+
+    DirBuffer* db = static_cast<DirBuffer*>(buf);
+
+    struct stat entry;
+    memset(&entry, 0, sizeof(entry));
+    if (!strcmp(name, ".")) {
+        entry.st_ino = db->ino;
+    } else if (!strcmp(name, "..")) {
+        entry.st_ino = UNKNOWN_INO;
+    } else {
+        uint64_t child = g_inodes.find(db->ino, name);
+        entry.st_ino = child ? child : UNKNOWN_INO;
+    }
+
+    size_t room = db->data.size() - db->pos;
+    size_t len = fuse_add_direntry(db->req, db->data.data() + db->pos, room, name, &entry, off);
+    if (len > room) {
+        return 1;
+    }
+    db->pos += len;
+    return 0;
+}
+
+static void ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int res = g_ops->opendir(path.c_str(), fi);
+    if (res != 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+    fuse_reply_open(req, fi);
+}
+
+static void ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                       struct fuse_file_info* fi) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    // 偏移由路径接口的 readdir 给出，目录修改后仍然有效
+    DirBuffer db;
+    db.req = req;
+    db.ino = ino;
+    db.data.resize(size);
+
+    int res = g_ops->readdir(path.c_str(), &db, add_direntry, off, fi,
+                             (enum fuse_readdir_flags)0);
+    if (res != 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+    fuse_reply_buf(req, db.data.data(), db.pos);
+}
+
+static void ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+    std::string path;
+    resolve(ino, path);
+    fuse_reply_err(req, -g_ops->releasedir(path.c_str(), fi));
+}
+
+// ------------------------------------------------------------
+// statfs / access
+// ------------------------------------------------------------
+static void ll_statfs(fuse_req_t req, fuse_ino_t ino) {
+    (void)ino;
+
+    struct statvfs st;
+    int res = g_ops->statfs("/", &st);
+    if (res != 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+    fuse_reply_statfs(req, &st);
+}
+
+static void ll_access(fuse_req_t req, fuse_ino_t ino, int mask) {
+    std::string path;
+    if (!resolve(ino, path)) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    fuse_reply_err(req, -g_ops->access(path.c_str(), mask));
+}
+
+// ------------------------------------------------------------
+// 运行低层 FUSE 会话
+// ------------------------------------------------------------
+int run_lowlevel_fuse(struct fuse_args* args, const struct fuse_operations* ops,
+                      const FuseConfig& config) {
+    g_ops = ops;
+    g_config = config;
+
+    struct fuse_lowlevel_ops ll_ops;
+    memset(&ll_ops, 0, sizeof(ll_ops));
+    ll_ops.init         = ll_init;
+    ll_ops.lookup       = ll_lookup;
+    ll_ops.forget       = ll_forget;
+    ll_ops.forget_multi = ll_forget_multi;
+    ll_ops.getattr      = ll_getattr;
+    ll_ops.setattr      = ll_setattr;
+    ll_ops.mkdir        = ll_mkdir;
+    ll_ops.unlink       = ll_unlink;
+    ll_ops.rmdir        = ll_rmdir;
+    ll_ops.rename       = ll_rename;
+    ll_ops.create       = ll_create;
+    ll_ops.open         = ll_open;
+    ll_ops.read         = ll_read;
+    ll_ops.write        = ll_write;
+    ll_ops.flush        = ll_flush;
+    ll_ops.release      = ll_release;
+    ll_ops.fsync        = ll_fsync;
+    ll_ops.fallocate    = ll_fallocate;
+    ll_ops.setxattr     = ll_setxattr;
+    ll_ops.getxattr     = ll_getxattr;
+    ll_ops.listxattr    = ll_listxattr;
+    ll_ops.opendir      = ll_opendir;
+    ll_ops.readdir      = ll_readdir;
+    ll_ops.releasedir   = ll_releasedir;
+    ll_ops.statfs       = ll_statfs;
+    ll_ops.access       = ll_access;
+
+    struct fuse_cmdline_opts opts;
+    if (fuse_parse_cmdline(args, &opts) != 0) {
+        return 1;
+    }
+
+    if (opts.show_help) {
+        fuse_cmdline_help();
+        fuse_lowlevel_help();
+        free(opts.mountpoint);
+        return 0;
+    }
+
+    if (opts.mountpoint == nullptr) {
+        std::fprintf(stderr, "未指定挂载点\n");
+        return 1;
+    }
+
+    int ret = 1;
+    struct fuse_session* se = fuse_session_new(args, &ll_ops, sizeof(ll_ops), nullptr);
+    if (se == nullptr) {
+        free(opts.mountpoint);
+        return 1;
+    }
+
+    if (fuse_set_signal_handlers(se) == 0) {
+        if (fuse_session_mount(se, opts.mountpoint) == 0) {
+            // 进程已在 main 中转入后台，这里不再 daemonize
+            if (opts.singlethread) {
+                ret = fuse_session_loop(se);
+            } else {
+                struct fuse_loop_config loop_config;
+                loop_config.clone_fd = opts.clone_fd;
+                loop_config.max_idle_threads = opts.max_idle_threads;
+                ret = fuse_session_loop_mt(se, &loop_config);
+            }
+            fuse_session_unmount(se);
+        }
+        fuse_remove_signal_handlers(se);
+    }
+
+    fuse_session_destroy(se);
+    free(opts.mountpoint);
+
+    return ret ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+#ifndef LOWLEVEL_FUSE_H
+#define LOWLEVEL_FUSE_H
+
+#include <cstdint>
+
+struct fuse_args;
+struct fuse_operations;
+
+struct FuseConfig {
+    bool lowlevel = false;            // 使用低层（inode 号）接口，默认 false
+    uint64_t entry_timeout_ms = 1000; // 内核缓存目录项的时间（毫秒）
+    uint64_t attr_timeout_ms = 1000;  // 内核缓存属性的时间（毫秒）
+    bool writeback_cache = false;     // 内核写回缓存（小写入在内核中合并后再下发）
+};
+
+// 低层 FUSE 前端
+// - 内核以 inode 号发起请求，由 InodeTable 转换为路径后调用 ops 中的路径处理函数，
+//   两种接口共用同一套文件系统语义
+// - lookup / getattr 回复带 entry_timeout / attr_timeout，内核在有效期内不再重复查询
+// - readdir 按偏移分页，直接从元数据中逐项读取，不复制整个目录
+// args 中需包含挂载点；返回值与 fuse_main 一致
+int run_lowlevel_fuse(struct fuse_args* args, const struct fuse_operations* ops,
+                      const FuseConfig& config);
+
+#endif
@@ -10,7 +10,11 @@
 #include "metadata_manager.h"
 #include "file_cache.h"
 #include "chunk_cache.h"
+#include "disk_cache.h"
+#include "lowlevel_fuse.h"
 #include "yml_parser.h"
+#include "metrics.h"
+#include "log.h"
 
 #include <memory>
 #include <vector>
@@ -18,7 +22,11 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
-#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/xattr.h>
+#include <linux/falloc.h>
 
 static std::shared_ptr<FileManager> g_fm;
 static std::shared_ptr<MetadataManager> g_meta;
@@ -26,6 +34,16 @@ static std::shared_ptr<MetadataManager> g_meta;
 // 和 MetadataManager 中保持一致
 static const char* META_PATH = "/.__cloudraidfs_meta";
 
+// 运行指标虚拟文件（只读，不出现在目录列表中），为空时关闭
+static std::string g_metrics_path = "/.cloudraidfs_metrics";
+
+// 指标文件的句柄带上最高位，与 FileManager 的句柄区分；
+// 打开时生成一份快照，之后的 read 都读这份快照
+static const uint64_t METRICS_FH_BIT = 1ULL << 63;
+static std::mutex g_metrics_mu;
+static std::unordered_map<uint64_t, std::string> g_metrics_snapshots;
+static uint64_t g_metrics_next_fh = 0;
+
 // ------------------------------------------------------------
 // 辅助：是否是内部元数据文件
 // ------------------------------------------------------------
@@ -33,6 +51,15 @@ static inline bool is_internal_meta(const std::string& p) {
     return p == META_PATH;
 }
 
+static inline bool is_metrics_file(const std::string& p) {
+    return !g_metrics_path.empty() && p == g_metrics_path;
+}
+
+// 不允许修改的保留路径
+static inline bool is_reserved(const std::string& p) {
+    return is_internal_meta(p) || is_metrics_file(p);
+}
+
 // ------------------------------------------------------------
 // getattr
 // ------------------------------------------------------------
@@ -49,6 +76,13 @@ static int raidfs_getattr(const char *path, struct stat *stbuf,
         return -ENOENT;
     }
 
+    // 指标文件大小未知（与 /proc 下的文件相同报告为 0），打开时使用 direct_io
+    if (is_metrics_file(p)) {
+        stbuf->st_mode = S_IFREG | 0444;
+        stbuf->st_nlink = 1;
+        return 0;
+    }
+
     // 根目录
     if (p == "/") {
         stbuf->st_mode = S_IFDIR | 0755;
@@ -81,7 +115,6 @@ static int raidfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                           off_t offset, struct fuse_file_info *fi,
                           enum fuse_readdir_flags flags)
 {
-    (void)offset;
     (void)fi;
     (void)flags;
 
@@ -92,17 +125,22 @@ static int raidfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
         return -ENOENT;
     }
 
-    filler(buf, ".", nullptr, 0, FUSE_FILL_DIR_PLUS);
-    filler(buf, "..", nullptr, 0, FUSE_FILL_DIR_PLUS);
+    // 分页返回：每个目录项带上下一项的偏移，缓冲区满时 filler 返回非 0，
+    // 内核下次从该偏移继续。偏移 1、2 为 "." 和 ".."，之后为目录中的槽位偏移 + 2
+    if (offset < 1 && filler(buf, ".", nullptr, 1, (enum fuse_fill_dir_flags)0))
+        return 0;
+    if (offset < 2 && filler(buf, "..", nullptr, 2, (enum fuse_fill_dir_flags)0))
+        return 0;
 
-    auto list = g_meta->list_dir(p);
-    for (auto &name : list) {
+    uint64_t from = offset > 2 ? (uint64_t)offset - 2 : 0;
+    bool is_root = p == "/";
+    g_meta->list_dir_from(p, from, [&](const char *name, uint64_t next) {
         // 不把内部元数据文件暴露出来
-        if (p == "/" && name == META_PATH + 1) {
-            continue;
+        if (is_root && !strcmp(name, META_PATH + 1)) {
+            return true;
         }
-        filler(buf, name.c_str(), nullptr, 0, FUSE_FILL_DIR_PLUS);
-    }
+        return filler(buf, name, nullptr, (off_t)(next + 2), (enum fuse_fill_dir_flags)0) == 0;
+    });
 
     return 0;
 }
@@ -114,11 +152,10 @@ static int raidfs_create(const char *path, mode_t mode,
                          struct fuse_file_info *fi)
 {
     (void)mode;
-    (void)fi;
 
     std::string p(path);
 
-    if (is_internal_meta(p))
+    if (is_reserved(p))
         return -EACCES;
 
     // 检查父目录是否存在
@@ -135,7 +172,18 @@ static int raidfs_create(const char *path, mode_t mode,
         return -EISDIR;
     }
 
+    // 新建文件：丢弃该路径上可能残留的旧缓存页
+    bool is_new = !g_meta->exists(p);
+    if (is_new) {
+        g_fm->discard(p);
+    }
+
     g_meta->create_file(p);
+    if (is_new) {
+        // 按配置规则确定条带大小
+        g_fm->init_layout(p);
+    }
+    fi->fh = g_fm->open_handle(p);
     return 0;
 }
 
@@ -148,7 +196,7 @@ static int raidfs_mkdir(const char *path, mode_t mode)
 
     std::string p(path);
 
-    if (is_internal_meta(p))
+    if (is_reserved(p))
         return -EACCES;
 
     // 检查是否已存在同名文件
@@ -175,7 +223,7 @@ static int raidfs_rmdir(const char *path)
 {
     std::string p(path);
 
-    if (is_internal_meta(p))
+    if (is_reserved(p))
         return -EACCES;
 
     if (p == "/")
@@ -205,12 +253,13 @@ static int raidfs_unlink(const char *path)
 {
     std::string p(path);
 
-    if (is_internal_meta(p))
+    if (is_reserved(p))
         return -EACCES;
 
     if (!g_meta->exists(p))
         return -ENOENT;
 
+    g_fm->discard(p);
     g_meta->remove_file(p);
     return 0;
 }
@@ -225,24 +274,27 @@ static int raidfs_rename(const char *from, const char *to, unsigned int flags)
     std::string old_path(from);
     std::string new_path(to);
 
-    if (is_internal_meta(old_path) || is_internal_meta(new_path))
+    if (is_reserved(old_path) || is_reserved(new_path))
         return -EACCES;
 
-    // 如果目标已存在，先删除
-    if (g_meta->exists(new_path)) {
-        g_meta->remove_file(new_path);
-    } else if (g_meta->is_dir(new_path)) {
-        if (!g_meta->is_empty_dir(new_path)) {
-            return -ENOTEMPTY;
+    // 写回、修改元数据与丢弃缓存由 FileManager 在阻塞相关写入的情况下完成
+    return g_fm->rename(old_path, new_path, g_meta->is_dir(old_path), [&]() -> int {
+        // 如果目标已存在，先删除
+        if (g_meta->exists(new_path)) {
+            g_fm->discard(new_path);
+            g_meta->remove_file(new_path);
+        } else if (g_meta->is_dir(new_path)) {
+            if (!g_meta->is_empty_dir(new_path)) {
+                return -ENOTEMPTY;
+            }
+            g_meta->remove_dir(new_path);
         }
-        g_meta->remove_dir(new_path);
-    }
-
-    if (!g_meta->rename(old_path, new_path)) {
-        return -ENOENT;
-    }
 
-    return 0;
+        if (!g_meta->rename(old_path, new_path)) {
+            return -ENOENT;
+        }
+        return 0;
+    });
 }
 
 // ------------------------------------------------------------
@@ -252,12 +304,25 @@ static int raidfs_open(const char *path, struct fuse_file_info *fi)
 {
     std::string p(path);
 
-    if (is_internal_meta(p))
+    if (is_metrics_file(p)) {
+        if ((fi->flags & O_ACCMODE) != O_RDONLY)
+            return -EACCES;
+        std::string snapshot = metrics().render();
+        std::lock_guard<std::mutex> lock(g_metrics_mu);
+        fi->fh = METRICS_FH_BIT | ++g_metrics_next_fh;
+        fi->direct_io = 1;
+        g_metrics_snapshots[fi->fh] = std::move(snapshot);
+        return 0;
+    }
+
+    if (is_reserved(p))
         return -EACCES;
 
     if (!g_meta->exists(p))
         return -ENOENT;
 
+    // 句柄用于识别顺序读
+    fi->fh = g_fm->open_handle(p);
     return 0;
 }
 
@@ -267,22 +332,33 @@ static int raidfs_open(const char *path, struct fuse_file_info *fi)
 static int raidfs_read(const char *path, char *buf, size_t size, off_t offset,
                        struct fuse_file_info *fi)
 {
-    (void)fi;
-
     std::string p(path);
 
-    if (is_internal_meta(p))
+    if (fi && (fi->fh & METRICS_FH_BIT)) {
+        std::lock_guard<std::mutex> lock(g_metrics_mu);
+        auto it = g_metrics_snapshots.find(fi->fh);
+        if (it == g_metrics_snapshots.end())
+            return -EBADF;
+        const std::string &data = it->second;
+        if ((uint64_t)offset >= data.size())
+            return 0;
+        size_t n = std::min(size, data.size() - (size_t)offset);
+        memcpy(buf, data.data() + offset, n);
+        return (int)n;
+    }
+
+    if (is_reserved(p))
         return -EACCES;
 
     if (!g_meta->exists(p))
         return -ENOENT;
 
-    std::string out;
-    if (!g_fm->read(p, (uint64_t)offset, size, out))
+    // 直接读入 FUSE 缓冲区，避免中间字符串的额外复制
+    size_t bytes_read = 0;
+    if (!g_fm->read_into(p, (uint64_t)offset, size, buf, bytes_read, fi ? fi->fh : 0))
         return -EIO;
 
-    memcpy(buf, out.data(), out.size());
-    return (int)out.size();
+    return (int)bytes_read;
 }
 
 // ------------------------------------------------------------
@@ -295,7 +371,7 @@ static int raidfs_write(const char *path, const char *buf, size_t size,
 
     std::string p(path);
 
-    if (is_internal_meta(p))
+    if (is_reserved(p))
         return -EACCES;
 
     if (!g_meta->exists(p))
@@ -317,7 +393,7 @@ static int raidfs_truncate(const char *path, off_t size,
 
     std::string p(path);
 
-    if (is_internal_meta(p))
+    if (is_reserved(p))
         return -EACCES;
 
     if (!g_meta->exists(p))
@@ -329,6 +405,35 @@ static int raidfs_truncate(const char *path, off_t size,
     return 0;
 }
 
+// ------------------------------------------------------------
+// fallocate - 预分配条带（只支持默认模式与 FALLOC_FL_KEEP_SIZE）
+// ------------------------------------------------------------
+static int raidfs_fallocate(const char *path, int mode, off_t offset, off_t length,
+                            struct fuse_file_info *fi)
+{
+    (void)fi;
+
+    std::string p(path);
+
+    if (is_reserved(p))
+        return -EACCES;
+
+    if (mode & ~FALLOC_FL_KEEP_SIZE)
+        return -EOPNOTSUPP;
+
+    if (offset < 0 || length <= 0)
+        return -EINVAL;
+
+    if (!g_meta->exists(p))
+        return -ENOENT;
+
+    if (!g_fm->fallocate(p, (uint64_t)offset, (uint64_t)length,
+                         (mode & FALLOC_FL_KEEP_SIZE) != 0))
+        return -EIO;
+
+    return 0;
+}
+
 // ------------------------------------------------------------
 // utimens - 设置文件时间戳（许多程序需要此功能）
 // ------------------------------------------------------------
@@ -340,7 +445,7 @@ static int raidfs_utimens(const char *path, const struct timespec ts[2],
 
     std::string p(path);
 
-    if (is_internal_meta(p))
+    if (is_reserved(p))
         return -EACCES;
 
     // 检查路径是否存在（文件或目录）
@@ -385,6 +490,9 @@ static int raidfs_access(const char *path, int mask)
     if (is_internal_meta(p))
         return -ENOENT;
 
+    if (is_metrics_file(p))
+        return (mask & (W_OK | X_OK)) ? -EACCES : 0;
+
     // 根目录
     if (p == "/") {
         return 0;
@@ -409,7 +517,7 @@ static int raidfs_chmod(const char *path, mode_t mode,
 
     std::string p(path);
 
-    if (is_internal_meta(p))
+    if (is_reserved(p))
         return -EACCES;
 
     // 检查路径是否存在
@@ -433,7 +541,7 @@ static int raidfs_chown(const char *path, uid_t uid, gid_t gid,
 
     std::string p(path);
 
-    if (is_internal_meta(p))
+    if (is_reserved(p))
         return -EACCES;
 
     // 检查路径是否存在
@@ -450,8 +558,11 @@ static int raidfs_chown(const char *path, uid_t uid, gid_t gid,
 // ------------------------------------------------------------
 static int raidfs_flush(const char *path, struct fuse_file_info *fi)
 {
-    (void)path;
-    (void)fi;
+    if (fi && (fi->fh & METRICS_FH_BIT))
+        return 0;
+
+    if (!g_fm->close_flush(path))
+        return -EIO;
     return 0;
 }
 
@@ -460,8 +571,16 @@ static int raidfs_flush(const char *path, struct fuse_file_info *fi)
 // ------------------------------------------------------------
 static int raidfs_release(const char *path, struct fuse_file_info *fi)
 {
-    (void)path;
-    (void)fi;
+    if (fi->fh & METRICS_FH_BIT) {
+        std::lock_guard<std::mutex> lock(g_metrics_mu);
+        g_metrics_snapshots.erase(fi->fh);
+        return 0;
+    }
+
+    g_fm->close_handle(fi->fh);
+
+    if (!g_fm->close_flush(path))
+        return -EIO;
     return 0;
 }
 
@@ -471,12 +590,94 @@ static int raidfs_release(const char *path, struct fuse_file_info *fi)
 static int raidfs_fsync(const char *path, int isdatasync,
                         struct fuse_file_info *fi)
 {
-    (void)path;
     (void)isdatasync;
-    (void)fi;
+
+    if (fi && (fi->fh & METRICS_FH_BIT))
+        return 0;
+
+    // 先写回数据，再提交元数据日志（并发的 fsync 共享同一次日志写入）
+    if (!g_fm->fsync(path))
+        return -EIO;
+    if (!g_meta->commit())
+        return -EIO;
     return 0;
 }
 
+// ------------------------------------------------------------
+// 扩展属性：只支持 user.cloudraidfs.stripe_size（文件的条带大小，十进制字节数）
+// 设置只能在文件写入数据之前进行（如 touch 之后、写入之前）
+// ------------------------------------------------------------
+static const char XATTR_STRIPE_SIZE[] = "user.cloudraidfs.stripe_size";
+
+static int raidfs_setxattr(const char *path, const char *name, const char *value,
+                           size_t size, int flags)
+{
+    std::string p(path);
+
+    if (is_reserved(p))
+        return -EACCES;
+
+    if (strcmp(name, XATTR_STRIPE_SIZE) != 0)
+        return -ENOTSUP;
+
+    if (!g_meta->exists(p))
+        return g_meta->is_dir(p) ? -ENOTSUP : -ENOENT;
+
+    // 属性总是存在（未设置时为默认条带大小），XATTR_CREATE 无法满足
+    if (flags & XATTR_CREATE)
+        return -EEXIST;
+
+    std::string text(value, size);
+    char *end = nullptr;
+    unsigned long long stripe_size = std::strtoull(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || !FileManager::valid_stripe_size(stripe_size))
+        return -EINVAL;
+
+    if (!g_fm->set_stripe_size(p, stripe_size))
+        return -EBUSY;
+
+    return 0;
+}
+
+static int raidfs_getxattr(const char *path, const char *name, char *value, size_t size)
+{
+    std::string p(path);
+
+    if (is_internal_meta(p))
+        return -ENOENT;
+
+    if (strcmp(name, XATTR_STRIPE_SIZE) != 0 || !g_meta->exists(p))
+        return -ENODATA;
+
+    std::string text = std::to_string(g_fm->stripe_size(p));
+    if (size == 0)
+        return (int)text.size();
+    if (size < text.size())
+        return -ERANGE;
+    memcpy(value, text.data(), text.size());
+    return (int)text.size();
+}
+
+static int raidfs_listxattr(const char *path, char *list, size_t size)
+{
+    std::string p(path);
+
+    if (is_internal_meta(p))
+        return -ENOENT;
+
+    if (!g_meta->exists(p))
+        return 0;
+
+    // 名字列表：以 '\0' 结尾的名字依次拼接
+    size_t len = sizeof(XATTR_STRIPE_SIZE);
+    if (size == 0)
+        return (int)len;
+    if (size < len)
+        return -ERANGE;
+    memcpy(list, XATTR_STRIPE_SIZE, len);
+    return (int)len;
+}
+
 // ------------------------------------------------------------
 // opendir - 打开目录
 // ------------------------------------------------------------
@@ -511,31 +712,165 @@ static int raidfs_releasedir(const char *path, struct fuse_file_info *fi)
 }
 
 // ------------------------------------------------------------
-// FUSE ops
+// FUSE 操作计时：每个操作一个延迟直方图与一个错误计数
+// 高层与低层接口都经由 raidfs_ops，两者都会被统计
 // ------------------------------------------------------------
+struct FuseOpMetrics {
+    Histogram *latency;
+    Counter *errors;
+};
+
+template <FuseOpMetrics *M, auto Fn> struct Timed;
+
+template <FuseOpMetrics *M, typename... Args, int (*Fn)(Args...)>
+struct Timed<M, Fn> {
+    static int call(Args... args) {
+        ScopedTimer timer(M->latency);
+        int ret = Fn(args...);
+        if (ret < 0) M->errors->add();
+        return ret;
+    }
+};
+
+static FuseOpMetrics make_op_metrics(const char *op) {
+    std::string labels = std::string("op=\"") + op + "\"";
+    return FuseOpMetrics{
+        metrics().histogram("cloudraidfs_fuse_op_duration_seconds", "FUSE 操作耗时", labels),
+        metrics().counter("cloudraidfs_fuse_op_errors_total", "FUSE 操作返回错误的次数", labels),
+    };
+}
+
+#define FUSE_OP(name) \
+    static FuseOpMetrics name##_metrics = make_op_metrics(#name); \
+    raidfs_ops.name = Timed<&name##_metrics, raidfs_##name>::call
+
 static struct fuse_operations raidfs_ops = {};
 static void init_ops() {
-    raidfs_ops.getattr    = raidfs_getattr;
-    raidfs_ops.readdir    = raidfs_readdir;
-    raidfs_ops.create     = raidfs_create;
-    raidfs_ops.mkdir      = raidfs_mkdir;
-    raidfs_ops.rmdir      = raidfs_rmdir;
-    raidfs_ops.unlink     = raidfs_unlink;
-    raidfs_ops.rename     = raidfs_rename;
-    raidfs_ops.truncate   = raidfs_truncate;
-    raidfs_ops.open       = raidfs_open;
-    raidfs_ops.read       = raidfs_read;
-    raidfs_ops.write      = raidfs_write;
-    raidfs_ops.utimens    = raidfs_utimens;
-    raidfs_ops.statfs     = raidfs_statfs;
-    raidfs_ops.access     = raidfs_access;
-    raidfs_ops.chmod      = raidfs_chmod;
-    raidfs_ops.chown      = raidfs_chown;
-    raidfs_ops.flush      = raidfs_flush;
-    raidfs_ops.release    = raidfs_release;
-    raidfs_ops.fsync      = raidfs_fsync;
-    raidfs_ops.opendir    = raidfs_opendir;
-    raidfs_ops.releasedir = raidfs_releasedir;
+    FUSE_OP(getattr);
+    FUSE_OP(readdir);
+    FUSE_OP(create);
+    FUSE_OP(mkdir);
+    FUSE_OP(rmdir);
+    FUSE_OP(unlink);
+    FUSE_OP(rename);
+    FUSE_OP(truncate);
+    FUSE_OP(fallocate);
+    FUSE_OP(open);
+    FUSE_OP(read);
+    FUSE_OP(write);
+    FUSE_OP(utimens);
+    FUSE_OP(statfs);
+    FUSE_OP(access);
+    FUSE_OP(chmod);
+    FUSE_OP(chown);
+    FUSE_OP(flush);
+    FUSE_OP(release);
+    FUSE_OP(fsync);
+    FUSE_OP(setxattr);
+    FUSE_OP(getxattr);
+    FUSE_OP(listxattr);
+    FUSE_OP(opendir);
+    FUSE_OP(releasedir);
+}
+
+// ------------------------------------------------------------
+// 导出已有的统计：缓存命中 / 未命中 / 淘汰、修复队列、后端熔断状态
+// 回调只持有弱引用，对象销毁后取值为 0
+// ------------------------------------------------------------
+template <typename Cache>
+static void register_cache_metrics(const char *name, const std::shared_ptr<Cache> &cache)
+{
+    if (!cache) return;
+    std::weak_ptr<Cache> w = cache;
+    std::string labels = std::string("cache=\"") + name + "\"";
+    auto read = [w](uint64_t (Cache::*fn)() const) {
+        return [w, fn]() -> double {
+            auto c = w.lock();
+            return c ? (double)((*c).*fn)() : 0;
+        };
+    };
+    metrics().counter_fn("cloudraidfs_cache_hits_total", "缓存命中次数", labels,
+                         read(&Cache::hit_count));
+    metrics().counter_fn("cloudraidfs_cache_misses_total", "缓存未命中次数", labels,
+                         read(&Cache::miss_count));
+    metrics().counter_fn("cloudraidfs_cache_evictions_total", "缓存因容量淘汰的条目数", labels,
+                         read(&Cache::eviction_count));
+}
+
+static void register_runtime_metrics(const std::shared_ptr<RAIDChunkStore> &raid,
+                                     const std::shared_ptr<MetadataManager> &meta,
+                                     const std::shared_ptr<FileCache> &file_cache,
+                                     const std::shared_ptr<ChunkCache> &chunk_cache,
+                                     const std::shared_ptr<DiskCache> &disk_cache)
+{
+    register_cache_metrics("file", file_cache);
+    register_cache_metrics("chunk", chunk_cache);
+    register_cache_metrics("disk", disk_cache);
+
+    if (chunk_cache) {
+        std::weak_ptr<ChunkCache> w = chunk_cache;
+        metrics().gauge_fn("cloudraidfs_cache_bytes", "缓存当前占用的字节数", "cache=\"chunk\"",
+                           [w]() -> double { auto c = w.lock(); return c ? (double)c->current_size() : 0; });
+        metrics().counter_fn("cloudraidfs_prefetch_total", "预读放入 chunk 缓存的条带数", "",
+                             [w]() -> double { auto c = w.lock(); return c ? (double)c->prefetch_count() : 0; });
+        metrics().counter_fn("cloudraidfs_prefetch_hits_total", "预读条带被读取命中的次数", "",
+                             [w]() -> double { auto c = w.lock(); return c ? (double)c->prefetch_hit_count() : 0; });
+        metrics().counter_fn("cloudraidfs_prefetch_wasted_total", "预读条带未被读取即被移除的次数", "",
+                             [w]() -> double { auto c = w.lock(); return c ? (double)c->prefetch_wasted_count() : 0; });
+    }
+    if (file_cache) {
+        std::weak_ptr<FileCache> w = file_cache;
+        metrics().gauge_fn("cloudraidfs_cache_bytes", "缓存当前占用的字节数", "cache=\"file\"",
+                           [w]() -> double { auto c = w.lock(); return c ? (double)c->current_size() : 0; });
+    }
+
+    std::weak_ptr<RAIDChunkStore> wr = raid;
+    auto repair = [wr](uint64_t RepairStats::*field) {
+        return [wr, field]() -> double {
+            auto r = wr.lock();
+            return r ? (double)(r->get_repair_stats().*field) : 0;
+        };
+    };
+    metrics().gauge_fn("cloudraidfs_repair_queue_depth", "排队等待修复的条带数", "",
+                       [wr]() -> double { auto r = wr.lock(); return r ? (double)r->get_repair_stats().queue_depth : 0; });
+    metrics().counter_fn("cloudraidfs_repair_completed_total", "修复成功的条带数", "",
+                         repair(&RepairStats::completed));
+    metrics().counter_fn("cloudraidfs_repair_failed_total", "修复失败的条带数", "",
+                         repair(&RepairStats::failed));
+    metrics().counter_fn("cloudraidfs_repair_bytes_total", "修复写入的字节数", "",
+                         repair(&RepairStats::bytes_repaired));
+
+    // 熔断状态：0 正常，1 熔断，2 探测中
+    size_t n = raid->get_backend_health().size();
+    for (size_t b = 0; b < n; b++) {
+        metrics().gauge_fn("cloudraidfs_backend_breaker_state", "后端熔断状态（0 正常，1 熔断，2 探测中）",
+                           "backend=\"" + std::to_string(b) + "\"",
+                           [wr, b]() -> double {
+            auto r = wr.lock();
+            if (!r) return 0;
+            auto stats = r->get_backend_health();
+            return b < stats.size() ? (double)(int)stats[b].state : 0;
+        });
+    }
+
+    // 数据管线的内容索引
+    std::weak_ptr<MetadataManager> wm = meta;
+    auto content = [wm](uint64_t ContentIndexStats::*field) {
+        return [wm, field]() -> double {
+            auto m = wm.lock();
+            return m ? (double)(m->content_stats().*field) : 0;
+        };
+    };
+    metrics().gauge_fn("cloudraidfs_pipeline_ref_stripes", "经内容索引引用存储对象的文件条带数", "",
+                       content(&ContentIndexStats::ref_stripes));
+    metrics().gauge_fn("cloudraidfs_pipeline_zero_stripes", "全零（不存储）的文件条带数", "",
+                       content(&ContentIndexStats::zero_stripes));
+    metrics().gauge_fn("cloudraidfs_pipeline_objects", "内容索引中的存储对象数", "",
+                       content(&ContentIndexStats::objects));
+    metrics().gauge_fn("cloudraidfs_pack_stripes", "小文件打包条带数", "",
+                       content(&ContentIndexStats::packs));
+    metrics().gauge_fn("cloudraidfs_packed_files", "打包存放的文件数", "",
+                       content(&ContentIndexStats::packed_files));
 }
 
 // ------------------------------------------------------------
@@ -561,6 +896,43 @@ int main(int argc, char *argv[])
 
     const YmlNode &root = parser.root();
 
+    // log_level: stderr 日志级别 error / warn / info（默认）/ debug
+    if (root.map.count("log_level")) {
+        const std::string &v = root.map.at("log_level").value;
+        LogLevel level;
+        if (!parse_log_level(v, level)) {
+            std::fprintf(stderr, "未知 log_level: %s\n", v.c_str());
+            return 1;
+        }
+        set_log_level(level);
+    }
+
+    // ------------------------------------------------------------
+    // 运行指标导出
+    // ------------------------------------------------------------
+    std::string metrics_listen;
+
+    if (root.map.count("metrics")) {
+        const auto &metrics_node = root.map.at("metrics");
+
+        // file: 挂载点下的只读虚拟文件，默认 /.cloudraidfs_metrics，空字符串关闭
+        if (metrics_node.map.count("file")) {
+            g_metrics_path = metrics_node.map.at("file").value;
+            if (!g_metrics_path.empty() && g_metrics_path[0] != '/') {
+                g_metrics_path = "/" + g_metrics_path;
+            }
+            if (g_metrics_path == "/" || g_metrics_path.find('/', 1) != std::string::npos) {
+                std::fprintf(stderr, "metrics.file 必须是根目录下的文件名\n");
+                return 1;
+            }
+        }
+
+        // listen: Prometheus HTTP 端点（如 127.0.0.1:9180），默认关闭
+        if (metrics_node.map.count("listen")) {
+            metrics_listen = metrics_node.map.at("listen").value;
+        }
+    }
+
     // mountpoint
     std::string mountpoint = root.map.at("mountpoint").value;
 
@@ -580,7 +952,31 @@ int main(int argc, char *argv[])
 
         if (type == "local") {
             std::string path = node.map.at("path").value;
-            backends.push_back(std::make_shared<LocalChunkStore>(path));
+            LocalChunkStoreConfig local_config;
+            if (node.map.count("layout")) {
+                local_config.layout = node.map.at("layout").value;
+                if (local_config.layout != "files" && local_config.layout != "log") {
+                    std::fprintf(stderr, "未知 local layout: %s\n",
+                                 local_config.layout.c_str());
+                    return 1;
+                }
+            }
+            if (node.map.count("sync")) {
+                local_config.sync = node.map.at("sync").value != "false";
+            }
+            if (node.map.count("direct_io")) {
+                local_config.direct_io = node.map.at("direct_io").value == "true";
+            }
+            if (node.map.count("segment_size")) {
+                local_config.segment_size =
+                    std::stoull(node.map.at("segment_size").value) * 1024 * 1024;
+            }
+            auto store = std::make_shared<LocalChunkStore>(path, local_config);
+            if (!store->open()) {
+                std::fprintf(stderr, "无法打开本地后端: %s\n", path.c_str());
+                return 1;
+            }
+            backends.push_back(store);
         }
         else if (type == "webdav") {
             std::string url  = node.map.at("url").value;
@@ -588,7 +984,24 @@ int main(int argc, char *argv[])
                                ? node.map.at("username").value : "";
             std::string pass = node.map.count("password")
                                ? node.map.at("password").value : "";
-            backends.push_back(std::make_shared<WebDavChunkStore>(url, user, pass));
+            WebDavConfig webdav_config;
+            if (node.map.count("connections")) {
+                webdav_config.connections = std::stoull(node.map.at("connections").value);
+            }
+            if (node.map.count("warm_connections")) {
+                webdav_config.warm_connections =
+                    std::stoull(node.map.at("warm_connections").value);
+            }
+            if (node.map.count("keepalive_interval")) {
+                webdav_config.keepalive_interval_ms =
+                    std::stoull(node.map.at("keepalive_interval").value);
+            }
+            if (webdav_config.connections == 0) {
+                std::fprintf(stderr, "webdav 后端 connections 必须大于 0\n");
+                return 1;
+            }
+            backends.push_back(std::make_shared<WebDavChunkStore>(url, user, pass,
+                                                                  webdav_config));
         }
         else if (type == "s3") {
             std::string endpoint   = node.map.at("endpoint").value;
@@ -599,8 +1012,17 @@ int main(int argc, char *argv[])
                            ? (node.map.at("use_ssl").value == "true") : true;
             std::string region = node.map.count("region")
                                  ? node.map.at("region").value : "";
+            size_t connections = node.map.count("connections")
+                                 ? std::stoull(node.map.at("connections").value) : 4;
+            bool pack = node.map.count("pack")
+                        ? (node.map.at("pack").value != "false") : true;
+            if (connections == 0) {
+                std::fprintf(stderr, "s3 后端 connections 必须大于 0\n");
+                return 1;
+            }
             backends.push_back(std::make_shared<S3ChunkStore>(
-                endpoint, access_key, secret_key, bucket, use_ssl, region));
+                endpoint, access_key, secret_key, bucket, use_ssl, region,
+                connections, pack));
         }
         else {
             std::fprintf(stderr, "未知后端类型: %s\n", type.c_str());
@@ -608,11 +1030,150 @@ int main(int argc, char *argv[])
         }
     }
 
+    if ((int)backends.size() < k + m) {
+        std::fprintf(stderr, "后端数量 (%zu) 少于 k+m (%d)\n", backends.size(), k + m);
+        return 1;
+    }
+
+    // ------------------------------------------------------------
+    // 后台运行
+    // ------------------------------------------------------------
+    // RAID 层、修复队列、写回缓冲等会创建常驻线程，而 fuse_main 在后台模式下
+    // 会 fork，子进程中这些线程不复存在；因此在创建线程之前先自行转入后台，
+    // 再以前台模式调用 fuse_main
+    bool foreground = false;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "-d") ||
+            !strcmp(argv[i], "--foreground") || !strcmp(argv[i], "--debug")) {
+            foreground = true;
+        }
+    }
+    if (!foreground && fuse_daemonize(0) != 0) {
+        std::fprintf(stderr, "无法转入后台运行\n");
+        return 1;
+    }
+
     // ------------------------------------------------------------
     // 构建 RAID 层
     // ------------------------------------------------------------
-    auto coder = std::make_shared<RSCoder>();
-    auto raid  = std::make_shared<RAIDChunkStore>(backends, k, m, coder);
+    // rs_layout: 新条带布局，systematic（默认）或 vandermonde（旧格式）
+    RSCoder::Layout layout = RSCoder::Layout::SYSTEMATIC;
+    if (root.map.count("rs_layout")) {
+        const std::string &v = root.map.at("rs_layout").value;
+        if (v == "vandermonde") {
+            layout = RSCoder::Layout::VANDERMONDE;
+        } else if (v != "systematic") {
+            std::fprintf(stderr, "未知 rs_layout: %s\n", v.c_str());
+            return 1;
+        }
+    }
+
+    RAIDConfig raid_config;
+
+    if (root.map.count("raid")) {
+        const auto &raid_node = root.map.at("raid");
+
+        // hedged_read: 是否只先读 k 个 chunk，默认 true
+        if (raid_node.map.count("hedged_read")) {
+            raid_config.hedged_read = raid_node.map.at("hedged_read").value != "false";
+        }
+
+        // hedge_delay: 对冲等待时间（毫秒），默认 200ms
+        if (raid_node.map.count("hedge_delay")) {
+            raid_config.hedge_delay_ms =
+                std::stoull(raid_node.map.at("hedge_delay").value);
+        }
+
+        // io_threads: 每个后端的 I/O 线程数，默认 4
+        if (raid_node.map.count("io_threads")) {
+            raid_config.io_threads =
+                std::stoull(raid_node.map.at("io_threads").value);
+        }
+
+        // io_queue_depth: 每个后端的 I/O 队列深度，默认 64
+        if (raid_node.map.count("io_queue_depth")) {
+            raid_config.io_queue_depth =
+                std::stoull(raid_node.map.at("io_queue_depth").value);
+        }
+
+        // repair_threads: 后台修复线程数，默认 1
+        if (raid_node.map.count("repair_threads")) {
+            raid_config.repair.threads =
+                std::stoull(raid_node.map.at("repair_threads").value);
+        }
+
+        // repair_max_pending: 最多排队等待修复的条带数，默认 4096
+        if (raid_node.map.count("repair_max_pending")) {
+            raid_config.repair.max_pending =
+                std::stoull(raid_node.map.at("repair_max_pending").value);
+        }
+
+        // repair_bandwidth: 每个后端的修复带宽（MB/s），默认 0 不限
+        if (raid_node.map.count("repair_bandwidth")) {
+            raid_config.repair.bandwidth_per_backend =
+                std::stoull(raid_node.map.at("repair_bandwidth").value) * 1024 * 1024;
+        }
+
+        // repair_iops: 每个后端的修复 IOPS，默认 0 不限
+        if (raid_node.map.count("repair_iops")) {
+            raid_config.repair.iops_per_backend =
+                std::stoull(raid_node.map.at("repair_iops").value);
+        }
+
+        // degraded_write: 跳过熔断中的后端，写入法定数量的 chunk 即成功，默认 true
+        if (raid_node.map.count("degraded_write")) {
+            raid_config.degraded_write = raid_node.map.at("degraded_write").value != "false";
+        }
+
+        // write_quorum: 降级写至少成功写入的 chunk 数，默认 0 表示 k+1
+        if (raid_node.map.count("write_quorum")) {
+            raid_config.write_quorum = std::stoi(raid_node.map.at("write_quorum").value);
+        }
+
+        // slow_request: 超过此时间（毫秒）的后端请求按超时计入熔断，默认 5000
+        if (raid_node.map.count("slow_request")) {
+            raid_config.health.slow_request_ms =
+                std::stoull(raid_node.map.at("slow_request").value);
+        }
+
+        // breaker_failures: 连续失败多少次后熔断，默认 5
+        if (raid_node.map.count("breaker_failures")) {
+            raid_config.health.failure_threshold =
+                (uint32_t)std::stoul(raid_node.map.at("breaker_failures").value);
+        }
+
+        // breaker_open_time: 熔断后多久（毫秒）允许探测，默认 30000
+        if (raid_node.map.count("breaker_open_time")) {
+            raid_config.health.open_ms =
+                std::stoull(raid_node.map.at("breaker_open_time").value);
+        }
+
+        // partial_update_max: 增量更新的最大范围（KB），0 关闭，默认 256
+        if (raid_node.map.count("partial_update_max")) {
+            raid_config.partial_update_max =
+                std::stoull(raid_node.map.at("partial_update_max").value) * 1024;
+        }
+    }
+
+    LOG_INFO("RAID配置: hedged_read=%s, hedge_delay=%llums, io_threads=%zu, io_queue_depth=%zu\n",
+             raid_config.hedged_read ? "true" : "false",
+             (unsigned long long)raid_config.hedge_delay_ms,
+             raid_config.io_threads, raid_config.io_queue_depth);
+    LOG_INFO("修复配置: threads=%zu, max_pending=%zu, bandwidth=%lluMB/s, iops=%llu\n",
+             raid_config.repair.threads, raid_config.repair.max_pending,
+             (unsigned long long)(raid_config.repair.bandwidth_per_backend / 1024 / 1024),
+             (unsigned long long)raid_config.repair.iops_per_backend);
+    LOG_INFO("健康检查: degraded_write=%s, write_quorum=%d, slow_request=%llums, "
+             "breaker_failures=%u, breaker_open_time=%llums\n",
+             raid_config.degraded_write ? "true" : "false", raid_config.write_quorum,
+             (unsigned long long)raid_config.health.slow_request_ms,
+             raid_config.health.failure_threshold,
+             (unsigned long long)raid_config.health.open_ms);
+    LOG_INFO("增量更新: partial_update_max=%lluKB\n",
+             (unsigned long long)(raid_config.partial_update_max / 1024));
+
+    auto coder = std::make_shared<RSCoder>(layout);
+    auto raid  = std::make_shared<RAIDChunkStore>(backends, k, m, coder, raid_config);
 
     // ------------------------------------------------------------
     // 初始化缓存
@@ -640,12 +1201,39 @@ int main(int argc, char *argv[])
             cache_config.cache_ttl_seconds = 
                 std::stoull(cache_node.map.at("cache_ttl").value);
         }
+
+        // shards: 分片数（并发读取时减少锁竞争），默认 16
+        if (cache_node.map.count("shards")) {
+            cache_config.shards = std::stoull(cache_node.map.at("shards").value);
+        }
+
+        // policy: 淘汰策略，s3fifo（默认）或 lru
+        if (cache_node.map.count("policy")) {
+            cache_config.policy = cache_node.map.at("policy").value;
+            if (!is_valid_cache_policy(cache_config.policy)) {
+                std::fprintf(stderr, "未知缓存策略: %s\n", cache_config.policy.c_str());
+                return 1;
+            }
+        }
+
+        // page_size: 缓存页大小（KB），默认 128KB
+        if (cache_node.map.count("page_size")) {
+            cache_config.page_size =
+                std::stoull(cache_node.map.at("page_size").value) * 1024;
+            if (cache_config.page_size == 0) {
+                std::fprintf(stderr, "cache.page_size 必须大于 0\n");
+                return 1;
+            }
+        }
     }
     
-    std::fprintf(stderr, "文件缓存配置: max_cache_size=%lluMB, max_file_size=%lluMB, cache_ttl=%llus\n",
-                 (unsigned long long)(cache_config.max_cache_size / 1024 / 1024),
-                 (unsigned long long)(cache_config.max_file_size / 1024 / 1024),
-                 (unsigned long long)cache_config.cache_ttl_seconds);
+    LOG_INFO("文件缓存配置: max_cache_size=%lluMB, max_file_size=%lluMB, cache_ttl=%llus, shards=%zu, policy=%s, page_size=%lluKB\n",
+             (unsigned long long)(cache_config.max_cache_size / 1024 / 1024),
+             (unsigned long long)(cache_config.max_file_size / 1024 / 1024),
+             (unsigned long long)cache_config.cache_ttl_seconds,
+             cache_config.shards,
+             cache_config.policy.c_str(),
+             (unsigned long long)(cache_config.page_size / 1024));
     
     auto file_cache = std::make_shared<FileCache>(cache_config);
 
@@ -669,50 +1257,366 @@ int main(int argc, char *argv[])
             chunk_cache_config.cache_ttl_seconds = 
                 std::stoull(chunk_cache_node.map.at("cache_ttl").value);
         }
+
+        // shards: 分片数（并发读取时减少锁竞争），默认 16
+        if (chunk_cache_node.map.count("shards")) {
+            chunk_cache_config.shards = std::stoull(chunk_cache_node.map.at("shards").value);
+        }
+
+        // policy: 淘汰策略，s3fifo（默认）或 lru
+        if (chunk_cache_node.map.count("policy")) {
+            chunk_cache_config.policy = chunk_cache_node.map.at("policy").value;
+            if (!is_valid_cache_policy(chunk_cache_config.policy)) {
+                std::fprintf(stderr, "未知缓存策略: %s\n", chunk_cache_config.policy.c_str());
+                return 1;
+            }
+        }
     }
     
-    std::fprintf(stderr, "Chunk缓存配置: max_cache_size=%lluMB, cache_ttl=%llus\n",
-                 (unsigned long long)(chunk_cache_config.max_cache_size / 1024 / 1024),
-                 (unsigned long long)chunk_cache_config.cache_ttl_seconds);
+    LOG_INFO("Chunk缓存配置: max_cache_size=%lluMB, cache_ttl=%llus, shards=%zu, policy=%s\n",
+             (unsigned long long)(chunk_cache_config.max_cache_size / 1024 / 1024),
+             (unsigned long long)chunk_cache_config.cache_ttl_seconds,
+             chunk_cache_config.shards,
+             chunk_cache_config.policy.c_str());
     
     auto chunk_cache = std::make_shared<ChunkCache>(chunk_cache_config);
 
+    // ------------------------------------------------------------
+    // 写回缓冲配置
+    // ------------------------------------------------------------
+    WriteBufferConfig wb_config;
+
+    if (root.map.count("write_buffer")) {
+        const auto &wb_node = root.map.at("write_buffer");
+
+        // enabled: 是否启用写回缓冲，默认 true
+        if (wb_node.map.count("enabled")) {
+            wb_config.enabled = wb_node.map.at("enabled").value != "false";
+        }
+
+        // max_dirty_size: 全局脏数据上限（MB），默认 256MB
+        if (wb_node.map.count("max_dirty_size")) {
+            wb_config.max_dirty_bytes =
+                std::stoull(wb_node.map.at("max_dirty_size").value) * 1024 * 1024;
+        }
+
+        // flush_timeout: 脏条带最长停留时间（毫秒），默认 5000ms
+        if (wb_node.map.count("flush_timeout")) {
+            wb_config.flush_timeout_ms =
+                std::stoull(wb_node.map.at("flush_timeout").value);
+        }
+
+        // batch_stripes: 连续写满多少个条带后批量写回，默认 8，1 为逐条带写回
+        if (wb_node.map.count("batch_stripes")) {
+            wb_config.batch_stripes =
+                std::stoull(wb_node.map.at("batch_stripes").value);
+            if (wb_config.batch_stripes == 0) {
+                std::fprintf(stderr, "write_buffer.batch_stripes 必须大于 0\n");
+                return 1;
+            }
+        }
+    }
+
+    LOG_INFO("写回缓冲配置: enabled=%s, max_dirty_size=%lluMB, flush_timeout=%llums, "
+             "batch_stripes=%llu\n",
+             wb_config.enabled ? "true" : "false",
+             (unsigned long long)(wb_config.max_dirty_bytes / 1024 / 1024),
+             (unsigned long long)wb_config.flush_timeout_ms,
+             (unsigned long long)wb_config.batch_stripes);
+
+    // ------------------------------------------------------------
+    // 顺序预读配置
+    // ------------------------------------------------------------
+    ReadaheadConfig ra_config;
+
+    if (root.map.count("readahead")) {
+        const auto &ra_node = root.map.at("readahead");
+
+        // enabled: 是否启用顺序预读，默认 true
+        if (ra_node.map.count("enabled")) {
+            ra_config.enabled = ra_node.map.at("enabled").value != "false";
+        }
+
+        // max_window: 最大预读窗口（条带数），默认 8
+        if (ra_node.map.count("max_window")) {
+            ra_config.max_window = std::stoull(ra_node.map.at("max_window").value);
+            if (ra_config.max_window == 0) ra_config.max_window = 1;
+        }
+
+        // threads: 预读线程数，默认 4
+        if (ra_node.map.count("threads")) {
+            ra_config.threads = std::stoull(ra_node.map.at("threads").value);
+        }
+    }
+
+    LOG_INFO("顺序预读配置: enabled=%s, max_window=%llu, threads=%zu\n",
+             ra_config.enabled ? "true" : "false",
+             (unsigned long long)ra_config.max_window,
+             ra_config.threads);
+
+    // ------------------------------------------------------------
+    // 数据管线配置（去重 / 压缩）
+    // ------------------------------------------------------------
+    DataPipelineConfig dp_config;
+
+    if (root.map.count("data_pipeline")) {
+        const auto &dp_node = root.map.at("data_pipeline");
+
+        // dedup: 内容去重（含全零条带），默认 false
+        if (dp_node.map.count("dedup")) {
+            dp_config.dedup = dp_node.map.at("dedup").value == "true";
+        }
+
+        // compression: none / lz4 / zstd，默认 none
+        if (dp_node.map.count("compression")) {
+            dp_config.compression = dp_node.map.at("compression").value;
+            if (dp_config.compression != "none" && dp_config.compression != "lz4" &&
+                dp_config.compression != "zstd") {
+                std::fprintf(stderr, "data_pipeline.compression 必须为 none / lz4 / zstd\n");
+                return 1;
+            }
+            if (!DataPipeline::codec_available(dp_config.compression)) {
+                std::fprintf(stderr, "data_pipeline.compression: 编译时未启用 %s\n",
+                             dp_config.compression.c_str());
+                return 1;
+            }
+        }
+
+        // zstd_level: zstd 压缩级别，默认 3
+        if (dp_node.map.count("zstd_level")) {
+            dp_config.zstd_level = std::stoi(dp_node.map.at("zstd_level").value);
+        }
+    }
+
+    LOG_INFO("数据管线配置: dedup=%s, compression=%s, zstd_level=%d\n",
+             dp_config.dedup ? "true" : "false",
+             dp_config.compression.c_str(),
+             dp_config.zstd_level);
+
+    // ------------------------------------------------------------
+    // 文件布局配置（条带大小 / 小文件打包）
+    // ------------------------------------------------------------
+    LayoutConfig layout_config;
+
+    if (root.map.count("layout")) {
+        const auto &layout_node = root.map.at("layout");
+
+        // stripe_size: 新文件的默认条带大小（KB），64 ~ 65536 且为 64 的倍数，默认 4096
+        if (layout_node.map.count("stripe_size")) {
+            layout_config.stripe_size =
+                std::stoull(layout_node.map.at("stripe_size").value) * 1024;
+            if (!FileManager::valid_stripe_size(layout_config.stripe_size)) {
+                std::fprintf(stderr, "layout.stripe_size 必须为 64 ~ 65536 之间 64 的倍数 (KB)\n");
+                return 1;
+            }
+        }
+
+        // rules: 路径前缀 → 条带大小（KB），最长的匹配前缀优先
+        if (layout_node.map.count("rules")) {
+            for (const auto &kv : layout_node.map.at("rules").map) {
+                uint64_t size = std::stoull(kv.second.value) * 1024;
+                if (kv.first.empty() || kv.first[0] != '/' ||
+                    !FileManager::valid_stripe_size(size)) {
+                    std::fprintf(stderr, "layout.rules: 无效的规则 %s\n", kv.first.c_str());
+                    return 1;
+                }
+                std::string prefix = kv.first;
+                while (prefix.size() > 1 && prefix.back() == '/') prefix.pop_back();
+                layout_config.rules.emplace_back(prefix, size);
+            }
+        }
+
+        // pack_max: 不超过此大小（KB）的新文件合并写入打包条带，0 关闭，默认 0
+        if (layout_node.map.count("pack_max")) {
+            layout_config.pack_max = std::stoull(layout_node.map.at("pack_max").value) * 1024;
+            if (layout_config.pack_max > FileManager::MAX_PACK_FILE_SIZE) {
+                std::fprintf(stderr, "layout.pack_max 不能超过 %lluKB\n",
+                             (unsigned long long)(FileManager::MAX_PACK_FILE_SIZE / 1024));
+                return 1;
+            }
+        }
+
+        // pack_delay: 关闭的小文件等待打包的最长时间（毫秒），默认 1000
+        if (layout_node.map.count("pack_delay")) {
+            layout_config.pack_delay_ms = std::stoull(layout_node.map.at("pack_delay").value);
+        }
+    }
+
+    // 打包在写回时进行，未启用写回缓冲时不打包
+    if (!wb_config.enabled) {
+        layout_config.pack_max = 0;
+    }
+
+    LOG_INFO("文件布局配置: stripe_size=%lluKB, rules=%zu, pack_max=%lluKB, pack_delay=%llums\n",
+             (unsigned long long)((layout_config.stripe_size ? layout_config.stripe_size
+                                                             : FileManager::STRIPE_SIZE) / 1024),
+             layout_config.rules.size(),
+             (unsigned long long)(layout_config.pack_max / 1024),
+             (unsigned long long)layout_config.pack_delay_ms);
+    for (const auto &rule : layout_config.rules) {
+        LOG_INFO("  条带大小规则: %s → %lluKB\n", rule.first.c_str(),
+                 (unsigned long long)(rule.second / 1024));
+    }
+
+    // ------------------------------------------------------------
+    // 元数据日志配置
+    // ------------------------------------------------------------
+    MetaJournalConfig journal_config;
+
+    if (root.map.count("metadata")) {
+        const auto &meta_node = root.map.at("metadata");
+
+        // commit_interval: 后台提交间隔（毫秒），0 表示只在 fsync / 卸载时提交，默认 5000
+        if (meta_node.map.count("commit_interval")) {
+            journal_config.commit_interval_ms =
+                std::stoull(meta_node.map.at("commit_interval").value);
+        }
+
+        // preload_shards: 挂载后在后台预加载全部元数据分片，默认 true
+        if (meta_node.map.count("preload_shards")) {
+            journal_config.preload_shards =
+                meta_node.map.at("preload_shards").value == "true";
+        }
+    }
+
+    LOG_INFO("元数据日志配置: commit_interval=%llums, preload_shards=%s\n",
+             (unsigned long long)journal_config.commit_interval_ms,
+             journal_config.preload_shards ? "true" : "false");
+
+    // ------------------------------------------------------------
+    // SSD 持久缓存配置
+    // ------------------------------------------------------------
+    DiskCacheConfig disk_cache_config;
+    std::shared_ptr<DiskCache> disk_cache;
+
+    if (root.map.count("disk_cache")) {
+        const auto &dc_node = root.map.at("disk_cache");
+
+        // enabled: 是否启用 SSD 缓存，默认 false
+        if (dc_node.map.count("enabled")) {
+            disk_cache_config.enabled = dc_node.map.at("enabled").value == "true";
+        }
+
+        // path: 缓存目录（启用时必填）
+        if (dc_node.map.count("path")) {
+            disk_cache_config.path = dc_node.map.at("path").value;
+        }
+
+        // max_size: 缓存容量（MB），默认 10240MB
+        if (dc_node.map.count("max_size")) {
+            disk_cache_config.max_size =
+                std::stoull(dc_node.map.at("max_size").value) * 1024 * 1024;
+        }
+
+        // direct_io: 是否使用 O_DIRECT，默认 true
+        if (dc_node.map.count("direct_io")) {
+            disk_cache_config.direct_io = dc_node.map.at("direct_io").value != "false";
+        }
+
+        // write_threads: 异步写入线程数，默认 1
+        if (dc_node.map.count("write_threads")) {
+            disk_cache_config.write_threads =
+                std::stoull(dc_node.map.at("write_threads").value);
+        }
+    }
+
+    if (disk_cache_config.enabled) {
+        if (disk_cache_config.path.empty()) {
+            std::fprintf(stderr, "disk_cache.path 未配置\n");
+            return 1;
+        }
+
+        disk_cache = std::make_shared<DiskCache>(disk_cache_config);
+        if (!disk_cache->open()) {
+            return 1;
+        }
+    }
+
+    LOG_INFO("SSD缓存配置: enabled=%s, path=%s, max_size=%lluMB, direct_io=%s\n",
+             disk_cache_config.enabled ? "true" : "false",
+             disk_cache_config.path.c_str(),
+             (unsigned long long)(disk_cache_config.max_size / 1024 / 1024),
+             disk_cache_config.direct_io ? "true" : "false");
+
+    // ------------------------------------------------------------
+    // FUSE 接口配置
+    // ------------------------------------------------------------
+    FuseConfig fuse_config;
+
+    if (root.map.count("fuse")) {
+        const auto &fuse_node = root.map.at("fuse");
+
+        // lowlevel: 是否使用低层（inode 号）接口，默认 false
+        if (fuse_node.map.count("lowlevel")) {
+            fuse_config.lowlevel = fuse_node.map.at("lowlevel").value == "true";
+        }
+
+        // entry_timeout: 内核目录项缓存时间（毫秒），默认 1000ms（仅低层接口）
+        if (fuse_node.map.count("entry_timeout")) {
+            fuse_config.entry_timeout_ms =
+                std::stoull(fuse_node.map.at("entry_timeout").value);
+        }
+
+        // attr_timeout: 内核属性缓存时间（毫秒），默认 1000ms（仅低层接口）
+        if (fuse_node.map.count("attr_timeout")) {
+            fuse_config.attr_timeout_ms =
+                std::stoull(fuse_node.map.at("attr_timeout").value);
+        }
+
+        // writeback_cache: 内核写回缓存，默认 false（仅低层接口）
+        if (fuse_node.map.count("writeback_cache")) {
+            fuse_config.writeback_cache = fuse_node.map.at("writeback_cache").value == "true";
+        }
+    }
+
+    LOG_INFO("FUSE配置: lowlevel=%s, entry_timeout=%llums, attr_timeout=%llums, writeback_cache=%s\n",
+             fuse_config.lowlevel ? "true" : "false",
+             (unsigned long long)fuse_config.entry_timeout_ms,
+             (unsigned long long)fuse_config.attr_timeout_ms,
+             fuse_config.writeback_cache ? "true" : "false");
+
     // ------------------------------------------------------------
     // 初始化元数据与文件管理器
     // ------------------------------------------------------------
     g_meta = std::make_shared<MetadataManager>();
-    g_fm   = std::make_shared<FileManager>(raid, g_meta, file_cache, chunk_cache);
+    g_fm   = std::make_shared<FileManager>(raid, g_meta, file_cache, chunk_cache,
+                                           wb_config, ra_config, disk_cache, dp_config,
+                                           layout_config);
 
-    // 元数据存储在 CloudRaidFS 内部文件中
+    // 元数据存储在保留条带中（检查点 + 日志）
     if (!g_meta->load_from_backend(g_fm.get())) {
-        // 首次启动或元数据损坏，初始化空的元数据文件
-        std::fprintf(stderr, "初始化新的元数据文件...\n");
+        if (g_meta->is_corrupt()) {
+            // 不能用空元数据覆盖，避免丢失全部文件
+            std::fprintf(stderr, "元数据损坏，拒绝挂载\n");
+            return 1;
+        }
+        // 首次启动，初始化空的元数据
+        LOG_INFO("初始化新的元数据...\n");
         g_meta->save_to_backend(g_fm.get());
     }
 
     // 更新 next_stripe_id，避免与已有 stripe 冲突
-    {
-        uint64_t max_stripe_id = 100;  // 保留 0-99 给元数据
-        std::function<void(const std::string&)> scan_stripes;
-        scan_stripes = [&](const std::string& dir) {
-            auto entries = g_meta->list_dir(dir);
-            for (const auto& name : entries) {
-                std::string full_path = (dir == "/") ? ("/" + name) : (dir + "/" + name);
-                if (g_meta->exists(full_path)) {
-                    const auto& stripes = g_meta->get_stripes(full_path);
-                    for (auto sid : stripes) {
-                        if (sid >= max_stripe_id) {
-                            max_stripe_id = sid + 1;
-                        }
-                    }
-                }
-                scan_stripes(full_path);
-            }
-        };
-        scan_stripes("/");
-        raid->set_next_stripe_id(max_stripe_id);
+    // 元数据记录已使用的最大条带号（包括未加载的分片），不需要遍历全部文件
+    raid->set_next_stripe_id(std::max<uint64_t>(100, g_meta->next_stripe_id()));
+
+    g_meta->start_background_commit(journal_config);
+    if (journal_config.preload_shards) {
+        g_meta->start_preload();
     }
 
+    // ------------------------------------------------------------
+    // 运行指标
+    // ------------------------------------------------------------
+    register_runtime_metrics(raid, g_meta, file_cache, chunk_cache, disk_cache);
+
+    MetricsServer metrics_server;
+    if (!metrics_listen.empty() && !metrics_server.start(metrics_listen)) {
+        return 1;
+    }
+    LOG_INFO("运行指标: file=%s, listen=%s\n",
+             g_metrics_path.empty() ? "(off)" : g_metrics_path.c_str(),
+             metrics_listen.empty() ? "(off)" : metrics_listen.c_str());
+
     // ------------------------------------------------------------
     // 构造 FUSE 参数
     // ------------------------------------------------------------
@@ -724,6 +1628,11 @@ int main(int argc, char *argv[])
         fuse_argv.push_back(argv[i]);
     }
 
+    // 已在前面转入后台
+    if (!foreground) {
+        fuse_argv.push_back((char*)"-f");
+    }
+
     struct fuse_args args = FUSE_ARGS_INIT(
         (int)fuse_argv.size(),
         fuse_argv.data()
@@ -731,10 +1640,24 @@ int main(int argc, char *argv[])
 
     fuse_opt_parse(&args, NULL, NULL, NULL);
 
-    int ret = fuse_main(args.argc, args.argv, &raidfs_ops, nullptr);
+    // 低层接口按 inode 号查找，复用同一套路径处理函数
+    int ret = fuse_config.lowlevel
+              ? run_lowlevel_fuse(&args, &raidfs_ops, fuse_config)
+              : fuse_main(args.argc, args.argv, &raidfs_ops, nullptr);
+
+    metrics_server.stop();
 
-    // 退出前保存元数据到 CloudRaidFS
-    g_meta->save_to_backend(g_fm.get());
+    // 退出前写回所有脏数据，再提交剩余的元数据日志
+    g_meta->stop_preload();
+    g_fm->flush_all();
+    g_meta->stop_background_commit();
+    g_meta->commit();
+
+    // 先销毁文件管理器（等待预读结束），再保存 SSD 缓存索引
+    g_fm.reset();
+    if (disk_cache) {
+        disk_cache->close();
+    }
     fuse_opt_free_args(&args);
 
     return ret;
@@ -1,247 +1,1700 @@
 #include "metadata_manager.h"
+#include "log.h"
 #include "file_manager.h"
 
 #include <cstring>
+#include <string_view>
+#include <cstdio>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
 
-MetadataManager::MetadataManager() {}
+// ------------------------------------------------------------
+// 保留条带布局（0-99）
+// ------------------------------------------------------------
+static const uint64_t META_STRIPE_SIZE = 4ULL * 1024 * 1024;
+
+static const uint64_t SUPERBLOCK_FIRST = 0;         // 条带 0、1
+static const uint64_t JOURNAL_FIRST = 2;            // 条带 2-33
+static const uint32_t JOURNAL_SEGMENTS = 16;        // 每段两个副本
+static const uint32_t JOURNAL_READ_AHEAD = 4;       // 挂载时每批并发读取的日志段数
+static const uint64_t CHECKPOINT_FIRST[2] = { 34, 67 };
+static const uint64_t CHECKPOINT_STRIPES = 33;
+
+// 日志段超过此大小后切换到下一段（每次提交重写整个段，限制写放大）
+static const uint64_t JOURNAL_SEGMENT_BYTES = 1ULL * 1024 * 1024;
+
+static const char SUPERBLOCK_MAGIC[8] = { 'C', 'R', 'F', 'S', 'M', 'E', 'T', 'A' };
+static const uint32_t SUPERBLOCK_VERSION = 1;
+static const size_t SUPERBLOCK_SIZE = 52;
+
+static const char JOURNAL_MAGIC[4] = { 'C', 'R', 'F', 'J' };
+static const size_t JOURNAL_HEADER_SIZE = 20;
+
+// 检查点根：magic + 版本 + 下一个条带号 + 分片索引
+static const char CHECKPOINT_MAGIC[8] = { 'C', 'R', 'F', 'S', 'C', 'K', 'P', 'T' };
+static const uint32_t CHECKPOINT_VERSION = 4;     // 3：分片索引带分片格式；4：带内容索引位置
+
+// 分片数据格式
+static const uint32_t SHARD_FORMAT_STRIPES = 1;   // 文件记录逐个条带号（版本 2 的检查点）
+static const uint32_t SHARD_FORMAT_EXTENTS = 2;   // 文件记录 extent
+static const uint32_t SHARD_FORMAT_LAYOUT = 3;    // 文件记录 extent、条带大小与打包位置
+
+// 检查点分片数：按目录路径哈希固定分片，分片数不随文件数变化，
+// 5000 万文件时每个分片约 1.2 万个文件
+static const uint32_t CHECKPOINT_SHARDS = 4096;
+
+// 并发解析分片的线程数上限；后台预加载每批读取的分片数
+static const size_t SHARD_PARSE_THREADS = 8;
+static const size_t PRELOAD_BATCH = 64;
+
+// 日志记录类型
+enum : uint8_t {
+    OP_CREATE = 1,      // path
+    OP_REMOVE,          // path
+    OP_SET_SIZE,        // path, u64
+    OP_ADD_STRIPE,      // path, u64（旧日志，只在重放时出现）
+    OP_MKDIR,           // path
+    OP_RMDIR,           // path
+    OP_RENAME,          // path, path
+    OP_ADD_EXTENT,      // path, u64 first, u64 count
+    OP_SET_REF,         // 内容哈希（可为空）, u64 条带, u64 存储对象
+    OP_CLEAR_REF,       // 空, u64 条带
+    OP_SET_LAYOUT,      // path, u64 条带大小
+    OP_SET_PACK,        // path, u64 打包条带（0 为清除）, u64 偏移 << 32 | 长度
+};
+
+static uint32_t crc32(const char* data, size_t len) {
+    static uint32_t table[256];
+    static bool init = [] {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int j = 0; j < 8; j++) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)init;
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void put_u32(std::string& out, uint32_t v) {
+    out.append(reinterpret_cast<const char*>(&v), 4);
+}
+
+static void put_u64(std::string& out, uint64_t v) {
+    out.append(reinterpret_cast<const char*>(&v), 8);
+}
+
+static void put_str(std::string& out, const std::string& s) {
+    put_u32(out, static_cast<uint32_t>(s.size()));
+    out.append(s);
+}
+
+// 顺序解析缓冲区，越界时返回 false
+struct ByteReader {
+    const char* p;
+    const char* end;
+
+    bool u8(uint8_t& v) {
+        if (p + 1 > end) return false;
+        v = (uint8_t)*p++;
+        return true;
+    }
+    bool u32(uint32_t& v) {
+        if (p + 4 > end) return false;
+        std::memcpy(&v, p, 4);
+        p += 4;
+        return true;
+    }
+    bool u64(uint64_t& v) {
+        if (p + 8 > end) return false;
+        std::memcpy(&v, p, 8);
+        p += 8;
+        return true;
+    }
+    bool str(std::string& s) {
+        uint32_t len = 0;
+        if (!u32(len)) return false;
+        if ((uint64_t)(end - p) < len) return false;
+        s.assign(p, len);
+        p += len;
+        return true;
+    }
+    // 不复制：v 指向缓冲区内部，缓冲区须在 v 使用期间保持有效
+    bool view(std::string_view& v) {
+        uint32_t len = 0;
+        if (!u32(len)) return false;
+        if ((uint64_t)(end - p) < len) return false;
+        v = std::string_view(p, len);
+        p += len;
+        return true;
+    }
+};
+
+// 一条日志记录（各类型用到的字段见 OP_* 的注释）
+struct JournalRecord {
+    uint8_t op = 0;
+    std::string path, path2;
+    uint64_t value = 0, value2 = 0;
+};
+
+// 解析下一条记录，类型未知或记录被截断时返回 false
+static bool next_record(ByteReader& r, JournalRecord& rec) {
+    rec.path2.clear();
+    rec.value = rec.value2 = 0;
+    if (!r.u8(rec.op) || !r.str(rec.path)) return false;
+
+    switch (rec.op) {
+    case OP_CREATE:
+    case OP_REMOVE:
+    case OP_MKDIR:
+    case OP_RMDIR:
+        return true;
+    case OP_SET_SIZE:
+    case OP_ADD_STRIPE:
+    case OP_CLEAR_REF:
+    case OP_SET_LAYOUT:
+        return r.u64(rec.value);
+    case OP_ADD_EXTENT:
+    case OP_SET_REF:
+    case OP_SET_PACK:
+        return r.u64(rec.value) && r.u64(rec.value2);
+    case OP_RENAME:
+        return r.str(rec.path2);
+    default:
+        return false;
+    }
+}
+
+struct Superblock {
+    uint64_t seq = 0;
+    uint32_t ckpt_slot = 0;
+    uint64_t ckpt_len = 0;
+    uint32_t ckpt_crc = 0;
+    uint32_t journal_seg = 0;
+    uint64_t journal_seq = 0;
+};
+
+static bool parse_superblock(const std::string& data, Superblock& sb) {
+    if (data.size() < SUPERBLOCK_SIZE) return false;
+    if (std::memcmp(data.data(), SUPERBLOCK_MAGIC, 8) != 0) return false;
+
+    uint32_t crc = 0;
+    std::memcpy(&crc, data.data() + SUPERBLOCK_SIZE - 4, 4);
+    if (crc != crc32(data.data(), SUPERBLOCK_SIZE - 4)) return false;
+
+    ByteReader r{ data.data() + 8, data.data() + SUPERBLOCK_SIZE - 4 };
+    uint32_t version = 0;
+    r.u32(version);
+    r.u64(sb.seq);
+    r.u32(sb.ckpt_slot);
+    r.u64(sb.ckpt_len);
+    r.u32(sb.ckpt_crc);
+    r.u32(sb.journal_seg);
+    r.u64(sb.journal_seq);
+
+    return version == SUPERBLOCK_VERSION && sb.ckpt_slot < 2 &&
+           sb.journal_seg < JOURNAL_SEGMENTS &&
+           sb.ckpt_len <= CHECKPOINT_STRIPES * META_STRIPE_SIZE;
+}
+
+// 日志段副本：header(magic, seq, len, crc) + 记录
+static bool parse_journal_copy(const std::string& data, uint64_t seq, std::string& records) {
+    if (data.size() < JOURNAL_HEADER_SIZE) return false;
+    if (std::memcmp(data.data(), JOURNAL_MAGIC, 4) != 0) return false;
+
+    uint64_t s = 0;
+    uint32_t len = 0, crc = 0;
+    std::memcpy(&s, data.data() + 4, 8);
+    std::memcpy(&len, data.data() + 12, 4);
+    std::memcpy(&crc, data.data() + 16, 4);
+
+    if (s != seq || data.size() < JOURNAL_HEADER_SIZE + (size_t)len) return false;
+    if (crc != crc32(data.data() + JOURNAL_HEADER_SIZE, len)) return false;
+
+    records.assign(data.data() + JOURNAL_HEADER_SIZE, len);
+    return true;
+}
+
+MetadataManager::MetadataManager()
+    : shard_locs_(CHECKPOINT_SHARDS),
+      shard_loaded_(new std::atomic<bool>[CHECKPOINT_SHARDS]),
+      shard_dirs_(CHECKPOINT_SHARDS)
+{
+    for (uint32_t i = 0; i < CHECKPOINT_SHARDS; i++) {
+        shard_loaded_[i] = true;
+    }
+}
+
+MetadataManager::~MetadataManager() {
+    stop_preload();
+    stop_background_commit();
+}
+
+// 路径的上级目录，"/a" → "/"，"/a/b" → "/a"
+static std::string parent_of(const std::string& path) {
+    size_t pos = path.rfind('/');
+    if (pos == std::string::npos || pos == 0) return "/";
+    return path.substr(0, pos);
+}
+
+static std::string child_of(const std::string& dir, const std::string& name) {
+    return dir == "/" ? "/" + name : dir + "/" + name;
+}
 
 // ------------------------------------------------------------
-// 从 CloudRaidFS 内部文件加载元数据
+// 加载：超级块 → 检查点根 → 重放日志（分片在访问时或由后台预加载线程加载）
+// 每一步的保留条带都整批并发读取
 // ------------------------------------------------------------
 bool MetadataManager::load_from_backend(FileManager* fm) {
-    // 首先注册元数据文件自身（使用保留的 stripe 0）
-    // 这样 FileManager::read 才能找到正确的 stripe
-    if (!exists(META_PATH)) {
-        create_file(META_PATH);
+    fm_ = fm;
+    corrupt_ = false;
+
+    files.clear();
+    directories.clear();
+    trie.clear();
+    dirty_shards_.clear();
+    stripe_refs_.clear();
+    objects_.clear();
+    by_hash_.clear();
+    content_loc_ = ShardLoc();
+
+    std::vector<std::string> sb_data;
+    fm->read_meta_stripes({ SUPERBLOCK_FIRST, SUPERBLOCK_FIRST + 1 }, sb_data);
+    std::vector<Superblock> sbs;
+    for (const auto& data : sb_data) {
+        Superblock sb;
+        if (parse_superblock(data, sb)) {
+            sbs.push_back(sb);
+        }
+    }
+
+    if (sbs.empty()) {
+        // 没有超级块：旧格式或首次启动
+        if (!load_legacy()) {
+            return false;
+        }
+        LOG_INFO("迁移旧格式元数据到日志格式...\n");
+        adopt_full_snapshot();
+        std::lock_guard<std::mutex> lock(commit_mu_);
+        if (!write_checkpoint()) {
+            LOG_ERROR("MetadataManager: 迁移旧格式元数据失败\n");
+        }
+        return true;
     }
-    files[META_PATH].stripes.clear();
-    files[META_PATH].stripes.push_back(0);  // 保留 stripe 0 给元数据文件
-    files[META_PATH].size = 16ULL * 1024 * 1024;  // 先设置一个足够大的值
 
-    // 尝试读取一段上限数据，如果读不到就认为没有元数据
-    const uint64_t MAX_META_SIZE = 16ull * 1024 * 1024;
+    // 从最新的超级块开始尝试，检查点损坏时退回上一个
+    std::sort(sbs.begin(), sbs.end(),
+              [](const Superblock& a, const Superblock& b) { return a.seq > b.seq; });
 
+    // 两个超级块指向的检查点根一次并发读取（根按 META_STRIPE_SIZE 切分写入）
+    std::vector<uint64_t> root_ids;
+    std::vector<size_t> root_first;
+    for (const Superblock& sb : sbs) {
+        root_first.push_back(root_ids.size());
+        for (uint64_t i = 0; i * META_STRIPE_SIZE < sb.ckpt_len; i++) {
+            root_ids.push_back(CHECKPOINT_FIRST[sb.ckpt_slot] + i);
+        }
+    }
+    root_first.push_back(root_ids.size());
+    std::vector<std::string> root_parts;
+    fm->read_meta_stripes(root_ids, root_parts);
+
+    std::vector<std::string> roots(sbs.size());
+    std::vector<char> root_ok(sbs.size(), 0);
+    for (size_t si = 0; si < sbs.size(); si++) {
+        std::string& root = roots[si];
+        for (size_t i = root_first[si]; i < root_first[si + 1]; i++) {
+            root.append(root_parts[i]);
+            root_parts[i].clear();
+        }
+        if (root.size() >= sbs[si].ckpt_len) {
+            root.resize((size_t)sbs[si].ckpt_len);
+            root_ok[si] = crc32(root.data(), root.size()) == sbs[si].ckpt_crc;
+        }
+    }
+
+    for (size_t si = 0; si < sbs.size(); si++) {
+        const Superblock& sb = sbs[si];
+
+        const std::string& root = roots[si];
+        bool ok = root_ok[si];
+        bool sharded = ok && root.size() >= 8 && std::memcmp(root.data(), CHECKPOINT_MAGIC, 8) == 0;
+        if (sharded) {
+            ok = parse_root(root, shard_locs_, next_stripe_id_, content_loc_) &&
+                 load_content_index(content_loc_);
+            for (uint32_t i = 0; ok && i < CHECKPOINT_SHARDS; i++) {
+                shard_dirs_[i].clear();
+                shard_loaded_[i] = shard_locs_[i].length == 0;
+            }
+        } else if (ok) {
+            // 整体快照格式的检查点
+            ok = decode_snapshot(root);
+        }
+        if (!ok) {
+            LOG_ERROR("MetadataManager: 检查点损坏 (超级块 seq=%llu)\n",
+                      (unsigned long long)sb.seq);
+            files.clear();
+            directories.clear();
+            trie.clear();
+            stripe_refs_.clear();
+            objects_.clear();
+            by_hash_.clear();
+            content_loc_ = ShardLoc();
+            continue;
+        }
+        if (!sharded) {
+            adopt_full_snapshot();
+        }
+
+        sb_seq_ = sb.seq;
+        ckpt_slot_ = sb.ckpt_slot;
+        journal_start_ = sb.journal_seg;
+        cur_seg_ = sb.journal_seg;
+        cur_seq_ = sb.journal_seq;
+        next_copy_ = 0;
+        tail_.clear();
+
+        // 记录两个槽位引用的条带，之后写检查点时释放不再引用的条带
+        ckpt_stripes_[0].clear();
+        ckpt_stripes_[1].clear();
+        for (const auto& loc : shard_locs_) {
+            ckpt_stripes_[ckpt_slot_].insert(loc.stripes.begin(), loc.stripes.end());
+        }
+        ckpt_stripes_[ckpt_slot_].insert(content_loc_.stripes.begin(), content_loc_.stripes.end());
+        for (size_t oi = 0; oi < sbs.size(); oi++) {
+            const Superblock& other = sbs[oi];
+            const std::string& other_root = roots[oi];
+            std::vector<ShardLoc> other_locs(CHECKPOINT_SHARDS);
+            ShardLoc other_content;
+            uint64_t unused = 0;
+            if (other.ckpt_slot != sb.ckpt_slot && root_ok[oi] && other_root.size() >= 8 &&
+                std::memcmp(other_root.data(), CHECKPOINT_MAGIC, 8) == 0 &&
+                parse_root(other_root, other_locs, unused, other_content)) {
+                other_locs.push_back(std::move(other_content));
+                for (const auto& loc : other_locs) {
+                    ckpt_stripes_[other.ckpt_slot].insert(loc.stripes.begin(), loc.stripes.end());
+                }
+            }
+        }
+
+        // 依次重放序号连续的日志段，每段取两个副本中较长的有效副本
+        // 每批 JOURNAL_READ_AHEAD 个段的两个副本并发读取，
+        // 重放涉及的分片在重放这批记录之前一并加载
+        size_t replayed = 0;
+        {
+            std::unique_lock<std::shared_mutex> lock(ns_mu_);
+            uint32_t seg = sb.journal_seg;
+            uint64_t seq = sb.journal_seq;
+            bool chained = true;
+            for (uint32_t n = 0; chained && n < JOURNAL_SEGMENTS; n += JOURNAL_READ_AHEAD) {
+                uint32_t batch = std::min(JOURNAL_READ_AHEAD, JOURNAL_SEGMENTS - n);
+                std::vector<uint64_t> ids;
+                for (uint32_t i = 0; i < batch; i++) {
+                    uint32_t s = (seg + i) % JOURNAL_SEGMENTS;
+                    ids.push_back(JOURNAL_FIRST + s * 2);
+                    ids.push_back(JOURNAL_FIRST + s * 2 + 1);
+                }
+                std::vector<std::string> copies;
+                fm->read_meta_stripes(ids, copies);
+
+                std::vector<std::pair<std::string, int>> segs;   // (记录, 副本)
+                for (uint32_t i = 0; i < batch; i++) {
+                    std::string best;
+                    int best_copy = -1;
+                    for (int c = 0; c < 2; c++) {
+                        std::string records;
+                        if (parse_journal_copy(copies[i * 2 + c], seq + i, records) &&
+                            (best_copy < 0 || records.size() > best.size())) {
+                            best.swap(records);
+                            best_copy = c;
+                        }
+                    }
+                    if (best_copy < 0) {
+                        chained = false;
+                        break;
+                    }
+                    segs.emplace_back(std::move(best), best_copy);
+                }
+
+                std::unordered_set<uint32_t> needed;
+                for (const auto& sg : segs) {
+                    journal_shards(sg.first, needed);
+                }
+                load_shards(std::vector<uint32_t>(needed.begin(), needed.end()));
+
+                for (auto& sg : segs) {
+                    if (!replay_records(sg.first)) {
+                        LOG_ERROR("MetadataManager: 日志段 %u 解析失败\n", seg);
+                        corrupt_ = true;
+                        return false;
+                    }
+
+                    cur_seg_ = seg;
+                    cur_seq_ = seq;
+                    tail_.swap(sg.first);
+                    next_copy_ = (uint32_t)(1 - sg.second);
+                    replayed++;
+
+                    seg = (seg + 1) % JOURNAL_SEGMENTS;
+                    seq++;
+                }
+            }
+        }
+
+        size_t loaded = 0;
+        for (uint32_t i = 0; i < CHECKPOINT_SHARDS; i++) {
+            if (shard_locs_[i].length > 0 && shard_loaded(i)) loaded++;
+        }
+        LOG_INFO("元数据已加载: 重放 %zu 个日志段, 已加载 %zu 个分片\n",
+                 replayed, loaded);
+
+        if (si > 0) {
+            // 退回了旧超级块：较新的日志段可能使用过后续序号，
+            // 跳过这些序号并立即写入新检查点，避免之后重放到它们
+            cur_seq_ = std::max(cur_seq_, sbs[0].journal_seq + JOURNAL_SEGMENTS);
+            std::lock_guard<std::mutex> commit_lock(commit_mu_);
+            write_checkpoint();
+        }
+        return true;
+    }
+
+    corrupt_ = true;
+    return false;
+}
+
+// 旧格式：save_to_backend 把快照作为内部文件写入条带 0 起的连续条带
+bool MetadataManager::load_legacy() {
     std::string data;
-    if (!fm->read(META_PATH, 0, MAX_META_SIZE, data) || data.empty()) {
-        // 首次启动或读取失败，保持元数据文件的注册状态
-        // 清空其他文件，只保留元数据文件自身
+    for (uint64_t i = 0; i < 4; i++) {
+        std::string part;
+        if (!fm_->read_meta_stripe(i, part) || part.empty()) break;
+        data.append(part);
+        if (part.size() < META_STRIPE_SIZE) break;
+    }
+
+    if (data.empty()) {
+        return false;
+    }
+    if (!decode_snapshot(data)) {
         files.clear();
         directories.clear();
         trie.clear();
         return false;
     }
+    return true;
+}
+
+// ------------------------------------------------------------
+// 整体快照（旧格式 / 整体快照检查点，只用于加载）
+// ------------------------------------------------------------
+bool MetadataManager::decode_snapshot(const std::string& data) {
+    ByteReader r{ data.data(), data.data() + data.size() };
+
+    files.clear();
+    directories.clear();
+    trie.clear();
+
+    // 读取文件数量
+    uint32_t file_count = 0;
+    if (!r.u32(file_count)) return false;
+
+    for (uint32_t i = 0; i < file_count; i++) {
+        std::string path;
+        if (!r.str(path)) return false;
+
+        FileMeta meta;
+        if (!r.u64(meta.size)) return false;
+
+        uint32_t stripe_count = 0;
+        if (!r.u32(stripe_count)) return false;
+        if ((uint64_t)(r.end - r.p) < (uint64_t)stripe_count * 8) return false;
+
+        for (uint32_t j = 0; j < stripe_count; j++) {
+            uint64_t id = 0;
+            r.u64(id);
+            meta.append(id, 1);
+        }
+
+        // 旧版本会把元数据文件自身写入快照
+        if (path == META_PATH) {
+            continue;
+        }
+
+        files[path] = std::move(meta);
+        trie.insert(path);
+    }
+
+    // 读取目录数量
+    uint32_t dir_count = 0;
+    if (!r.u32(dir_count)) return false;
+
+    for (uint32_t i = 0; i < dir_count; i++) {
+        std::string path;
+        if (!r.str(path)) return false;
+
+        directories.insert(path);
+        trie.insert(path);
+    }
+
+    return true;
+}
+
+void MetadataManager::adopt_full_snapshot() {
+    for (uint32_t i = 0; i < CHECKPOINT_SHARDS; i++) {
+        shard_locs_[i] = ShardLoc();
+        shard_dirs_[i].clear();
+        shard_loaded_[i] = true;
+    }
+
+    auto add_ancestors = [&](const std::string& path) {
+        std::string dir = path;
+        do {
+            dir = parent_of(dir);
+            uint32_t s = shard_of(dir);
+            if (!shard_dirs_[s].insert(dir).second) break;   // 更上层已登记
+            dirty_shards_.insert(s);
+        } while (dir != "/");
+    };
+
+    for (const auto& kv : files) {
+        add_ancestors(kv.first);
+        for (const Extent& e : kv.second.extents) {
+            next_stripe_id_ = std::max(next_stripe_id_, e.first + e.count);
+        }
+    }
+    for (const auto& dir : directories) {
+        add_ancestors(dir);
+    }
+}
+
+// ------------------------------------------------------------
+// 检查点分片
+// ------------------------------------------------------------
+// FNV-1a：分片号写入检查点，哈希必须跨版本稳定
+uint32_t MetadataManager::shard_of(const std::string& dir) const {
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : dir) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return (uint32_t)(h % CHECKPOINT_SHARDS);
+}
+
+void MetadataManager::ensure_loaded(const std::string& dir) {
+    uint32_t s = shard_of(dir);
+    if (shard_loaded(s)) return;
+
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    load_shard(s);
+}
+
+bool MetadataManager::load_shard(uint32_t shard) {
+    if (shard_loaded(shard)) return true;
+    return load_shards({ shard });
+}
+
+bool MetadataManager::load_shards(const std::vector<uint32_t>& shards) {
+    bool all_ok = true;
+    std::vector<uint32_t> todo;
+    std::vector<ShardLoc> locs;
+    for (uint32_t s : shards) {
+        if (shard_loaded(s)) continue;
+        // 分片已有内存中的修改却没有加载成功过：不能再用磁盘内容覆盖
+        if (dirty_shards_.count(s)) {
+            all_ok = false;
+            continue;
+        }
+        todo.push_back(s);
+        locs.push_back(shard_locs_[s]);
+    }
+    if (todo.empty()) return all_ok;
+
+    std::vector<ParsedShard> parsed;
+    std::vector<char> ok;
+    fetch_shards(locs, parsed, ok);
+    for (size_t i = 0; i < todo.size(); i++) {
+        if (!ok[i]) {
+            LOG_ERROR("MetadataManager: 加载元数据分片 %u 失败\n", todo[i]);
+            all_ok = false;
+            continue;
+        }
+        apply_shard(parsed[i]);
+        shard_loaded_[todo[i]] = true;
+    }
+    return all_ok;
+}
+
+void MetadataManager::fetch_shards(const std::vector<ShardLoc>& locs,
+                                   std::vector<ParsedShard>& parsed,
+                                   std::vector<char>& ok) const {
+    parsed.assign(locs.size(), ParsedShard());
+    ok.assign(locs.size(), 0);
+
+    // 多个分片常打包在同一条带中，每个条带只读一次
+    std::vector<uint64_t> ids;
+    std::unordered_map<uint64_t, size_t> index;
+    for (const auto& loc : locs) {
+        for (uint64_t id : loc.stripes) {
+            if (index.emplace(id, ids.size()).second) ids.push_back(id);
+        }
+    }
+    if (!fm_) return;
+    std::vector<std::string> stripes;
+    fm_->read_meta_stripes(ids, stripes);   // 读取失败的条带为空，对应分片校验失败
+
+    // 校验与解析按分片分给多个线程；只跨一个条带的分片直接在条带数据上解析
+    std::atomic<size_t> next{ 0 };
+    auto worker = [&] {
+        std::string joined;
+        for (size_t i = next++; i < locs.size(); i = next++) {
+            const ShardLoc& loc = locs[i];
+            std::string_view data;
+            if (loc.stripes.size() == 1) {
+                data = stripes[index.at(loc.stripes[0])];
+            } else {
+                joined.clear();
+                for (uint64_t id : loc.stripes) joined.append(stripes[index.at(id)]);
+                data = joined;
+            }
+            if (data.size() < (uint64_t)loc.offset + loc.length) continue;
+            data = data.substr(loc.offset, (size_t)loc.length);
+            ok[i] = crc32(data.data(), data.size()) == loc.crc &&
+                    parse_shard(data, loc.format, parsed[i]);
+        }
+    };
+
+    size_t threads = std::min<size_t>({ locs.size(), SHARD_PARSE_THREADS,
+                                        std::max(1u, std::thread::hardware_concurrency()) });
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool) {
+        t.join();
+    }
+}
+
+void MetadataManager::load_subtree(const std::string& dir) {
+    load_shard(shard_of(dir));
+    for (const auto& name : trie.list_dir(dir)) {
+        std::string child = child_of(dir, name);
+        if (!files.count(child)) {
+            load_subtree(child);
+        }
+    }
+}
+
+void MetadataManager::prepare(const std::string& path) {
+    std::string dir = path;
+    do {
+        dir = parent_of(dir);
+        uint32_t s = shard_of(dir);
+        load_shard(s);
+        shard_dirs_[s].insert(dir);
+        dirty_shards_.insert(s);
+    } while (dir != "/");
+}
+
+void MetadataManager::compact_shards() {
+    // 只重写部分分片时，旧打包条带中其余分片仍被引用，条带无法释放；
+    // 引用的打包条带数远多于存活数据所需时，把存活最少的条带中的分片一并重写
+    std::unordered_map<uint64_t, uint64_t> live;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < CHECKPOINT_SHARDS; i++) {
+        const ShardLoc& loc = shard_locs_[i];
+        if (loc.stripes.size() == 1 && !dirty_shards_.count(i)) {
+            live[loc.stripes[0]] += loc.length;
+            total += loc.length;
+        }
+    }
+
+    size_t target = (size_t)(total / META_STRIPE_SIZE) * 2 + 16;
+    if (live.size() <= target) return;
+
+    std::vector<std::pair<uint64_t, uint64_t>> order(live.begin(), live.end());
+    std::sort(order.begin(), order.end(),
+              [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) {
+                  return a.second < b.second;
+              });
+
+    std::unordered_set<uint64_t> victims;
+    for (size_t i = 0; i < order.size() - target / 2; i++) {
+        victims.insert(order[i].first);
+    }
+    for (uint32_t i = 0; i < CHECKPOINT_SHARDS; i++) {
+        const ShardLoc& loc = shard_locs_[i];
+        if (loc.stripes.size() == 1 && victims.count(loc.stripes[0]) && load_shard(i)) {
+            dirty_shards_.insert(i);
+        }
+    }
+}
+
+// 分片格式：目录数，每个目录：目录路径、文件（名字、大小、条带、条带大小、打包位置）、
+// 子目录（名字、是否显式创建）
+std::string MetadataManager::encode_shard(uint32_t shard) {
+    std::string out;
+    put_u32(out, 0);
+    uint32_t dir_count = 0;
+
+    auto& dirs = shard_dirs_[shard];
+    for (auto it = dirs.begin(); it != dirs.end();) {
+        const std::string& dir = *it;
+        std::vector<std::string> children = trie.list_dir(dir);
+        if (children.empty()) {
+            // 目录已被删除或清空，不再属于该分片
+            it = dirs.erase(it);
+            continue;
+        }
+
+        std::string file_part, dir_part;
+        uint32_t file_count = 0, subdir_count = 0;
+        for (const auto& name : children) {
+            std::string full = child_of(dir, name);
+            if (full == META_PATH) continue;
+
+            auto fit = files.find(full);
+            if (fit != files.end()) {
+                put_str(file_part, name);
+                put_u64(file_part, fit->second.size);
+                put_u32(file_part, static_cast<uint32_t>(fit->second.extents.size()));
+                for (const Extent& e : fit->second.extents) {
+                    put_u64(file_part, e.first);
+                    put_u64(file_part, e.count);
+                }
+                put_u32(file_part, fit->second.stripe_size);
+                put_u64(file_part, fit->second.pack_id);
+                put_u32(file_part, fit->second.pack_offset);
+                put_u32(file_part, fit->second.pack_length);
+                file_count++;
+            } else {
+                put_str(dir_part, name);
+                dir_part.push_back(directories.count(full) ? 1 : 0);
+                subdir_count++;
+            }
+        }
+
+        put_str(out, dir);
+        put_u32(out, file_count);
+        out.append(file_part);
+        put_u32(out, subdir_count);
+        out.append(dir_part);
+        dir_count++;
+        ++it;
+    }
+
+    if (dir_count == 0) {
+        out.clear();
+    } else {
+        std::memcpy(&out[0], &dir_count, 4);
+    }
+    return out;
+}
+
+bool MetadataManager::parse_shard(std::string_view data, uint32_t format,
+                                  ParsedShard& out) const {
+    ByteReader r{ data.data(), data.data() + data.size() };
+
+    uint32_t dir_count = 0;
+    if (!r.u32(dir_count)) return false;
+
+    auto full_path = [](const std::string& dir, std::string_view name) {
+        std::string full;
+        full.reserve(dir.size() + 1 + name.size());
+        if (dir != "/") full.append(dir);
+        full.push_back('/');
+        full.append(name);
+        return full;
+    };
+
+    for (uint32_t i = 0; i < dir_count; i++) {
+        ParsedShard::Dir d;
+        if (!r.str(d.path)) return false;
+        d.shard = shard_of(d.path);
+
+        uint32_t file_count = 0;
+        if (!r.u32(file_count)) return false;
+        for (uint32_t j = 0; j < file_count; j++) {
+            std::string_view name;
+            FileMeta meta;
+            uint32_t n = 0;
+            if (!r.view(name) || !r.u64(meta.size) || !r.u32(n)) return false;
+
+            // 旧格式逐个记录条带号，新格式记录 (first, count)
+            uint64_t width = format == SHARD_FORMAT_STRIPES ? 8 : 16;
+            if ((uint64_t)(r.end - r.p) < (uint64_t)n * width) return false;
+            for (uint32_t k = 0; k < n; k++) {
+                uint64_t first = 0, count = 1;
+                r.u64(first);
+                if (format != SHARD_FORMAT_STRIPES) r.u64(count);
+                meta.append(first, count);
+            }
+            if (format >= SHARD_FORMAT_LAYOUT &&
+                (!r.u32(meta.stripe_size) || !r.u64(meta.pack_id) ||
+                 !r.u32(meta.pack_offset) || !r.u32(meta.pack_length))) {
+                return false;
+            }
+            d.files.emplace_back(full_path(d.path, name), std::move(meta));
+        }
+
+        uint32_t subdir_count = 0;
+        if (!r.u32(subdir_count)) return false;
+        for (uint32_t j = 0; j < subdir_count; j++) {
+            std::string_view name;
+            uint8_t is_explicit = 0;
+            if (!r.view(name) || !r.u8(is_explicit)) return false;
+            d.subdirs.emplace_back(full_path(d.path, name), is_explicit != 0);
+        }
+        out.dirs.push_back(std::move(d));
+    }
+    return true;
+}
+
+void MetadataManager::apply_shard(ParsedShard& parsed) {
+    for (auto& d : parsed.dirs) {
+        for (auto& f : d.files) {
+            trie.insert(f.first);
+            files[std::move(f.first)] = std::move(f.second);
+        }
+        for (auto& sub : d.subdirs) {
+            if (sub.second) {
+                trie.insert(sub.first);
+                directories.insert(std::move(sub.first));
+            } else {
+                // 子目录的内容在其所在分片中
+                trie.insert_dir(sub.first);
+            }
+        }
+        shard_dirs_[d.shard].insert(std::move(d.path));
+    }
+}
+
+bool MetadataManager::parse_root(const std::string& data, std::vector<ShardLoc>& locs,
+                                 uint64_t& next_stripe_id, ShardLoc& content_loc) {
+    ByteReader r{ data.data() + 8, data.data() + data.size() };
+
+    uint32_t version = 0, shard_count = 0;
+    if (!r.u32(version) || version < 2 || version > CHECKPOINT_VERSION) return false;
+    if (!r.u64(next_stripe_id)) return false;
+    if (!r.u32(shard_count) || shard_count != CHECKPOINT_SHARDS) return false;
+
+    locs.assign(CHECKPOINT_SHARDS, ShardLoc());
+    for (uint32_t i = 0; i < shard_count; i++) {
+        ShardLoc& loc = locs[i];
+        uint32_t n = 0;
+        if (!r.u64(loc.length) || !r.u32(loc.crc) || !r.u32(loc.offset)) return false;
+        loc.format = SHARD_FORMAT_STRIPES;
+        if (version >= 3 && !r.u32(loc.format)) return false;
+        if (!r.u32(n)) return false;
+        if ((uint64_t)(r.end - r.p) < (uint64_t)n * 8) return false;
+        loc.stripes.resize(n);
+        for (uint32_t j = 0; j < n; j++) {
+            r.u64(loc.stripes[j]);
+        }
+    }
+
+    // 版本 4 起根的末尾为内容索引的位置
+    content_loc = ShardLoc();
+    if (version >= 4) {
+        uint32_t n = 0;
+        if (!r.u64(content_loc.length) || !r.u32(content_loc.crc) || !r.u32(n)) return false;
+        if ((uint64_t)(r.end - r.p) < (uint64_t)n * 8) return false;
+        content_loc.stripes.resize(n);
+        for (uint32_t j = 0; j < n; j++) {
+            r.u64(content_loc.stripes[j]);
+        }
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// 日志记录
+// ------------------------------------------------------------
+void MetadataManager::append_record(uint8_t op, const std::string& path,
+                                    const std::string* path2, const uint64_t* value,
+                                    const uint64_t* value2) {
+    if (replaying_) return;
+
+    std::lock_guard<std::mutex> lock(journal_mu_);
+
+    // 连续对同一文件设置大小（顺序追加写）只保留最后一次
+    if (op == OP_SET_SIZE && last_size_pos_ != std::string::npos && last_size_path_ == path) {
+        std::memcpy(&pending_[last_size_pos_], value, 8);
+        return;
+    }
+    last_size_pos_ = std::string::npos;
+
+    pending_.push_back((char)op);
+    put_str(pending_, path);
+    if (path2) {
+        put_str(pending_, *path2);
+    }
+    if (value) {
+        if (op == OP_SET_SIZE) {
+            last_size_pos_ = pending_.size();
+            last_size_path_ = path;
+        }
+        put_u64(pending_, *value);
+    }
+    if (value2) {
+        put_u64(pending_, *value2);
+    }
+    next_lsn_++;
+
+    // 本次修改释放的条带在这条记录持久化后删除
+    for (uint64_t id : unlogged_free_) {
+        pending_free_.emplace_back(next_lsn_, id);
+    }
+    unlogged_free_.clear();
+}
+
+bool MetadataManager::replay_records(const std::string& records) {
+    ByteReader r{ records.data(), records.data() + records.size() };
+
+    replaying_ = true;
+    bool ok = true;
+    JournalRecord rec;
+    while (ok && r.p < r.end) {
+        ok = next_record(r, rec);
+        if (!ok) break;
+
+        const std::string& path = rec.path;
+        switch (rec.op) {
+        case OP_CREATE:     do_create_file(path); break;
+        case OP_REMOVE:     do_remove_file(path); break;
+        case OP_MKDIR:      do_create_dir(path); break;
+        case OP_RMDIR:      do_remove_dir(path); break;
+        case OP_SET_SIZE:   do_set_size(path, rec.value); break;
+        case OP_ADD_STRIPE: do_add_stripes(path, rec.value, 1); break;
+        case OP_ADD_EXTENT: do_add_stripes(path, rec.value, rec.value2); break;
+        case OP_RENAME:     do_rename(path, rec.path2); break;
+        case OP_SET_REF:    do_set_stripe_ref(rec.value, rec.value2, path, false); break;
+        case OP_CLEAR_REF:  do_clear_stripe_ref(rec.value); break;
+        case OP_SET_LAYOUT: do_set_stripe_size(path, (uint32_t)rec.value); break;
+        case OP_SET_PACK:
+            do_set_pack(path, rec.value, (uint32_t)(rec.value2 >> 32), (uint32_t)rec.value2);
+            break;
+        }
+    }
+    replaying_ = false;
+    return ok;
+}
+
+// 日志记录涉及的路径及其所有上级目录所在的分片（重放前一并加载）
+void MetadataManager::journal_shards(const std::string& records,
+                                     std::unordered_set<uint32_t>& shards) const {
+    ByteReader r{ records.data(), records.data() + records.size() };
+
+    JournalRecord rec;
+    while (r.p < r.end && next_record(r, rec)) {
+        if (rec.op == OP_SET_REF || rec.op == OP_CLEAR_REF) continue;   // path 为内容哈希
+        for (const std::string* p : { &rec.path, &rec.path2 }) {
+            if (p->empty()) continue;
+            std::string dir = *p;
+            shards.insert(shard_of(dir));
+            while (dir != "/") {
+                dir = parent_of(dir);
+                shards.insert(shard_of(dir));
+            }
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// 提交
+// ------------------------------------------------------------
+bool MetadataManager::commit() {
+    if (!fm_) return true;
+
+    uint64_t target;
+    {
+        std::lock_guard<std::mutex> lock(journal_mu_);
+        target = next_lsn_;
+    }
+
+    // 等待前一个提交者；它可能已经顺带提交了本次调用之前的记录
+    std::lock_guard<std::mutex> commit_lock(commit_mu_);
+
+    std::string batch;
+    uint64_t end;
+    {
+        std::lock_guard<std::mutex> lock(journal_mu_);
+        if (durable_lsn_ >= target) {
+            return true;
+        }
+        batch.swap(pending_);
+        last_size_pos_ = std::string::npos;
+        end = next_lsn_;
+    }
+
+    if (!write_journal(batch)) {
+        std::lock_guard<std::mutex> lock(journal_mu_);
+        pending_.insert(0, batch);
+        last_size_pos_ = std::string::npos;
+        LOG_ERROR("MetadataManager::commit: 写入元数据日志失败\n");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(journal_mu_);
+        if (durable_lsn_ < end) {
+            durable_lsn_ = end;
+        }
+    }
+    free_released();
+    return true;
+}
+
+bool MetadataManager::write_journal(const std::string& batch) {
+    if (batch.empty()) {
+        return true;
+    }
+
+    // 单批超过一个条带：直接写检查点
+    if (batch.size() > META_STRIPE_SIZE - JOURNAL_HEADER_SIZE) {
+        return write_checkpoint();
+    }
+
+    uint32_t saved_seg = cur_seg_;
+    uint64_t saved_seq = cur_seq_;
+    uint32_t saved_copy = next_copy_;
+    std::string saved_tail;
+
+    if (!tail_.empty() && tail_.size() + batch.size() > JOURNAL_SEGMENT_BYTES) {
+        uint32_t next = (cur_seg_ + 1) % JOURNAL_SEGMENTS;
+        if (next == journal_start_) {
+            // 日志环已满：写检查点，旧日志随之作废
+            return write_checkpoint();
+        }
+        cur_seg_ = next;
+        cur_seq_++;
+        next_copy_ = 0;
+        saved_tail.swap(tail_);
+    }
+
+    std::string records = tail_ + batch;
+    std::string data(JOURNAL_MAGIC, 4);
+    put_u64(data, cur_seq_);
+    put_u32(data, static_cast<uint32_t>(records.size()));
+    put_u32(data, crc32(records.data(), records.size()));
+    data.append(records);
+
+    // 与上次写入的副本交替，写入中途崩溃时另一个副本仍保留已提交的记录
+    if (!fm_->write_meta_stripe(JOURNAL_FIRST + cur_seg_ * 2 + next_copy_, data)) {
+        if (cur_seg_ != saved_seg) {
+            tail_.swap(saved_tail);
+        }
+        cur_seg_ = saved_seg;
+        cur_seq_ = saved_seq;
+        next_copy_ = saved_copy;
+        return false;
+    }
+
+    tail_.swap(records);
+    next_copy_ ^= 1;
+    return true;
+}
+
+bool MetadataManager::write_checkpoint() {
+    std::vector<std::pair<uint32_t, std::string>> blobs;
+    std::unordered_set<uint32_t> dirty;
+    std::string covered;
+    std::string content_blob;
+    bool write_content;
+    uint64_t lsn, min_id;
+    {
+        // 快照与日志位置必须一致：独占 ns_mu_ 期间没有新的修改
+        std::unique_lock<std::shared_mutex> ns_lock(ns_mu_);
+        std::lock_guard<std::mutex> lock(journal_mu_);
+        for (uint32_t s : dirty_shards_) {
+            if (!shard_loaded(s)) {
+                LOG_ERROR("MetadataManager: 分片 %u 未能加载，无法写入检查点\n", s);
+                return false;
+            }
+        }
+        compact_shards();
+        dirty.swap(dirty_shards_);
+        for (uint32_t s : dirty) {
+            blobs.emplace_back(s, encode_shard(s));
+        }
+        write_content = content_dirty_;
+        if (write_content) {
+            content_blob = encode_content_index();
+            content_dirty_ = false;
+        }
+        covered.swap(pending_);
+        last_size_pos_ = std::string::npos;
+        lsn = next_lsn_;
+        min_id = next_stripe_id_;
+    }
 
-    const char* p   = data.data();
-    const char* end = p + data.size();
+    std::vector<ShardLoc> locs = shard_locs_;
+    std::unordered_set<uint64_t> used;
+    bool ok = true;
 
-    auto read_u32 = [&](uint32_t& v) {
-        if (p + 4 > end) return false;
-        std::memcpy(&v, p, 4);
-        p += 4;
-        return true;
+    // 把有修改的分片打包写入新分配的条带；超过一个条带的分片单独占用连续条带
+    std::string pack;
+    uint64_t pack_id = 0;
+    auto flush_pack = [&]() {
+        if (!pack.empty()) {
+            ok = ok && fm_->write_meta_stripe(pack_id, pack);
+            pack.clear();
+        }
     };
 
-    auto read_u64 = [&](uint64_t& v) {
-        if (p + 8 > end) return false;
-        std::memcpy(&v, p, 8);
-        p += 8;
-        return true;
-    };
+    for (auto& kv : blobs) {
+        ShardLoc loc;
+        loc.format = SHARD_FORMAT_LAYOUT;
+        const std::string& blob = kv.second;
+        if (!blob.empty()) {
+            loc.length = blob.size();
+            loc.crc = crc32(blob.data(), blob.size());
 
-    files.clear();
-    directories.clear();
-    trie.clear();
+            if (blob.size() > META_STRIPE_SIZE) {
+                for (uint64_t off = 0; ok && off < blob.size(); off += META_STRIPE_SIZE) {
+                    uint64_t id = fm_->allocate_meta_stripe(min_id);
+                    loc.stripes.push_back(id);
+                    ok = fm_->write_meta_stripe(id, blob.substr((size_t)off, (size_t)META_STRIPE_SIZE));
+                }
+            } else {
+                if (pack.size() + blob.size() > META_STRIPE_SIZE) {
+                    flush_pack();
+                }
+                if (pack.empty()) {
+                    pack_id = fm_->allocate_meta_stripe(min_id);
+                }
+                loc.stripes.push_back(pack_id);
+                loc.offset = static_cast<uint32_t>(pack.size());
+                pack.append(blob);
+            }
+        }
+        locs[kv.first] = std::move(loc);
+        if (!ok) break;
+    }
+    flush_pack();
 
-    // 读取文件数量
-    uint32_t file_count = 0;
-    if (!read_u32(file_count)) return false;
+    // 内容索引有修改时整体写入新条带
+    ShardLoc content_loc = content_loc_;
+    if (ok && write_content) {
+        content_loc = ShardLoc();
+        content_loc.length = content_blob.size();
+        content_loc.crc = crc32(content_blob.data(), content_blob.size());
+        for (uint64_t off = 0; ok && off < content_blob.size(); off += META_STRIPE_SIZE) {
+            uint64_t id = fm_->allocate_meta_stripe(min_id);
+            content_loc.stripes.push_back(id);
+            ok = fm_->write_meta_stripe(id, content_blob.substr((size_t)off, (size_t)META_STRIPE_SIZE));
+        }
+    }
 
-    for (uint32_t i = 0; i < file_count; i++) {
-        uint32_t path_len = 0;
-        if (!read_u32(path_len)) return false;
+    uint64_t next_id = 0;
+    for (const auto& loc : locs) {
+        for (uint64_t id : loc.stripes) {
+            used.insert(id);
+            next_id = std::max(next_id, id + 1);
+        }
+    }
+    for (uint64_t id : content_loc.stripes) {
+        used.insert(id);
+        next_id = std::max(next_id, id + 1);
+    }
+    {
+        std::unique_lock<std::shared_mutex> ns_lock(ns_mu_);
+        next_stripe_id_ = std::max(next_stripe_id_, next_id);
+        next_id = next_stripe_id_;
+    }
+
+    std::string root(CHECKPOINT_MAGIC, 8);
+    put_u32(root, CHECKPOINT_VERSION);
+    put_u64(root, next_id);
+    put_u32(root, CHECKPOINT_SHARDS);
+    for (const auto& loc : locs) {
+        put_u64(root, loc.length);
+        put_u32(root, loc.crc);
+        put_u32(root, loc.offset);
+        put_u32(root, loc.format);
+        put_u32(root, static_cast<uint32_t>(loc.stripes.size()));
+        for (uint64_t id : loc.stripes) {
+            put_u64(root, id);
+        }
+    }
+    put_u64(root, content_loc.length);
+    put_u32(root, content_loc.crc);
+    put_u32(root, static_cast<uint32_t>(content_loc.stripes.size()));
+    for (uint64_t id : content_loc.stripes) {
+        put_u64(root, id);
+    }
 
-        if (p + path_len > end) return false;
-        std::string path(p, path_len);
-        p += path_len;
+    uint32_t slot = 1 - ckpt_slot_;
+    uint32_t new_seg = (cur_seg_ + 1) % JOURNAL_SEGMENTS;
+    uint64_t new_seq = cur_seq_ + 1;
 
-        FileMeta meta;
+    if (ok && root.size() > CHECKPOINT_STRIPES * META_STRIPE_SIZE) {
+        LOG_ERROR("MetadataManager: 检查点索引过大 (%zu 字节)\n", root.size());
+        ok = false;
+    }
 
-        if (!read_u64(meta.size)) return false;
+    for (uint64_t i = 0; ok && i * META_STRIPE_SIZE < root.size(); i++) {
+        std::string part = root.substr((size_t)(i * META_STRIPE_SIZE), (size_t)META_STRIPE_SIZE);
+        ok = fm_->write_meta_stripe(CHECKPOINT_FIRST[slot] + i, part);
+    }
 
-        uint32_t stripe_count = 0;
-        if (!read_u32(stripe_count)) return false;
+    // 超级块写入成功后新检查点才生效
+    ok = ok && write_superblock(slot, root.size(), crc32(root.data(), root.size()),
+                                new_seg, new_seq);
+    if (!ok) {
+        std::unique_lock<std::shared_mutex> ns_lock(ns_mu_);
+        std::lock_guard<std::mutex> lock(journal_mu_);
+        pending_.insert(0, covered);
+        last_size_pos_ = std::string::npos;
+        dirty_shards_.insert(dirty.begin(), dirty.end());
+        if (write_content) {
+            content_dirty_ = true;
+        }
+        return false;
+    }
 
-        meta.stripes.resize(stripe_count);
-        for (uint32_t j = 0; j < stripe_count; j++) {
-            if (!read_u64(meta.stripes[j])) return false;
+    // 槽位中原来的检查点（上上个）已被覆盖，释放只有它引用的条带
+    // 上一个检查点仍是回退目标，它引用的条带保留
+    for (uint64_t id : ckpt_stripes_[slot]) {
+        if (!used.count(id) && !ckpt_stripes_[ckpt_slot_].count(id)) {
+            fm_->delete_meta_stripe(id);
         }
+    }
+    ckpt_stripes_[slot].swap(used);
 
-        files[path] = meta;
-        trie.insert(path);
+    {
+        // 未加载的分片之后从新位置加载
+        std::unique_lock<std::shared_mutex> ns_lock(ns_mu_);
+        shard_locs_.swap(locs);
     }
+    content_loc_ = std::move(content_loc);
+    ckpt_slot_ = slot;
+    journal_start_ = new_seg;
+    cur_seg_ = new_seg;
+    cur_seq_ = new_seq;
+    next_copy_ = 0;
+    tail_.clear();
 
-    // 读取目录数量
-    uint32_t dir_count = 0;
-    if (!read_u32(dir_count)) return false;
+    {
+        std::lock_guard<std::mutex> lock(journal_mu_);
+        if (durable_lsn_ < lsn) {
+            durable_lsn_ = lsn;
+        }
+    }
+    free_released();
+    return true;
+}
 
-    for (uint32_t i = 0; i < dir_count; i++) {
-        uint32_t path_len = 0;
-        if (!read_u32(path_len)) return false;
+bool MetadataManager::write_superblock(uint32_t slot, uint64_t ckpt_len, uint32_t ckpt_crc,
+                                       uint32_t journal_seg, uint64_t journal_seq) {
+    uint64_t seq = sb_seq_ + 1;
 
-        if (p + path_len > end) return false;
-        std::string path(p, path_len);
-        p += path_len;
+    std::string data(SUPERBLOCK_MAGIC, 8);
+    put_u32(data, SUPERBLOCK_VERSION);
+    put_u64(data, seq);
+    put_u32(data, slot);
+    put_u64(data, ckpt_len);
+    put_u32(data, ckpt_crc);
+    put_u32(data, journal_seg);
+    put_u64(data, journal_seq);
+    put_u32(data, crc32(data.data(), data.size()));
 
-        directories.insert(path);
-        trie.insert(path);
+    // 两个超级块交替写入，保留上一个有效版本
+    if (!fm_->write_meta_stripe(SUPERBLOCK_FIRST + seq % 2, data)) {
+        return false;
     }
-
+    sb_seq_ = seq;
     return true;
 }
 
 // ------------------------------------------------------------
-// 保存元数据到 CloudRaidFS 内部文件
+// 写入完整检查点
 // ------------------------------------------------------------
 bool MetadataManager::save_to_backend(FileManager* fm) {
-    std::string data;
-
-    auto write_u32 = [&](uint32_t v) {
-        data.append(reinterpret_cast<const char*>(&v), 4);
-    };
-
-    auto write_u64 = [&](uint64_t v) {
-        data.append(reinterpret_cast<const char*>(&v), 8);
-    };
+    fm_ = fm;
+    std::lock_guard<std::mutex> lock(commit_mu_);
+    return write_checkpoint();
+}
 
-    // 排除元数据文件自身，只序列化用户文件
-    uint32_t file_count = 0;
-    for (auto it = files.begin(); it != files.end(); ++it) {
-        if (it->first != META_PATH) {
-            file_count++;
-        }
+// ------------------------------------------------------------
+// 后台定期提交
+// ------------------------------------------------------------
+void MetadataManager::start_background_commit(const MetaJournalConfig& config) {
+    if (config.commit_interval_ms == 0 || committer_.joinable()) {
+        return;
     }
-    write_u32(file_count);
 
-    for (auto it = files.begin(); it != files.end(); ++it) {
-        const std::string& path = it->first;
-        const FileMeta& meta    = it->second;
-
-        // 跳过元数据文件自身
-        if (path == META_PATH) {
-            continue;
+    bg_stop_ = false;
+    auto interval = std::chrono::milliseconds(config.commit_interval_ms);
+    committer_ = std::thread([this, interval] {
+        std::unique_lock<std::mutex> lock(bg_mu_);
+        while (!bg_cv_.wait_for(lock, interval, [this] { return bg_stop_; })) {
+            lock.unlock();
+            commit();
+            lock.lock();
         }
+    });
+}
+
+void MetadataManager::stop_background_commit() {
+    {
+        std::lock_guard<std::mutex> lock(bg_mu_);
+        bg_stop_ = true;
+    }
+    bg_cv_.notify_all();
+    if (committer_.joinable()) {
+        committer_.join();
+    }
+}
 
-        uint32_t path_len = static_cast<uint32_t>(path.size());
-        write_u32(path_len);
-        data.append(path.data(), path_len);
+void MetadataManager::start_preload() {
+    if (preloader_.joinable()) {
+        return;
+    }
 
-        write_u64(meta.size);
+    preload_stop_ = false;
+    preloader_ = std::thread([this] {
+        auto start = std::chrono::steady_clock::now();
+        size_t loaded = 0;
+        uint32_t next = 0;
+        while (!preload_stop_ && next < CHECKPOINT_SHARDS) {
+            std::vector<uint32_t> batch;
+            std::vector<ShardLoc> locs;
+            {
+                std::shared_lock<std::shared_mutex> lock(ns_mu_);
+                for (; next < CHECKPOINT_SHARDS && batch.size() < PRELOAD_BATCH; next++) {
+                    if (shard_loaded(next) || dirty_shards_.count(next)) continue;
+                    batch.push_back(next);
+                    locs.push_back(shard_locs_[next]);
+                }
+            }
+            if (batch.empty()) break;
 
-        uint32_t stripe_count = static_cast<uint32_t>(meta.stripes.size());
-        write_u32(stripe_count);
+            std::vector<ParsedShard> parsed;
+            std::vector<char> ok;
+            fetch_shards(locs, parsed, ok);
 
-        for (size_t i = 0; i < meta.stripes.size(); ++i) {
-            write_u64(meta.stripes[i]);
+            // 读取期间分片可能已被访问加载或修改，只并入仍未加载的分片；
+            // 未加载的分片不会被检查点重写，读到的内容仍然有效
+            std::unique_lock<std::shared_mutex> lock(ns_mu_);
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (!ok[i] || shard_loaded(batch[i]) || dirty_shards_.count(batch[i])) continue;
+                apply_shard(parsed[i]);
+                shard_loaded_[batch[i]] = true;
+                loaded++;
+            }
         }
-    }
 
-    // 序列化目录
-    uint32_t dir_count = static_cast<uint32_t>(directories.size());
-    write_u32(dir_count);
-
-    for (const auto& dir_path : directories) {
-        uint32_t path_len = static_cast<uint32_t>(dir_path.size());
-        write_u32(path_len);
-        data.append(dir_path.data(), path_len);
-    }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        LOG_INFO("元数据分片预加载%s: %zu 个分片, %lldms\n",
+                 preload_stop_ ? "中止" : "完成", loaded, (long long)ms);
+    });
+}
 
-    // 确保元数据文件已注册（使用保留的 stripe ID）
-    if (!exists(META_PATH)) {
-        create_file(META_PATH);
-    }
-    // 清空旧的 stripe 列表，重新分配保留的 stripe
-    files[META_PATH].stripes.clear();
-    
-    // 计算需要多少个 stripe（每个 stripe 4MB）
-    const uint64_t STRIPE_SIZE = 4ULL * 1024 * 1024;
-    uint64_t num_stripes = (data.size() + STRIPE_SIZE - 1) / STRIPE_SIZE;
-    if (num_stripes == 0) num_stripes = 1;
-    
-    // 使用保留的 stripe ID（从 0 开始）
-    for (uint64_t i = 0; i < num_stripes; ++i) {
-        files[META_PATH].stripes.push_back(i);  // 保留 stripe 0, 1, 2, ...
+void MetadataManager::stop_preload() {
+    preload_stop_ = true;
+    if (preloader_.joinable()) {
+        preloader_.join();
     }
-    files[META_PATH].size = data.size();
-
-    // 写入 CloudRaidFS 内部文件
-    return fm->write(META_PATH, 0, data.data(), data.size());
 }
 
 // ------------------------------------------------------------
 // 基本操作
+// 读取前先加载相关目录的分片；修改前由 prepare 加载并标记上级目录的分片
 // ------------------------------------------------------------
+uint64_t MetadataManager::next_stripe_id() const {
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    return next_stripe_id_;
+}
+
 bool MetadataManager::exists(const std::string& path) {
+    ensure_loaded(parent_of(path));
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
     return files.count(path) > 0;
 }
 
-FileMeta* MetadataManager::get(const std::string& path) {
-    if (!exists(path)) return nullptr;
-    return &files[path];
+void MetadataManager::create_file(const std::string& path) {
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    do_create_file(path);
 }
 
-void MetadataManager::create_file(const std::string& path) {
-    if (!exists(path)) {
+void MetadataManager::do_create_file(const std::string& path) {
+    prepare(path);
+    if (!files.count(path)) {
         files[path] = FileMeta();
+        append_record(OP_CREATE, path);
     }
     trie.insert(path);
 }
 
 void MetadataManager::remove_file(const std::string& path) {
-    if (!exists(path)) return;
-    files.erase(path);
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    do_remove_file(path);
+}
+
+void MetadataManager::do_remove_file(const std::string& path) {
+    prepare(path);
+    auto it = files.find(path);
+    if (it == files.end()) return;
+
+    // 释放文件条带对存储对象的引用（未经管线的条带仍按原样保留）
+    if (!stripe_refs_.empty()) {
+        for (const Extent& e : it->second.extents) {
+            for (uint64_t id = e.first; id < e.first + e.count; id++) {
+                auto ref = stripe_refs_.find(id);
+                if (ref == stripe_refs_.end()) continue;
+                unref_object(ref->second);
+                stripe_refs_.erase(ref);
+                content_dirty_ = true;
+            }
+        }
+    }
+
+    if (it->second.pack_id != 0) {
+        unref_pack(it->second.pack_id);
+        content_dirty_ = true;
+    }
+
+    files.erase(it);
     trie.remove(path);
+    append_record(OP_REMOVE, path);
 }
 
 std::vector<std::string> MetadataManager::list_dir(const std::string& path) {
+    ensure_loaded(path);
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
     return trie.list_dir(path);
 }
 
+bool MetadataManager::list_dir_from(const std::string& path, uint64_t offset,
+                                    const std::function<bool(const char*, uint64_t)>& fn) {
+    ensure_loaded(path);
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    return trie.for_each_child(path, offset, fn);
+}
+
+size_t MetadataManager::child_count_nolock(const std::string& path) {
+    load_shard(shard_of(path));
+    return trie.child_count(path);
+}
+
 void MetadataManager::set_size(const std::string& path, uint64_t size) {
-    if (!exists(path)) create_file(path);
-    files[path].size = size;
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    do_set_size(path, size);
+}
+
+void MetadataManager::do_set_size(const std::string& path, uint64_t size) {
+    uint32_t s = shard_of(parent_of(path));
+    load_shard(s);
+    if (!files.count(path)) do_create_file(path);
+    FileMeta& meta = files[path];
+    meta.size = size;
+    dirty_shards_.insert(s);
+    append_record(OP_SET_SIZE, path, nullptr, &size);
+
+    // 截断时打包内容一并截短，之后扩大文件时新增部分为 0
+    // 单独记录：连续的 SET_SIZE 会合并为最后一条，重放时看不到中间较小的大小
+    if (meta.pack_id != 0 && meta.pack_length > size) {
+        do_set_pack(path, meta.pack_id, meta.pack_offset, (uint32_t)size);
+    }
 }
 
 uint64_t MetadataManager::get_size(const std::string& path) {
-    if (!exists(path)) return 0;
-    return files[path].size;
+    ensure_loaded(parent_of(path));
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    auto it = files.find(path);
+    return it == files.end() ? 0 : it->second.size;
+}
+
+void MetadataManager::extend_size(const std::string& path, uint64_t size) {
+    // 大多数写入不扩大文件，先持共享锁检查
+    if (get_size(path) >= size) return;
+
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    auto it = files.find(path);
+    if (it == files.end() || it->second.size < size) {
+        do_set_size(path, size);
+    }
+}
+
+bool MetadataManager::add_stripes(const std::string& path, uint64_t expected_count,
+                                  uint64_t first, uint64_t count) {
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    load_shard(shard_of(parent_of(path)));
+    auto it = files.find(path);
+    if ((it == files.end() ? 0 : it->second.stripe_count) != expected_count) {
+        return false;
+    }
+    do_add_stripes(path, first, count);
+    return true;
+}
+
+void MetadataManager::do_add_stripes(const std::string& path, uint64_t first, uint64_t count) {
+    if (count == 0) return;
+    uint32_t s = shard_of(parent_of(path));
+    load_shard(s);
+    if (!files.count(path)) do_create_file(path);
+    files[path].append(first, count);
+    dirty_shards_.insert(s);
+    next_stripe_id_ = std::max(next_stripe_id_, first + count);
+    append_record(OP_ADD_EXTENT, path, nullptr, &first, &count);
+}
+
+uint64_t MetadataManager::stripe_count(const std::string& path) {
+    ensure_loaded(parent_of(path));
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    auto it = files.find(path);
+    return it == files.end() ? 0 : it->second.stripe_count;
+}
+
+bool MetadataManager::get_stripe(const std::string& path, uint64_t index, uint64_t& stripe_id) {
+    ensure_loaded(parent_of(path));
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    auto it = files.find(path);
+    return it != files.end() && it->second.stripe_at(index, stripe_id);
+}
+
+std::vector<uint64_t> MetadataManager::get_stripe_ids(const std::string& path, uint64_t from,
+                                                      uint64_t count) {
+    std::vector<uint64_t> ids;
+    ensure_loaded(parent_of(path));
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    auto it = files.find(path);
+    if (it == files.end()) {
+        return ids;
+    }
+
+    const FileMeta& meta = it->second;
+    uint64_t id = 0;
+    for (uint64_t i = from; i < from + count && meta.stripe_at(i, id); i++) {
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+std::vector<Extent> MetadataManager::get_extents(const std::string& path) {
+    ensure_loaded(parent_of(path));
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    auto it = files.find(path);
+    if (it == files.end()) {
+        return std::vector<Extent>();
+    }
+    return it->second.extents;
+}
+
+// ------------------------------------------------------------
+// 文件布局：条带大小与打包位置
+// ------------------------------------------------------------
+uint32_t MetadataManager::stripe_size(const std::string& path) {
+    ensure_loaded(parent_of(path));
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    auto it = files.find(path);
+    return it == files.end() ? 0 : it->second.stripe_size;
 }
 
-void MetadataManager::add_stripe(const std::string& path, uint64_t stripe_id) {
-    if (!exists(path)) create_file(path);
-    files[path].stripes.push_back(stripe_id);
+bool MetadataManager::set_stripe_size(const std::string& path, uint32_t stripe_size) {
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    load_shard(shard_of(parent_of(path)));
+    auto it = files.find(path);
+    if (it == files.end() || it->second.stripe_count > 0 || it->second.pack_id != 0) {
+        return false;
+    }
+    if (it->second.stripe_size != stripe_size) {
+        do_set_stripe_size(path, stripe_size);
+    }
+    return true;
+}
+
+void MetadataManager::do_set_stripe_size(const std::string& path, uint32_t stripe_size) {
+    uint32_t s = shard_of(parent_of(path));
+    load_shard(s);
+    if (!files.count(path)) do_create_file(path);
+    files[path].stripe_size = stripe_size;
+    dirty_shards_.insert(s);
+    uint64_t value = stripe_size;
+    append_record(OP_SET_LAYOUT, path, nullptr, &value);
 }
 
-const std::vector<uint64_t>& MetadataManager::get_stripes(const std::string& path) {
-    static const std::vector<uint64_t> empty_stripes;
+void MetadataManager::set_pack(const std::string& path, uint64_t pack_id, uint32_t offset,
+                               uint32_t length) {
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    load_shard(shard_of(parent_of(path)));
     auto it = files.find(path);
     if (it == files.end()) {
-        return empty_stripes;
+        // 打包期间文件已被删除：没有文件引用这个位置
+        return;
+    }
+    const FileMeta& meta = it->second;
+    if (meta.pack_id == pack_id && meta.pack_offset == offset && meta.pack_length == length) {
+        return;
     }
-    return it->second.stripes;
+    do_set_pack(path, pack_id, offset, length);
+}
+
+void MetadataManager::do_set_pack(const std::string& path, uint64_t pack_id, uint32_t offset,
+                                  uint32_t length) {
+    uint32_t s = shard_of(parent_of(path));
+    load_shard(s);
+    if (!files.count(path)) do_create_file(path);
+    FileMeta& meta = files[path];
+    if (meta.pack_id != 0 && meta.pack_id != pack_id) {
+        unref_pack(meta.pack_id);
+    }
+    if (pack_id != 0 && meta.pack_id != pack_id) {
+        packs_[pack_id]++;
+        next_stripe_id_ = std::max(next_stripe_id_, pack_id + 1);
+        // 打包前文件只有一个尚未写入后端的条带，内容改由打包条带保存
+        meta.extents.clear();
+        meta.stripe_count = 0;
+    }
+    meta.pack_id = pack_id;
+    meta.pack_offset = pack_id != 0 ? offset : 0;
+    meta.pack_length = pack_id != 0 ? length : 0;
+    dirty_shards_.insert(s);
+    content_dirty_ = true;
+    uint64_t where = ((uint64_t)meta.pack_offset << 32) | meta.pack_length;
+    append_record(OP_SET_PACK, path, nullptr, &pack_id, &where);
+}
+
+bool MetadataManager::get_pack(const std::string& path, uint64_t& pack_id, uint32_t& offset,
+                               uint32_t& length) {
+    ensure_loaded(parent_of(path));
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    auto it = files.find(path);
+    if (it == files.end() || it->second.pack_id == 0) return false;
+    pack_id = it->second.pack_id;
+    offset = it->second.pack_offset;
+    length = it->second.pack_length;
+    return true;
 }
 
 // ------------------------------------------------------------
 // 目录操作
 // ------------------------------------------------------------
 bool MetadataManager::create_dir(const std::string& path) {
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    return do_create_dir(path);
+}
+
+bool MetadataManager::do_create_dir(const std::string& path) {
     if (path.empty() || path == "/") {
         return false;  // 根目录已存在
     }
+
+    prepare(path);
     
     // 检查是否已存在同名文件
-    if (exists(path)) {
+    if (files.count(path)) {
         return false;
     }
     
@@ -254,39 +1707,43 @@ bool MetadataManager::create_dir(const std::string& path) {
     size_t last_slash = path.rfind('/');
     if (last_slash != std::string::npos && last_slash > 0) {
         std::string parent = path.substr(0, last_slash);
-        if (!is_dir(parent) && parent != "/") {
+        if (!is_dir_nolock(parent) && parent != "/") {
             return false;  // 父目录不存在
         }
     }
     
     directories.insert(path);
     trie.insert(path);
+    append_record(OP_MKDIR, path);
     return true;
 }
 
 bool MetadataManager::remove_dir(const std::string& path) {
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    return do_remove_dir(path);
+}
+
+bool MetadataManager::do_remove_dir(const std::string& path) {
     if (path.empty() || path == "/") {
         return false;  // 不能删除根目录
     }
+
+    prepare(path);
     
     // 检查目录是否存在
     if (directories.count(path) == 0) {
-        // 可能是隐式目录（由文件路径创建）
-        auto children = list_dir(path);
-        if (children.empty()) {
-            return false;  // 目录不存在
-        }
-        return false;  // 隐式目录非空，不能删除
+        // 不存在，或是隐式目录（由文件路径创建，必然非空），都不能删除
+        return false;
     }
     
     // 检查目录是否为空
-    auto children = list_dir(path);
-    if (!children.empty()) {
+    if (child_count_nolock(path) > 0) {
         return false;  // 目录非空
     }
     
     directories.erase(path);
     trie.remove(path);
+    append_record(OP_RMDIR, path);
     return true;
 }
 
@@ -294,42 +1751,58 @@ bool MetadataManager::is_dir(const std::string& path) {
     if (path == "/") {
         return true;  // 根目录
     }
-    
-    // 显式创建的目录
-    if (directories.count(path) > 0) {
+
+    // 显式创建的目录记录在上级目录的分片中，隐式目录要看其自身分片中是否有子项
+    ensure_loaded(parent_of(path));
+    ensure_loaded(path);
+
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    return is_dir_nolock(path);
+}
+
+bool MetadataManager::is_dir_nolock(const std::string& path) {
+    if (path == "/") {
         return true;
     }
-    
-    // 隐式目录（有子项但不是文件）
-    if (!exists(path)) {
-        auto children = list_dir(path);
-        if (!children.empty()) {
-            return true;
-        }
+
+    load_shard(shard_of(parent_of(path)));
+    if (directories.count(path) > 0) {
+        return true;
     }
-    
-    return false;
+    return !files.count(path) && child_count_nolock(path) > 0;
 }
 
 bool MetadataManager::is_empty_dir(const std::string& path) {
     if (!is_dir(path)) {
         return false;
     }
-    auto children = list_dir(path);
-    return children.empty();
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    return trie.child_count(path) == 0;
 }
 
 // ------------------------------------------------------------
 // 重命名操作
 // ------------------------------------------------------------
 bool MetadataManager::rename(const std::string& old_path, const std::string& new_path) {
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    if (!do_rename(old_path, new_path)) {
+        return false;
+    }
+    append_record(OP_RENAME, old_path, &new_path);
+    return true;
+}
+
+bool MetadataManager::do_rename(const std::string& old_path, const std::string& new_path) {
     if (old_path.empty() || new_path.empty() || 
         old_path == "/" || new_path == "/") {
         return false;
     }
     
+    prepare(old_path);
+    prepare(new_path);
+
     // 检查新路径是否已存在
-    if (exists(new_path) || directories.count(new_path) > 0) {
+    if (files.count(new_path) || directories.count(new_path) > 0) {
         return false;
     }
     
@@ -337,13 +1810,18 @@ bool MetadataManager::rename(const std::string& old_path, const std::string& new
     size_t last_slash = new_path.rfind('/');
     if (last_slash != std::string::npos && last_slash > 0) {
         std::string parent = new_path.substr(0, last_slash);
-        if (!is_dir(parent) && parent != "/") {
+        if (!is_dir_nolock(parent) && parent != "/") {
             return false;  // 父目录不存在
         }
     }
     
+    // 重命名目录前把整个子树加载到内存
+    if (!files.count(old_path)) {
+        load_subtree(old_path);
+    }
+
     // 重命名文件
-    if (exists(old_path)) {
+    if (files.count(old_path)) {
         FileMeta meta = files[old_path];
         files.erase(old_path);
         trie.remove(old_path);
@@ -382,6 +1860,8 @@ bool MetadataManager::rename(const std::string& old_path, const std::string& new
         // 移动文件
         for (const auto& pair : files_to_move) {
             std::string new_file_path = new_path + pair.first.substr(old_path.size());
+            prepare(pair.first);
+            prepare(new_file_path);
             files.erase(pair.first);
             trie.remove(pair.first);
             files[new_file_path] = pair.second;
@@ -391,6 +1871,8 @@ bool MetadataManager::rename(const std::string& old_path, const std::string& new
         // 移动子目录
         for (const auto& dir : dirs_to_move) {
             std::string new_dir_path = new_path + dir.substr(old_path.size());
+            prepare(dir);
+            prepare(new_dir_path);
             directories.erase(dir);
             trie.remove(dir);
             directories.insert(new_dir_path);
@@ -407,8 +1889,7 @@ bool MetadataManager::rename(const std::string& old_path, const std::string& new
     }
     
     // 隐式目录的重命名（有子项但未显式创建）
-    auto children = list_dir(old_path);
-    if (!children.empty()) {
+    if (child_count_nolock(old_path) > 0) {
         // 收集所有需要移动的文件和子目录
         std::vector<std::pair<std::string, FileMeta>> files_to_move;
         std::vector<std::string> dirs_to_move;
@@ -435,6 +1916,8 @@ bool MetadataManager::rename(const std::string& old_path, const std::string& new
         // 移动文件
         for (const auto& pair : files_to_move) {
             std::string new_file_path = new_path + pair.first.substr(old_path.size());
+            prepare(pair.first);
+            prepare(new_file_path);
             files.erase(pair.first);
             trie.remove(pair.first);
             files[new_file_path] = pair.second;
@@ -444,6 +1927,8 @@ bool MetadataManager::rename(const std::string& old_path, const std::string& new
         // 移动子目录
         for (const auto& dir : dirs_to_move) {
             std::string new_dir_path = new_path + dir.substr(old_path.size());
+            prepare(dir);
+            prepare(new_dir_path);
             directories.erase(dir);
             trie.remove(dir);
             directories.insert(new_dir_path);
@@ -455,3 +1940,221 @@ bool MetadataManager::rename(const std::string& old_path, const std::string& new
     
     return false;  // 源路径不存在
 }
+
+// ------------------------------------------------------------
+// 条带内容索引
+// ------------------------------------------------------------
+bool MetadataManager::stripe_ref(uint64_t stripe_id, uint64_t& phys) {
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    auto it = stripe_refs_.find(stripe_id);
+    if (it == stripe_refs_.end()) return false;
+    phys = it->second;
+    return true;
+}
+
+bool MetadataManager::ref_existing(uint64_t stripe_id, const std::string& hash,
+                                   bool raw_written) {
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    auto it = by_hash_.find(hash);
+    if (it == by_hash_.end()) return false;
+    do_set_stripe_ref(stripe_id, it->second, hash, raw_written);
+    return true;
+}
+
+void MetadataManager::set_stripe_ref(uint64_t stripe_id, uint64_t phys, const std::string& hash,
+                                     bool raw_written) {
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    do_set_stripe_ref(stripe_id, phys, hash, raw_written);
+}
+
+void MetadataManager::clear_stripe_ref(uint64_t stripe_id) {
+    // 大多数条带没有引用，先持共享锁检查
+    {
+        std::shared_lock<std::shared_mutex> lock(ns_mu_);
+        if (!stripe_refs_.count(stripe_id)) return;
+    }
+    std::unique_lock<std::shared_mutex> lock(ns_mu_);
+    do_clear_stripe_ref(stripe_id);
+}
+
+void MetadataManager::do_set_stripe_ref(uint64_t stripe_id, uint64_t phys,
+                                        const std::string& hash, bool raw_written) {
+    auto it = stripe_refs_.find(stripe_id);
+    if (it != stripe_refs_.end()) {
+        if (it->second == phys) return;
+        unref_object(it->second);
+    } else if (raw_written && !replaying_) {
+        // 条带号自身存放的旧数据不再被读取
+        unlogged_free_.push_back(stripe_id);
+    }
+
+    if (phys != 0) {
+        StripeObject& obj = objects_[phys];
+        if (obj.refs == 0 && !hash.empty()) {
+            obj.hash = hash;
+            // 并发写入相同内容时可能各自上传了一份，只登记先到的一份
+            by_hash_.emplace(hash, phys);
+        }
+        obj.refs++;
+        next_stripe_id_ = std::max(next_stripe_id_, phys + 1);
+    }
+    stripe_refs_[stripe_id] = phys;
+    content_dirty_ = true;
+    append_record(OP_SET_REF, hash, nullptr, &stripe_id, &phys);
+}
+
+void MetadataManager::do_clear_stripe_ref(uint64_t stripe_id) {
+    auto it = stripe_refs_.find(stripe_id);
+    if (it == stripe_refs_.end()) return;
+    unref_object(it->second);
+    stripe_refs_.erase(it);
+    content_dirty_ = true;
+    append_record(OP_CLEAR_REF, std::string(), nullptr, &stripe_id);
+}
+
+void MetadataManager::unref_object(uint64_t phys) {
+    if (phys == 0) return;
+    auto it = objects_.find(phys);
+    if (it == objects_.end() || --it->second.refs > 0) return;
+
+    // 最后一个引用：不再参与去重，修改持久化后删除对象
+    // 重放时不删除（对象可能已经删除；崩溃前未来得及删除的对象会遗留在后端）
+    auto h = by_hash_.find(it->second.hash);
+    if (h != by_hash_.end() && h->second == phys) {
+        by_hash_.erase(h);
+    }
+    objects_.erase(it);
+    if (!replaying_) {
+        unlogged_free_.push_back(phys);
+    }
+}
+
+void MetadataManager::unref_pack(uint64_t pack_id) {
+    auto it = packs_.find(pack_id);
+    if (it == packs_.end() || --it->second > 0) return;
+
+    // 打包条带中的文件全部删除或改写：修改持久化后删除条带
+    packs_.erase(it);
+    if (!replaying_) {
+        unlogged_free_.push_back(pack_id);
+    }
+}
+
+ContentIndexStats MetadataManager::content_stats() const {
+    std::shared_lock<std::shared_mutex> lock(ns_mu_);
+    ContentIndexStats s;
+    s.ref_stripes = stripe_refs_.size();
+    for (const auto& kv : stripe_refs_) {
+        if (kv.second == 0) s.zero_stripes++;
+    }
+    s.objects = objects_.size();
+    s.packs = packs_.size();
+    for (const auto& kv : packs_) {
+        s.packed_files += kv.second;
+    }
+    return s;
+}
+
+// 格式：对象数，每个对象：条带号、内容哈希；引用数，每个引用：文件条带号、对象条带号；
+// 打包条带数，每个打包条带：条带号、引用它的文件数（旧格式没有这一部分）
+// 对象的引用计数在加载时由引用重新统计；打包条带的引用来自文件元数据（分片按需加载），直接保存
+std::string MetadataManager::encode_content_index() const {
+    std::string out;
+    if (stripe_refs_.empty() && packs_.empty()) return out;
+
+    put_u64(out, objects_.size());
+    for (const auto& kv : objects_) {
+        put_u64(out, kv.first);
+        put_str(out, kv.second.hash);
+    }
+    put_u64(out, stripe_refs_.size());
+    for (const auto& kv : stripe_refs_) {
+        put_u64(out, kv.first);
+        put_u64(out, kv.second);
+    }
+    put_u64(out, packs_.size());
+    for (const auto& kv : packs_) {
+        put_u64(out, kv.first);
+        put_u64(out, kv.second);
+    }
+    return out;
+}
+
+bool MetadataManager::decode_content_index(const std::string& data) {
+    ByteReader r{ data.data(), data.data() + data.size() };
+
+    uint64_t object_count = 0;
+    if (!r.u64(object_count)) return false;
+    for (uint64_t i = 0; i < object_count; i++) {
+        uint64_t phys = 0;
+        std::string hash;
+        if (!r.u64(phys) || !r.str(hash)) return false;
+        objects_[phys].hash = hash;
+        if (!hash.empty()) by_hash_.emplace(std::move(hash), phys);
+    }
+
+    uint64_t ref_count = 0;
+    if (!r.u64(ref_count)) return false;
+    if ((uint64_t)(r.end - r.p) < ref_count * 16) return false;
+    stripe_refs_.reserve((size_t)ref_count);
+    for (uint64_t i = 0; i < ref_count; i++) {
+        uint64_t id = 0, phys = 0;
+        r.u64(id);
+        r.u64(phys);
+        stripe_refs_[id] = phys;
+        if (phys == 0) continue;
+        auto it = objects_.find(phys);
+        if (it == objects_.end()) return false;
+        it->second.refs++;
+    }
+
+    if (r.p == r.end) return true;
+    uint64_t pack_count = 0;
+    if (!r.u64(pack_count) || (uint64_t)(r.end - r.p) < pack_count * 16) return false;
+    for (uint64_t i = 0; i < pack_count; i++) {
+        uint64_t id = 0, refs = 0;
+        r.u64(id);
+        r.u64(refs);
+        packs_[id] = refs;
+    }
+    return true;
+}
+
+bool MetadataManager::load_content_index(const ShardLoc& loc) {
+    if (loc.length == 0) return true;
+
+    std::vector<std::string> parts;
+    if (!fm_->read_meta_stripes(loc.stripes, parts)) {
+        LOG_ERROR("MetadataManager: 读取内容索引失败\n");
+        return false;
+    }
+    std::string data;
+    for (const auto& part : parts) {
+        data.append(part);
+    }
+    if (data.size() < loc.length) return false;
+    data.resize((size_t)loc.length);
+    if (crc32(data.data(), data.size()) != loc.crc || !decode_content_index(data)) {
+        LOG_ERROR("MetadataManager: 内容索引损坏\n");
+        return false;
+    }
+    return true;
+}
+
+void MetadataManager::free_released() {
+    std::vector<uint64_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(journal_mu_);
+        auto mid = std::partition(pending_free_.begin(), pending_free_.end(),
+                                  [&](const std::pair<uint64_t, uint64_t>& f) {
+                                      return f.first > durable_lsn_;
+                                  });
+        for (auto it = mid; it != pending_free_.end(); ++it) {
+            ids.push_back(it->second);
+        }
+        pending_free_.erase(mid, pending_free_.end());
+    }
+    for (uint64_t id : ids) {
+        fm_->delete_data_stripe(id);
+    }
+}
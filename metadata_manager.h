@@ -5,40 +5,170 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <string_view>
 #include <cstdint>
 #include "path_trie.h"
 
 class FileManager; // 前置声明
 
+// 一段连续分配的条带：文件第 index 个条带起共 count 个，条带号从 first 起连续
+struct Extent {
+    uint64_t index = 0;
+    uint64_t first = 0;
+    uint64_t count = 0;
+};
+
 struct FileMeta {
     uint64_t size = 0;
-    std::vector<uint64_t> stripes;
+    uint64_t stripe_count = 0;     // 条带总数
+    std::vector<Extent> extents;   // 按 index 递增
+
+    uint32_t stripe_size = 0;      // 条带大小（字节），0 表示默认大小
+
+    // 打包存放的小文件：文件 [0, pack_length) 的内容位于打包条带 pack_id 的 pack_offset 处，
+    // 其后到文件末尾为 0。pack_id 为 0 表示未打包；打包存放的文件没有条带
+    uint64_t pack_id = 0;
+    uint32_t pack_offset = 0;
+    uint32_t pack_length = 0;
+
+    // 追加 count 个从 first 起连续的条带，与最后一段相邻时合并
+    void append(uint64_t first, uint64_t count) {
+        if (count == 0) return;
+        if (!extents.empty() && extents.back().first + extents.back().count == first) {
+            extents.back().count += count;
+        } else {
+            extents.push_back(Extent{ stripe_count, first, count });
+        }
+        stripe_count += count;
+    }
+
+    // 第 index 个条带的条带号
+    bool stripe_at(uint64_t index, uint64_t& id) const {
+        if (index >= stripe_count) return false;
+        auto it = std::upper_bound(extents.begin(), extents.end(), index,
+                                   [](uint64_t i, const Extent& e) { return i < e.index; });
+        --it;
+        id = it->first + (index - it->index);
+        return true;
+    }
+};
+
+// 条带内容索引的统计
+struct ContentIndexStats {
+    uint64_t ref_stripes = 0;   // 经由内容索引引用存储对象的文件条带数
+    uint64_t zero_stripes = 0;  // 其中全零（不存储）的条带数
+    uint64_t objects = 0;       // 存储对象数
+    uint64_t packs = 0;         // 小文件打包条带数
+    uint64_t packed_files = 0;  // 打包存放的文件数
 };
 
+struct MetaJournalConfig {
+    uint64_t commit_interval_ms = 5000;  // 后台定期提交间隔，0 表示只在 fsync / 卸载时提交
+    bool preload_shards = true;          // 挂载后在后台预加载全部分片
+};
+
+// 元数据持久化
+// - 超级块（条带 0、1，交替写入）：记录当前检查点位置与日志起点
+// - 日志环（条带 2-33）：每个修改操作追加一条日志记录，批量提交；
+//   每个日志段占两个条带交替写入，写入中途崩溃不会损坏已提交的记录
+// - 检查点根（A：条带 34-66，B：条带 67-99）：日志环写满时写入，
+//   超级块切换到新检查点后旧日志即可覆盖
+// - 检查点内容按目录路径哈希分为固定数量的分片，分片数据打包存放在普通条带中，
+//   根中只保存分片索引；检查点只重写有修改的分片
+// - 挂载时只读取根索引并重放日志，目录首次被访问时才加载其所在的分片；
+//   可选的后台线程随后分批预加载其余分片，挂载后即可访问命名空间
+// - 加载时同一步需要的保留条带与分片条带整批并发读取，分片在多个线程中解析
+// - 兼容旧的单文件格式与整体快照格式，首次加载时自动迁移
+// 并发：所有公有函数都可以在多个 FUSE 线程中同时调用
+// - 命名空间（文件、目录、分片状态）由读写锁 ns_mu_ 保护，查询持共享锁并发执行，修改持独占锁
+// - 日志缓冲由 journal_mu_ 单独保护，提交写入后端期间不阻塞查询与修改
+// - 查询返回副本而不是内部数据的引用
 class MetadataManager {
 public:
     MetadataManager();
+    ~MetadataManager();
 
-    // 从 CloudRaidFS 内部文件加载元数据
+    // 加载检查点并重放日志（也会记住 fm，之后的提交都经由它读写保留条带）
+    // 没有元数据（首次启动）时返回 false；元数据损坏时同样返回 false，并标记 is_corrupt()
     bool load_from_backend(FileManager* fm);
 
-    // 保存元数据到 CloudRaidFS 内部文件
+    // 写入完整检查点并清空日志（首次启动时初始化元数据）
     bool save_to_backend(FileManager* fm);
 
+    // 提交尚未持久化的日志记录
+    // 组提交：并发调用的 fsync 共享同一次写入，返回时调用前的修改均已持久化
+    bool commit();
+
+    // 后台定期提交，限制崩溃时丢失修改的时间窗口
+    void start_background_commit(const MetaJournalConfig& config);
+    void stop_background_commit();
+
+    // 后台分批加载尚未加载的分片（读取与解析不持锁，只在并入时短暂独占 ns_mu_）
+    void start_preload();
+    void stop_preload();
+
+    // 超级块存在但检查点或日志无法解析
+    bool is_corrupt() const { return corrupt_; }
+
+    // 已使用的最大条带号 + 1（包括未加载分片中的文件与检查点自身的条带）
+    uint64_t next_stripe_id() const;
+
     // 基本操作
     bool exists(const std::string& path);
-    FileMeta* get(const std::string& path);
 
     void create_file(const std::string& path);
     void remove_file(const std::string& path);
 
     std::vector<std::string> list_dir(const std::string& path);
 
+    // 从偏移 offset 起逐个回调目录项 fn(name, next_offset)，fn 返回 false 时停止
+    // 偏移在目录修改后仍然有效，供 readdir 分页；回调期间持有共享锁，不能调用本类的修改操作
+    // 目录不存在时返回 false
+    bool list_dir_from(const std::string& path, uint64_t offset,
+                       const std::function<bool(const char*, uint64_t)>& fn);
+
     void set_size(const std::string& path, uint64_t size);
     uint64_t get_size(const std::string& path);
 
-    void add_stripe(const std::string& path, uint64_t stripe_id);
-    const std::vector<uint64_t>& get_stripes(const std::string& path);
+    // 文件大小小于 size 时扩大到 size（并发写入同一文件时大小不会被改小）
+    void extend_size(const std::string& path, uint64_t size);
+
+    // 文件当前恰有 expected_count 个条带时，追加 count 个从 first 起连续分配的条带
+    // 并发扩展同一文件时只有一方成功，失败方重新读取条带数后重试
+    bool add_stripes(const std::string& path, uint64_t expected_count,
+                     uint64_t first, uint64_t count);
+    uint64_t stripe_count(const std::string& path);
+
+    // 第 index 个条带的条带号，条带不存在时返回 false
+    bool get_stripe(const std::string& path, uint64_t index, uint64_t& stripe_id);
+
+    // 第 [from, from+count) 个条带中已存在的条带号
+    std::vector<uint64_t> get_stripe_ids(const std::string& path, uint64_t from, uint64_t count);
+
+    std::vector<Extent> get_extents(const std::string& path);
+
+    // ---------------- 文件布局 ----------------
+    // 文件的条带大小，0 表示默认大小（文件不存在时同样返回 0）
+    uint32_t stripe_size(const std::string& path);
+
+    // 设置条带大小：只能在文件还没有数据（条带或打包内容）时设置，否则返回 false
+    bool set_stripe_size(const std::string& path, uint32_t stripe_size);
+
+    // 文件内容已写入打包条带 pack_id 的 [offset, offset+length)：记录位置、引用该条带，
+    // 并去掉文件自身（尚未写入的）条带；pack_id 为 0 表示清除打包位置（内容已写入新条带之后调用）
+    void set_pack(const std::string& path, uint64_t pack_id, uint32_t offset, uint32_t length);
+
+    // 文件打包存放时返回 true 并给出位置
+    bool get_pack(const std::string& path, uint64_t& pack_id, uint32_t& offset,
+                  uint32_t& length);
 
     // 目录操作
     bool create_dir(const std::string& path);
@@ -49,12 +179,207 @@ public:
     // 重命名操作
     bool rename(const std::string& old_path, const std::string& new_path);
 
+    // ---------------- 条带内容索引（数据管线） ----------------
+    // 文件条带（文件 extent 中的条带号）可以引用一个存储对象（另外分配的条带号），
+    // 多个条带引用同一对象时共享存储；没有引用的条带按原样存储在同号条带中
+    // 存储对象在最后一个引用释放、且该修改提交后删除
+
+    // 条带有引用时返回 true；phys 为 0 表示全零条带（不存储）
+    bool stripe_ref(uint64_t stripe_id, uint64_t& phys);
+
+    // 内容哈希为 hash 的对象已存在时，条带改为引用该对象并返回 true
+    // raw_written 表示条带号自身可能存有未经管线的旧数据，提交后一并删除
+    bool ref_existing(uint64_t stripe_id, const std::string& hash, bool raw_written);
+
+    // 条带改为引用新写入的对象 phys（0 表示全零条带），释放原有引用
+    // hash 非空时对象登记到内容索引，之后相同内容的条带可以直接引用
+    void set_stripe_ref(uint64_t stripe_id, uint64_t phys, const std::string& hash,
+                        bool raw_written);
+
+    // 条带改回按原样存储（关闭管线后重写），释放原有引用
+    void clear_stripe_ref(uint64_t stripe_id);
+
+    ContentIndexStats content_stats() const;
+
 private:
+    // 实际修改内存状态并追加日志记录（重放时不追加）
+    // 调用方独占持有 ns_mu_，保证修改与日志顺序一致、检查点与日志位置一致
+    void do_create_file(const std::string& path);
+    void do_remove_file(const std::string& path);
+    void do_set_size(const std::string& path, uint64_t size);
+    void do_add_stripes(const std::string& path, uint64_t first, uint64_t count);
+    bool do_create_dir(const std::string& path);
+    bool do_remove_dir(const std::string& path);
+    bool do_rename(const std::string& old_path, const std::string& new_path);
+    void do_set_stripe_ref(uint64_t stripe_id, uint64_t phys, const std::string& hash,
+                           bool raw_written);
+    void do_clear_stripe_ref(uint64_t stripe_id);
+    void do_set_stripe_size(const std::string& path, uint32_t stripe_size);
+    void do_set_pack(const std::string& path, uint64_t pack_id, uint32_t offset,
+                     uint32_t length);
+
+    // 释放对存储对象的一个引用，最后一个引用释放时登记删除（持有 ns_mu_）
+    void unref_object(uint64_t phys);
+
+    // 释放对打包条带的一个引用，最后一个引用释放时登记删除（持有 ns_mu_）
+    void unref_pack(uint64_t pack_id);
+
+    // 追加一条日志记录到 pending_（内部持有 journal_mu_）
+    void append_record(uint8_t op, const std::string& path,
+                       const std::string* path2 = nullptr, const uint64_t* value = nullptr,
+                       const uint64_t* value2 = nullptr);
+
+    // 解析完整快照（旧的单文件格式 / 整体快照检查点）
+    bool decode_snapshot(const std::string& data);
+
+    // 整体加载后建立分片信息，所有分片标记为已加载、需要写入
+    void adopt_full_snapshot();
+
+    // 检查点分片
+    uint32_t shard_of(const std::string& dir) const;
+    bool shard_loaded(uint32_t shard) const { return shard_loaded_[shard].load(); }
+
+    // 加载目录所在分片（查询使用，未加载时内部独占持有 ns_mu_）
+    // 分片加载后不会再卸载，之后持共享锁访问其内容即可
+    void ensure_loaded(const std::string& dir);
+
+    // 以下函数假设已独占持有 ns_mu_
+    // 对已加载的分片 load_shard 不做修改，is_dir_nolock / child_count_nolock 在持共享锁时同样可用
+    bool load_shard(uint32_t shard);
+    bool load_shards(const std::vector<uint32_t>& shards);
+    void load_subtree(const std::string& dir);
+
+    // 修改 path 前调用：加载并标记其所有上级目录的分片
+    void prepare(const std::string& path);
+
+    bool is_dir_nolock(const std::string& path);
+    size_t child_count_nolock(const std::string& path);
+
+    // 打包条带中存活的分片过少时，标记这些分片重写以回收条带
+    void compact_shards();
+
+    std::string encode_shard(uint32_t shard);
+
+    // 解析后的分片：每个目录的文件与子目录（完整路径），并入时只需移动
+    struct ParsedShard {
+        struct Dir {
+            std::string path;
+            uint32_t shard = 0;
+            std::vector<std::pair<std::string, FileMeta>> files;
+            std::vector<std::pair<std::string, bool>> subdirs;   // (路径, 是否显式创建)
+        };
+        std::vector<Dir> dirs;
+    };
+    struct ShardLoc;
+
+    // 解析不访问命名空间，可以不持锁在多个线程中同时进行
+    bool parse_shard(std::string_view data, uint32_t format, ParsedShard& out) const;
+    void apply_shard(ParsedShard& parsed);   // 独占持有 ns_mu_
+
+    // 整批读取分片所在的条带并并发校验、解析，ok[i] 表示 locs[i] 是否成功（不持锁）
+    void fetch_shards(const std::vector<ShardLoc>& locs, std::vector<ParsedShard>& parsed,
+                      std::vector<char>& ok) const;
+
+    // 重放一个日志段中的记录
+    bool replay_records(const std::string& records);
+
+    // 日志记录涉及的分片（重放前一并加载）
+    void journal_shards(const std::string& records, std::unordered_set<uint32_t>& shards) const;
+
+    // 旧格式：条带 0 起始的单个元数据文件
+    bool load_legacy();
+
+    // 以下函数在持有 commit_mu_ 时调用
+    bool write_journal(const std::string& batch);
+    bool write_checkpoint();
+    bool write_superblock(uint32_t slot, uint64_t ckpt_len, uint32_t ckpt_crc,
+                          uint32_t journal_seg, uint64_t journal_seq);
+
     std::unordered_map<std::string, FileMeta> files;
     std::unordered_set<std::string> directories;  // 显式创建的目录
     PathTrie trie;
 
     static constexpr const char* META_PATH = "/.__cloudraidfs_meta";
+
+    // 分片在检查点中的位置：数据为 stripes 依次拼接后从 offset 开始的 length 字节
+    struct ShardLoc {
+        std::vector<uint64_t> stripes;
+        uint32_t offset = 0;
+        uint64_t length = 0;
+        uint32_t crc = 0;
+        uint32_t format = 0;     // 分片数据格式（旧格式的分片在下次重写时升级）
+    };
+
+    std::vector<ShardLoc> shard_locs_;
+    std::unique_ptr<std::atomic<bool>[]> shard_loaded_;
+    std::vector<std::unordered_set<std::string>> shard_dirs_;   // 分片 -> 内存中属于该分片的目录
+    std::unordered_set<uint32_t> dirty_shards_;
+    std::unordered_set<uint64_t> ckpt_stripes_[2];               // 两个检查点槽位各自引用的条带
+    uint64_t next_stripe_id_ = 100;
+
+    static bool parse_root(const std::string& data, std::vector<ShardLoc>& locs,
+                           uint64_t& next_stripe_id, ShardLoc& content_loc);
+
+    // 内容索引：文件条带 → 存储对象（0 为全零），存储对象 → 哈希与引用计数，哈希 → 存储对象
+    // 由 ns_mu_ 保护，挂载时整体加载，检查点中单独保存（有修改时整体重写）
+    struct StripeObject {
+        std::string hash;    // 为空表示不参与去重
+        uint64_t refs = 0;
+    };
+    std::unordered_map<uint64_t, uint64_t> stripe_refs_;
+    std::unordered_map<uint64_t, StripeObject> objects_;
+    std::unordered_map<std::string, uint64_t> by_hash_;
+    std::unordered_map<uint64_t, uint64_t> packs_;   // 打包条带 -> 引用它的文件数（与索引一起保存）
+    bool content_dirty_ = false;
+    ShardLoc content_loc_;
+
+    std::string encode_content_index() const;
+    bool decode_content_index(const std::string& data);
+    bool load_content_index(const ShardLoc& loc);
+
+    // 待删除的条带：本次修改释放的条带（ns_mu_ 保护）在追加日志记录时登记为
+    // (记录序号, 条带号)（journal_mu_ 保护），记录持久化后才删除，
+    // 崩溃时不会删掉仍被已提交元数据引用的数据
+    std::vector<uint64_t> unlogged_free_;
+    std::vector<std::pair<uint64_t, uint64_t>> pending_free_;
+
+    // 删除已持久化的待删除条带（持有 commit_mu_ 时调用）
+    void free_released();
+
+    FileManager* fm_ = nullptr;
+    bool corrupt_ = false;
+    bool replaying_ = false;
+
+    // 命名空间读写锁：加锁顺序 commit_mu_ → ns_mu_ → journal_mu_
+    mutable std::shared_mutex ns_mu_;
+
+    // 内存中的日志：修改操作在 journal_mu_ 下追加
+    std::mutex journal_mu_;
+    std::string pending_;
+    uint64_t next_lsn_ = 0;          // 已追加的记录数
+    uint64_t durable_lsn_ = 0;       // 已持久化的记录数
+    size_t last_size_pos_ = std::string::npos;  // pending_ 中最后一条记录为 SET_SIZE 时其大小字段的位置
+    std::string last_size_path_;
+
+    // 持久化状态：同一时刻只有一个提交者
+    std::mutex commit_mu_;
+    uint64_t sb_seq_ = 0;            // 当前超级块序号
+    uint32_t ckpt_slot_ = 0;         // 当前检查点槽位
+    uint32_t journal_start_ = 0;     // 日志起始段
+    uint32_t cur_seg_ = 0;           // 当前写入的日志段
+    uint64_t cur_seq_ = 0;           // 当前日志段序号
+    uint32_t next_copy_ = 0;         // 当前段下一次写入的副本
+    std::string tail_;               // 当前日志段已提交的记录
+
+    // 后台提交线程
+    std::thread committer_;
+    std::mutex bg_mu_;
+    std::condition_variable bg_cv_;
+    bool bg_stop_ = false;
+
+    // 后台预加载线程
+    std::thread preloader_;
+    std::atomic<bool> preload_stop_{ false };
 };
 
 #endif
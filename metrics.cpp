@@ -0,0 +1,282 @@
+#include "metrics.h"
+#include "log.h"
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+// 等待连接时的轮询间隔，决定 stop() 最长需要等待多久
+static const int ACCEPT_POLL_MS = 500;
+// 单个请求的读写超时
+static const int REQUEST_TIMEOUT_SEC = 2;
+// 请求头上限，超过即放弃该连接
+static const size_t MAX_REQUEST_SIZE = 8192;
+
+int Histogram::bucket_of(uint64_t us)
+{
+    if (us < (uint64_t)SUB) return (int)us;
+    int e = 63 - __builtin_clzll(us);
+    if (e > MAX_EXP) return BUCKETS - 1;
+    int sub = (int)((us >> (e - SUB_BITS)) & (SUB - 1));
+    return (e - SUB_BITS + 1) * SUB + sub;
+}
+
+uint64_t Histogram::upper_bound(int bucket)
+{
+    if (bucket < SUB) return (uint64_t)bucket + 1;
+    int e = bucket / SUB - 1 + SUB_BITS;
+    uint64_t width = 1ULL << (e - SUB_BITS);
+    return (uint64_t)(SUB + bucket % SUB) * width + width;
+}
+
+Histogram::Snapshot Histogram::snapshot() const
+{
+    Snapshot s;
+    s.buckets.resize(BUCKETS);
+    for (int i = 0; i < BUCKETS; i++) {
+        s.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        s.count += s.buckets[i];
+    }
+    s.sum_us = sum_us_.load(std::memory_order_relaxed);
+    return s;
+}
+
+MetricsRegistry &metrics()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Series &MetricsRegistry::series(const std::string &name,
+                                                 const std::string &help,
+                                                 const std::string &labels,
+                                                 Type type)
+{
+    auto it = families_.find(name);
+    if (it == families_.end()) {
+        it = families_.emplace(name, Family{type, help, {}}).first;
+    }
+
+    for (auto &s : it->second.series) {
+        if (s->labels == labels) return *s;
+    }
+    auto s = std::make_unique<Series>();
+    s->labels = labels;
+    it->second.series.push_back(std::move(s));
+    return *it->second.series.back();
+}
+
+Counter *MetricsRegistry::counter(const std::string &name, const std::string &help,
+                                  const std::string &labels)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    Series &s = series(name, help, labels, Type::COUNTER);
+    if (!s.counter) s.counter = std::make_unique<Counter>();
+    return s.counter.get();
+}
+
+Histogram *MetricsRegistry::histogram(const std::string &name, const std::string &help,
+                                      const std::string &labels)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    Series &s = series(name, help, labels, Type::HISTOGRAM);
+    if (!s.hist) s.hist = std::make_unique<Histogram>();
+    return s.hist.get();
+}
+
+void MetricsRegistry::counter_fn(const std::string &name, const std::string &help,
+                                 const std::string &labels, ValueFn fn)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    series(name, help, labels, Type::COUNTER).fn = std::move(fn);
+}
+
+void MetricsRegistry::gauge_fn(const std::string &name, const std::string &help,
+                               const std::string &labels, ValueFn fn)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    series(name, help, labels, Type::GAUGE).fn = std::move(fn);
+}
+
+// name{labels[,extra]} value
+static void append_sample(std::string &out, const std::string &name,
+                          const std::string &labels, const std::string &extra,
+                          double value)
+{
+    out += name;
+    if (!labels.empty() || !extra.empty()) {
+        out += '{';
+        out += labels;
+        if (!labels.empty() && !extra.empty()) out += ',';
+        out += extra;
+        out += '}';
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), " %.17g\n", value);
+    out += buf;
+}
+
+std::string MetricsRegistry::render() const
+{
+    std::lock_guard<std::mutex> lock(mu_);
+
+    std::string out;
+    out.reserve(16384);
+    for (const auto &kv : families_) {
+        const std::string &name = kv.first;
+        const Family &f = kv.second;
+
+        const char *type = f.type == Type::COUNTER ? "counter"
+                         : f.type == Type::GAUGE ? "gauge" : "histogram";
+        out += "# HELP " + name + " " + f.help + "\n";
+        out += "# TYPE " + name + " " + type + "\n";
+
+        for (const auto &s : f.series) {
+            if (s->fn) {
+                append_sample(out, name, s->labels, "", s->fn());
+            } else if (s->counter) {
+                append_sample(out, name, s->labels, "", (double)s->counter->value());
+            } else if (s->hist) {
+                Histogram::Snapshot snap = s->hist->snapshot();
+                uint64_t cumulative = 0;
+                char le[48];
+                for (int i = 0; i < Histogram::BUCKETS; i++) {
+                    if (!snap.buckets[i]) continue;
+                    cumulative += snap.buckets[i];
+                    snprintf(le, sizeof(le), "le=\"%g\"",
+                             (double)Histogram::upper_bound(i) / 1e6);
+                    append_sample(out, name + "_bucket", s->labels, le, (double)cumulative);
+                }
+                append_sample(out, name + "_bucket", s->labels, "le=\"+Inf\"", (double)snap.count);
+                append_sample(out, name + "_sum", s->labels, "", (double)snap.sum_us / 1e6);
+                append_sample(out, name + "_count", s->labels, "", (double)snap.count);
+            }
+        }
+    }
+    return out;
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+bool MetricsServer::start(const std::string &listen)
+{
+    size_t colon = listen.rfind(':');
+    if (colon == std::string::npos) {
+        LOG_ERROR("MetricsServer: 无效的监听地址 %s\n", listen.c_str());
+        return false;
+    }
+    std::string host = listen.substr(0, colon);
+    std::string port = listen.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    struct addrinfo *res = nullptr;
+    int rc = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res);
+    if (rc != 0) {
+        LOG_ERROR("MetricsServer: 无法解析 %s: %s\n", listen.c_str(), gai_strerror(rc));
+        return false;
+    }
+
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        int fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(fd, 16) == 0) {
+            fd_ = fd;
+            break;
+        }
+        ::close(fd);
+    }
+    freeaddrinfo(res);
+
+    if (fd_ < 0) {
+        LOG_ERROR("MetricsServer: 无法监听 %s: %s\n", listen.c_str(), strerror(errno));
+        return false;
+    }
+
+    stop_ = false;
+    thread_ = std::thread(&MetricsServer::run, this);
+    LOG_INFO("MetricsServer: 监听 %s\n", listen.c_str());
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    stop_ = true;
+    if (thread_.joinable()) thread_.join();
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void MetricsServer::run()
+{
+    while (!stop_) {
+        struct pollfd pfd = { fd_, POLLIN, 0 };
+        int rc = ::poll(&pfd, 1, ACCEPT_POLL_MS);
+        if (rc <= 0) continue;
+
+        int conn = ::accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0) continue;
+
+        struct timeval tv = { REQUEST_TIMEOUT_SEC, 0 };
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        serve(conn);
+        ::close(conn);
+    }
+}
+
+void MetricsServer::serve(int fd)
+{
+    // 只需要请求行，读到头部结束为止
+    std::string req;
+    char buf[1024];
+    while (req.find("\r\n\r\n") == std::string::npos && req.size() < MAX_REQUEST_SIZE) {
+        ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        req.append(buf, (size_t)n);
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (req.compare(0, 4, "GET ") != 0) {
+        status = "405 Method Not Allowed";
+    } else {
+        size_t end = req.find(' ', 4);
+        std::string path = req.substr(4, end == std::string::npos ? std::string::npos : end - 4);
+        if (path == "/metrics" || path == "/") {
+            body = metrics().render();
+        } else {
+            status = "404 Not Found";
+        }
+    }
+
+    std::string resp = "HTTP/1.1 " + status + "\r\n"
+                       "Content-Type: text/plain; version=0.0.4\r\n"
+                       "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                       "Connection: close\r\n\r\n" + body;
+
+    size_t off = 0;
+    while (off < resp.size()) {
+        ssize_t n = ::send(fd, resp.data() + off, resp.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) return;
+        off += (size_t)n;
+    }
+}
@@ -0,0 +1,156 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 运行指标
+// - Counter：单个原子计数器，热路径上只有一次 relaxed fetch_add
+// - Histogram：对数-线性分桶的延迟直方图（微秒）。每个 2 倍区间再等分为 8 个子桶，
+//   相对误差不超过 12.5%；记录一次只有两次 relaxed fetch_add（桶与总和），无锁
+// - 回调指标：导出时调用函数取值，用于已有的统计（缓存命中数、队列长度等）
+// 指标按名字与标签登记，返回的指针在进程生命周期内有效；热路径在构造时取得指针，
+// 之后不再查找。导出为 Prometheus 文本格式，由挂载点下的虚拟文件或 HTTP 端点提供
+
+class Counter {
+public:
+    void add(uint64_t n = 1) { v_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return v_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> v_{0};
+};
+
+class Histogram {
+public:
+    static constexpr int SUB_BITS = 3;
+    static constexpr int SUB = 1 << SUB_BITS;
+    // 2^MAX_EXP 微秒（约 12 天）以上的值并入最后一个桶
+    static constexpr int MAX_EXP = 40;
+    static constexpr int BUCKETS = (MAX_EXP - SUB_BITS + 2) * SUB;
+
+    void record(uint64_t us)
+    {
+        buckets_[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+        sum_us_.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    void record_since(std::chrono::steady_clock::time_point start)
+    {
+        record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    // 值所在的桶
+    static int bucket_of(uint64_t us);
+
+    // 桶的上界（微秒，不含）
+    static uint64_t upper_bound(int bucket);
+
+    struct Snapshot {
+        std::vector<uint64_t> buckets;
+        uint64_t count = 0;
+        uint64_t sum_us = 0;
+    };
+
+    // 各桶分别原子读取，与并发的 record 之间不保证整体一致
+    Snapshot snapshot() const;
+
+private:
+    std::atomic<uint64_t> buckets_[BUCKETS];
+    std::atomic<uint64_t> sum_us_{0};
+};
+
+// 作用域计时：析构时把经过的时间记入直方图（h 为空时不记录）
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram *h)
+        : h_(h), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { if (h_) h_->record_since(start_); }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    Histogram *h_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+class MetricsRegistry {
+public:
+    using ValueFn = std::function<double()>;
+
+    // 登记（或取得已登记的）指标；labels 为 Prometheus 标签串，如 op="read"
+    Counter *counter(const std::string &name, const std::string &help,
+                     const std::string &labels = "");
+    Histogram *histogram(const std::string &name, const std::string &help,
+                         const std::string &labels = "");
+
+    // 导出时取值的计数器 / 瞬时值；同名同标签再次登记时替换回调
+    // 回调在导出时持有注册表锁调用，不能再登记指标
+    void counter_fn(const std::string &name, const std::string &help,
+                    const std::string &labels, ValueFn fn);
+    void gauge_fn(const std::string &name, const std::string &help,
+                  const std::string &labels, ValueFn fn);
+
+    // Prometheus 文本格式；直方图只输出非空的桶，时间单位为秒
+    std::string render() const;
+
+private:
+    enum class Type { COUNTER, GAUGE, HISTOGRAM };
+
+    struct Series {
+        std::string labels;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Histogram> hist;
+        ValueFn fn;
+    };
+
+    struct Family {
+        Type type;
+        std::string help;
+        std::vector<std::unique_ptr<Series>> series;
+    };
+
+    // 持有 mu_
+    Series &series(const std::string &name, const std::string &help,
+                   const std::string &labels, Type type);
+
+    mutable std::mutex mu_;
+    std::map<std::string, Family> families_;
+};
+
+// 进程内唯一的注册表
+MetricsRegistry &metrics();
+
+// Prometheus 文本格式的 HTTP 端点：单线程逐个处理请求，GET /metrics 返回 render()
+class MetricsServer {
+public:
+    MetricsServer() = default;
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+    // listen 形如 127.0.0.1:9180、[::1]:9180 或 :9180（所有地址）。失败返回 false
+    bool start(const std::string &listen);
+    void stop();
+
+private:
+    void run();
+    void serve(int fd);
+
+    int fd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+#endif // METRICS_H
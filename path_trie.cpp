@@ -0,0 +1,337 @@
+#include "path_trie.h"
+#include <utility>
+
+// 字符区中已释放的字节超过该值且超过一半时整理
+static const size_t NAME_COMPACT_MIN = 1 << 20;
+
+// ------------------------------------------------------------
+// FlatIndex
+// ------------------------------------------------------------
+
+void FlatIndex::insert(uint32_t hash, uint32_t value) {
+    if ((count_ + 1) * 2 > slots_.size()) {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        slots_.resize(old.empty() ? 16 : old.size() * 2);
+        for (const Slot& s : old) {
+            if (s.value != NONE) place(s.hash, s.value);
+        }
+    }
+    place(hash, value);
+    count_++;
+}
+
+void FlatIndex::place(uint32_t hash, uint32_t value) {
+    size_t mask = slots_.size() - 1;
+    size_t i = hash & mask;
+    while (slots_[i].value != NONE) {
+        i = (i + 1) & mask;
+    }
+    slots_[i].value = value;
+    slots_[i].hash = hash;
+}
+
+void FlatIndex::erase_at(size_t i) {
+    // 向后移位：把探测链上后续不在起始位置的元素前移，保持探测链连续
+    size_t mask = slots_.size() - 1;
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (slots_[j].value == NONE) break;
+        size_t home = slots_[j].hash & mask;
+        bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (stays) continue;
+        slots_[i] = slots_[j];
+        i = j;
+    }
+    slots_[i].value = NONE;
+    count_--;
+}
+
+// ------------------------------------------------------------
+// PathTrie
+// ------------------------------------------------------------
+
+PathTrie::PathTrie() {
+    nodes_.push_back(Node());
+}
+
+PathTrie::PathTrie(PathTrie&& other) noexcept : PathTrie() {
+    *this = std::move(other);
+}
+
+PathTrie& PathTrie::operator=(PathTrie&& other) noexcept {
+    if (this != &other) {
+        std::swap(nodes_, other.nodes_);
+        std::swap(free_nodes_, other.free_nodes_);
+        std::swap(dirs_, other.dirs_);
+        std::swap(free_dirs_, other.free_dirs_);
+        std::swap(children_, other.children_);
+        std::swap(chars_, other.chars_);
+        std::swap(names_, other.names_);
+        std::swap(free_names_, other.free_names_);
+        std::swap(name_index_, other.name_index_);
+        std::swap(garbage_, other.garbage_);
+        other.clear();
+    }
+    return *this;
+}
+
+void PathTrie::clear() {
+    nodes_.clear();
+    nodes_.push_back(Node());
+    free_nodes_.clear();
+    dirs_.clear();
+    free_dirs_.clear();
+    children_.clear();
+    chars_.clear();
+    names_.clear();
+    free_names_.clear();
+    name_index_.clear();
+    garbage_ = 0;
+}
+
+void PathTrie::insert(const std::string& path) {
+    nodes_[walk_create(path)].is_file = true;
+}
+
+void PathTrie::insert_dir(const std::string& path) {
+    walk_create(path);
+}
+
+void PathTrie::remove(const std::string& path) {
+    uint32_t n = find_node(path);
+    if (n == NONE) return;
+
+    nodes_[n].is_file = false;
+
+    // 删除没有子项、本身也不是条目的节点，并向上继续
+    while (n != ROOT && !nodes_[n].is_file && nodes_[n].dir == NONE) {
+        uint32_t parent = nodes_[n].parent;
+        erase_node(n);
+        n = parent;
+    }
+}
+
+std::vector<std::string> PathTrie::list_dir(const std::string& path) const {
+    std::vector<std::string> result;
+    uint32_t n = find_node(path);
+    if (n == NONE || nodes_[n].dir == NONE) return result;
+
+    result.reserve(dirs_[nodes_[n].dir].live);
+    for (uint32_t c : dirs_[nodes_[n].dir].slots) {
+        if (c & HOLE) continue;
+        result.emplace_back(name_view(nodes_[c].name));
+    }
+    return result;
+}
+
+bool PathTrie::exists(const std::string& path) const {
+    uint32_t n = find_node(path);
+    return n != NONE && nodes_[n].is_file;
+}
+
+size_t PathTrie::child_count(const std::string& path) const {
+    uint32_t n = find_node(path);
+    if (n == NONE || nodes_[n].dir == NONE) return 0;
+    return dirs_[nodes_[n].dir].live;
+}
+
+// ------------------------------------------------------------
+// 内部函数
+// ------------------------------------------------------------
+
+uint32_t PathTrie::hash_name(std::string_view s) {
+    // FNV-1a，再经 murmur3 的 fmix32 打散低位（开放寻址表按低位取桶）
+    uint32_t h = 2166136261u;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+uint32_t PathTrie::hash_child(uint32_t parent, uint32_t name_hash) {
+    uint32_t h = name_hash ^ (parent * 0x9E3779B1u);
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+uint32_t PathTrie::intern(std::string_view s, uint32_t h) {
+    uint32_t id = name_index_.find(h, [&](uint32_t v) { return name_view(v) == s; });
+    if (id != FlatIndex::NONE) {
+        names_[id].refs++;
+        return id;
+    }
+
+    if (!free_names_.empty()) {
+        id = free_names_.back();
+        free_names_.pop_back();
+    } else {
+        id = static_cast<uint32_t>(names_.size());
+        names_.push_back(Name());
+    }
+
+    Name& name = names_[id];
+    name.offset = static_cast<uint32_t>(chars_.size());
+    name.length = static_cast<uint32_t>(s.size());
+    name.refs = 1;
+    chars_.append(s.data(), s.size());
+    chars_.push_back('\0');
+
+    name_index_.insert(h, id);
+    return id;
+}
+
+void PathTrie::release_name(uint32_t id) {
+    Name& name = names_[id];
+    if (--name.refs > 0) return;
+
+    std::string_view s = name_view(id);
+    name_index_.erase(hash_name(s), [&](uint32_t v) { return v == id; });
+    garbage_ += name.length + 1;
+    free_names_.push_back(id);
+
+    if (garbage_ >= NAME_COMPACT_MIN && garbage_ * 2 > chars_.size()) {
+        compact_names();
+    }
+}
+
+void PathTrie::compact_names() {
+    // 名字下标不变，只重排字符区
+    std::string packed;
+    packed.reserve(chars_.size() - garbage_);
+    for (Name& name : names_) {
+        if (name.refs == 0) continue;
+        uint32_t offset = static_cast<uint32_t>(packed.size());
+        packed.append(chars_, name.offset, name.length + 1);
+        name.offset = offset;
+    }
+    chars_.swap(packed);
+    garbage_ = 0;
+}
+
+uint32_t PathTrie::find_child(uint32_t parent, std::string_view name, uint32_t h) const {
+    uint32_t c = children_.find(hash_child(parent, h), [&](uint32_t v) {
+        return nodes_[v].parent == parent && name_view(nodes_[v].name) == name;
+    });
+    return c == FlatIndex::NONE ? NONE : c;
+}
+
+uint32_t PathTrie::find_node(const std::string& path) const {
+    uint32_t cur = ROOT;
+    size_t i = 0;
+    while (i < path.size()) {
+        if (path[i] == '/') {
+            i++;
+            continue;
+        }
+        size_t j = path.find('/', i);
+        if (j == std::string::npos) j = path.size();
+
+        if (nodes_[cur].dir == NONE) return NONE;
+        std::string_view part(path.data() + i, j - i);
+        cur = find_child(cur, part, hash_name(part));
+        if (cur == NONE) return NONE;
+        i = j;
+    }
+    return cur;
+}
+
+uint32_t PathTrie::walk_create(const std::string& path) {
+    uint32_t cur = ROOT;
+    size_t i = 0;
+    while (i < path.size()) {
+        if (path[i] == '/') {
+            i++;
+            continue;
+        }
+        size_t j = path.find('/', i);
+        if (j == std::string::npos) j = path.size();
+
+        std::string_view part(path.data() + i, j - i);
+        uint32_t h = hash_name(part);
+        uint32_t next = nodes_[cur].dir == NONE ? NONE : find_child(cur, part, h);
+        cur = next == NONE ? add_child(cur, part, h) : next;
+        i = j;
+    }
+    return cur;
+}
+
+uint32_t PathTrie::add_child(uint32_t parent, std::string_view name, uint32_t h) {
+    uint32_t id = intern(name, h);
+
+    uint32_t c;
+    if (!free_nodes_.empty()) {
+        c = free_nodes_.back();
+        free_nodes_.pop_back();
+        nodes_[c] = Node();
+    } else {
+        c = static_cast<uint32_t>(nodes_.size());
+        nodes_.push_back(Node());
+    }
+
+    if (nodes_[parent].dir == NONE) {
+        uint32_t d;
+        if (!free_dirs_.empty()) {
+            d = free_dirs_.back();
+            free_dirs_.pop_back();
+        } else {
+            d = static_cast<uint32_t>(dirs_.size());
+            dirs_.push_back(Dir());
+        }
+        nodes_[parent].dir = d;
+    }
+
+    Dir& dir = dirs_[nodes_[parent].dir];
+    uint32_t slot;
+    if (dir.free_head != NO_SLOT) {
+        slot = dir.free_head;
+        dir.free_head = dir.slots[slot] & ~HOLE;
+        dir.slots[slot] = c;
+    } else {
+        slot = static_cast<uint32_t>(dir.slots.size());
+        dir.slots.push_back(c);
+    }
+    dir.live++;
+
+    Node& node = nodes_[c];
+    node.parent = parent;
+    node.name = id;
+    node.slot = slot;
+
+    children_.insert(hash_child(parent, h), c);
+    return c;
+}
+
+void PathTrie::erase_node(uint32_t n) {
+    Node& node = nodes_[n];
+    uint32_t parent = node.parent;
+
+    children_.erase(hash_child(parent, hash_name(name_view(node.name))),
+                    [&](uint32_t v) { return v == n; });
+
+    uint32_t d = nodes_[parent].dir;
+    Dir& dir = dirs_[d];
+    dir.live--;
+    if (dir.live == 0) {
+        // 目录已空，释放槽位数组（之后新建的子项从偏移 0 开始）
+        dir = Dir();
+        free_dirs_.push_back(d);
+        nodes_[parent].dir = NONE;
+    } else {
+        dir.slots[node.slot] = HOLE | dir.free_head;
+        dir.free_head = node.slot;
+    }
+
+    release_name(node.name);
+    node = Node();
+    free_nodes_.push_back(n);
+}
@@ -2,146 +2,180 @@
 #define CLOUDRAIDFS_PATH_TRIE_H
 
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
-#include <sstream>
+#include <cstdint>
 
-class PathTrie {
+// 开放寻址哈希索引：只存 32 位值及其哈希，相等比较由调用方提供
+// 线性探测，删除时向后移位，不留墓碑
+class FlatIndex {
 public:
-    struct Node {
-        bool is_file = false;
-        std::unordered_map<std::string, Node*> children;
-    };
-
-    PathTrie() {
-        root = new Node();
+    static constexpr uint32_t NONE = 0xffffffffu;
+
+    template <typename Eq>
+    uint32_t find(uint32_t hash, Eq eq) const {
+        if (slots_.empty()) return NONE;
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot& s = slots_[i];
+            if (s.value == NONE) return NONE;
+            if (s.hash == hash && eq(s.value)) return s.value;
+        }
     }
 
-    ~PathTrie() {
-        free_node(root);
+    void insert(uint32_t hash, uint32_t value);
+
+    template <typename Eq>
+    bool erase(uint32_t hash, Eq eq) {
+        if (slots_.empty()) return false;
+        size_t mask = slots_.size() - 1;
+        size_t i = hash & mask;
+        for (;; i = (i + 1) & mask) {
+            const Slot& s = slots_[i];
+            if (s.value == NONE) return false;
+            if (s.hash == hash && eq(s.value)) break;
+        }
+        erase_at(i);
+        return true;
     }
 
-    // 禁用拷贝（避免浅拷贝导致的段错误）
+    void clear() { slots_.clear(); count_ = 0; }
+
+private:
+    struct Slot {
+        uint32_t value = NONE;
+        uint32_t hash = 0;
+    };
+
+    std::vector<Slot> slots_;      // 大小为 2 的幂，装载率不超过 1/2
+    size_t count_ = 0;
+
+    void place(uint32_t hash, uint32_t value);
+    void erase_at(size_t i);
+};
+
+// 路径前缀树（目录结构）
+// - 节点存放在连续数组中，以 32 位下标互相引用，删除的节点进入空闲链表复用
+// - 名字驻留在共享的字符区中，同名条目（不同目录下的 README 等）只存一份
+// - 所有 (父节点, 名字) -> 子节点 的映射保存在一张开放寻址表中，
+//   查找路径时按 '/' 逐段切分，不构造临时字符串
+// - 只有拥有子项的节点才分配目录信息：子项槽位数组与子项数，
+//   判断目录是否为空为 O(1)
+// - 子项槽位下标即为读目录的偏移：新子项优先填入空出的槽位，删除只留下空位，
+//   因此分页遍历期间一直存在的子项恰好被访问一次
+class PathTrie {
+public:
+    PathTrie();
+
+    // 禁用拷贝
     PathTrie(const PathTrie&) = delete;
     PathTrie& operator=(const PathTrie&) = delete;
 
-    // 移动构造
-    PathTrie(PathTrie&& other) noexcept : root(other.root) {
-        other.root = new Node();
-    }
-
-    // 移动赋值
-    PathTrie& operator=(PathTrie&& other) noexcept {
-        if (this != &other) {
-            free_node(root);
-            root = other.root;
-            other.root = new Node();
-        }
-        return *this;
-    }
+    PathTrie(PathTrie&& other) noexcept;
+    PathTrie& operator=(PathTrie&& other) noexcept;
 
     // 清空 trie
-    void clear() {
-        free_node(root);
-        root = new Node();
-    }
+    void clear();
 
     // 插入路径，例如 "/sub/a.txt"
-    void insert(const std::string& path) {
-        std::vector<std::string> parts = split(path);
-        Node* cur = root;
-
-        for (auto& p : parts) {
-            if (!cur->children.count(p)) {
-                cur->children[p] = new Node();
-            }
-            cur = cur->children[p];
-        }
-        cur->is_file = true;
-    }
+    void insert(const std::string& path);
 
-    // 删除路径
-    void remove(const std::string& path) {
-        std::vector<std::string> parts = split(path);
-        remove_recursive(root, parts, 0);
-    }
+    // 只插入目录节点，不标记为条目本身（懒加载时记录子目录存在，其内容稍后加载）
+    void insert_dir(const std::string& path);
+
+    // 删除路径（没有子项的上级隐式节点一并删除）
+    void remove(const std::string& path);
 
     // 列出目录内容
     // path = "/" → ["sub", "hello.txt"]
     // path = "/sub" → ["a.txt", "b"]
-    std::vector<std::string> list_dir(const std::string& path) {
-        Node* node = find_node(path);
-        if (!node) return {};
+    // 只读操作（list_dir / exists / child_count / for_each_child）可以在多个线程中并发调用
+    std::vector<std::string> list_dir(const std::string& path) const;
 
-        std::vector<std::string> result;
-        for (auto& kv : node->children) {
-            result.push_back(kv.first);
+    // 判断路径是否存在
+    bool exists(const std::string& path) const;
+
+    // 直接子项数，路径不存在时为 0
+    size_t child_count(const std::string& path) const;
+
+    // 从偏移 offset 起依次回调 fn(name, next_offset)，fn 返回 false 时停止
+    // name 以 '\0' 结尾，只在回调期间有效；next_offset 为继续遍历时传入的偏移
+    // 路径不存在时返回 false
+    template <typename F>
+    bool for_each_child(const std::string& path, uint64_t offset, F&& fn) const {
+        uint32_t n = find_node(path);
+        if (n == NONE) return false;
+        uint32_t d = nodes_[n].dir;
+        if (d == NONE) return true;
+
+        const std::vector<uint32_t>& slots = dirs_[d].slots;
+        for (uint64_t i = offset; i < slots.size(); i++) {
+            uint32_t c = slots[i];
+            if (c & HOLE) continue;
+            if (!fn(name_ptr(nodes_[c].name), i + 1)) break;
         }
-        return result;
+        return true;
     }
 
-    // 判断路径是否存在
-    bool exists(const std::string& path) {
-        Node* node = find_node(path);
-        return node && node->is_file;
-    }
+    // 节点数（包括根节点）
+    size_t node_count() const { return nodes_.size() - free_nodes_.size(); }
 
 private:
-    Node* root;
+    static constexpr uint32_t NONE = 0xffffffffu;
+    static constexpr uint32_t HOLE = 0x80000000u;   // 槽位为空，低位为下一个空槽位
+    static constexpr uint32_t NO_SLOT = HOLE - 1;   // 空槽位链表结束
+    static constexpr uint32_t ROOT = 0;
 
-    // 释放节点
-    void free_node(Node* n) {
-        if (!n) return;
-        for (auto& kv : n->children) {
-            free_node(kv.second);
-        }
-        delete n;
-    }
-
-    // 分割路径 "/a/b/c.txt" → ["a","b","c.txt"]
-    std::vector<std::string> split(const std::string& path) {
-        std::vector<std::string> parts;
-        std::stringstream ss(path);
-        std::string item;
+    struct Node {
+        uint32_t parent = NONE;
+        uint32_t name = NONE;
+        uint32_t slot = 0;          // 在父目录槽位数组中的下标
+        uint32_t dir = NONE;        // 目录信息下标，没有子项时为 NONE
+        bool is_file = false;       // 条目本身存在（文件或显式创建的目录）
+    };
 
-        while (std::getline(ss, item, '/')) {
-            if (!item.empty()) parts.push_back(item);
-        }
-        return parts;
-    }
+    struct Dir {
+        std::vector<uint32_t> slots;   // 子节点下标或空位
+        uint32_t live = 0;             // 子项数
+        uint32_t free_head = NO_SLOT;  // 空槽位链表头
+    };
 
-    // 找到路径对应的节点
-    Node* find_node(const std::string& path) {
-        std::vector<std::string> parts = split(path);
-        Node* cur = root;
+    struct Name {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+        uint32_t refs = 0;
+    };
 
-        for (auto& p : parts) {
-            if (!cur->children.count(p)) return nullptr;
-            cur = cur->children[p];
-        }
-        return cur;
-    }
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> free_nodes_;
+    std::vector<Dir> dirs_;
+    std::vector<uint32_t> free_dirs_;
+    FlatIndex children_;                // 哈希 (父节点, 名字) -> 子节点
 
-    // 递归删除
-    bool remove_recursive(Node* node, const std::vector<std::string>& parts, size_t idx) {
-        if (idx == parts.size()) {
-            node->is_file = false;
-            return node->children.empty();
-        }
+    // 驻留名字：字符区中每个名字后跟 '\0'
+    std::string chars_;
+    std::vector<Name> names_;
+    std::vector<uint32_t> free_names_;
+    FlatIndex name_index_;              // 哈希 (名字) -> 名字下标
+    size_t garbage_ = 0;                // 字符区中已释放的字节数
 
-        const std::string& key = parts[idx];
-        if (!node->children.count(key)) return false;
+    static uint32_t hash_name(std::string_view s);
+    static uint32_t hash_child(uint32_t parent, uint32_t name_hash);
 
-        Node* child = node->children[key];
-        bool should_delete = remove_recursive(child, parts, idx + 1);
+    std::string_view name_view(uint32_t id) const {
+        return std::string_view(chars_.data() + names_[id].offset, names_[id].length);
+    }
+    const char* name_ptr(uint32_t id) const { return chars_.data() + names_[id].offset; }
 
-        if (should_delete) {
-            delete child;
-            node->children.erase(key);
-        }
+    uint32_t intern(std::string_view s, uint32_t h);
+    void release_name(uint32_t id);
+    void compact_names();
 
-        return (!node->is_file && node->children.empty());
-    }
+    uint32_t find_child(uint32_t parent, std::string_view name, uint32_t h) const;
+    uint32_t find_node(const std::string& path) const;
+    uint32_t add_child(uint32_t parent, std::string_view name, uint32_t h);
+    void erase_node(uint32_t n);
+    uint32_t walk_create(const std::string& path);
 };
 
 #endif
@@ -1,25 +1,231 @@
 #include "raid_chunk_store.h"
+#include "log.h"
 #include <cstdio>
 #include <cinttypes>
-#include <atomic>
-#include <thread>
+#include <algorithm>
+#include <condition_variable>
 #include <chrono>
+#include <map>
 
 // 构造函数
 RAIDChunkStore::RAIDChunkStore(std::vector<std::shared_ptr<ChunkStore>> backends,
                                int k, int m,
-                               std::shared_ptr<ErasureCoder> coder)
-    : backends(std::move(backends)), k(k), m(m), coder(std::move(coder))
+                               std::shared_ptr<ErasureCoder> coder,
+                               const RAIDConfig &config)
+    : backends(std::move(backends)), k(k), m(m), coder(std::move(coder)),
+      config_(config)
 {
-    if ((int)this->backends.size() != k + m) {
-        fprintf(stderr, "RAIDChunkStore: backend 数量必须等于 k+m\n");
+    if ((int)this->backends.size() < k + m) {
+        LOG_ERROR("RAIDChunkStore: backend 数量不能少于 k+m\n");
     }
     if (!this->coder) {
-        fprintf(stderr, "RAIDChunkStore: coder 不能为空\n");
+        LOG_ERROR("RAIDChunkStore: coder 不能为空\n");
     }
+
+    // 每个后端一个常驻 I/O 线程池，慢后端的积压不会占用其他后端的线程
+    for (size_t i = 0; i < this->backends.size(); i++) {
+        io_pools_.push_back(std::make_unique<IOThreadPool>(config_.io_threads,
+                                                           config_.io_queue_depth));
+    }
+    health_ = std::make_shared<BackendHealth>((int)this->backends.size(), config_.health);
+    repair_queue_ = std::make_unique<RepairQueue>(
+        (int)this->backends.size(), config_.repair,
+        [this](uint64_t stripe_id, const std::vector<int> &missing) {
+            return repair_stripe(stripe_id, missing);
+        });
+    health_->set_recover_callback([this](int backend) {
+        on_backend_recovered(backend);
+    });
+}
+
+RAIDChunkStore::~RAIDChunkStore()
+{
+    // 先摘掉恢复回调（迟到的读结果仍会更新 health_），
+    // 再停止修复队列（修复会向后端线程池投递读写），最后回收后端线程池
+    stopping_ = true;
+    health_->set_recover_callback(nullptr);
+    repair_queue_->stop();
+    io_pools_.clear();
+    repair_queue_.reset();
+}
+
+// 在后端 i 上执行一次 I/O：投递到其线程池（队列满时阻塞）
+void RAIDChunkStore::run_on_backend(int i, std::function<void()> task)
+{
+    auto &pool = io_pools_[i];
+    // 线程池已关闭（析构过程中）时退化为同步执行，保证回调一定被调用
+    if (!pool->submit(task)) {
+        task();
+    }
+}
+
+// 法定数至少为 m+1：过期位置不超过 k-1 个，任意 k 个 chunk 中至少有一个代号最新，
+// 只读 k 个 chunk 时也能发现过期的一组
+int RAIDChunkStore::write_quorum() const
+{
+    int q = config_.write_quorum > 0 ? config_.write_quorum : k + 1;
+    return std::max(std::max(k, m + 1), std::min(q, k + m));
+}
+
+// 写入代号取当前时间（微秒）与上一个代号 +1 中的较大者：
+// 进程内严格递增，重启后仍大于之前写入（读到的代号也会推高下限）
+uint64_t RAIDChunkStore::next_generation()
+{
+    uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    uint64_t cur = last_generation_.load();
+    uint64_t next;
+    do {
+        next = std::max(cur + 1, now);
+    } while (!last_generation_.compare_exchange_weak(cur, next));
+    return next;
+}
+
+void RAIDChunkStore::observe_generation(uint64_t gen)
+{
+    uint64_t cur = last_generation_.load();
+    while (gen > cur && !last_generation_.compare_exchange_weak(cur, gen)) {
+    }
+}
+
+// 已读到的 chunk 中代号最新的一组的数量
+static int newest_count(const std::vector<std::string> &chunks,
+                        const std::vector<uint64_t> &gens)
+{
+    uint64_t newest = 0;
+    int count = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunks[i].empty()) continue;
+        if (count == 0 || gens[i] > newest) {
+            newest = gens[i];
+            count = 1;
+        } else if (gens[i] == newest) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// 选出代号最新且不少于 k 个的一组（写入未达法定数时最新一组可能不足 k 个，
+// 此时退回较旧的完整一组；都不足时保留最新一组，解码会失败）
+int RAIDChunkStore::keep_generation(std::vector<std::string> &chunks, std::vector<int> *dropped)
+{
+    std::vector<uint64_t> gens(chunks.size(), 0);
+    std::map<uint64_t, int> groups;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunks[i].empty()) continue;
+        gens[i] = coder->generation(chunks[i]);
+        groups[gens[i]]++;
+    }
+    if (groups.empty()) return 0;
+    observe_generation(groups.rbegin()->first);
+
+    uint64_t pick = groups.rbegin()->first;
+    for (auto it = groups.rbegin(); it != groups.rend(); ++it) {
+        if (it->second >= k) {
+            pick = it->first;
+            break;
+        }
+    }
+
+    int kept = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunks[i].empty()) continue;
+        if (gens[i] == pick) {
+            kept++;
+        } else {
+            chunks[i].clear();
+            if (dropped) dropped->push_back((int)i);
+        }
+    }
+    return kept;
+}
+
+std::vector<int> RAIDChunkStore::stale_positions(uint64_t stripe_id)
+{
+    StripeShard &shard = shard_of(stripe_id);
+    std::lock_guard<std::mutex> lock(shard.stale_mu);
+    auto it = shard.stale.find(stripe_id);
+    return it == shard.stale.end() ? std::vector<int>() : it->second;
+}
+
+// 以本次写入未成功的位置替换过期集合：写入成功的位置已是新数据
+void RAIDChunkStore::set_stale(uint64_t stripe_id, const std::vector<int> &positions)
+{
+    StripeShard &shard = shard_of(stripe_id);
+    std::lock_guard<std::mutex> lock(shard.stale_mu);
+    if (positions.empty()) {
+        shard.stale.erase(stripe_id);
+    } else {
+        shard.stale[stripe_id] = positions;
+    }
+}
+
+// positions 为空指针时清除全部过期位置
+void RAIDChunkStore::clear_stale(uint64_t stripe_id, const std::vector<int> *positions)
+{
+    StripeShard &shard = shard_of(stripe_id);
+    std::lock_guard<std::mutex> lock(shard.stale_mu);
+    auto it = shard.stale.find(stripe_id);
+    if (it == shard.stale.end()) return;
+    if (positions) {
+        auto &v = it->second;
+        v.erase(std::remove_if(v.begin(), v.end(), [&](int p) {
+            return std::find(positions->begin(), positions->end(), p) != positions->end();
+        }), v.end());
+        if (!v.empty()) return;
+    }
+    shard.stale.erase(it);
+}
+
+void RAIDChunkStore::on_backend_recovered(int backend)
+{
+    if (stopping_) return;
+
+    // 逐分片收集落在该后端上的过期 chunk，释放锁后再入队
+    // 修复队列满时多余的条带被丢弃，之后读到时会再次登记
+    for (auto &shard : shards_) {
+        std::vector<std::pair<uint64_t, std::vector<int>>> todo;
+        {
+            std::lock_guard<std::mutex> lock(shard.stale_mu);
+            for (const auto &kv : shard.stale) {
+                std::vector<int> positions;
+                for (int pos : kv.second) {
+                    if (backend_of(kv.first, pos) == backend) positions.push_back(pos);
+                }
+                if (!positions.empty()) todo.emplace_back(kv.first, std::move(positions));
+            }
+        }
+        for (const auto &t : todo) {
+            repair_queue_->enqueue(t.first, t.second);
+        }
+    }
+}
+
+// 读取顺序：可用后端在前、熔断中的后端在后，各自按健康分数升序，
+// 分数相同时数据块优先；过期位置保存的是旧数据，不参与读取
+std::vector<int> RAIDChunkStore::read_order(uint64_t stripe_id)
+{
+    const int n = k + m;
+    std::vector<int> stale = stale_positions(stripe_id);
+
+    std::vector<int> order;
+    std::vector<std::pair<int, double>> key(n);
+    for (int pos = 0; pos < n; pos++) {
+        if (std::find(stale.begin(), stale.end(), pos) != stale.end()) continue;
+        int b = backend_of(stripe_id, pos);
+        key[pos] = { health_->usable(b) ? 0 : 1, health_->read_score(b) };
+        order.push_back(pos);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return key[a] < key[b];
+    });
+    return order;
 }
 
 // 写入条带：编码 → 并发写入多个后端（真正并行，返回时间为最慢后端耗时）
+// 降级写时跳过熔断中的后端，达到法定数即成功，未写入的位置标记过期并登记修复
+// 过期位置保留旧的写入代号，重启后仍能识别；编码器不支持写入代号时不做降级写
 bool RAIDChunkStore::write_chunk(uint64_t stripe_id,
                                  uint32_t chunk_id,
                                  const std::string &data)
@@ -28,110 +234,724 @@ bool RAIDChunkStore::write_chunk(uint64_t stripe_id,
 
     if (!coder) return false;
 
+    const int n = k + m;
+    const int quorum = write_quorum();
+
     // 1. 编码成 k+m 个 chunk
     std::vector<std::string> chunks;
     if (!coder->encode(data, k, m, chunks)) {
-        fprintf(stderr, "RAIDChunkStore::write_chunk: encode 失败, stripe=%" PRIu64 "\n", stripe_id);
+        LOG_ERROR("RAIDChunkStore::write_chunk: encode 失败, stripe=%" PRIu64 "\n", stripe_id);
         return false;
     }
-    if ((int)chunks.size() != k + m) {
-        fprintf(stderr, "RAIDChunkStore::write_chunk: chunks 数量 != k+m\n");
+    if ((int)chunks.size() != n) {
+        LOG_ERROR("RAIDChunkStore::write_chunk: chunks 数量 != k+m\n");
         return false;
     }
+    const bool degraded = config_.degraded_write &&
+                          coder->set_generation(chunks, next_generation());
 
-    // 2. 准备统计
-    std::vector<BackendStats> backend_stats(k + m);
-    std::vector<bool> results(k + m, false);
-    
-    auto overall_start = std::chrono::steady_clock::now();
+    // 2. 选出要写入的位置：可用后端不足法定数时仍然全部尝试
+    std::vector<char> skip(n, 0);
+    if (degraded) {
+        int usable = 0;
+        for (int pos = 0; pos < n; pos++) {
+            if (health_->usable(backend_of(stripe_id, pos))) {
+                usable++;
+            } else {
+                skip[pos] = 1;
+            }
+        }
+        if (usable < quorum) skip.assign(n, 0);
+    }
 
-    // 3. 并发写入（使用 std::thread 真正并行）
-    std::vector<std::thread> threads;
-    threads.reserve(k + m);
+    std::vector<char> results(n, 0);
 
-    for (int i = 0; i < k + m; i++) {
-        threads.emplace_back([this, &chunks, &backend_stats, &results, stripe_id, i]() {
+    // 3. 投递到各后端的 I/O 线程池并发写入
+    // 持有条带分片的共享锁并推进写代数，使进行中的修复放弃补写旧数据
+    StripeShard &shard = shard_of(stripe_id);
+    std::shared_lock<std::shared_mutex> shard_lock(shard.mu);
+    shard.gen++;
+
+    WaitGroup wg(n - (int)std::count(skip.begin(), skip.end(), 1));
+
+    for (int pos = 0; pos < n; pos++) {
+        if (skip[pos]) continue;
+        int b = backend_of(stripe_id, pos);
+        run_on_backend(b, [this, &chunks, &results, &wg, stripe_id, pos, b]() {
             auto start = std::chrono::steady_clock::now();
-            bool ok = backends[i]->write_chunk(stripe_id, (uint32_t)i, chunks[i]);
-            auto end = std::chrono::steady_clock::now();
-            
-            double elapsed = std::chrono::duration<double, std::milli>(end - start).count();
-            
-            backend_stats[i].backend_id = i;
-            backend_stats[i].elapsed_ms = elapsed;
-            backend_stats[i].success = ok;
-            results[i] = ok;
+            size_t bytes = chunks[pos].size();
+            bool ok = backends[b]->write_chunk(stripe_id, (uint32_t)pos, chunks[pos]);
+            double elapsed = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            health_->record(b, BackendHealth::Op::WRITE, elapsed, bytes, ok);
+            results[pos] = ok;
+            wg.done();
         });
     }
 
-    // 4. 等待所有线程完成
-    for (auto &t : threads) {
-        t.join();
+    // 4. 等待所有后端完成，在释放分片锁之前更新过期位置（修复持独占锁读取）
+    wg.wait();
+
+    std::vector<int> missing;
+    for (int pos = 0; pos < n; pos++) {
+        if (!results[pos]) missing.push_back(pos);
     }
+    set_stale(stripe_id, missing);
+    shard_lock.unlock();
 
-    auto overall_end = std::chrono::steady_clock::now();
-    double total_elapsed = std::chrono::duration<double, std::milli>(overall_end - overall_start).count();
+    // 5. 检查结果
+    int ok_count = n - (int)missing.size();
+    if (missing.empty()) return true;
 
-    // 5. 更新统计
-    {
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        last_write_stats_.total_elapsed_ms = total_elapsed;
-        last_write_stats_.backends = std::move(backend_stats);
+    if (!degraded || ok_count < quorum) {
+        LOG_ERROR("RAIDChunkStore::write_chunk: stripe=%" PRIu64
+                  " 只写入 %d/%d 个 chunk\n", stripe_id, ok_count, n);
+        return false;
     }
 
-    // 6. 打印统计信息
-    fprintf(stderr, "RAIDChunkStore::write_chunk stripe=%" PRIu64 " 总耗时=%.2fms (各后端并行)\n", 
-            stripe_id, total_elapsed);
-    for (const auto &s : last_write_stats_.backends) {
-        fprintf(stderr, "  后端[%d]: %.2fms %s\n", 
-                s.backend_id, s.elapsed_ms, s.success ? "成功" : "失败");
+    // 降级写成功：可用后端上的失败立即登记修复，熔断中的后端等恢复后再登记
+    std::vector<int> repair;
+    for (int pos : missing) {
+        if (health_->usable(backend_of(stripe_id, pos))) repair.push_back(pos);
     }
+    if (!repair.empty()) repair_queue_->enqueue(stripe_id, repair);
+    return true;
+}
 
-    // 7. 检查结果
-    bool ok = true;
-    for (int i = 0; i < k + m; i++) {
-        if (!results[i]) ok = false;
+// 批量写入条带：编码全部条带后，每个后端提交一次（或逐个 chunk 并发）写入
+bool RAIDChunkStore::write_stripes(const std::vector<uint64_t> &stripe_ids,
+                                   const std::vector<const std::string *> &data)
+{
+    if (!coder) return false;
+    if (stripe_ids.size() != data.size()) return false;
+    if (stripe_ids.empty()) return true;
+    if (stripe_ids.size() == 1) return write_chunk(stripe_ids[0], 0, *data[0]);
+
+    const int n = k + m;
+    const int nb = (int)backends.size();
+    const int quorum = write_quorum();
+    const size_t count = stripe_ids.size();
+
+    // 1. 编码：chunks[s][pos] 为第 s 个条带的第 pos 个 chunk
+    std::vector<std::vector<std::string>> chunks(count);
+    bool degraded = config_.degraded_write;
+    for (size_t s = 0; s < count; s++) {
+        if (!coder->encode(*data[s], k, m, chunks[s]) || (int)chunks[s].size() != n) {
+            LOG_ERROR("RAIDChunkStore::write_stripes: encode 失败, stripe=%" PRIu64 "\n",
+                      stripe_ids[s]);
+            return false;
+        }
+        if (!coder->set_generation(chunks[s], next_generation())) degraded = false;
     }
 
-    if (!ok) {
-        fprintf(stderr, "RAIDChunkStore::write_chunk: 部分后端写入失败\n");
+    // 2. 降级写时跳过熔断中的后端（可用后端不足法定数时仍然全部尝试）
+    std::vector<char> skip_backend(nb, 0);
+    if (degraded) {
+        for (int b = 0; b < nb; b++) skip_backend[b] = !health_->usable(b);
+        for (size_t s = 0; s < count; s++) {
+            int usable = 0;
+            for (int pos = 0; pos < n; pos++) {
+                if (!skip_backend[backend_of(stripe_ids[s], pos)]) usable++;
+            }
+            if (usable < quorum) {
+                skip_backend.assign(nb, 0);
+                break;
+            }
+        }
     }
 
-    return ok;
+    // 每个后端本批要写的 (条带序号, 位置)
+    std::vector<std::vector<std::pair<size_t, int>>> work(nb);
+    for (size_t s = 0; s < count; s++) {
+        for (int pos = 0; pos < n; pos++) {
+            int b = backend_of(stripe_ids[s], pos);
+            if (!skip_backend[b]) work[b].push_back({ s, pos });
+        }
+    }
+
+    // 3. 按分片序号加锁（与修复的独占锁不会互等），推进每个条带的写代数
+    std::vector<size_t> shard_ids;
+    for (uint64_t id : stripe_ids) shard_ids.push_back(id % STRIPE_SHARDS);
+    std::sort(shard_ids.begin(), shard_ids.end());
+    shard_ids.erase(std::unique(shard_ids.begin(), shard_ids.end()), shard_ids.end());
+
+    std::vector<std::shared_lock<std::shared_mutex>> shard_locks;
+    for (size_t sid : shard_ids) {
+        shard_locks.emplace_back(shards_[sid].mu);
+    }
+    for (uint64_t id : stripe_ids) shard_of(id).gen++;
+
+    // 4. 投递写入：results[s * n + pos]
+    std::vector<char> results(count * n, 0);
+
+    int tasks = 0;
+    for (int b = 0; b < nb; b++) {
+        if (work[b].empty()) continue;
+        tasks += backends[b]->supports_batch() ? 1 : (int)work[b].size();
+    }
+    WaitGroup wg(tasks);
+
+    for (int b = 0; b < nb; b++) {
+        if (work[b].empty()) continue;
+
+        if (backends[b]->supports_batch()) {
+            run_on_backend(b, [this, &chunks, &stripe_ids, &results, &work, &wg, n, b]() {
+                auto start = std::chrono::steady_clock::now();
+                std::vector<ChunkWrite> writes;
+                uint64_t bytes = 0;
+                writes.reserve(work[b].size());
+                for (const auto &w : work[b]) {
+                    writes.push_back(ChunkWrite{ stripe_ids[w.first], (uint32_t)w.second,
+                                                 &chunks[w.first][w.second] });
+                    bytes += chunks[w.first][w.second].size();
+                }
+                bool ok = backends[b]->write_chunks(writes);
+                double elapsed = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+                health_->record(b, BackendHealth::Op::WRITE, elapsed, bytes, ok);
+                for (const auto &w : work[b]) results[w.first * n + w.second] = ok;
+                wg.done();
+            });
+            continue;
+        }
+
+        for (const auto &w : work[b]) {
+            size_t s = w.first;
+            int pos = w.second;
+            run_on_backend(b, [this, &chunks, &stripe_ids, &results, &wg, s, pos, n, b]() {
+                auto start = std::chrono::steady_clock::now();
+                size_t bytes = chunks[s][pos].size();
+                bool ok = backends[b]->write_chunk(stripe_ids[s], (uint32_t)pos, chunks[s][pos]);
+                double elapsed = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+                health_->record(b, BackendHealth::Op::WRITE, elapsed, bytes, ok);
+                results[s * n + pos] = ok;
+                wg.done();
+            });
+        }
+    }
+
+    wg.wait();
+
+    // 5. 逐条带更新过期位置并判定结果
+    bool all_ok = true;
+    std::vector<std::pair<uint64_t, std::vector<int>>> repairs;
+    for (size_t s = 0; s < count; s++) {
+        std::vector<int> missing;
+        for (int pos = 0; pos < n; pos++) {
+            if (!results[s * n + pos]) missing.push_back(pos);
+        }
+        set_stale(stripe_ids[s], missing);
+        if (missing.empty()) continue;
+
+        if (!degraded || n - (int)missing.size() < quorum) {
+            all_ok = false;
+            continue;
+        }
+        std::vector<int> repair;
+        for (int pos : missing) {
+            if (health_->usable(backend_of(stripe_ids[s], pos))) repair.push_back(pos);
+        }
+        if (!repair.empty()) repairs.emplace_back(stripe_ids[s], std::move(repair));
+    }
+    shard_locks.clear();
+
+    for (const auto &r : repairs) {
+        repair_queue_->enqueue(r.first, r.second);
+    }
+    if (!all_ok) {
+        LOG_ERROR("RAIDChunkStore::write_stripes: stripes=%zu first=%" PRIu64
+                  " 部分条带写入的 chunk 不足\n", count, stripe_ids[0]);
+    }
+    return all_ok;
 }
 
-// 自动修复缺失 chunk：用完整 data 重新编码，然后补写缺失位置
-void RAIDChunkStore::repair_missing_chunks(uint64_t stripe_id,
-                                           const std::vector<bool> &present,
-                                           const std::string &data)
+// 增量路径搬运的字节数不超过整条带重写的 1/PARTIAL_UPDATE_GAIN 时才使用
+static const uint64_t PARTIAL_UPDATE_GAIN = 2;
+
+// 增量更新：只读写被修改的数据块与 m 个校验块中的对应区间
+// 每个位置只发一次读请求与一次写请求，各位置并发执行；全部旧内容读到后才开始写入
+// 全程独占条带分片：与同一条带的其他增量更新、整条带写入/删除和修复补写互斥，
+// 并推进写代数使读取了旧 chunk 的修复放弃补写
+bool RAIDChunkStore::update_ranges(uint64_t stripe_id, uint64_t stripe_size,
+                                   const std::vector<std::pair<uint64_t, std::string>> &pieces)
 {
-    if (!coder) return;
+    if (!coder || pieces.empty()) return false;
 
-    std::vector<std::string> chunks;
-    if (!coder->encode(data, k, m, chunks)) {
-        fprintf(stderr, "RAIDChunkStore::repair_missing_chunks: encode 失败\n");
-        return;
+    const int n = k + m;
+    const size_t header_size = coder->chunk_header_size();
+
+    // 1. 定位每个区间所在的数据块与块内偏移（区间须按偏移升序且互不重叠）
+    struct Piece {
+        int data_index;
+        uint64_t chunk_offset;
+        const std::string *data;
+    };
+    std::vector<Piece> located;
+    uint64_t total = 0;
+    uint64_t prev_end = 0;
+    for (const auto &p : pieces) {
+        Piece lp{ 0, 0, &p.second };
+        if (p.second.empty() || p.first < prev_end ||
+            !coder->locate_range(stripe_size, k, p.first, p.second.size(),
+                                 lp.data_index, lp.chunk_offset)) {
+            return false;
+        }
+        prev_end = p.first + p.second.size();
+        total += p.second.size();
+        located.push_back(lp);
     }
-    if ((int)chunks.size() != k + m) return;
+    if (total > config_.partial_update_max) return false;
 
-    std::vector<std::thread> threads;
+    // 校验块要改写的区间：各区间块内范围的并集（不同数据块的区间可能落在校验块的同一处）
+    std::vector<std::pair<uint64_t, uint64_t>> spans;
+    for (const auto &lp : located) {
+        spans.push_back({ lp.chunk_offset, lp.chunk_offset + lp.data->size() });
+    }
+    std::sort(spans.begin(), spans.end());
+    std::vector<std::pair<uint64_t, uint64_t>> merged;
+    for (const auto &s : spans) {
+        if (!merged.empty() && s.first <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second, s.second);
+        } else {
+            merged.push_back(s);
+        }
+    }
+    uint64_t parity_bytes = 0;
+    for (const auto &s : merged) parity_bytes += s.second - s.first;
+
+    // 搬运量：数据区间与校验区间各读写一次；整条带重写读 k 个、写 k+m 个 chunk
+    uint64_t partial_bytes = 2 * (total + (uint64_t)m * parity_bytes);
+    uint64_t full_bytes = stripe_size + stripe_size * (uint64_t)n / (uint64_t)k;
+    if (partial_bytes * PARTIAL_UPDATE_GAIN > full_bytes) return false;
 
-    for (int i = 0; i < k + m; i++) {
-        if (!present[i]) {
-            threads.emplace_back([this, &chunks, stripe_id, i]() {
-                fprintf(stderr, "RAIDChunkStore: 修复 stripe %lu 的 chunk %d\n",
-                        (unsigned long)stripe_id, i);
-                backends[i]->write_chunk(stripe_id, (uint32_t)i, chunks[i]);
+    // 改写的位置：被修改的数据块与全部校验块
+    // 写入失败时要给其余全部位置写入新的写入代号，因此 n 个位置的后端都必须支持范围读写且可用
+    std::vector<int> positions;
+    for (const auto &lp : located) {
+        if (std::find(positions.begin(), positions.end(), lp.data_index) == positions.end()) {
+            positions.push_back(lp.data_index);
+        }
+    }
+    for (int i = 0; i < m; i++) positions.push_back(k + i);
+    for (int pos = 0; pos < n; pos++) {
+        int b = backend_of(stripe_id, pos);
+        if (!backends[b]->supports_range() || !health_->usable(b)) return false;
+    }
+
+    // 每个位置要读取的区间：chunk 头部（未改写的数据块只读头部），
+    // 其后数据块为落在其中的各区间，校验块为并集
+    std::vector<std::vector<RangeRef>> ranges(n);
+    for (int pos = 0; pos < n; pos++) ranges[pos].push_back(RangeRef{ 0, header_size });
+    for (const auto &lp : located) {
+        ranges[lp.data_index].push_back(RangeRef{ lp.chunk_offset, lp.data->size() });
+    }
+    for (int i = 0; i < m; i++) {
+        for (const auto &s : merged) {
+            ranges[k + i].push_back(RangeRef{ s.first, (size_t)(s.second - s.first) });
+        }
+    }
+
+    StripeShard &shard = shard_of(stripe_id);
+    std::unique_lock<std::shared_mutex> shard_lock(shard.mu);
+    // 有过期位置时校验关系已不完整，交给整条带重写
+    if (!stale_positions(stripe_id).empty()) return false;
+    shard.gen++;
+
+    // 2. 并发读取，每个位置一次请求：头部与全部旧区间
+    std::vector<std::vector<std::string>> old(n);
+    std::vector<char> read_ok(n, 0);
+    WaitGroup rwg(n);
+    for (int pos = 0; pos < n; pos++) {
+        int b = backend_of(stripe_id, pos);
+        run_on_backend(b, [this, &ranges, &old, &read_ok, &rwg, stripe_id, pos, b]() {
+            auto start = std::chrono::steady_clock::now();
+            bool ok = backends[b]->read_ranges(stripe_id, (uint32_t)pos, ranges[pos], old[pos]) &&
+                      old[pos].size() == ranges[pos].size();
+            uint64_t bytes = 0;
+            for (size_t j = 0; ok && j < old[pos].size(); j++) {
+                ok = old[pos][j].size() == ranges[pos][j].len;
+                bytes += old[pos][j].size();
+            }
+            double elapsed = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            health_->record(b, BackendHealth::Op::READ, elapsed, bytes, ok);
+            read_ok[pos] = ok;
+            rwg.done();
+        });
+    }
+    rwg.wait();
+
+    // 头部含写入代号，n 个位置必须一致：代号不同说明有位置错过了某次整条带写入
+    // （重启后内存中的过期集合已丢失），失败时也不能把它改写为新代号
+    for (int pos = 0; pos < n; pos++) {
+        if (!read_ok[pos]) return false;
+    }
+    const std::string header = old[0][0];
+    for (int pos = 0; pos < n; pos++) {
+        if (old[pos][0] != header) return false;
+    }
+    if (!coder->check_update_header(header, k, m, stripe_size)) return false;
+
+    // 3. 逐个区间按差值更新校验块并集缓冲区中的对应切片
+    std::vector<size_t> next_range(n, 1);
+    for (const auto &lp : located) {
+        const std::string &old_data = old[lp.data_index][next_range[lp.data_index]++];
+        const size_t len = lp.data->size();
+
+        size_t s = 0;
+        while (merged[s].second <= lp.chunk_offset) s++;
+        const size_t off = (size_t)(lp.chunk_offset - merged[s].first);
+
+        std::vector<std::string> parity(m);
+        for (int i = 0; i < m; i++) parity[i] = old[k + i][1 + s].substr(off, len);
+        if (!coder->update_parity(k, m, lp.data_index, old_data, *lp.data, parity)) return false;
+        for (int i = 0; i < m; i++) old[k + i][1 + s].replace(off, len, parity[i]);
+    }
+
+    // 4. 并发写回，每个位置一次请求
+    std::vector<std::vector<RangeWrite>> writes(n);
+    for (const auto &lp : located) {
+        writes[lp.data_index].push_back(RangeWrite{ lp.chunk_offset, lp.data });
+    }
+    for (int i = 0; i < m; i++) {
+        for (size_t s = 0; s < merged.size(); s++) {
+            writes[k + i].push_back(RangeWrite{ merged[s].first, &old[k + i][1 + s] });
+        }
+    }
+
+    std::vector<char> results(n, 0);
+    WaitGroup wwg((int)positions.size());
+    for (int pos : positions) {
+        int b = backend_of(stripe_id, pos);
+        run_on_backend(b, [this, &writes, &results, &wwg, stripe_id, pos, b]() {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t bytes = 0;
+            for (const auto &w : writes[pos]) bytes += w.data->size();
+            bool ok = backends[b]->write_ranges(stripe_id, (uint32_t)pos, writes[pos]);
+            double elapsed = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            health_->record(b, BackendHealth::Op::WRITE, elapsed, bytes, ok);
+            results[pos] = ok;
+            wwg.done();
+        });
+    }
+    wwg.wait();
+
+    std::vector<int> failed;
+    for (int pos : positions) {
+        if (!results[pos]) failed.push_back(pos);
+    }
+    if (failed.empty()) return true;
+
+    // 5. 写入失败的位置内容不确定：先标记过期（读取不再使用），
+    // 再给其余全部位置（已是新内容或未改动）写入新的写入代号，失败的位置保留旧代号，
+    // 只要至少 k 个位置写入了新代号，重启后同样不会被用来解码；
+    // 最后登记修复并返回 false，由调用方整条带重写
+    set_stale(stripe_id, failed);
+
+    std::vector<std::string> stamp{ header };
+    int stamped = 0;
+    if (coder->set_generation(stamp, next_generation())) {
+        std::vector<int> others;
+        for (int pos = 0; pos < n; pos++) {
+            if (std::find(failed.begin(), failed.end(), pos) == failed.end()) {
+                others.push_back(pos);
+            }
+        }
+        const std::vector<RangeWrite> stamp_write{ RangeWrite{ 0, &stamp[0] } };
+        std::vector<char> stamp_ok(n, 0);
+        WaitGroup swg((int)others.size());
+        for (int pos : others) {
+            int b = backend_of(stripe_id, pos);
+            run_on_backend(b, [this, &stamp_write, &stamp_ok, &swg, stripe_id, pos, b]() {
+                auto start = std::chrono::steady_clock::now();
+                bool ok = backends[b]->write_ranges(stripe_id, (uint32_t)pos, stamp_write);
+                double elapsed = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+                health_->record(b, BackendHealth::Op::WRITE, elapsed, stamp_write[0].data->size(),
+                                ok);
+                stamp_ok[pos] = ok;
+                swg.done();
+            });
+        }
+        swg.wait();
+        stamped = (int)std::count(stamp_ok.begin(), stamp_ok.end(), 1);
+    }
+    shard_lock.unlock();
+
+    if (stamped < k) {
+        // 重启前必须整条带重写（调用方随即进行），否则重启后可能用到写入失败的位置
+        LOG_ERROR("RAIDChunkStore::update_ranges: stripe=%" PRIu64 " 有 %zu 个位置写入失败，"
+                  "只有 %d 个位置更新了写入代号\n", stripe_id, failed.size(), stamped);
+    } else {
+        LOG_WARN("RAIDChunkStore::update_ranges: stripe=%" PRIu64 " 有 %zu 个位置写入失败，"
+                 "%d 个位置已更新写入代号\n", stripe_id, failed.size(), stamped);
+    }
+    std::vector<int> repair;
+    for (int pos : failed) {
+        if (health_->usable(backend_of(stripe_id, pos))) repair.push_back(pos);
+    }
+    if (!repair.empty()) repair_queue_->enqueue(stripe_id, repair);
+    return false;
+}
+
+// 批量读取条带：每个条带按读取顺序选 k 个位置，同一后端上的 chunk 合并为一次批量读取，
+// 凑不齐的条带单独走 read_chunk
+bool RAIDChunkStore::read_stripes(const std::vector<uint64_t> &stripe_ids,
+                                  std::vector<std::string> &out)
+{
+    out.assign(stripe_ids.size(), std::string());
+    if (!coder) return false;
+    if (stripe_ids.empty()) return true;
+
+    const int n = k + m;
+    const int nb = (int)backends.size();
+    const size_t count = stripe_ids.size();
+
+    // 每个后端本批要读的 (条带序号, 位置)
+    std::vector<std::vector<std::pair<size_t, int>>> work(nb);
+    for (size_t s = 0; s < count; s++) {
+        std::vector<int> order = read_order(stripe_ids[s]);
+        if ((int)order.size() > k) order.resize(k);
+        for (int pos : order) {
+            work[backend_of(stripe_ids[s], pos)].push_back({ s, pos });
+        }
+    }
+
+    // chunks[s][pos]：未读取或失败的位置为空
+    std::vector<std::vector<std::string>> chunks(count, std::vector<std::string>(n));
+
+    int tasks = 0;
+    for (int b = 0; b < nb; b++) {
+        if (work[b].empty()) continue;
+        tasks += backends[b]->supports_batch() ? 1 : (int)work[b].size();
+    }
+    WaitGroup wg(tasks);
+
+    for (int b = 0; b < nb; b++) {
+        if (work[b].empty()) continue;
+
+        if (backends[b]->supports_batch()) {
+            run_on_backend(b, [this, &chunks, &stripe_ids, &work, &wg, b]() {
+                auto start = std::chrono::steady_clock::now();
+                std::vector<ChunkRef> refs;
+                refs.reserve(work[b].size());
+                for (const auto &w : work[b]) {
+                    refs.push_back(ChunkRef{ stripe_ids[w.first], (uint32_t)w.second });
+                }
+                std::vector<std::string> bufs;
+                std::vector<ChunkStatus> status;
+                backends[b]->read_chunks(refs, bufs, &status);
+                uint64_t bytes = 0;
+                for (size_t j = 0; j < work[b].size() && j < bufs.size(); j++) {
+                    bytes += bufs[j].size();
+                    chunks[work[b][j].first][work[b][j].second] = std::move(bufs[j]);
+                }
+                double elapsed = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+                // 整批按一次请求计入：有任一项出错即为失败，全部不存在时按 NOT_FOUND 计
+                ChunkStatus batch = bytes > 0 ? ChunkStatus::OK : ChunkStatus::NOT_FOUND;
+                if (status.size() != refs.size() ||
+                    std::count(status.begin(), status.end(), ChunkStatus::ERROR) > 0) {
+                    batch = ChunkStatus::ERROR;
+                }
+                health_->record_read(b, elapsed, bytes, batch);
+                wg.done();
+            });
+            continue;
+        }
+
+        for (const auto &w : work[b]) {
+            size_t s = w.first;
+            int pos = w.second;
+            run_on_backend(b, [this, &chunks, &stripe_ids, &wg, s, pos, b]() {
+                auto start = std::chrono::steady_clock::now();
+                std::string buf;
+                ChunkStatus status = backends[b]->read_chunk_status(stripe_ids[s],
+                                                                    (uint32_t)pos, buf);
+                double elapsed = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+                health_->record_read(b, elapsed, buf.size(), status);
+                if (status == ChunkStatus::OK) chunks[s][pos] = std::move(buf);
+                wg.done();
+            });
+        }
+    }
+    wg.wait();
+
+    bool all_ok = true;
+    for (size_t s = 0; s < count; s++) {
+        int ok_count = keep_generation(chunks[s], nullptr);
+
+        bool ok = ok_count == k && coder->decode(chunks[s], k, m, out[s]);
+        if (!ok) {
+            // 有 chunk 缺失或过期：单独读取，由 read_chunk 对冲补读并登记修复
+            out[s].clear();
+            ok = read_chunk(stripe_ids[s], 0, out[s]);
+        }
+        if (!ok) {
+            out[s].clear();
+            all_ok = false;
+        }
+    }
+    return all_ok;
+}
+
+// 后台修复一个条带：读取 k 个现存 chunk，只重建 missing 位置并补写
+// 读写均按后端申请修复额度；期间条带被重写或删除则放弃
+bool RAIDChunkStore::repair_stripe(uint64_t stripe_id,
+                                   const std::vector<int> &missing)
+{
+    if (!coder) return false;
+
+    const int n = k + m;
+    StripeShard &shard = shard_of(stripe_id);
+    uint64_t gen = shard.gen.load();
+
+    std::vector<char> skip(n, 0);
+    for (int i : missing) {
+        if (i >= 0 && i < n) skip[i] = 1;
+    }
+
+    // 1. 按读取顺序分批读取，直到凑齐 k 个代号最新的现存 chunk
+    // （内存中记录的过期位置不在读取顺序中，重启后遗留的过期 chunk 按写入代号识别）
+    std::vector<std::string> chunks(n);
+    std::vector<uint64_t> gens(n, 0);
+    std::vector<int> lost = missing;
+    std::vector<int> order = read_order(stripe_id);
+    size_t next = 0;
+    int ok_count = 0;
+
+    while (ok_count < k) {
+        std::vector<int> batch;
+        while ((int)batch.size() < k - ok_count && next < order.size()) {
+            int i = order[next++];
+            if (!skip[i]) batch.push_back(i);
+        }
+        if (batch.empty()) break;
+
+        for (int i : batch) {
+            if (!repair_queue_->throttle(backend_of(stripe_id, i), 0)) return false;
+        }
+
+        std::vector<char> results(n, 0);
+        WaitGroup wg((int)batch.size());
+        for (int i : batch) {
+            int b = backend_of(stripe_id, i);
+            run_on_backend(b, [this, &chunks, &results, &wg, stripe_id, i, b]() {
+                auto start = std::chrono::steady_clock::now();
+                std::string buf;
+                ChunkStatus status = backends[b]->read_chunk_status(stripe_id, (uint32_t)i, buf);
+                bool ok = status == ChunkStatus::OK && !buf.empty();
+                double elapsed = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+                health_->record_read(b, elapsed, buf.size(), status);
+                if (ok) {
+                    chunks[i] = std::move(buf);
+                    results[i] = 1;
+                }
+                wg.done();
             });
         }
+        wg.wait();
+
+        for (int i : batch) {
+            if (results[i]) {
+                gens[i] = coder->generation(chunks[i]);
+                repair_queue_->consume(backend_of(stripe_id, i), chunks[i].size());
+            } else {
+                lost.push_back(i);
+            }
+        }
+        ok_count = newest_count(chunks, gens);
     }
 
-    for (auto &t : threads) {
-        t.join();
+    // 代号较旧的 chunk 同样需要重建
+    std::vector<int> dropped;
+    ok_count = keep_generation(chunks, &dropped);
+    lost.insert(lost.end(), dropped.begin(), dropped.end());
+
+    if (ok_count < k) {
+        LOG_WARN("RAIDChunkStore::repair_stripe: stripe %" PRIu64 " 现存 chunk 不足 k\n",
+                 stripe_id);
+        return false;
     }
+
+    // 2. 只计算缺失的行
+    std::vector<std::string> rebuilt;
+    if (!coder->reconstruct(chunks, k, m, lost, rebuilt)) {
+        LOG_ERROR("RAIDChunkStore::repair_stripe: reconstruct 失败\n");
+        return false;
+    }
+    if ((int)rebuilt.size() != n) return false;
+
+    for (int i : lost) {
+        if (!repair_queue_->throttle(backend_of(stripe_id, i), rebuilt[i].size())) return false;
+    }
+
+    // 3. 补写：独占条带分片，确认读取以来没有新的写入/删除
+    std::unique_lock<std::shared_mutex> lock(shard.mu);
+    if (shard.gen.load() != gen) {
+        return true;  // 条带已被整体重写，无需修复
+    }
+
+    std::vector<char> results(n, 0);
+    WaitGroup wg((int)lost.size());
+    for (int i : lost) {
+        int b = backend_of(stripe_id, i);
+        run_on_backend(b, [this, &rebuilt, &results, &wg, stripe_id, i, b]() {
+            auto start = std::chrono::steady_clock::now();
+            size_t bytes = rebuilt[i].size();
+            bool ok = backends[b]->write_chunk(stripe_id, (uint32_t)i, rebuilt[i]);
+            double elapsed = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            health_->record(b, BackendHealth::Op::WRITE, elapsed, bytes, ok);
+            results[i] = ok;
+            wg.done();
+        });
+    }
+    wg.wait();
+
+    std::vector<int> repaired;
+    for (int i : lost) {
+        if (results[i]) repaired.push_back(i);
+    }
+    clear_stale(stripe_id, &repaired);
+    lock.unlock();
+
+    for (int i : repaired) {
+        repair_queue_->record_repaired(rebuilt[i].size());
+    }
+    return repaired.size() == lost.size();
 }
 
-// 读取条带：从任意 k 个有效 chunk 恢复 + 自动修复缺失 chunk
+// 一次条带读取的共享状态
+// 读线程可能在 read_chunk 返回后才结束（被对冲掉的慢后端），
+// 因此状态由 shared_ptr 持有，返回后迟到的结果直接丢弃
+// （只更新健康统计，已按超时计入的请求不再重复计入）
+struct StripeReadState {
+    std::mutex mu;
+    std::condition_variable cv;
+    std::vector<std::string> chunks;
+    std::vector<uint64_t> gens;
+    std::vector<BackendStats> stats;
+    std::vector<bool> launched;
+    std::vector<bool> finished;
+    std::vector<bool> timed_out;
+    std::vector<std::chrono::steady_clock::time_point> start;
+    int ok_count = 0;   // 代号最新的一组 chunk 的数量
+    int inflight = 0;
+    bool closed = false;
+
+    explicit StripeReadState(int n)
+        : chunks(n), gens(n, 0), stats(n), launched(n, false), finished(n, false),
+          timed_out(n, false), start(n) {}
+};
+
+// 读取条带：优先只读 k 个 chunk，失败或超时后再对冲请求其余 chunk，
+// 凑齐 k 个写入代号相同的 chunk 即开始解码（读到代号较旧的过期 chunk 时继续补读），
+// 并自动修复确认缺失或过期的 chunk
 bool RAIDChunkStore::read_chunk(uint64_t stripe_id,
                                 uint32_t chunk_id,
                                 std::string &out)
@@ -140,78 +960,135 @@ bool RAIDChunkStore::read_chunk(uint64_t stripe_id,
 
     if (!coder) return false;
 
-    std::vector<std::string> chunks(k + m);
-    std::vector<bool> present(k + m, false);
-    std::atomic<int> ok_count{0};
+    const int n = k + m;
+    auto st = std::make_shared<StripeReadState>(n);
+    std::vector<int> order = read_order(stripe_id);
+    const int avail = (int)order.size();
+    int next = 0;
 
-    // 准备统计
-    std::vector<BackendStats> backend_stats(k + m);
-    
     auto overall_start = std::chrono::steady_clock::now();
 
-    // 并发读取所有 chunk（使用 std::thread 真正并行）
-    std::vector<std::thread> threads;
-    threads.reserve(k + m);
+    // 发起对 order[next] 的读取
+    // 调用方持有 st->mu；投递任务期间释放锁，避免线程池满时与完成回调互等
+    auto launch = [&](std::unique_lock<std::mutex> &lock) {
+        int i = order[next++];
+        int b = backend_of(stripe_id, i);
+        st->launched[i] = true;
+        st->start[i] = std::chrono::steady_clock::now();
+        st->inflight++;
+        lock.unlock();
 
-    for (int i = 0; i < k + m; i++) {
-        threads.emplace_back([this, &chunks, &present, &ok_count, &backend_stats, stripe_id, i]() {
-            auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<ChunkStore> backend = backends[b];
+        std::shared_ptr<BackendHealth> health = health_;
+        std::shared_ptr<ErasureCoder> chunk_coder = coder;
+        run_on_backend(b, [st, backend, health, chunk_coder, stripe_id, i, b]() {
             std::string buf;
-            bool ok = backends[i]->read_chunk(stripe_id, (uint32_t)i, buf) && !buf.empty();
+            ChunkStatus status = backend->read_chunk_status(stripe_id, (uint32_t)i, buf);
+            bool ok = status == ChunkStatus::OK && !buf.empty();
+            uint64_t gen = ok ? chunk_coder->generation(buf) : 0;
             auto end = std::chrono::steady_clock::now();
-            
-            double elapsed = std::chrono::duration<double, std::milli>(end - start).count();
-            
-            backend_stats[i].backend_id = i;
-            backend_stats[i].elapsed_ms = elapsed;
-            backend_stats[i].success = ok;
-            
-            if (ok) {
-                chunks[i] = std::move(buf);
-                present[i] = true;
-                ok_count.fetch_add(1, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> guard(st->mu);
+            st->inflight--;
+            st->finished[i] = true;
+            st->stats[i].backend_id = b;
+            st->stats[i].elapsed_ms =
+                std::chrono::duration<double, std::milli>(end - st->start[i]).count();
+            st->stats[i].success = ok;
+            if (!st->timed_out[i]) {
+                health->record_read(b, st->stats[i].elapsed_ms, buf.size(), status);
+            }
+            if (ok && !st->closed) {
+                st->chunks[i] = std::move(buf);
+                st->gens[i] = gen;
+                st->ok_count = newest_count(st->chunks, st->gens);
             }
+            st->cv.notify_all();
         });
-    }
 
-    // 等待所有读取完成
-    for (auto &t : threads) {
-        t.join();
+        lock.lock();
+    };
+
+    std::unique_lock<std::mutex> lock(st->mu);
+
+    // 首轮：非对冲模式一次请求全部 chunk，否则只请求 k 个
+    int first = std::min(config_.hedged_read ? k : n, avail);
+    while (next < first) launch(lock);
+
+    auto hedge_at = overall_start + std::chrono::milliseconds(config_.hedge_delay_ms);
+
+    while (st->ok_count < k) {
+        // 失败补读：在途请求不足以凑齐 k 个时立即补发
+        while (st->inflight < k - st->ok_count && next < avail) {
+            launch(lock);
+        }
+        if (st->inflight == 0) break;  // 全部结束仍不足 k 个
+
+        if (next < avail) {
+            // 对冲：超时仍未凑齐则再请求缺少数量的 chunk
+            if (st->cv.wait_until(lock, hedge_at) == std::cv_status::timeout) {
+                int need = k - st->ok_count;
+                for (int j = 0; j < need && next < avail; j++) launch(lock);
+                hedge_at = std::chrono::steady_clock::now() +
+                           std::chrono::milliseconds(config_.hedge_delay_ms);
+            }
+        } else {
+            st->cv.wait(lock);
+        }
     }
 
     auto overall_end = std::chrono::steady_clock::now();
-    double total_elapsed = std::chrono::duration<double, std::milli>(overall_end - overall_start).count();
 
-    // 更新统计
-    {
-        std::lock_guard<std::mutex> lock(stats_mutex_);
-        last_read_stats_.total_elapsed_ms = total_elapsed;
-        last_read_stats_.backends = std::move(backend_stats);
+    // 收集结果；仍在途且已超过慢请求阈值的后端按超时计入健康统计
+    st->closed = true;
+    std::vector<std::string> chunks = std::move(st->chunks);
+    std::vector<int> missing;
+    std::vector<std::pair<int, double>> timeouts;
+    for (int i = 0; i < n; i++) {
+        if (!st->launched[i]) continue;
+        if (!st->finished[i]) {
+            double waited = std::chrono::duration<double, std::milli>(
+                overall_end - st->start[i]).count();
+            if (health_->slow_request_ms() && waited > (double)health_->slow_request_ms()) {
+                st->timed_out[i] = true;
+                timeouts.push_back({ backend_of(stripe_id, i), waited });
+            }
+        } else if (!st->stats[i].success) {
+            missing.push_back(i);
+        }
     }
+    lock.unlock();
 
-    // 打印统计信息
-    fprintf(stderr, "RAIDChunkStore::read_chunk stripe=%" PRIu64 " 总耗时=%.2fms (各后端并行)\n", 
-            stripe_id, total_elapsed);
-    for (const auto &s : last_read_stats_.backends) {
-        fprintf(stderr, "  后端[%d]: %.2fms %s\n", 
-                s.backend_id, s.elapsed_ms, s.success ? "成功" : "失败");
+    for (const auto &t : timeouts) {
+        health_->record_timeout(t.first, BackendHealth::Op::READ, t.second);
     }
 
-    if (ok_count.load() < k) {
+    // 代号较旧的 chunk 错过了最近一次整条带写入，不参与解码并登记修复
+    std::vector<int> dropped;
+    if (keep_generation(chunks, &dropped) < k) {
         // stripe 不存在或损坏，静默返回失败（首次启动时这是正常情况）
         return false;
     }
 
     // 解码：ErasureCoder 负责从部分非空 chunks 中恢复原始 data
     if (!coder->decode(chunks, k, m, out)) {
-        fprintf(stderr, "RAIDChunkStore::read_chunk: decode 失败\n");
+        LOG_ERROR("RAIDChunkStore::read_chunk: decode 失败\n");
         return false;
     }
 
-    // 自动修复缺失 chunk（后台异步执行，不阻塞返回）
-    std::thread([this, stripe_id, present, out]() {
-        repair_missing_chunks(stripe_id, present, out);
-    }).detach();
+    // 确认缺失的 chunk 与降级写留下的过期 chunk 交给后台修复队列（按条带去重、限速）
+    // 未请求或被对冲掉的 chunk 状态未知，不做修复；熔断中的后端等恢复后再登记
+    // 修复队列已满时直接丢弃，下次读到该条带会再次触发
+    std::vector<int> stale = stale_positions(stripe_id);
+    missing.insert(missing.end(), stale.begin(), stale.end());
+    missing.insert(missing.end(), dropped.begin(), dropped.end());
+    std::vector<int> repair;
+    for (int pos : missing) {
+        if (health_->usable(backend_of(stripe_id, pos))) repair.push_back(pos);
+    }
+    if (!repair.empty()) {
+        repair_queue_->enqueue(stripe_id, repair);
+    }
 
     return true;
 }
@@ -222,23 +1099,28 @@ bool RAIDChunkStore::delete_chunk(uint64_t stripe_id,
 {
     (void)chunk_id; // 暂不使用
 
-    std::vector<bool> results(k + m, false);
-    std::vector<std::thread> threads;
-    threads.reserve(k + m);
+    const int n = k + m;
+    StripeShard &shard = shard_of(stripe_id);
+    std::shared_lock<std::shared_mutex> shard_lock(shard.mu);
+    shard.gen++;
+
+    std::vector<char> results(n, 0);
+    WaitGroup wg(n);
 
-    for (int i = 0; i < k + m; i++) {
-        threads.emplace_back([this, &results, stripe_id, i]() {
-            results[i] = backends[i]->delete_chunk(stripe_id, (uint32_t)i);
+    for (int pos = 0; pos < n; pos++) {
+        int b = backend_of(stripe_id, pos);
+        run_on_backend(b, [this, &results, &wg, stripe_id, pos, b]() {
+            results[pos] = backends[b]->delete_chunk(stripe_id, (uint32_t)pos);
+            wg.done();
         });
     }
 
-    for (auto &t : threads) {
-        t.join();
-    }
+    wg.wait();
+    clear_stale(stripe_id, nullptr);
 
     bool ok = true;
-    for (int i = 0; i < k + m; i++) {
-        if (!results[i]) ok = false;
+    for (int pos = 0; pos < n; pos++) {
+        if (!results[pos]) ok = false;
     }
     return ok;
 }
@@ -3,24 +3,56 @@
 
 #include "chunk_store.h"
 #include "erasure_coder.h"
+#include "io_thread_pool.h"
+#include "repair_queue.h"
+#include "backend_health.h"
 #include <vector>
 #include <memory>
 #include <string>
 #include <cstdint>
 #include <chrono>
 #include <mutex>
+#include <functional>
+#include <shared_mutex>
+#include <atomic>
+#include <unordered_map>
 
-// 后端操作统计信息
+// 一次请求中单个后端的结果
 struct BackendStats {
     int backend_id;
     double elapsed_ms;   // 该后端耗时(毫秒)
     bool success;
 };
 
-// 一次批量操作的统计结果
-struct OperationStats {
-    double total_elapsed_ms;           // 总耗时（最慢后端）
-    std::vector<BackendStats> backends; // 每个后端的统计
+// RAID 层配置
+struct RAIDConfig {
+    // 对冲读：先只请求 k 个 chunk（按后端延迟挑选），
+    // 读取失败时立即补读，超过 hedge_delay_ms 仍未凑齐时再请求其余 chunk
+    // 关闭时一次请求全部 k+m 个 chunk
+    bool hedged_read = true;
+    uint64_t hedge_delay_ms = 200;
+
+    // 每个后端的 I/O 线程数与队列深度；队列满时新请求阻塞（背压）
+    size_t io_threads = 4;
+    size_t io_queue_depth = 64;
+
+    // 后台修复队列（线程数、队列上限、每个后端的修复带宽/IOPS）
+    RepairConfig repair;
+
+    // 后端健康跟踪与熔断（EWMA 延迟/错误率，连续失败后暂停使用）
+    HealthConfig health;
+
+    // 降级写：跳过熔断中的后端，成功写入不少于 write_quorum 个 chunk 即返回成功，
+    // 未写入的 chunk 标记为过期（读取时不再使用）并登记修复
+    // 过期判定依赖 chunk 头中的写入代号（重启后仍然有效），编码器不支持时不做降级写
+    // 关闭时必须全部 k+m 个 chunk 写入成功
+    bool degraded_write = true;
+    int write_quorum = 0;   // 0 表示 k+1；实际取值不小于 max(k, m+1)，不超过 k+m
+
+    // 增量更新：小范围覆盖写只读写一个数据块与 m 个校验块的对应区间，
+    // 不超过此长度（字节）的范围才走增量路径，0 表示关闭
+    // 需要相关后端都支持范围读写（supports_range），否则照常整条带重写
+    uint64_t partial_update_max = 256 * 1024;
 };
 
 // RAID (k+m) 纠删码层
@@ -29,16 +61,23 @@ struct OperationStats {
 //
 // 读取时从任意 k 个有效 chunk 恢复原始数据
 // 并自动修复缺失的 chunk
+//
+// 后端数多于 k+m 时按条带轮转放置：条带 s 的第 pos 个 chunk 存放在
+// 后端 (s * (k+m) + pos) % N 上，相邻条带落在不同的后端组，负载均匀分布
+// 后端数等于 k+m 时第 pos 个 chunk 始终在后端 pos 上（与旧版本一致）
+// 放置只取决于条带号与后端数，已有数据时不能再增减后端
 
 class RAIDChunkStore : public ChunkStore {
 public:
-    // backends: 多个后端，每个后端存一个 chunk
+    // backends: 多个后端（至少 k+m 个），每个后端存一个 chunk
     // k: 数据块数量
     // m: 校验块数量
     // coder: 通用 (k+m) 纠删码实现（如 RSCoder）
     RAIDChunkStore(std::vector<std::shared_ptr<ChunkStore>> backends,
                    int k, int m,
-                   std::shared_ptr<ErasureCoder> coder);
+                   std::shared_ptr<ErasureCoder> coder,
+                   const RAIDConfig &config = RAIDConfig());
+    ~RAIDChunkStore() override;
 
     // 这里忽略 chunk_id，因为对上层暴露的是"整条带"
     bool read_chunk(uint64_t stripe_id,
@@ -51,34 +90,120 @@ public:
 
     bool delete_chunk(uint64_t stripe_id,
                       uint32_t chunk_id) override;
+
+    // 批量写入多个条带（大块顺序写入时由写回缓冲调用）
+    // 逐条带编码后，支持批量写的后端一次收到本批全部 chunk（如 S3 打包为一个对象），
+    // 其余后端仍逐个 chunk 并发写入；全部成功才返回 true
+    bool write_stripes(const std::vector<uint64_t> &stripe_ids,
+                       const std::vector<const std::string *> &data);
+
+    // 增量更新条带内若干区间的内容（条带长度不变），pieces 为按偏移升序、互不重叠的
+    // (条带内偏移, 新内容)；stripe_size 必须等于条带当前的原始长度
+    // 读取被修改数据块的旧字节与 m 个校验块的对应区间，计算差值后只写回这些区间；
+    // 每个位置只发一次读请求与一次写请求，各位置并发执行
+    // 不满足条件（非系统码、长度不符、区间跨数据块、总量超过 partial_update_max、
+    // 搬运量超过整条带重写的一半、n 个位置中任一后端不支持范围读写或不可用、
+    // 有过期位置、各位置 chunk 头部不一致）
+    // 或读取失败时不做任何修改并返回 false，调用方应改为整条带写入
+    // 写入阶段部分失败时失败的位置被标记为过期，其余位置写入新的写入代号
+    // （重启后仍能识别失败的位置），登记修复后同样返回 false
+    bool update_ranges(uint64_t stripe_id, uint64_t stripe_size,
+                       const std::vector<std::pair<uint64_t, std::string>> &pieces);
+
+    // 批量读取多个条带（预读使用）
+    // 按延迟挑选 k 个后端各发起一次批量读取；某个条带凑不齐 k 个 chunk 时
+    // 改用 read_chunk 单独读取（对冲、修复照常）
+    // out 与 stripe_ids 一一对应，失败的项为空字符串；全部成功才返回 true
+    bool read_stripes(const std::vector<uint64_t> &stripe_ids,
+                      std::vector<std::string> &out);
     
-    uint64_t allocate_new_stripe() { return next_stripe_id++; }
+    // stripe ID 分配可以在多个线程中并发调用
+    uint64_t allocate_new_stripe() { return next_stripe_id.fetch_add(1); }
+
+    // 一次分配 count 个连续的 stripe ID，返回第一个
+    uint64_t allocate_stripes(uint64_t count) { return next_stripe_id.fetch_add(count); }
     
-    // 设置下一个 stripe ID（用于加载元数据后更新）
+    // 设置下一个 stripe ID（用于加载元数据后更新，只会增大）
     void set_next_stripe_id(uint64_t id) { 
-        if (id > next_stripe_id) next_stripe_id = id; 
+        uint64_t cur = next_stripe_id.load();
+        while (id > cur && !next_stripe_id.compare_exchange_weak(cur, id)) {
+        }
     }
 
-    // 获取最近一次操作的统计信息
-    OperationStats get_last_read_stats() const { return last_read_stats_; }
-    OperationStats get_last_write_stats() const { return last_write_stats_; }
+    // 各后端的健康状态（EWMA 延迟/吞吐、错误率、熔断状态）
+    std::vector<BackendHealthStats> get_backend_health() const { return health_->stats(); }
+
+    // 修复队列统计（队列深度、吞吐）
+    RepairStats get_repair_stats() const { return repair_queue_->stats(); }
 
 private:
     std::vector<std::shared_ptr<ChunkStore>> backends;
     int k;
     int m;
     std::shared_ptr<ErasureCoder> coder;
-    uint64_t next_stripe_id = 100;  // 保留 0-99 给元数据文件
+    std::atomic<uint64_t> next_stripe_id{100};  // 保留 0-99 给元数据文件
+
+    RAIDConfig config_;
+
+    // 后端健康跟踪（被对冲掉的读请求可能在析构后才完成，回调持有共享引用）
+    std::shared_ptr<BackendHealth> health_;
+    std::atomic<bool> stopping_{false};
+
+    // 后端 I/O 线程池（与 backends 一一对应）与后台修复队列
+    std::vector<std::unique_ptr<IOThreadPool>> io_pools_;
+    std::unique_ptr<RepairQueue> repair_queue_;
+
+    // 条带分片：写入/删除持共享锁并推进写代数，修复补写时持独占锁并校验代数，
+    // 防止修复把旧数据写回刚被重写的条带
+    // stale 记录降级写跳过或写入失败的 chunk 位置（旧数据，读取与修复时不能使用），
+    // 修复补写或条带被完整重写/删除后清除；只保存在内存中，
+    // 重启后这些 chunk 由头部较旧的写入代号识别（见 keep_generation）
+    struct StripeShard {
+        std::shared_mutex mu;
+        std::atomic<uint64_t> gen{0};
+        std::mutex stale_mu;
+        std::unordered_map<uint64_t, std::vector<int>> stale;
+    };
+    static const size_t STRIPE_SHARDS = 256;
+    StripeShard shards_[STRIPE_SHARDS];
+
+    StripeShard &shard_of(uint64_t stripe_id) { return shards_[stripe_id % STRIPE_SHARDS]; }
+
+    void run_on_backend(int i, std::function<void()> task);
+
+    // 条带 stripe_id 的第 pos 个 chunk 所在的后端
+    int backend_of(uint64_t stripe_id, int pos) const {
+        return (int)(((stripe_id % backends.size()) * (uint64_t)(k + m) + (uint64_t)pos) %
+                     backends.size());
+    }
+
+    // 条带的读取顺序（chunk 位置）：可用后端按健康分数升序，熔断中的后端排在最后，
+    // 分数相同时数据块优先；过期的位置不出现在结果中
+    std::vector<int> read_order(uint64_t stripe_id);
+
+    // 过期位置的查询与维护
+    std::vector<int> stale_positions(uint64_t stripe_id);
+    void set_stale(uint64_t stripe_id, const std::vector<int> &positions);
+    void clear_stale(uint64_t stripe_id, const std::vector<int> *positions);
+
+    // 写入时需要成功的最少 chunk 数
+    int write_quorum() const;
+
+    // 整条带写入的写入代号：严格递增，跨重启单调（取墙钟微秒与已见代号的较大者）
+    std::atomic<uint64_t> last_generation_{0};
+    uint64_t next_generation();
+    void observe_generation(uint64_t gen);
+
+    // 读到的 chunk 按写入代号分组，只保留用于解码的一组（代号最新且不少于 k 个），
+    // 其余 chunk 清空并记入 dropped；返回保留的数量
+    int keep_generation(std::vector<std::string> &chunks, std::vector<int> *dropped);
 
-    // 最近一次操作统计
-    mutable std::mutex stats_mutex_;
-    OperationStats last_read_stats_;
-    OperationStats last_write_stats_;
+    // 后端从熔断中恢复：重新登记其上过期 chunk 的修复
+    void on_backend_recovered(int backend);
 
-    // 自动修复：根据完整 data 重新编码，并把缺失 chunk 补写回去
-    void repair_missing_chunks(uint64_t stripe_id,
-                               const std::vector<bool> &present,
-                               const std::string &data);
+    // 后台修复（由 RepairQueue 调用）：重新读取 k 个现存 chunk，
+    // 只重建 missing 位置并补写
+    bool repair_stripe(uint64_t stripe_id, const std::vector<int> &missing);
 };
 
 #endif // RAID_CHUNK_STORE_H
@@ -0,0 +1,186 @@
+#include "repair_queue.h"
+#include "log.h"
+#include <algorithm>
+#include <iterator>
+#include <cstdio>
+#include <cinttypes>
+
+RepairQueue::RepairQueue(int num_backends, const RepairConfig &config, RepairFn fn)
+    : config_(config), fn_(std::move(fn))
+{
+    auto now = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_backends; i++) {
+        auto b = std::make_unique<BackendBudget>();
+        // 初始给满 1 秒的额度
+        b->bytes.tokens = (double)config_.bandwidth_per_backend;
+        b->bytes.last = now;
+        b->ops.tokens = (double)config_.iops_per_backend;
+        b->ops.last = now;
+        budgets_.push_back(std::move(b));
+    }
+
+    size_t n = config_.threads ? config_.threads : 1;
+    for (size_t i = 0; i < n; i++) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+RepairQueue::~RepairQueue()
+{
+    stop();
+}
+
+void RepairQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+
+    // 正在进行的修复会在下一次 throttle() 时放弃，排队中的条带直接丢弃
+    for (auto &t : workers_) {
+        if (t.joinable()) t.join();
+    }
+}
+
+bool RepairQueue::enqueue(uint64_t stripe_id, const std::vector<int> &missing)
+{
+    if (missing.empty()) return true;
+
+    std::vector<int> sorted = missing;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    std::lock_guard<std::mutex> lock(mu_);
+    if (stopping_) return false;
+
+    auto it = pending_.find(stripe_id);
+    if (it != pending_.end()) {
+        // 合并缺失位置（保持升序去重）
+        std::vector<int> merged;
+        std::set_union(it->second.begin(), it->second.end(),
+                       sorted.begin(), sorted.end(),
+                       std::back_inserter(merged));
+        it->second = std::move(merged);
+        stats_.merged++;
+        return true;
+    }
+
+    if (pending_.size() >= config_.max_pending) {
+        stats_.dropped++;
+        return false;
+    }
+
+    pending_.emplace(stripe_id, std::move(sorted));
+    order_.push_back(stripe_id);
+    stats_.enqueued++;
+    cv_.notify_one();
+    return true;
+}
+
+// 按经过时间补充令牌，上限为 1 秒的额度，返回补充后的余额
+double RepairQueue::refill(TokenBucket &b, uint64_t rate,
+                           std::chrono::steady_clock::time_point now)
+{
+    double elapsed = std::chrono::duration<double>(now - b.last).count();
+    b.last = now;
+    b.tokens = std::min((double)rate, b.tokens + elapsed * (double)rate);
+    return b.tokens;
+}
+
+bool RepairQueue::throttle(int backend, uint64_t bytes)
+{
+    if (backend < 0 || backend >= (int)budgets_.size()) return !stopping_;
+
+    const uint64_t bw   = config_.bandwidth_per_backend;
+    const uint64_t iops = config_.iops_per_backend;
+    BackendBudget &b = *budgets_[backend];
+
+    std::unique_lock<std::mutex> lock(b.mu);
+    for (;;) {
+        if (stopping_) return false;
+
+        auto now = std::chrono::steady_clock::now();
+        double wait = 0;
+        if (iops > 0) {
+            double t = refill(b.ops, iops, now);
+            if (t < 1.0) wait = std::max(wait, (1.0 - t) / (double)iops);
+        }
+        if (bw > 0) {
+            double t = refill(b.bytes, bw, now);
+            if (t < 0) wait = std::max(wait, -t / (double)bw);
+        }
+        if (wait <= 0) break;
+
+        // 分段睡眠，便于关闭时尽快退出
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::duration<double>(std::min(wait, 0.1)));
+        lock.lock();
+    }
+
+    if (iops > 0) b.ops.tokens -= 1.0;
+    if (bw > 0) b.bytes.tokens -= (double)bytes;
+    return true;
+}
+
+void RepairQueue::consume(int backend, uint64_t bytes)
+{
+    if (backend < 0 || backend >= (int)budgets_.size()) return;
+    if (config_.bandwidth_per_backend == 0) return;
+
+    BackendBudget &b = *budgets_[backend];
+    std::lock_guard<std::mutex> lock(b.mu);
+    b.bytes.tokens -= (double)bytes;
+}
+
+void RepairQueue::record_repaired(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    stats_.chunks_repaired++;
+    stats_.bytes_repaired += bytes;
+}
+
+RepairStats RepairQueue::stats() const
+{
+    std::lock_guard<std::mutex> lock(mu_);
+    RepairStats s = stats_;
+    s.queue_depth = pending_.size();
+    return s;
+}
+
+void RepairQueue::worker_loop()
+{
+    for (;;) {
+        uint64_t stripe_id;
+        std::vector<int> missing;
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            cv_.wait(lock, [this] { return stopping_ || !order_.empty(); });
+            if (stopping_) return;
+
+            stripe_id = order_.front();
+            order_.pop_front();
+            auto it = pending_.find(stripe_id);
+            missing = std::move(it->second);
+            pending_.erase(it);
+            stats_.in_progress++;
+        }
+
+        bool ok = fn_(stripe_id, missing);
+
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stats_.in_progress--;
+            if (ok) {
+                stats_.completed++;
+            } else {
+                stats_.failed++;
+            }
+        }
+
+        if (!ok) {
+            LOG_WARN("RepairQueue: stripe %" PRIu64 " 修复失败\n", stripe_id);
+        }
+    }
+}
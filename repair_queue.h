@@ -0,0 +1,109 @@
+#ifndef REPAIR_QUEUE_H
+#define REPAIR_QUEUE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <atomic>
+
+// 后台修复队列
+// - 按 stripe 去重：同一条带重复入队时合并缺失位置，不会重复修复
+// - 每个后端独立的令牌桶，限制修复占用的带宽与 IOPS
+// - 队列长度有上限，超出时丢弃新请求（下次读到该条带会再次入队）
+// 实际修复由构造时传入的 RepairFn 完成，RepairFn 内部通过 throttle()
+// 申请后端额度
+
+struct RepairConfig {
+    size_t threads = 1;                  // 修复线程数
+    size_t max_pending = 4096;           // 最多排队的条带数
+    uint64_t bandwidth_per_backend = 0;  // 每个后端的修复带宽（字节/秒），0 表示不限
+    uint64_t iops_per_backend = 0;       // 每个后端的修复 IOPS，0 表示不限
+};
+
+struct RepairStats {
+    size_t queue_depth = 0;     // 当前排队条带数
+    size_t in_progress = 0;     // 正在修复的条带数
+    uint64_t enqueued = 0;      // 累计入队次数
+    uint64_t merged = 0;        // 被去重合并的入队次数
+    uint64_t dropped = 0;       // 队列满丢弃的次数
+    uint64_t completed = 0;     // 修复成功的条带数
+    uint64_t failed = 0;        // 修复失败的条带数
+    uint64_t chunks_repaired = 0;
+    uint64_t bytes_repaired = 0;
+};
+
+class RepairQueue {
+public:
+    // missing: 需要重建的 chunk 位置（升序）
+    // 返回 true 表示修复成功
+    using RepairFn = std::function<bool(uint64_t stripe_id,
+                                        const std::vector<int> &missing)>;
+
+    RepairQueue(int num_backends, const RepairConfig &config, RepairFn fn);
+    ~RepairQueue();
+
+    RepairQueue(const RepairQueue &) = delete;
+    RepairQueue &operator=(const RepairQueue &) = delete;
+
+    // 停止修复线程并等待其退出（可重复调用，析构时自动调用）
+    void stop();
+
+    // 条带入队；已在队列中时合并缺失位置
+    // 队列满时返回 false
+    bool enqueue(uint64_t stripe_id, const std::vector<int> &missing);
+
+    // 向后端 backend 申请一次 I/O 的额度（bytes 字节），额度不足时阻塞
+    // 带宽允许透支，透支部分由下一次申请等待补回
+    // 队列正在关闭时返回 false，调用方应放弃本次修复
+    bool throttle(int backend, uint64_t bytes);
+
+    // 事后扣除带宽额度（读取前无法得知大小时使用），不阻塞
+    void consume(int backend, uint64_t bytes);
+
+    // 记录一次成功写回
+    void record_repaired(uint64_t bytes);
+
+    RepairStats stats() const;
+
+private:
+    // 令牌桶：tokens 可为负（透支），按 rate 每秒恢复，上限 1 秒的额度
+    struct TokenBucket {
+        double tokens = 0;
+        std::chrono::steady_clock::time_point last;
+    };
+
+    struct BackendBudget {
+        std::mutex mu;
+        TokenBucket bytes;
+        TokenBucket ops;
+    };
+
+    void worker_loop();
+    static double refill(TokenBucket &b, uint64_t rate,
+                         std::chrono::steady_clock::time_point now);
+
+    RepairConfig config_;
+    RepairFn fn_;
+
+    // stripe_id -> 缺失位置；order_ 保持先入先出
+    std::unordered_map<uint64_t, std::vector<int>> pending_;
+    std::deque<uint64_t> order_;
+    std::atomic<bool> stopping_{false};
+
+    mutable std::mutex mu_;
+    std::condition_variable cv_;
+    RepairStats stats_;
+
+    std::vector<std::unique_ptr<BackendBudget>> budgets_;
+    std::vector<std::thread> workers_;
+};
+
+#endif // REPAIR_QUEUE_H
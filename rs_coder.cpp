@@ -1,54 +1,185 @@
 #include "rs_coder.h"
+#include "log.h"
+#include "metrics.h"
+#include "gf256.h"
+#include <algorithm>
 #include <cstring>
 #include <cstdio>
 
-// GF(256) 乘法表（可选：你可以换成预计算表）
-static uint8_t gf_mul_table[256][256];
-static bool gf_init = false;
-
-static void gf_init_table() {
-    if (gf_init) return;
-    gf_init = true;
-
-    for (int a = 0; a < 256; a++) {
-        for (int b = 0; b < 256; b++) {
-            uint8_t x = 0;
-            uint8_t aa = (uint8_t)a;
-            uint8_t bb = (uint8_t)b;
-            while (bb) {
-                if (bb & 1U) x ^= aa;
-                bool hi = (aa & 0x80U) != 0;
-                aa <<= 1;
-                if (hi) aa ^= 0x1D; // x^8 + x^4 + x^3 + x^2 + 1
-                bb >>= 1;
+// 编码时按字节区间分块处理，使目标块与各数据列的当前区间常驻 L1/L2
+static const size_t RS_BLOCK_SIZE = 32 * 1024;
+
+// 编解码耗时，所有实例共享
+static Histogram *const g_encode_time = metrics().histogram(
+    "cloudraidfs_ec_duration_seconds", "纠删码编码、解码与重建耗时", "op=\"encode\"");
+static Histogram *const g_decode_time = metrics().histogram(
+    "cloudraidfs_ec_duration_seconds", "纠删码编码、解码与重建耗时", "op=\"decode\"");
+static Histogram *const g_reconstruct_time = metrics().histogram(
+    "cloudraidfs_ec_duration_seconds", "纠删码编码、解码与重建耗时", "op=\"reconstruct\"");
+static Histogram *const g_update_time = metrics().histogram(
+    "cloudraidfs_ec_duration_seconds", "纠删码编码、解码与重建耗时", "op=\"update\"");
+
+// ------------------------------------------------------------
+// 系统码 chunk 头（小端）
+//   [0..3]   magic "CRSC"
+//   [4]      版本号
+//   [5]      布局（RS_LAYOUT_SYSTEMATIC）
+//   [6]      k
+//   [7]      m
+//   [8..15]  原始条带长度
+//   [16..23] 写入代号（版本 2 起；版本 1 的头部只有 16 字节，代号视为 0）
+// 旧格式（Vandermonde）chunk 没有头部，长度头编码在数据中
+// ------------------------------------------------------------
+static const uint8_t RS_CHUNK_MAGIC[4] = { 'C', 'R', 'S', 'C' };
+static const uint8_t RS_CHUNK_VERSION = 2;
+static const uint8_t RS_CHUNK_VERSION_V1 = 1;
+static const uint8_t RS_LAYOUT_SYSTEMATIC = 1;
+static const size_t  RS_CHUNK_HEADER_SIZE = 24;
+static const size_t  RS_CHUNK_HEADER_SIZE_V1 = 16;
+
+struct RSChunkHeader {
+    uint8_t  layout;
+    uint8_t  k;
+    uint8_t  m;
+    uint64_t orig_size;
+    uint64_t gen = 0;
+    size_t   size = RS_CHUNK_HEADER_SIZE;   // 头部长度（随版本不同）
+};
+
+static void write_chunk_header(std::string &chunk, const RSChunkHeader &h)
+{
+    std::memcpy(&chunk[0], RS_CHUNK_MAGIC, 4);
+    chunk[4] = (char)RS_CHUNK_VERSION;
+    chunk[5] = (char)h.layout;
+    chunk[6] = (char)h.k;
+    chunk[7] = (char)h.m;
+    std::memcpy(&chunk[8], &h.orig_size, 8);
+    std::memcpy(&chunk[16], &h.gen, 8);
+}
+
+// 当前版本的 chunk（可以读写写入代号）
+static bool has_current_header(const std::string &chunk)
+{
+    return chunk.size() >= RS_CHUNK_HEADER_SIZE &&
+           std::memcmp(chunk.data(), RS_CHUNK_MAGIC, 4) == 0 &&
+           (uint8_t)chunk[4] == RS_CHUNK_VERSION;
+}
+
+// 识别新格式 chunk：magic/版本/参数/长度必须全部自洽，
+// 旧格式 chunk 恰好满足全部条件的概率可以忽略
+static bool parse_chunk_header(const std::string &chunk, int k, int m,
+                               RSChunkHeader &h)
+{
+    if (chunk.size() < RS_CHUNK_HEADER_SIZE_V1) return false;
+    if (std::memcmp(chunk.data(), RS_CHUNK_MAGIC, 4) != 0) return false;
+
+    uint8_t version = (uint8_t)chunk[4];
+    if (version == RS_CHUNK_VERSION) {
+        if (chunk.size() < RS_CHUNK_HEADER_SIZE) return false;
+        h.size = RS_CHUNK_HEADER_SIZE;
+        std::memcpy(&h.gen, chunk.data() + 16, 8);
+    } else if (version == RS_CHUNK_VERSION_V1) {
+        h.size = RS_CHUNK_HEADER_SIZE_V1;
+        h.gen = 0;
+    } else {
+        return false;
+    }
+
+    h.layout = (uint8_t)chunk[5];
+    h.k = (uint8_t)chunk[6];
+    h.m = (uint8_t)chunk[7];
+    std::memcpy(&h.orig_size, chunk.data() + 8, 8);
+
+    if (h.layout != RS_LAYOUT_SYSTEMATIC) return false;
+    if (h.k != k || h.m != m) return false;
+
+    uint64_t payload = chunk.size() - h.size;
+    uint64_t expect  = (h.orig_size + (uint64_t)k - 1) / (uint64_t)k;
+    return payload == expect;
+}
+
+// 选出最多 k 个有效 chunk（非空，优先取靠前的数据块），
+// 校验长度一致并按 chunk 头识别条带格式
+static bool probe_stripe(const std::vector<std::string> &chunks,
+                         int k, int m,
+                         std::vector<int> &valid,
+                         size_t &chunk_size,
+                         RSCoder::Layout &layout,
+                         size_t &skip,
+                         RSChunkHeader &h)
+{
+    valid.clear();
+    valid.reserve(k);
+    for (int i = 0; i < k + m; i++) {
+        if (!chunks[i].empty()) {
+            valid.push_back(i);
+            if ((int)valid.size() == k) break;
+        }
+    }
+    if ((int)valid.size() < k) {
+        LOG_DEBUG("RSCoder: 有效 chunk 不足 k，无法恢复\n");
+        return false;
+    }
+
+    // 检查这些有效 chunk 长度是否一致，并确定 chunk_size
+    chunk_size = chunks[valid[0]].size();
+    for (int idx : valid) {
+        if (chunks[idx].size() != chunk_size) {
+            LOG_DEBUG("RSCoder::decode: 有效 chunk 长度不一致\n");
+            return false;
+        }
+    }
+
+    // 识别条带格式：所有有效 chunk 的系统码头部（含写入代号）必须一致
+    skip = 0;
+    layout = RSCoder::Layout::VANDERMONDE;
+    if (parse_chunk_header(chunks[valid[0]], k, m, h)) {
+        for (int idx : valid) {
+            if (std::memcmp(chunks[idx].data(), chunks[valid[0]].data(), h.size) != 0) {
+                LOG_DEBUG("RSCoder::decode: chunk 头部不一致\n");
+                return false;
             }
-            gf_mul_table[a][b] = x;
         }
+        layout = RSCoder::Layout::SYSTEMATIC;
+        skip = h.size;
     }
+    return true;
 }
 
-RSCoder::RSCoder() {
-    gf_init_table();
+RSCoder::RSCoder(Layout layout)
+    : layout_(layout)
+{
+    gf_init();
 }
 
 uint8_t RSCoder::gf_mul(uint8_t a, uint8_t b) const {
-    return gf_mul_table[a][b];
+    return ::gf_mul(a, b);
 }
 
 uint8_t RSCoder::gf_inv(uint8_t a) const {
-    if (a == 0) return 0;
-    for (int i = 1; i < 256; i++) {
-        if (gf_mul_table[a][i] == 1) return (uint8_t)i;
-    }
-    return 0;
+    return ::gf_inv(a);
 }
 
-// 生成 Vandermonde 矩阵
-void RSCoder::build_matrix(int k, int m,
-                           std::vector<std::vector<uint8_t>> &matrix)
+// 生成编码矩阵（k+m 行，k 列）
+//   VANDERMONDE：第 row 行为 (row+1)^col
+//   SYSTEMATIC ：前 k 行为单位阵，后 m 行为 Cauchy 矩阵 1/(x_i + y_j)
+//                x_i = k + i, y_j = j，任意 k 行构成的子矩阵均可逆
+void RSCoder::build_matrix(int k, int m, Layout layout, Matrix &matrix)
 {
     matrix.assign(k + m, std::vector<uint8_t>(k));
 
+    if (layout == Layout::SYSTEMATIC) {
+        for (int row = 0; row < k; row++) {
+            matrix[row][row] = 1;
+        }
+        for (int i = 0; i < m; i++) {
+            for (int j = 0; j < k; j++) {
+                matrix[k + i][j] = gf_inv((uint8_t)((k + i) ^ j));
+            }
+        }
+        return;
+    }
+
     for (int row = 0; row < k + m; row++) {
         uint8_t x = (uint8_t)(row + 1);
         uint8_t v = 1;
@@ -59,15 +190,98 @@ void RSCoder::build_matrix(int k, int m,
     }
 }
 
+std::shared_ptr<const RSCoder::Matrix> RSCoder::get_matrix(int k, int m, Layout layout)
+{
+    uint32_t key = ((uint32_t)layout << 16) | ((uint32_t)k << 8) | (uint32_t)m;
+
+    std::lock_guard<std::mutex> lock(matrix_cache_mu_);
+    auto it = matrix_cache_.find(key);
+    if (it != matrix_cache_.end()) return it->second;
+
+    auto mat = std::make_shared<Matrix>();
+    build_matrix(k, m, layout, *mat);
+    matrix_cache_[key] = mat;
+    return mat;
+}
+
+// dst[r] = sum(coef[r][c] * src[c])，按区间分块
+void RSCoder::apply_matrix(const std::vector<std::vector<uint8_t>> &coef,
+                           const std::vector<const uint8_t *> &src,
+                           const std::vector<uint8_t *> &dst,
+                           size_t len)
+{
+    for (size_t off = 0; off < len; off += RS_BLOCK_SIZE) {
+        size_t n = std::min(RS_BLOCK_SIZE, len - off);
+        for (size_t r = 0; r < dst.size(); r++) {
+            gf_mul_region(coef[r][0], src[0] + off, dst[r] + off, n);
+            for (size_t c = 1; c < src.size(); c++) {
+                gf_mul_add_region(coef[r][c], src[c] + off, dst[r] + off, n);
+            }
+        }
+    }
+}
+
 // 编码：data → k+m 个 chunk
 bool RSCoder::encode(const std::string &data,
                      int k, int m,
                      std::vector<std::string> &out_chunks)
+{
+    ScopedTimer timer(g_encode_time);
+    return encode_layout(data, k, m, layout_, out_chunks);
+}
+
+bool RSCoder::encode_layout(const std::string &data,
+                            int k, int m, Layout layout,
+                            std::vector<std::string> &out_chunks)
 {
     if (k <= 0 || m <= 0) {
-        fprintf(stderr, "RSCoder::encode: k,m 必须 > 0\n");
+        LOG_ERROR("RSCoder::encode: k,m 必须 > 0\n");
         return false;
     }
+    if (k + m > 255) {
+        LOG_ERROR("RSCoder::encode: k+m 不能超过 255\n");
+        return false;
+    }
+
+    std::shared_ptr<const Matrix> mat_ptr = get_matrix(k, m, layout);
+    const Matrix &mat = *mat_ptr;
+
+    if (layout == Layout::SYSTEMATIC) {
+        // 数据块即原始数据切片，只需计算 m 个校验块
+        size_t payload = (data.size() + (size_t)k - 1) / (size_t)k;
+
+        RSChunkHeader h;
+        h.layout = RS_LAYOUT_SYSTEMATIC;
+        h.k = (uint8_t)k;
+        h.m = (uint8_t)m;
+        h.orig_size = (uint64_t)data.size();
+
+        out_chunks.assign(k + m, std::string(RS_CHUNK_HEADER_SIZE + payload, 0));
+        for (int i = 0; i < k + m; i++) {
+            write_chunk_header(out_chunks[i], h);
+        }
+
+        for (int i = 0; i < k; i++) {
+            size_t begin = (size_t)i * payload;
+            if (begin >= data.size()) break;
+            size_t n = std::min(payload, data.size() - begin);
+            std::memcpy(&out_chunks[i][RS_CHUNK_HEADER_SIZE], data.data() + begin, n);
+        }
+
+        if (payload == 0) return true;
+
+        std::vector<std::vector<uint8_t>> coef(mat.begin() + k, mat.end());
+        std::vector<const uint8_t *> src(k);
+        std::vector<uint8_t *> dst(m);
+        for (int i = 0; i < k; i++) {
+            src[i] = (const uint8_t *)out_chunks[i].data() + RS_CHUNK_HEADER_SIZE;
+        }
+        for (int i = 0; i < m; i++) {
+            dst[i] = (uint8_t *)&out_chunks[k + i][RS_CHUNK_HEADER_SIZE];
+        }
+        apply_matrix(coef, src, dst, payload);
+        return true;
+    }
 
     const size_t meta_size = sizeof(uint64_t); // 8 字节长度头
     uint64_t orig_size = (uint64_t)data.size();
@@ -93,21 +307,16 @@ bool RSCoder::encode(const std::string &data,
     // 输出 k+m 个 chunk，每个 chunk 仅存 payload（无额外头）
     out_chunks.assign(k + m, std::string(chunk_size, 0));
 
-    // 生成编码矩阵（k+m 行，k 列）
-    std::vector<std::vector<uint8_t>> mat;
-    build_matrix(k, m, mat);
-
-    // 对每个块内字节位置编码
+    // 逐区间做矩阵-向量乘：out[row] = sum(mat[row][col] * data[col])
+    std::vector<const uint8_t *> src(k);
+    std::vector<uint8_t *> dst(k + m);
+    for (int col = 0; col < k; col++) {
+        src[col] = (const uint8_t *)padded.data() + (size_t)col * chunk_size;
+    }
     for (int row = 0; row < k + m; row++) {
-        for (size_t b = 0; b < chunk_size; b++) {
-            uint8_t acc = 0;
-            for (int col = 0; col < k; col++) {
-                uint8_t v = (uint8_t)padded[(size_t)col * chunk_size + b];
-                acc ^= gf_mul(mat[row][col], v);
-            }
-            out_chunks[row][b] = (char)acc;
-        }
+        dst[row] = (uint8_t *)&out_chunks[row][0];
     }
+    apply_matrix(mat, src, dst, chunk_size);
 
     return true;
 }
@@ -117,146 +326,333 @@ bool RSCoder::decode(const std::vector<std::string> &chunks,
                      int k, int m,
                      std::string &out_data)
 {
+    ScopedTimer timer(g_decode_time);
+
     if ((int)chunks.size() != k + m) {
-        fprintf(stderr, "RSCoder::decode: chunks.size() 必须是 k+m\n");
+        LOG_DEBUG("RSCoder::decode: chunks.size() 必须是 k+m\n");
         return false;
     }
 
     const size_t meta_size = sizeof(uint64_t);
 
-    // 收集最多 k 个有效 chunk 的索引（非空）
     std::vector<int> valid;
-    valid.reserve(k);
-    for (int i = 0; i < k + m; i++) {
-        if (!chunks[i].empty()) {
-            valid.push_back(i);
-            if ((int)valid.size() == k) break;
-        }
+    RSChunkHeader h;
+    size_t chunk_size = 0;
+    size_t skip = 0;
+    Layout layout;
+    if (!probe_stripe(chunks, k, m, valid, chunk_size, layout, skip, h)) {
+        return false;
     }
-    if ((int)valid.size() < k) {
-        fprintf(stderr, "RSCoder: 有效 chunk 不足 k，无法恢复\n");
+
+    size_t payload = chunk_size - skip;
+    size_t padded_size = payload * (size_t)k;
+
+    if (layout == Layout::VANDERMONDE && padded_size < meta_size) {
+        // 长度头可能跨越多个 chunk，只要求解码结果整体能容纳头部
+        LOG_DEBUG("RSCoder::decode: 有效 chunk 长度不足以包含头部\n");
         return false;
     }
 
-    // 检查这些有效 chunk 长度是否一致，并确定 chunk_size
-    size_t chunk_size = chunks[valid[0]].size();
-    if (chunk_size < meta_size) {
-        fprintf(stderr, "RSCoder::decode: 有效 chunk 长度不足以包含头部\n");
+    // 取得（或计算并缓存）该擦除模式对应的逆矩阵
+    std::shared_ptr<const DecodeMatrix> dm = get_decode_matrix(k, m, layout, valid);
+    if (!dm) {
+        LOG_DEBUG("RSCoder: 子矩阵不可逆，无法恢复\n");
         return false;
     }
-    for (int idx : valid) {
-        if (chunks[idx].size() != chunk_size) {
-            fprintf(stderr, "RSCoder::decode: 有效 chunk 长度不一致\n");
-            return false;
+
+    if (dm->identity && layout == Layout::SYSTEMATIC) {
+        // 快速路径：数据块全部可用，直接拼接原始切片
+        out_data.resize((size_t)h.orig_size);
+        size_t left = (size_t)h.orig_size;
+        for (int r = 0; r < k && left > 0; r++) {
+            size_t n = std::min(payload, left);
+            std::memcpy(&out_data[(size_t)r * payload],
+                        chunks[valid[r]].data() + skip, n);
+            left -= n;
         }
+        return true;
     }
 
-    // 基矩阵（不会被修改）
-    std::vector<std::vector<uint8_t>> base_mat(k, std::vector<uint8_t>(k));
-    for (int r = 0; r < k; r++) {
-        uint8_t x = (uint8_t)(valid[r] + 1);
-        uint8_t v = 1;
-        for (int c = 0; c < k; c++) {
-            base_mat[r][c] = v;
-            v = gf_mul(v, x);
+    // 解出的 k 个数据块直接写入 out_data
+    out_data.resize(padded_size);
+    if (payload > 0) {
+        std::vector<const uint8_t *> src(k);
+        std::vector<uint8_t *> dst(k);
+        for (int r = 0; r < k; r++) {
+            src[r] = (const uint8_t *)chunks[valid[r]].data() + skip;
+            dst[r] = (uint8_t *)&out_data[(size_t)r * payload];
         }
+        apply_matrix(dm->inv, src, dst, payload);
     }
 
-    // 解出的 k 个数据块（总长度 k * chunk_size）
-    std::string padded(chunk_size * (size_t)k, 0);
+    if (layout == Layout::SYSTEMATIC) {
+        out_data.resize((size_t)h.orig_size);
+        return true;
+    }
 
-    // 对每个字节位置做一次求解
-    for (size_t b = 0; b < chunk_size; b++) {
-        // 构造等式右侧向量 vec
-        std::vector<uint8_t> vec(k);
-        for (int r = 0; r < k; r++) {
-            int idx = valid[r];
-            const std::string &chunk = chunks[idx];
+    // 旧格式：从前 8 字节里取出 orig_size，并原地去掉头部
+    uint64_t orig_size = 0;
+    std::memcpy(&orig_size, out_data.data(), meta_size);
 
-            if (chunk.size() < b + 1) {
-                fprintf(stderr, "RSCoder::decode: chunk %d 数据长度不足\n", idx);
-                return false;
+    size_t max_payload = padded_size - meta_size;
+    if (orig_size > (uint64_t)max_payload) {
+        LOG_DEBUG("RSCoder::decode: orig_size 超出解码 payload 长度\n");
+        out_data.clear();
+        return false;
+    }
+
+    out_data.erase(0, meta_size);
+    out_data.resize((size_t)orig_size);
+
+    return true;
+}
+
+// 重建缺失 chunk：只计算 wanted 行
+// 第 j 行 chunk = M[j] · inv(M[valid]) · valid chunks，
+// 直接由现存 chunk 线性组合得到，无需先解出整条带再整体编码
+bool RSCoder::reconstruct(const std::vector<std::string> &chunks,
+                          int k, int m,
+                          const std::vector<int> &wanted,
+                          std::vector<std::string> &out_chunks)
+{
+    ScopedTimer timer(g_reconstruct_time);
+
+    if ((int)chunks.size() != k + m) {
+        LOG_DEBUG("RSCoder::reconstruct: chunks.size() 必须是 k+m\n");
+        return false;
+    }
+
+    std::vector<int> valid;
+    RSChunkHeader h;
+    size_t chunk_size = 0;
+    size_t skip = 0;
+    Layout layout;
+    if (!probe_stripe(chunks, k, m, valid, chunk_size, layout, skip, h)) {
+        return false;
+    }
+
+    std::shared_ptr<const DecodeMatrix> dm = get_decode_matrix(k, m, layout, valid);
+    if (!dm) {
+        LOG_DEBUG("RSCoder: 子矩阵不可逆，无法恢复\n");
+        return false;
+    }
+
+    std::shared_ptr<const Matrix> mat_ptr = get_matrix(k, m, layout);
+    const Matrix &mat = *mat_ptr;
+
+    // 合成系数：coef[r] = M[wanted[r]] · inv
+    out_chunks.assign(k + m, std::string());
+    std::vector<std::vector<uint8_t>> coef;
+    std::vector<uint8_t *> dst;
+    for (int j : wanted) {
+        if (j < 0 || j >= k + m) continue;
+
+        std::vector<uint8_t> row(k, 0);
+        for (int c = 0; c < k; c++) {
+            uint8_t v = 0;
+            for (int t = 0; t < k; t++) {
+                v ^= gf_mul(mat[j][t], dm->inv[t][c]);
             }
-            vec[r] = (uint8_t)chunk[b];
+            row[c] = v;
         }
+        coef.push_back(std::move(row));
 
-        // 高斯消元
-        std::vector<std::vector<uint8_t>> mat = base_mat;
-        std::vector<uint8_t> sol(k);
-        if (!solve_matrix(mat, vec, sol)) {
-            fprintf(stderr, "RSCoder: 高斯消元失败 (b=%zu)\n", b);
-            return false;
+        // 系统码各 chunk 头部相同，直接沿用现存 chunk 的头部
+        out_chunks[j].resize(chunk_size);
+        if (skip > 0) {
+            std::memcpy(&out_chunks[j][0], chunks[valid[0]].data(), skip);
         }
+        dst.push_back((uint8_t *)&out_chunks[j][0] + skip);
+    }
 
-        for (int i = 0; i < k; i++) {
-            padded[(size_t)i * chunk_size + b] = (char)sol[i];
+    size_t payload = chunk_size - skip;
+    if (!dst.empty() && payload > 0) {
+        std::vector<const uint8_t *> src(k);
+        for (int r = 0; r < k; r++) {
+            src[r] = (const uint8_t *)chunks[valid[r]].data() + skip;
         }
+        apply_matrix(coef, src, dst, payload);
     }
+    return true;
+}
 
-    // 从 padded 的前 8 字节里取出 orig_size
-    if (padded.size() < meta_size) {
-        fprintf(stderr, "RSCoder::decode: 解码结果长度不足以包含头部\n");
-        return false;
-    }
+// ------------------------------------------------------------
+// 增量更新
+// 系统码校验块 P_i = sum_j C[i][j] * D_j，数据块 D_j 的一段改变 Δ 时
+// P_i 的同一区间只需加上 C[i][j] * Δ（GF(256) 中加法即异或）
+// ------------------------------------------------------------
+size_t RSCoder::chunk_header_size() const
+{
+    return RS_CHUNK_HEADER_SIZE;
+}
+
+bool RSCoder::check_update_header(const std::string &header,
+                                  int k, int m, uint64_t stripe_size) const
+{
+    if (header.size() != RS_CHUNK_HEADER_SIZE) return false;
+    if (std::memcmp(header.data(), RS_CHUNK_MAGIC, 4) != 0) return false;
+    if ((uint8_t)header[4] != RS_CHUNK_VERSION) return false;
+    if ((uint8_t)header[5] != RS_LAYOUT_SYSTEMATIC) return false;
+    if ((uint8_t)header[6] != k || (uint8_t)header[7] != m) return false;
 
     uint64_t orig_size = 0;
-    std::memcpy(&orig_size, padded.data(), meta_size);
+    std::memcpy(&orig_size, header.data() + 8, 8);
+    return orig_size == stripe_size;
+}
 
-    size_t max_payload = padded.size() - meta_size;
-    if (orig_size > (uint64_t)max_payload) {
-        fprintf(stderr, "RSCoder::decode: orig_size 超出解码 payload 长度\n");
-        return false;
+// ------------------------------------------------------------
+// 写入代号
+// ------------------------------------------------------------
+bool RSCoder::set_generation(std::vector<std::string> &chunks, uint64_t gen)
+{
+    for (const auto &c : chunks) {
+        if (!has_current_header(c)) return false;
+    }
+    for (auto &c : chunks) {
+        std::memcpy(&c[16], &gen, 8);
     }
+    return true;
+}
+
+uint64_t RSCoder::generation(const std::string &chunk) const
+{
+    if (!has_current_header(chunk)) return 0;
+    uint64_t gen = 0;
+    std::memcpy(&gen, chunk.data() + 16, 8);
+    return gen;
+}
+
+bool RSCoder::locate_range(uint64_t stripe_size, int k, uint64_t offset, size_t len,
+                           int &data_index, uint64_t &chunk_offset) const
+{
+    if (k <= 0 || len == 0 || offset + len > stripe_size) return false;
 
-    out_data.assign(padded.data() + meta_size,
-                    padded.data() + meta_size + (size_t)orig_size);
+    uint64_t payload = (stripe_size + (uint64_t)k - 1) / (uint64_t)k;
+    uint64_t first = offset / payload;
+    uint64_t last = (offset + len - 1) / payload;
+    if (first != last) return false;
 
+    data_index = (int)first;
+    chunk_offset = RS_CHUNK_HEADER_SIZE + offset % payload;
     return true;
 }
 
-// 高斯消元（GF(256)）
-bool RSCoder::solve_matrix(std::vector<std::vector<uint8_t>> &mat,
-                           std::vector<uint8_t> &vec,
-                           std::vector<uint8_t> &sol)
+bool RSCoder::update_parity(int k, int m, int data_index,
+                            const std::string &old_data,
+                            const std::string &new_data,
+                            std::vector<std::string> &parity)
 {
-    int n = (int)mat.size();
+    ScopedTimer timer(g_update_time);
 
-    // 前向消元
-    for (int i = 0; i < n; i++) {
-        if (mat[i][i] == 0) {
-            // 简单处理：不做行交换，直接失败
-            return false;
-        }
+    if (data_index < 0 || data_index >= k || (int)parity.size() != m) return false;
+    size_t len = new_data.size();
+    if (old_data.size() != len) return false;
+    for (const auto &p : parity) {
+        if (p.size() != len) return false;
+    }
 
-        uint8_t inv = gf_inv(mat[i][i]);
-        if (inv == 0) return false;
+    std::string delta(new_data);
+    gf_mul_add_region(1, (const uint8_t *)old_data.data(), (uint8_t *)&delta[0], len);
 
-        // 归一化
-        for (int j = i; j < n; j++) {
-            mat[i][j] = gf_mul(mat[i][j], inv);
+    std::shared_ptr<const Matrix> mat = get_matrix(k, m, Layout::SYSTEMATIC);
+    for (int i = 0; i < m; i++) {
+        gf_mul_add_region((*mat)[k + i][data_index], (const uint8_t *)delta.data(),
+                          (uint8_t *)&parity[i][0], len);
+    }
+    return true;
+}
+
+// 取得 valid 行构成的 k×k 子矩阵的逆（按擦除模式缓存）
+std::shared_ptr<const RSCoder::DecodeMatrix>
+RSCoder::get_decode_matrix(int k, int m, Layout layout,
+                           const std::vector<int> &valid)
+{
+    // key = 布局, k, m, valid 索引序列
+    std::string key;
+    key.reserve(valid.size() + 3);
+    key.push_back((char)layout);
+    key.push_back((char)k);
+    key.push_back((char)m);
+    for (int idx : valid) key.push_back((char)idx);
+
+    {
+        std::lock_guard<std::mutex> lock(decode_cache_mu_);
+        auto it = decode_cache_.find(key);
+        if (it != decode_cache_.end()) {
+            decode_lru_.on_access(key);
+            return it->second;
         }
-        vec[i] = gf_mul(vec[i], inv);
+    }
 
-        // 消元
-        for (int r = i + 1; r < n; r++) {
-            uint8_t f = mat[r][i];
-            if (f == 0) continue;
+    std::shared_ptr<const Matrix> mat = get_matrix(k, m, layout);
 
-            for (int c = i; c < n; c++) {
-                mat[r][c] ^= gf_mul(f, mat[i][c]);
-            }
-            vec[r] ^= gf_mul(f, vec[i]);
+    Matrix sub(k);
+    for (int r = 0; r < k; r++) {
+        sub[r] = (*mat)[valid[r]];
+    }
+
+    auto dm = std::make_shared<DecodeMatrix>();
+    if (!invert_matrix(sub, dm->inv)) {
+        return nullptr;
+    }
+
+    dm->identity = true;
+    for (int r = 0; r < k; r++) {
+        for (int c = 0; c < k; c++) {
+            if (dm->inv[r][c] != (r == c ? 1 : 0)) dm->identity = false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(decode_cache_mu_);
+    if (decode_cache_.emplace(key, dm).second) {
+        decode_lru_.on_insert(key, 1);
+        // 擦除模式数量通常很少；异常增长时只淘汰最久未用的模式，常用模式留在缓存中
+        std::string victim;
+        while (decode_cache_.size() > DECODE_CACHE_MAX && decode_lru_.evict(victim)) {
+            decode_cache_.erase(victim);
         }
     }
+    return dm;
+}
 
-    // 回代
-    sol.assign(n, 0);
-    for (int i = n - 1; i >= 0; i--) {
-        uint8_t acc = vec[i];
-        for (int j = i + 1; j < n; j++) {
-            acc ^= gf_mul(mat[i][j], sol[j]);
+// Gauss-Jordan 求逆（GF(256)，带行交换）
+bool RSCoder::invert_matrix(std::vector<std::vector<uint8_t>> &mat,
+                            std::vector<std::vector<uint8_t>> &inv)
+{
+    int n = (int)mat.size();
+
+    inv.assign(n, std::vector<uint8_t>(n, 0));
+    for (int i = 0; i < n; i++) inv[i][i] = 1;
+
+    for (int i = 0; i < n; i++) {
+        // 找主元
+        int pivot = -1;
+        for (int r = i; r < n; r++) {
+            if (mat[r][i] != 0) { pivot = r; break; }
+        }
+        if (pivot < 0) return false;
+        if (pivot != i) {
+            std::swap(mat[pivot], mat[i]);
+            std::swap(inv[pivot], inv[i]);
+        }
+
+        // 归一化
+        uint8_t f = gf_inv(mat[i][i]);
+        for (int c = 0; c < n; c++) {
+            mat[i][c] = gf_mul(mat[i][c], f);
+            inv[i][c] = gf_mul(inv[i][c], f);
+        }
+
+        // 消去其它行的第 i 列
+        for (int r = 0; r < n; r++) {
+            if (r == i) continue;
+            uint8_t g = mat[r][i];
+            if (g == 0) continue;
+            for (int c = 0; c < n; c++) {
+                mat[r][c] ^= gf_mul(g, mat[i][c]);
+                inv[r][c] ^= gf_mul(g, inv[i][c]);
+            }
         }
-        sol[i] = acc;
     }
 
     return true;
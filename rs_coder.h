@@ -5,14 +5,30 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "cache_policy.h"
 
 // Reed-Solomon (k+m) 纠删码实现
 // 支持 m = 1, 2, 3（甚至更多）
-// 基于 GF(256) 的 Vandermonde 矩阵
+// 区域乘加使用 gf256 中的 SIMD 内核（SSSE3/AVX2/AVX-512/NEON）
+//
+// 两种条带布局：
+//   SYSTEMATIC ：chunk 0..k-1 即原始数据切片，只计算 m 个 Cauchy 校验块；
+//                每个 chunk 带版本头（含写入代号），健康读只需拼接
+//   VANDERMONDE：旧格式，所有 chunk 都是线性组合，无 chunk 头
+// 解码按 chunk 头自动识别布局，旧条带始终可读
 
 class RSCoder : public ErasureCoder {
 public:
-    RSCoder();
+    enum class Layout : uint8_t {
+        VANDERMONDE = 0,
+        SYSTEMATIC  = 1,
+    };
+
+    // layout: 新写入条带使用的布局
+    explicit RSCoder(Layout layout = Layout::SYSTEMATIC);
 
     bool encode(const std::string &data,
                 int k, int m,
@@ -22,18 +38,78 @@ public:
                 int k, int m,
                 std::string &out_data) override;
 
+    bool reconstruct(const std::vector<std::string> &chunks,
+                     int k, int m,
+                     const std::vector<int> &wanted,
+                     std::vector<std::string> &out_chunks) override;
+
+    bool is_systematic() const override { return layout_ == Layout::SYSTEMATIC; }
+
+    // 写入代号只支持当前版本的系统码 chunk
+    bool set_generation(std::vector<std::string> &chunks, uint64_t gen) override;
+    uint64_t generation(const std::string &chunk) const override;
+
+    // 增量更新只支持系统码条带（按 chunk 头识别，与新条带的布局设置无关）
+    size_t chunk_header_size() const override;
+
+    bool check_update_header(const std::string &header,
+                             int k, int m, uint64_t stripe_size) const override;
+
+    bool locate_range(uint64_t stripe_size, int k, uint64_t offset, size_t len,
+                      int &data_index, uint64_t &chunk_offset) const override;
+
+    // parity[i] += C[i][data_index] * (old_data ^ new_data)
+    bool update_parity(int k, int m, int data_index,
+                       const std::string &old_data,
+                       const std::string &new_data,
+                       std::vector<std::string> &parity) override;
+
 private:
+    Layout layout_;
+
     uint8_t gf_mul(uint8_t a, uint8_t b) const;
     uint8_t gf_inv(uint8_t a) const;
 
-    // 生成 Vandermonde 编码矩阵
-    void build_matrix(int k, int m,
-                      std::vector<std::vector<uint8_t>> &matrix);
+    using Matrix = std::vector<std::vector<uint8_t>>;
+
+    // 生成编码矩阵（k+m 行，k 列）
+    void build_matrix(int k, int m, Layout layout, Matrix &matrix);
+
+    // 编码矩阵只取决于 (布局, k, m)，生成一次后缓存
+    std::unordered_map<uint32_t, std::shared_ptr<const Matrix>> matrix_cache_;
+    std::mutex matrix_cache_mu_;
+
+    std::shared_ptr<const Matrix> get_matrix(int k, int m, Layout layout);
+
+    // dst[r] = sum(coef[r][c] * src[c])，每个区域长 len 字节
+    void apply_matrix(const std::vector<std::vector<uint8_t>> &coef,
+                      const std::vector<const uint8_t *> &src,
+                      const std::vector<uint8_t *> &dst,
+                      size_t len);
+
+    bool encode_layout(const std::string &data,
+                       int k, int m, Layout layout,
+                       std::vector<std::string> &out_chunks);
+
+    // 解码矩阵：valid 行子矩阵的逆（k×k）
+    struct DecodeMatrix {
+        std::vector<std::vector<uint8_t>> inv;
+        bool identity = false;   // 逆为单位阵时解码退化为拼接
+    };
+
+    static const size_t DECODE_CACHE_MAX = 4096;
+
+    // 擦除模式 -> 解码矩阵，超过上限时按 LRU 逐个淘汰
+    std::unordered_map<std::string, std::shared_ptr<const DecodeMatrix>> decode_cache_;
+    LRUPolicy<std::string> decode_lru_;
+    std::mutex decode_cache_mu_;
+
+    std::shared_ptr<const DecodeMatrix> get_decode_matrix(int k, int m, Layout layout,
+                                                          const std::vector<int> &valid);
 
-    // 高斯消元恢复矩阵
-    bool solve_matrix(std::vector<std::vector<uint8_t>> &mat,
-                      std::vector<uint8_t> &vec,
-                      std::vector<uint8_t> &solution);
+    // Gauss-Jordan 求逆（会修改 mat）
+    bool invert_matrix(std::vector<std::vector<uint8_t>> &mat,
+                       std::vector<std::vector<uint8_t>> &inv);
 };
 
 #endif // RS_CODER_H
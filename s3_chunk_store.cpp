@@ -1,7 +1,11 @@
 #include "s3_chunk_store.h"
+#include "log.h"
 
 #include <cstdio>
+#include <cstring>
+#include <cinttypes>
 #include <sstream>
+#include <algorithm>
 
 // minio-cpp headers
 #include <miniocpp/client.h>
@@ -9,38 +13,81 @@
 // 重试次数
 static const int S3_MAX_RETRIES = 3;
 
+// 包头魔数
+static const char PACK_MAGIC[4] = { 'C', 'R', 'P', 'K' };
+
+// 包对象与墓碑对象所在前缀
+static const char PACK_PREFIX[] = "packs/";
+
+// 借出一个客户端，析构时归还
+class S3ChunkStore::Lease {
+public:
+    explicit Lease(S3ChunkStore& store) : store_(store) {
+        std::unique_lock<std::mutex> lock(store_.pool_mu_);
+        store_.pool_cv_.wait(lock, [this] { return !store_.idle_clients_.empty(); });
+        index_ = store_.idle_clients_.back();
+        store_.idle_clients_.pop_back();
+    }
+
+    ~Lease() {
+        {
+            std::lock_guard<std::mutex> lock(store_.pool_mu_);
+            store_.idle_clients_.push_back(index_);
+        }
+        store_.pool_cv_.notify_one();
+    }
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    minio::s3::Client* operator->() const { return store_.clients_[index_].get(); }
+
+private:
+    S3ChunkStore& store_;
+    size_t index_ = 0;
+};
+
 // 构造函数
 S3ChunkStore::S3ChunkStore(const std::string& endpoint,
                            const std::string& access_key,
                            const std::string& secret_key,
                            const std::string& bucket,
                            bool use_ssl,
-                           const std::string& region)
+                           const std::string& region,
+                           size_t connections,
+                           bool pack)
     : endpoint_(endpoint),
       access_key_(access_key),
       secret_key_(secret_key),
       bucket_(bucket),
       region_(region.empty() ? "us-east-1" : region),
-      use_ssl_(use_ssl)
+      use_ssl_(use_ssl),
+      pack_(pack)
 {
     // 构建 endpoint URL
     std::string full_endpoint = endpoint_;
     if (full_endpoint.find("://") == std::string::npos) {
         full_endpoint = (use_ssl_ ? "https://" : "http://") + full_endpoint;
     }
-    
+
     // 创建 minio-cpp 客户端
     minio::s3::BaseUrl base_url(full_endpoint);
     base_url.https = use_ssl_;
-    
+
     // 创建凭证提供者（保存为成员变量，确保生命周期）
     creds_provider_ = std::make_unique<minio::creds::StaticProvider>(access_key_, secret_key_);
-    
-    // 创建客户端（使用成员变量的指针）
-    client_ = std::make_unique<minio::s3::Client>(base_url, creds_provider_.get());
-    
-    std::fprintf(stderr, "S3ChunkStore: initialized with endpoint=%s, bucket=%s, ssl=%s\n",
-                 endpoint_.c_str(), bucket_.c_str(), use_ssl_ ? "true" : "false");
+
+    // 创建客户端池（各客户端共享凭证提供者）
+    if (connections == 0) connections = 1;
+    for (size_t i = 0; i < connections; i++) {
+        clients_.push_back(std::make_unique<minio::s3::Client>(base_url, creds_provider_.get()));
+        idle_clients_.push_back(i);
+    }
+
+    LOG_INFO("S3ChunkStore: initialized with endpoint=%s, bucket=%s, ssl=%s, "
+             "connections=%zu, pack=%s\n",
+             endpoint_.c_str(), bucket_.c_str(), use_ssl_ ? "true" : "false",
+             connections, pack_ ? "true" : "false");
 }
 
 // 析构函数
@@ -49,45 +96,51 @@ S3ChunkStore::~S3ChunkStore() = default;
 // 确保 bucket 存在
 void S3ChunkStore::ensure_bucket()
 {
+    if (bucket_exists_checked_.load(std::memory_order_acquire)) {
+        return;
+    }
+
     std::lock_guard<std::mutex> lock(bucket_mu_);
-    
-    if (bucket_exists_checked_) {
+
+    if (bucket_exists_checked_.load(std::memory_order_relaxed)) {
         return;
     }
-    
+
+    Lease client(*this);
+
     // 检查 bucket 是否存在
     minio::s3::BucketExistsArgs exists_args;
     exists_args.bucket = bucket_;
-    
-    minio::s3::BucketExistsResponse exists_resp = client_->BucketExists(exists_args);
-    
+
+    minio::s3::BucketExistsResponse exists_resp = client->BucketExists(exists_args);
+
     if (exists_resp) {
         if (!exists_resp.exist) {
             // Bucket 不存在，尝试创建
-            std::fprintf(stderr, "S3ChunkStore::ensure_bucket: bucket %s does not exist, creating...\n",
-                         bucket_.c_str());
-            
+            LOG_INFO("S3ChunkStore::ensure_bucket: bucket %s does not exist, creating...\n",
+                     bucket_.c_str());
+
             minio::s3::MakeBucketArgs make_args;
             make_args.bucket = bucket_;
             if (!region_.empty() && region_ != "us-east-1") {
                 make_args.region = region_;
             }
-            
-            minio::s3::MakeBucketResponse make_resp = client_->MakeBucket(make_args);
+
+            minio::s3::MakeBucketResponse make_resp = client->MakeBucket(make_args);
             if (!make_resp) {
-                std::fprintf(stderr, "S3ChunkStore::ensure_bucket: CreateBucket failed: %s\n",
-                             make_resp.Error().String().c_str());
+                LOG_ERROR("S3ChunkStore::ensure_bucket: CreateBucket failed: %s\n",
+                          make_resp.Error().String().c_str());
             } else {
-                std::fprintf(stderr, "S3ChunkStore::ensure_bucket: created bucket %s\n",
-                             bucket_.c_str());
+                LOG_INFO("S3ChunkStore::ensure_bucket: created bucket %s\n",
+                         bucket_.c_str());
             }
         }
     } else {
-        std::fprintf(stderr, "S3ChunkStore::ensure_bucket: BucketExists check failed: %s\n",
-                     exists_resp.Error().String().c_str());
+        LOG_ERROR("S3ChunkStore::ensure_bucket: BucketExists check failed: %s\n",
+                  exists_resp.Error().String().c_str());
     }
-    
-    bucket_exists_checked_ = true;
+
+    bucket_exists_checked_.store(true, std::memory_order_release);
 }
 
 // 生成对象 key
@@ -100,145 +153,579 @@ std::string S3ChunkStore::make_object_key(uint64_t stripe_id, uint32_t chunk_id)
     return std::string(buf);
 }
 
-// 读取 chunk
-bool S3ChunkStore::read_chunk(uint64_t stripe_id,
-                              uint32_t chunk_id,
-                              std::string& out)
+std::string S3ChunkStore::make_tombstone_key(const std::string& pack_key, uint64_t stripe_id)
+{
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), ".%08" PRIu64 ".dead", stripe_id);
+    return pack_key + buf;
+}
+
+// ------------------------------------------------------------
+// 对象操作
+// ------------------------------------------------------------
+
+// 对象不存在是正常情况（首次启动、条带尚未写入），不需要重试或打印错误
+// minio-cpp 返回的错误信息可能包含 "404"、"NoSuchKey"、"ResourceNotFound" 等
+static bool is_not_found(const minio::s3::Response& resp)
 {
-    ensure_bucket();
-    
-    std::string object_key = make_object_key(stripe_id, chunk_id);
-    
-    out.clear();
-    
-    minio::s3::GetObjectArgs args;
-    args.bucket = bucket_;
-    args.object = object_key;
-    
-    // 使用回调函数收集数据
-    std::ostringstream data_stream;
-    args.datafunc = [&data_stream](minio::http::DataFunctionArgs args) -> bool {
-        data_stream.write(args.datachunk.data(), args.datachunk.size());
-        return true;
-    };
-    
-    std::lock_guard<std::mutex> lock(client_mu_);
-    minio::s3::GetObjectResponse resp = client_->GetObject(args);
-    
-    if (resp) {
-        out = data_stream.str();
-        return true;
-    }
-    
-    // 检查是否是 404 Not Found（对象不存在是正常情况，不需要重试或打印错误）
-    // minio-cpp 返回的错误信息可能包含 "404"、"NoSuchKey"、"ResourceNotFound" 等
     std::string error_code = resp.code;
     std::string error_msg = resp.Error().String();
-    if (error_code == "NoSuchKey" || error_code == "ResourceNotFound" ||
-        error_msg.find("404") != std::string::npos ||
-        error_msg.find("NoSuchKey") != std::string::npos ||
-        error_msg.find("Not Found") != std::string::npos) {
-        // 对象不存在，静默返回 false（首次启动时这是正常情况）
-        out.clear();
-        return false;
-    }
-    
-    // 其他错误才需要重试
-    for (int attempt = 1; attempt < S3_MAX_RETRIES; ++attempt) {
-        std::fprintf(stderr, "S3ChunkStore::read_chunk: %s attempt %d failed: %s\n",
-                     object_key.c_str(), attempt, error_msg.c_str());
-        
+    return error_code == "NoSuchKey" || error_code == "ResourceNotFound" ||
+           error_msg.find("404") != std::string::npos ||
+           error_msg.find("NoSuchKey") != std::string::npos ||
+           error_msg.find("Not Found") != std::string::npos;
+}
+
+bool S3ChunkStore::get_object(const std::string& key, size_t offset, size_t length,
+                              std::string& out, bool& not_found)
+{
+    not_found = false;
+
+    std::string error_msg;
+    for (int attempt = 0; attempt < S3_MAX_RETRIES; ++attempt) {
         out.clear();
-        data_stream.str("");
-        data_stream.clear();
-        
-        minio::s3::GetObjectResponse retry_resp = client_->GetObject(args);
-        
-        if (retry_resp) {
-            out = data_stream.str();
+
+        minio::s3::GetObjectArgs args;
+        args.bucket = bucket_;
+        args.object = key;
+
+        // 范围读取
+        size_t range_offset = offset;
+        size_t range_length = length;
+        if (length > 0) {
+            args.offset = &range_offset;
+            args.length = &range_length;
+            out.reserve(length);
+        }
+
+        // 使用回调函数收集数据
+        args.datafunc = [&out](minio::http::DataFunctionArgs args) -> bool {
+            out.append(args.datachunk.data(), args.datachunk.size());
             return true;
+        };
+
+        minio::s3::GetObjectResponse resp;
+        {
+            Lease client(*this);
+            resp = client->GetObject(args);
         }
-        
-        error_code = retry_resp.code;
-        error_msg = retry_resp.Error().String();
-        if (error_code == "NoSuchKey" || error_code == "ResourceNotFound" ||
-            error_msg.find("404") != std::string::npos ||
-            error_msg.find("NoSuchKey") != std::string::npos ||
-            error_msg.find("Not Found") != std::string::npos) {
+
+        if (resp) {
+            return true;
+        }
+
+        if (is_not_found(resp)) {
             out.clear();
+            not_found = true;
             return false;
         }
+
+        error_msg = resp.Error().String();
+        LOG_WARN("S3ChunkStore::get_object: %s attempt %d failed: %s\n",
+                 key.c_str(), attempt + 1, error_msg.c_str());
     }
-    
-    std::fprintf(stderr, "S3ChunkStore::read_chunk: %s failed after %d retries: %s\n",
-                 object_key.c_str(), S3_MAX_RETRIES, error_msg.c_str());
+
+    out.clear();
+    LOG_ERROR("S3ChunkStore::get_object: %s failed after %d retries: %s\n",
+              key.c_str(), S3_MAX_RETRIES, error_msg.c_str());
     return false;
 }
 
-// 写入 chunk
-bool S3ChunkStore::write_chunk(uint64_t stripe_id,
-                               uint32_t chunk_id,
-                               const std::string& data)
+bool S3ChunkStore::put_object(const std::string& key, const std::string& data)
 {
-    ensure_bucket();
-    
-    std::string object_key = make_object_key(stripe_id, chunk_id);
-    
     for (int attempt = 0; attempt < S3_MAX_RETRIES; ++attempt) {
         // 创建输入流
         std::istringstream data_stream(data);
-        
+
+        // part_size 为 0 时由 SDK 选择分段大小，超过单段的对象自动分段上传
         minio::s3::PutObjectArgs args(data_stream, static_cast<long>(data.size()), 0);
         args.bucket = bucket_;
-        args.object = object_key;
+        args.object = key;
         args.content_type = "application/octet-stream";
-        
-        std::lock_guard<std::mutex> lock(client_mu_);
-        minio::s3::PutObjectResponse resp = client_->PutObject(args);
-        
+
+        minio::s3::PutObjectResponse resp;
+        {
+            Lease client(*this);
+            resp = client->PutObject(args);
+        }
+
         if (resp) {
             return true;
         }
-        
-        std::fprintf(stderr, "S3ChunkStore::write_chunk: %s attempt %d failed: %s\n",
-                     object_key.c_str(), attempt + 1, resp.Error().String().c_str());
+
+        LOG_WARN("S3ChunkStore::put_object: %s attempt %d failed: %s\n",
+                 key.c_str(), attempt + 1, resp.Error().String().c_str());
     }
-    
-    std::fprintf(stderr, "S3ChunkStore::write_chunk: %s failed after %d retries\n",
-                 object_key.c_str(), S3_MAX_RETRIES);
+
+    LOG_ERROR("S3ChunkStore::put_object: %s failed after %d retries\n",
+              key.c_str(), S3_MAX_RETRIES);
     return false;
 }
 
-// 删除 chunk
-bool S3ChunkStore::delete_chunk(uint64_t stripe_id, uint32_t chunk_id)
+bool S3ChunkStore::remove_object(const std::string& key)
 {
-    ensure_bucket();
-    
-    std::string object_key = make_object_key(stripe_id, chunk_id);
-    
     for (int attempt = 0; attempt < S3_MAX_RETRIES; ++attempt) {
         minio::s3::RemoveObjectArgs args;
         args.bucket = bucket_;
-        args.object = object_key;
-        
-        std::lock_guard<std::mutex> lock(client_mu_);
-        minio::s3::RemoveObjectResponse resp = client_->RemoveObject(args);
-        
+        args.object = key;
+
+        minio::s3::RemoveObjectResponse resp;
+        {
+            Lease client(*this);
+            resp = client->RemoveObject(args);
+        }
+
         if (resp) {
             return true;
         }
-        
+
         // S3 删除不存在的对象通常不报错，但检查一下
         std::string error_code = resp.code;
         if (error_code == "NoSuchKey" || error_code == "ResourceNotFound") {
             return true;  // 对象本来就不存在，视为成功
         }
-        
-        std::fprintf(stderr, "S3ChunkStore::delete_chunk: %s attempt %d failed: %s\n",
-                     object_key.c_str(), attempt + 1, resp.Error().String().c_str());
+
+        LOG_WARN("S3ChunkStore::remove_object: %s attempt %d failed: %s\n",
+                 key.c_str(), attempt + 1, resp.Error().String().c_str());
     }
-    
-    std::fprintf(stderr, "S3ChunkStore::delete_chunk: %s failed after %d retries\n",
-                 object_key.c_str(), S3_MAX_RETRIES);
+
+    LOG_ERROR("S3ChunkStore::remove_object: %s failed after %d retries\n",
+              key.c_str(), S3_MAX_RETRIES);
     return false;
 }
+
+// ------------------------------------------------------------
+// 包索引
+// ------------------------------------------------------------
+
+// 列出 packs/ 下的包与墓碑，重建 stripe -> 包 的索引
+// 同一条带出现在多个有效包中时（墓碑写入前崩溃）以序号大的包为准；
+// 没有对应包的墓碑、已全部失效的包在这里清理
+bool S3ChunkStore::load_index()
+{
+    std::lock_guard<std::mutex> lock(index_mu_);
+    if (index_loaded_) return true;
+
+    std::map<std::string, std::shared_ptr<Pack>> packs;
+    std::vector<std::pair<std::string, uint64_t>> tombstones;
+    {
+        Lease client(*this);
+
+        minio::s3::ListObjectsArgs args;
+        args.bucket = bucket_;
+        args.prefix = PACK_PREFIX;
+        args.recursive = true;
+
+        minio::s3::ListObjectsResult result = client->ListObjects(args);
+        for (; result; ++result) {
+            minio::s3::Item item = *result;
+            if (!item) {
+                LOG_ERROR("S3ChunkStore::load_index: ListObjects failed: %s\n",
+                          item.Error().String().c_str());
+                return false;
+            }
+
+            const std::string& name = item.name;
+            size_t pos = name.find(".pack");
+            size_t slash = name.rfind('/', pos);
+            if (pos == std::string::npos || slash == std::string::npos) continue;
+
+            std::string pack_key = name.substr(0, pos + 5);
+            if (pack_key.size() == name.size()) {
+                auto p = std::make_shared<Pack>();
+                unsigned chunk_id = 0;
+                if (std::sscanf(name.c_str() + std::strlen(PACK_PREFIX), "%u", &chunk_id) != 1 ||
+                    std::sscanf(name.c_str() + slash + 1, "%" SCNx64 "-%" SCNu64 "-%u",
+                                &p->seq, &p->first, &p->count) != 3 ||
+                    p->count == 0 || p->count > MAX_PACK_STRIPES) {
+                    continue;
+                }
+                p->key = pack_key;
+                p->chunk_id = chunk_id;
+                p->live = p->count;
+                p->dead.assign(p->count, 0);
+                packs[pack_key] = p;
+                next_seq_ = std::max(next_seq_, p->seq + 1);
+            } else {
+                uint64_t stripe_id = 0;
+                if (std::sscanf(name.c_str() + pos + 5, ".%" SCNu64 ".dead", &stripe_id) == 1) {
+                    tombstones.emplace_back(pack_key, stripe_id);
+                }
+            }
+        }
+    }
+
+    std::vector<std::string> garbage;
+    for (const auto& t : tombstones) {
+        auto it = packs.find(t.first);
+        if (it == packs.end()) {
+            garbage.push_back(make_tombstone_key(t.first, t.second));
+            continue;
+        }
+        Pack& p = *it->second;
+        if (t.second < p.first || t.second >= p.first + p.count) continue;
+        if (!p.dead[t.second - p.first]) {
+            p.dead[t.second - p.first] = 1;
+            p.live--;
+        }
+    }
+
+    // 按序号从小到大登记，序号大的包覆盖先前的登记
+    std::vector<std::shared_ptr<Pack>> ordered;
+    for (const auto& kv : packs) ordered.push_back(kv.second);
+    std::sort(ordered.begin(), ordered.end(),
+              [](const std::shared_ptr<Pack>& a, const std::shared_ptr<Pack>& b) {
+                  return a->seq < b->seq;
+              });
+
+    for (const auto& p : ordered) {
+        auto& index = packed_[p->chunk_id];
+        for (uint32_t i = 0; i < p->count; i++) {
+            if (p->dead[i]) continue;
+            auto& slot = index[p->first + i];
+            if (slot) {
+                Pack& old = *slot;
+                old.dead[p->first + i - old.first] = 1;
+                old.live--;
+            }
+            slot = p;
+        }
+    }
+
+    size_t live_packs = 0;
+    for (const auto& p : ordered) {
+        if (p->live > 0) {
+            live_packs++;
+            continue;
+        }
+        // 已全部失效（删除包之前中断）：先删包再删墓碑
+        garbage.insert(garbage.begin(), p->key);
+        for (uint32_t i = 0; i < p->count; i++) {
+            garbage.push_back(make_tombstone_key(p->key, p->first + i));
+        }
+    }
+
+    for (const auto& key : garbage) {
+        remove_object(key);
+    }
+
+    LOG_INFO("S3ChunkStore::load_index: %zu packs, %zu tombstones, %zu removed\n",
+             live_packs, tombstones.size(), garbage.size());
+    index_loaded_ = true;
+    return true;
+}
+
+std::shared_ptr<S3ChunkStore::Pack> S3ChunkStore::find_pack(uint64_t stripe_id, uint32_t chunk_id)
+{
+    std::lock_guard<std::mutex> lock(index_mu_);
+    auto cit = packed_.find(chunk_id);
+    if (cit == packed_.end()) return nullptr;
+    auto it = cit->second.find(stripe_id);
+    return it == cit->second.end() ? nullptr : it->second;
+}
+
+bool S3ChunkStore::bury(const std::shared_ptr<Pack>& pack, uint64_t stripe_id)
+{
+    // 调用前新数据已经写好（或条带已删除），墓碑写入后才移出索引
+    if (!put_object(make_tombstone_key(pack->key, stripe_id), std::string())) {
+        return false;
+    }
+
+    bool reclaim = false;
+    {
+        std::lock_guard<std::mutex> lock(index_mu_);
+        uint64_t i = stripe_id - pack->first;
+        if (!pack->dead[i]) {
+            pack->dead[i] = 1;
+            pack->live--;
+        }
+        auto& index = packed_[pack->chunk_id];
+        auto it = index.find(stripe_id);
+        if (it != index.end() && it->second == pack) {
+            index.erase(it);
+        }
+        if (pack->live == 0 && !pack->deleting) {
+            pack->deleting = true;
+            reclaim = true;
+        }
+    }
+
+    // 包内条带全部失效：先删包，再删其墓碑（中断留下的墓碑在下次启动时清理）
+    if (reclaim && remove_object(pack->key)) {
+        for (uint32_t i = 0; i < pack->count; i++) {
+            remove_object(make_tombstone_key(pack->key, pack->first + i));
+        }
+    }
+    return true;
+}
+
+bool S3ChunkStore::load_offsets(const std::shared_ptr<Pack>& pack)
+{
+    {
+        std::lock_guard<std::mutex> lock(index_mu_);
+        if (!pack->offsets.empty()) return true;
+    }
+
+    size_t header_size = 8 + 8 * ((size_t)pack->count + 1);
+    std::string header;
+    bool not_found = false;
+    if (!get_object(pack->key, 0, header_size, header, not_found)) {
+        return false;
+    }
+
+    uint32_t count = 0;
+    if (header.size() < header_size) return false;
+    std::memcpy(&count, header.data() + 4, 4);
+    if (std::memcmp(header.data(), PACK_MAGIC, 4) != 0 || count != pack->count) {
+        LOG_ERROR("S3ChunkStore::load_offsets: %s 包头损坏\n", pack->key.c_str());
+        return false;
+    }
+
+    std::vector<uint64_t> offsets(count + 1);
+    std::memcpy(offsets.data(), header.data() + 8, 8 * offsets.size());
+
+    std::lock_guard<std::mutex> lock(index_mu_);
+    pack->offsets = std::move(offsets);
+    return true;
+}
+
+bool S3ChunkStore::read_pack_range(const std::shared_ptr<Pack>& pack, uint32_t a, uint32_t b,
+                                   std::vector<std::string>& out, bool& not_found)
+{
+    not_found = false;
+    out.clear();
+    if (!load_offsets(pack)) return false;
+
+    std::vector<uint64_t> offsets;
+    {
+        std::lock_guard<std::mutex> lock(index_mu_);
+        offsets.assign(pack->offsets.begin() + a, pack->offsets.begin() + b + 1);
+    }
+
+    uint64_t begin = offsets.front();
+    uint64_t length = offsets.back() - begin;
+    std::string data;
+    if (length > 0 && !get_object(pack->key, (size_t)begin, (size_t)length, data, not_found)) {
+        return false;
+    }
+    if (data.size() != length) return false;
+
+    for (uint32_t i = 0; i + 1 < offsets.size(); i++) {
+        out.emplace_back(data, (size_t)(offsets[i] - begin), (size_t)(offsets[i + 1] - offsets[i]));
+    }
+    return true;
+}
+
+bool S3ChunkStore::write_pack(const ChunkWrite* writes, size_t count)
+{
+    uint32_t chunk_id = writes[0].chunk_id;
+
+    // 包头 + 数据
+    std::vector<uint64_t> offsets(count + 1);
+    uint64_t pos = 8 + 8 * (count + 1);
+    for (size_t i = 0; i < count; i++) {
+        offsets[i] = pos;
+        pos += writes[i].data->size();
+    }
+    offsets[count] = pos;
+
+    std::string body;
+    body.reserve((size_t)pos);
+    uint32_t n = (uint32_t)count;
+    body.append(PACK_MAGIC, 4);
+    body.append(reinterpret_cast<const char*>(&n), 4);
+    body.append(reinterpret_cast<const char*>(offsets.data()), 8 * offsets.size());
+    for (size_t i = 0; i < count; i++) {
+        body.append(*writes[i].data);
+    }
+
+    auto pack = std::make_shared<Pack>();
+    pack->chunk_id = chunk_id;
+    pack->first = writes[0].stripe_id;
+    pack->count = n;
+    pack->live = n;
+    pack->dead.assign(count, 0);
+    pack->offsets = std::move(offsets);
+    {
+        std::lock_guard<std::mutex> lock(index_mu_);
+        pack->seq = next_seq_++;
+    }
+
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "%s%02u/%016" PRIx64 "-%08" PRIu64 "-%u.pack",
+                  PACK_PREFIX, (unsigned int)chunk_id, pack->seq, pack->first, n);
+    pack->key = buf;
+
+    if (!put_object(pack->key, body)) {
+        return false;
+    }
+
+    // 登记新包，再让旧包中的副本失效
+    // 墓碑写入失败不影响结果：重启后同一条带以序号大的包为准
+    std::vector<std::shared_ptr<Pack>> olds(count);
+    {
+        std::lock_guard<std::mutex> lock(index_mu_);
+        auto& index = packed_[chunk_id];
+        for (size_t i = 0; i < count; i++) {
+            auto& slot = index[pack->first + i];
+            olds[i] = std::move(slot);
+            slot = pack;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (olds[i]) bury(olds[i], pack->first + i);
+    }
+    return true;
+}
+
+// ------------------------------------------------------------
+// ChunkStore 接口
+// ------------------------------------------------------------
+
+bool S3ChunkStore::read_chunk(uint64_t stripe_id,
+                              uint32_t chunk_id,
+                              std::string& out)
+{
+    return read_chunk_status(stripe_id, chunk_id, out) == ChunkStatus::OK;
+}
+
+// 读取 chunk
+ChunkStatus S3ChunkStore::read_chunk_status(uint64_t stripe_id,
+                                            uint32_t chunk_id,
+                                            std::string& out)
+{
+    ensure_bucket();
+    out.clear();
+    if (!load_index()) return ChunkStatus::ERROR;
+
+    // 在包中：范围读取；包刚被回收时重新查找一次
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        auto pack = find_pack(stripe_id, chunk_id);
+        if (!pack) break;
+
+        uint32_t i = (uint32_t)(stripe_id - pack->first);
+        std::vector<std::string> parts;
+        bool not_found = false;
+        if (read_pack_range(pack, i, i + 1, parts, not_found)) {
+            out = std::move(parts[0]);
+            return ChunkStatus::OK;
+        }
+        if (!not_found) return ChunkStatus::ERROR;
+    }
+
+    bool not_found = false;
+    if (get_object(make_object_key(stripe_id, chunk_id), 0, 0, out, not_found)) {
+        return ChunkStatus::OK;
+    }
+    return not_found ? ChunkStatus::NOT_FOUND : ChunkStatus::ERROR;
+}
+
+// 写入 chunk
+bool S3ChunkStore::write_chunk(uint64_t stripe_id,
+                               uint32_t chunk_id,
+                               const std::string& data)
+{
+    ensure_bucket();
+    if (!load_index()) return false;
+
+    // 先写单独对象，再让包中的旧副本失效：中途失败时读到的仍是完整的旧数据
+    auto pack = find_pack(stripe_id, chunk_id);
+    if (!put_object(make_object_key(stripe_id, chunk_id), data)) return false;
+
+    return !pack || bury(pack, stripe_id);
+}
+
+// 删除 chunk
+bool S3ChunkStore::delete_chunk(uint64_t stripe_id, uint32_t chunk_id)
+{
+    ensure_bucket();
+    if (!load_index()) return false;
+
+    auto pack = find_pack(stripe_id, chunk_id);
+    if (pack && !bury(pack, stripe_id)) return false;
+
+    // 单独对象可能存在（打包之前写入、或包内条带被覆盖后写入）
+    return remove_object(make_object_key(stripe_id, chunk_id));
+}
+
+// 批量写入：按 (chunk_id, stripe_id) 排序后，每段连续条带写成一个包
+bool S3ChunkStore::write_chunks(const std::vector<ChunkWrite>& writes)
+{
+    if (!pack_) return ChunkStore::write_chunks(writes);
+
+    ensure_bucket();
+    if (!load_index()) return false;
+
+    std::vector<ChunkWrite> sorted = writes;
+    std::sort(sorted.begin(), sorted.end(), [](const ChunkWrite& a, const ChunkWrite& b) {
+        return a.chunk_id != b.chunk_id ? a.chunk_id < b.chunk_id : a.stripe_id < b.stripe_id;
+    });
+
+    bool ok = true;
+    size_t i = 0;
+    while (i < sorted.size()) {
+        size_t j = i + 1;
+        while (j < sorted.size() && j - i < MAX_PACK_STRIPES &&
+               sorted[j].chunk_id == sorted[i].chunk_id &&
+               sorted[j].stripe_id == sorted[j - 1].stripe_id + 1) {
+            j++;
+        }
+
+        bool written = j - i == 1
+            ? write_chunk(sorted[i].stripe_id, sorted[i].chunk_id, *sorted[i].data)
+            : write_pack(&sorted[i], j - i);
+        if (!written) ok = false;
+        i = j;
+    }
+    return ok;
+}
+
+// 批量读取：同一包中相邻的条带合并为一次范围读取，其余逐个读取
+bool S3ChunkStore::read_chunks(const std::vector<ChunkRef>& refs,
+                               std::vector<std::string>& out,
+                               std::vector<ChunkStatus>* status)
+{
+    out.assign(refs.size(), std::string());
+    if (status) status->assign(refs.size(), ChunkStatus::ERROR);
+
+    ensure_bucket();
+    if (!load_index()) return false;
+
+    std::vector<std::shared_ptr<Pack>> packs(refs.size());
+    for (size_t i = 0; i < refs.size(); i++) {
+        packs[i] = find_pack(refs[i].stripe_id, refs[i].chunk_id);
+    }
+
+    bool ok = true;
+    size_t i = 0;
+    while (i < refs.size()) {
+        size_t j = i + 1;
+        if (packs[i]) {
+            while (j < refs.size() && packs[j] == packs[i] &&
+                   refs[j].stripe_id == refs[j - 1].stripe_id + 1) {
+                j++;
+            }
+
+            uint32_t a = (uint32_t)(refs[i].stripe_id - packs[i]->first);
+            std::vector<std::string> parts;
+            bool not_found = false;
+            if (read_pack_range(packs[i], a, a + (uint32_t)(j - i), parts, not_found)) {
+                for (size_t t = i; t < j; t++) {
+                    out[t] = std::move(parts[t - i]);
+                    if (status) (*status)[t] = ChunkStatus::OK;
+                }
+                i = j;
+                continue;
+            }
+        }
+
+        // 不在包中或范围读取失败：逐个读取
+        for (size_t t = i; t < j; t++) {
+            ChunkStatus st = read_chunk_status(refs[t].stripe_id, refs[t].chunk_id, out[t]);
+            if (st != ChunkStatus::OK) ok = false;
+            if (status) (*status)[t] = st;
+        }
+        i = j;
+    }
+    return ok;
+}
@@ -4,7 +4,12 @@
 #include "chunk_store.h"
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <vector>
+#include <map>
+#include <unordered_map>
 
 // 前向声明 minio-cpp 类型
 namespace minio {
@@ -18,17 +23,26 @@ namespace creds {
 }
 
 // S3 实现的 ChunkStore（使用 minio-cpp SDK）
-// 每个 chunk 对应一个对象：
+// 单独写入的 chunk 对应一个对象：
 //   <bucket>/stripes/<stripe_id>/<chunk_id>.chunk
+// 批量写入的连续条带打包为一个对象（大包由 SDK 自动分段上传），按范围读取：
+//   <bucket>/packs/<chunk_id>/<seq>-<first>-<count>.pack
+//   包头："CRPK" + u32 条带数 + (条带数 + 1) 个 u64 偏移，其后为各 chunk 数据
+// 包不可修改：包内条带被覆盖或删除时写入墓碑对象 <包 key>.<stripe_id>.dead，
+// 此后该条带以单独对象为准；包内条带全部失效后删除包及其墓碑
 
 class S3ChunkStore : public ChunkStore {
 public:
+    // connections: 并发连接（客户端）数
+    // pack: 批量写入时把连续条带打包为一个对象
     S3ChunkStore(const std::string& endpoint,
                  const std::string& access_key,
                  const std::string& secret_key,
                  const std::string& bucket,
                  bool use_ssl = true,
-                 const std::string& region = "");
+                 const std::string& region = "",
+                 size_t connections = 4,
+                 bool pack = true);
 
     ~S3ChunkStore();
 
@@ -36,6 +50,11 @@ public:
                     uint32_t chunk_id,
                     std::string& out) override;
 
+    // 对象不存在（NoSuchKey / 404）时返回 NOT_FOUND
+    ChunkStatus read_chunk_status(uint64_t stripe_id,
+                                  uint32_t chunk_id,
+                                  std::string& out) override;
+
     bool write_chunk(uint64_t stripe_id,
                      uint32_t chunk_id,
                      const std::string& data) override;
@@ -43,6 +62,14 @@ public:
     bool delete_chunk(uint64_t stripe_id,
                       uint32_t chunk_id) override;
 
+    bool supports_batch() const override { return pack_; }
+
+    bool write_chunks(const std::vector<ChunkWrite>& writes) override;
+
+    bool read_chunks(const std::vector<ChunkRef>& refs,
+                     std::vector<std::string>& out,
+                     std::vector<ChunkStatus>* status = nullptr) override;
+
 private:
     std::string endpoint_;
     std::string access_key_;
@@ -50,21 +77,74 @@ private:
     std::string bucket_;
     std::string region_;
     bool use_ssl_;
+    bool pack_;
 
-    // minio-cpp 凭证提供者（必须在 client_ 之前声明，确保生命周期）
+    // minio-cpp 凭证提供者（必须在客户端之前声明，确保生命周期）
     std::unique_ptr<minio::creds::StaticProvider> creds_provider_;
 
-    // minio-cpp 客户端
-    std::unique_ptr<minio::s3::Client> client_;
-    std::mutex client_mu_;
+    // 客户端池：每个请求借出一个客户端，不同请求互不等待
+    std::vector<std::unique_ptr<minio::s3::Client>> clients_;
+    std::vector<size_t> idle_clients_;
+    std::mutex pool_mu_;
+    std::condition_variable pool_cv_;
 
-    // 确保 bucket 存在
-    bool bucket_exists_checked_ = false;
+    class Lease;
+
+    // 确保 bucket 存在（检查过之后不再加锁）
+    std::atomic<bool> bucket_exists_checked_{false};
     std::mutex bucket_mu_;
     void ensure_bucket();
 
     // 生成对象 key
     std::string make_object_key(uint64_t stripe_id, uint32_t chunk_id) const;
+    static std::string make_tombstone_key(const std::string& pack_key, uint64_t stripe_id);
+
+    // ---------------- 包对象 ----------------
+    struct Pack {
+        std::string key;
+        uint32_t chunk_id = 0;
+        uint64_t seq = 0;
+        uint64_t first = 0;
+        uint32_t count = 0;
+        uint32_t live = 0;                 // 未被墓碑遮盖的条带数
+        std::vector<char> dead;            // 每个条带是否已有墓碑
+        std::vector<uint64_t> offsets;     // 包内偏移（count + 1 项），为空时需读取包头
+        bool deleting = false;
+    };
+
+    static const uint32_t MAX_PACK_STRIPES = 64;
+
+    // 每个 chunk_id：stripe_id -> 当前有效的包
+    std::map<uint32_t, std::unordered_map<uint64_t, std::shared_ptr<Pack>>> packed_;
+    uint64_t next_seq_ = 1;
+    bool index_loaded_ = false;
+    std::mutex index_mu_;
+
+    // 列出 packs/ 建立索引（首次使用时调用，失败则下次重试）
+    bool load_index();
+
+    // 查找条带所在的有效包，不在包中返回 nullptr
+    std::shared_ptr<Pack> find_pack(uint64_t stripe_id, uint32_t chunk_id);
+
+    // 为包内条带写入墓碑并移出索引；包内条带全部失效时删除包
+    bool bury(const std::shared_ptr<Pack>& pack, uint64_t stripe_id);
+
+    // 把连续条带写成一个包（调用前 writes 已按 stripe_id 排序且连续）
+    bool write_pack(const ChunkWrite* writes, size_t count);
+
+    // 读取包内第 [a, b) 个条带的 chunk（一次范围读取）
+    // 包对象不存在（刚被回收）时 not_found 为 true
+    bool read_pack_range(const std::shared_ptr<Pack>& pack, uint32_t a, uint32_t b,
+                         std::vector<std::string>& out, bool& not_found);
+    bool load_offsets(const std::shared_ptr<Pack>& pack);
+
+    // ---------------- 对象操作（含重试） ----------------
+    // 读取对象的 [offset, offset+length)，length 为 0 表示读到末尾
+    // 对象不存在时返回 false 且 not_found 为 true
+    bool get_object(const std::string& key, size_t offset, size_t length,
+                    std::string& out, bool& not_found);
+    bool put_object(const std::string& key, const std::string& data);
+    bool remove_object(const std::string& key);
 };
 
 #endif // S3_CHUNK_STORE_H
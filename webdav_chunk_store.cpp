@@ -1,12 +1,18 @@
 #include "webdav_chunk_store.h"
+#include "log.h"
 
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <algorithm>
+#include <vector>
 
 // 重试次数
 static const int WEBDAV_MAX_RETRIES = 3;
 
+// 已知目录缓存上限（约 40MB）
+static const size_t DIR_CACHE_ENTRIES = 1 << 20;
+
 // 认证回调的用户数据结构
 struct AuthData {
     std::string username;
@@ -20,25 +26,44 @@ NeonPool::NeonPool(const std::string& scheme,
                    int port,
                    const std::string& username,
                    const std::string& password,
-                   size_t max_size)
+                   const std::string& probe_path,
+                   const WebDavConfig& config)
     : scheme_(scheme),
       host_(host),
       port_(port),
       username_(username),
       password_(password),
-      max_size_(max_size)
+      probe_path_(probe_path),
+      config_(config)
 {
     // 初始化 neon 库（只需一次，多次调用也安全）
     ne_sock_init();
+
+    if (config_.connections == 0) config_.connections = 1;
+    config_.warm_connections = std::min(config_.warm_connections, config_.connections);
+
+    // 预热与探活在后台进行，不阻塞挂载
+    if (config_.warm_connections > 0 || config_.keepalive_interval_ms > 0) {
+        keeper_ = std::thread([this]() { keeper_loop(); });
+    }
 }
 
 NeonPool::~NeonPool()
 {
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        stop_ = true;
+    }
+    stop_cv_.notify_all();
+    if (keeper_.joinable()) {
+        keeper_.join();
+    }
+
     std::lock_guard<std::mutex> lock(mu_);
-    while (!pool_.empty()) {
-        ne_session_destroy(pool_.front());
-        pool_.pop();
+    for (const Idle& s : idle_) {
+        ne_session_destroy(s.sess);
     }
+    idle_.clear();
     // 注意：ne_sock_exit() 应该在程序退出时调用一次
 }
 
@@ -71,6 +96,9 @@ ne_session* NeonPool::create_session()
     // 设置超时
     ne_set_connect_timeout(sess, 10);
     ne_set_read_timeout(sess, 30);
+
+    // 保持长连接（HTTP/1.1 keep-alive），请求之间复用 TCP / TLS 连接
+    ne_set_session_flag(sess, NE_SESSFLAG_PERSIST, 1);
     
     // 设置认证回调
     if (!username_.empty()) {
@@ -92,25 +120,106 @@ ne_session* NeonPool::create_session()
     return sess;
 }
 
+bool NeonPool::probe(ne_session* sess)
+{
+    unsigned int caps = 0;
+    return ne_options2(sess, probe_path_.c_str(), &caps) == NE_OK;
+}
+
 ne_session* NeonPool::acquire()
 {
-    std::lock_guard<std::mutex> lock(mu_);
-    if (!pool_.empty()) {
-        ne_session* sess = pool_.front();
-        pool_.pop();
-        return sess;
+    {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [this] { return !idle_.empty() || in_use_ < config_.connections; });
+        in_use_++;
+        if (!idle_.empty()) {
+            ne_session* sess = idle_.back().sess;
+            idle_.pop_back();
+            return sess;
+        }
+    }
+
+    ne_session* sess = create_session();
+    if (!sess) {
+        std::lock_guard<std::mutex> lock(mu_);
+        in_use_--;
+        cv_.notify_one();
     }
-    return create_session();
+    return sess;
 }
 
 void NeonPool::release(ne_session* sess)
 {
     if (!sess) return;
-    std::lock_guard<std::mutex> lock(mu_);
-    if (pool_.size() < max_size_) {
-        pool_.push(sess);
-    } else {
-        ne_session_destroy(sess);
+    {
+        std::lock_guard<std::mutex> lock(mu_);
+        in_use_--;
+        idle_.push_back(Idle{sess, std::chrono::steady_clock::now()});
+    }
+    cv_.notify_one();
+}
+
+// 后台维护：补足预热连接，对空闲超过探活间隔的连接发送 OPTIONS
+void NeonPool::keeper_loop()
+{
+    auto interval = std::chrono::milliseconds(config_.keepalive_interval_ms);
+    bool warned = false;
+
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!stop_) {
+        // 1. 取出空闲过久的连接（从最旧的开始）
+        std::vector<ne_session*> stale;
+        if (config_.keepalive_interval_ms > 0) {
+            auto now = std::chrono::steady_clock::now();
+            while (!idle_.empty() && now - idle_.front().since >= interval) {
+                stale.push_back(idle_.front().sess);
+                idle_.pop_front();
+                in_use_++;
+            }
+        }
+
+        // 2. 预热连接不足时补足
+        size_t total = idle_.size() + in_use_;
+        size_t create = total < config_.warm_connections ? config_.warm_connections - total : 0;
+        in_use_ += create;
+        lock.unlock();
+
+        std::vector<ne_session*> healthy;
+        for (ne_session* sess : stale) {
+            if (probe(sess)) {
+                healthy.push_back(sess);
+            } else {
+                ne_session_destroy(sess);
+            }
+        }
+        size_t failed = 0;
+        for (size_t i = 0; i < create; i++) {
+            ne_session* sess = create_session();
+            if (sess && probe(sess)) {
+                healthy.push_back(sess);
+            } else {
+                if (sess) ne_session_destroy(sess);
+                failed++;
+            }
+        }
+
+        // 服务器不可达时只在状态变化时打印
+        if (failed > 0 && !warned) {
+            LOG_WARN("NeonPool: %s://%s:%d 预热连接失败\n",
+                     scheme_.c_str(), host_.c_str(), port_);
+        }
+        warned = failed > 0;
+
+        lock.lock();
+        in_use_ -= stale.size() + create;
+        for (ne_session* sess : healthy) {
+            idle_.push_back(Idle{sess, std::chrono::steady_clock::now()});
+        }
+        cv_.notify_all();
+
+        auto wait = config_.keepalive_interval_ms > 0
+                    ? interval / 2 : std::chrono::milliseconds(60000);
+        stop_cv_.wait_for(lock, wait, [this] { return stop_; });
     }
 }
 
@@ -119,15 +228,17 @@ void NeonPool::release(ne_session* sess)
 // 构造函数
 WebDavChunkStore::WebDavChunkStore(const std::string& base_url,
                                    const std::string& user,
-                                   const std::string& pass)
+                                   const std::string& pass,
+                                   const WebDavConfig& config)
     : base_url_(base_url),
       username_(user),
-      password_(pass)
+      password_(pass),
+      config_(config)
 {
     // 解析 URL
     ne_uri uri;
     if (ne_uri_parse(base_url.c_str(), &uri) != 0) {
-        std::fprintf(stderr, "WebDavChunkStore: failed to parse URL: %s\n", base_url.c_str());
+        LOG_ERROR("WebDavChunkStore: failed to parse URL: %s\n", base_url.c_str());
         return;
     }
     
@@ -145,10 +256,12 @@ WebDavChunkStore::WebDavChunkStore(const std::string& base_url,
     ne_uri_free(&uri);
     
     // 创建连接池
-    neon_pool_ = std::make_unique<NeonPool>(scheme, host, port, username_, password_, 16);
+    neon_pool_ = std::make_unique<NeonPool>(scheme, host, port, username_, password_,
+                                            base_path_, config_);
     
-    std::fprintf(stderr, "WebDavChunkStore: initialized with URL=%s, user=%s\n",
-                 base_url.c_str(), username_.c_str());
+    LOG_INFO("WebDavChunkStore: initialized with URL=%s, user=%s, connections=%zu, warm=%zu\n",
+             base_url.c_str(), username_.c_str(), config_.connections,
+             config_.warm_connections);
 }
 
 // 析构函数
@@ -197,25 +310,44 @@ bool WebDavChunkStore::mkcol(ne_session* sess, const std::string& path)
         return true;
     }
 
-    std::fprintf(stderr, "WebDavChunkStore::mkcol: %s failed, error: %s\n",
-                 path.c_str(), ne_get_error(sess));
+    LOG_WARN("WebDavChunkStore::mkcol: %s failed, error: %s\n",
+             path.c_str(), ne_get_error(sess));
     ne_request_destroy(req);
     return false;
 }
 
+bool WebDavChunkStore::dir_known(uint64_t stripe_id)
+{
+    std::lock_guard<std::mutex> lock(dir_cache_mu_);
+    return known_stripe_dirs_.count(stripe_id) > 0;
+}
+
+void WebDavChunkStore::remember_dir(uint64_t stripe_id)
+{
+    std::lock_guard<std::mutex> lock(dir_cache_mu_);
+    if (known_stripe_dirs_.size() >= DIR_CACHE_ENTRIES) {
+        known_stripe_dirs_.clear();
+    }
+    known_stripe_dirs_.insert(stripe_id);
+}
+
+void WebDavChunkStore::forget_dir(uint64_t stripe_id)
+{
+    std::lock_guard<std::mutex> lock(dir_cache_mu_);
+    known_stripe_dirs_.erase(stripe_id);
+}
+
 // 确保 stripe 目录存在（带缓存）
 void WebDavChunkStore::ensure_stripe_dir(uint64_t stripe_id)
 {
-    // 快速检查是否已创建
-    {
-        std::lock_guard<std::mutex> lock(dir_cache_mu_);
-        if (created_stripe_dirs_.count(stripe_id) > 0) {
-            return;  // 已创建，直接返回
-        }
+    // 快速检查是否已知存在
+    if (dir_known(stripe_id)) {
+        return;
     }
     
     // 需要创建目录
     NeonHandle sess(*neon_pool_);
+    if (!sess.get()) return;
     
     // 确保 stripes 根目录存在
     {
@@ -232,139 +364,155 @@ void WebDavChunkStore::ensure_stripe_dir(uint64_t stripe_id)
     std::snprintf(dirbuf, sizeof(dirbuf), "stripes/%08lu", (unsigned long)stripe_id);
     std::string stripe_path = make_dir_path(dirbuf);
     
-    mkcol(sess, stripe_path);
-    
-    // 记录已创建
-    {
-        std::lock_guard<std::mutex> lock(dir_cache_mu_);
-        created_stripe_dirs_.insert(stripe_id);
+    if (mkcol(sess, stripe_path)) {
+        remember_dir(stripe_id);
     }
 }
 
-// 读取 chunk - 响应体接收器
-struct ReadBodyContext {
-    std::string* out;
-};
-
-static int read_body_reader(void* userdata, const char* buf, size_t len)
+// 读取 chunk：按 Content-Length 一次分配，响应体直接读入 out
+static int read_response(ne_request* req, std::string& out)
 {
-    auto* ctx = static_cast<ReadBodyContext*>(userdata);
-    ctx->out->append(buf, len);
-    return 0;
+    int ret;
+    do {
+        out.clear();
+        ret = ne_begin_request(req);
+        if (ret != NE_OK) break;
+
+        const ne_status* status = ne_get_status(req);
+        if (status->code < 200 || status->code >= 300) {
+            ret = ne_discard_response(req);
+            if (ret == NE_OK) ret = ne_end_request(req);
+            continue;
+        }
+
+        const char* length = ne_get_response_header(req, "Content-Length");
+        size_t expect = length ? std::strtoull(length, nullptr, 10) : 0;
+        size_t pos = 0;
+        out.resize(expect > 0 ? expect : 64 * 1024);
+
+        for (;;) {
+            if (pos == out.size()) out.resize(out.size() * 2);
+            ssize_t n = ne_read_response_block(req, &out[pos], out.size() - pos);
+            if (n < 0) {
+                ret = NE_ERROR;
+                break;
+            }
+            if (n == 0) break;
+            pos += (size_t)n;
+        }
+        out.resize(pos);
+        if (ret != NE_OK) break;
+
+        ret = ne_end_request(req);
+    } while (ret == NE_RETRY);
+    return ret;
 }
 
 bool WebDavChunkStore::read_chunk(uint64_t stripe_id,
                                   uint32_t chunk_index,
                                   std::string& out)
+{
+    return read_chunk_status(stripe_id, chunk_index, out) == ChunkStatus::OK;
+}
+
+ChunkStatus WebDavChunkStore::read_chunk_status(uint64_t stripe_id,
+                                                uint32_t chunk_index,
+                                                std::string& out)
 {
     std::string path = make_path(stripe_id, chunk_index);
     
     for (int attempt = 0; attempt < WEBDAV_MAX_RETRIES; ++attempt) {
         NeonHandle sess(*neon_pool_);
-        
-        out.clear();
+        if (!sess.get()) continue;
         
         // 创建 GET 请求
         ne_request* req = ne_request_create(sess, "GET", path.c_str());
         
-        // 设置响应体处理
-        ReadBodyContext ctx{&out};
-        ne_add_response_body_reader(req, ne_accept_2xx, read_body_reader, &ctx);
-        
-        int ret = ne_request_dispatch(req);
+        int ret = read_response(req, out);
         const ne_status* status = ne_get_status(req);
         int http_code = status ? status->code : 0;
         
         ne_request_destroy(req);
         
         if (ret == NE_OK && http_code >= 200 && http_code < 300) {
-            return true;
+            // chunk 存在说明目录存在，之后覆盖写时跳过 MKCOL
+            remember_dir(stripe_id);
+            return ChunkStatus::OK;
         }
         
         if (http_code == 404) {
             out.clear();
-            return false;
+            return ChunkStatus::NOT_FOUND;
         }
         
-        std::fprintf(stderr, "WebDavChunkStore::read_chunk: %s attempt %d failed, HTTP %d, error: %s\n",
-                     path.c_str(), attempt + 1, http_code, ne_get_error(sess));
+        LOG_WARN("WebDavChunkStore::read_chunk: %s attempt %d failed, HTTP %d, error: %s\n",
+                 path.c_str(), attempt + 1, http_code, ne_get_error(sess));
     }
     
-    std::fprintf(stderr, "WebDavChunkStore::read_chunk: %s failed after %d retries\n",
-                 path.c_str(), WEBDAV_MAX_RETRIES);
-    return false;
+    out.clear();
+    LOG_ERROR("WebDavChunkStore::read_chunk: %s failed after %d retries\n",
+              path.c_str(), WEBDAV_MAX_RETRIES);
+    return ChunkStatus::ERROR;
 }
 
-// 写入 chunk - 请求体提供器
-struct WriteBodyContext {
-    const char* ptr;
-    size_t left;
-};
-
-static ssize_t write_body_provider(void* userdata, char* buffer, size_t buflen)
+// 发送一次 PUT：请求体直接从 data 发送，不经中间缓冲
+int WebDavChunkStore::put_once(const std::string& path, const std::string& data)
 {
-    auto* ctx = static_cast<WriteBodyContext*>(userdata);
-    
-    if (ctx->left == 0) {
-        return 0;  // 数据已全部发送
+    NeonHandle sess(*neon_pool_);
+    if (!sess.get()) return 0;
+
+    ne_request* req = ne_request_create(sess, "PUT", path.c_str());
+    ne_set_request_body_buffer(req, data.data(), data.size());
+    ne_add_request_header(req, "Content-Type", "application/octet-stream");
+
+    int ret = ne_request_dispatch(req);
+    const ne_status* status = ne_get_status(req);
+    int http_code = status ? status->code : 0;
+
+    ne_request_destroy(req);
+
+    if (ret != NE_OK || http_code < 200 || http_code >= 300) {
+        LOG_WARN("WebDavChunkStore::write_chunk: %s failed, HTTP %d, error: %s\n",
+                 path.c_str(), http_code, ne_get_error(sess));
     }
-    
-    size_t to_copy = (ctx->left < buflen) ? ctx->left : buflen;
-    std::memcpy(buffer, ctx->ptr, to_copy);
-    ctx->ptr += to_copy;
-    ctx->left -= to_copy;
-    
-    return static_cast<ssize_t>(to_copy);
+    return ret == NE_OK ? http_code : 0;
 }
 
 bool WebDavChunkStore::write_chunk(uint64_t stripe_id,
                                    uint32_t chunk_index,
                                    const std::string& data)
 {
-    // 确保目录存在（带缓存）
-    ensure_stripe_dir(stripe_id);
-    
     std::string path = make_path(stripe_id, chunk_index);
     
     for (int attempt = 0; attempt < WEBDAV_MAX_RETRIES; ++attempt) {
-        NeonHandle sess(*neon_pool_);
-        
-        // 创建 PUT 请求
-        ne_request* req = ne_request_create(sess, "PUT", path.c_str());
-        
-        // 设置请求体
-        WriteBodyContext ctx{data.data(), data.size()};
-        ne_set_request_body_provider(req, data.size(), write_body_provider, &ctx);
-        
-        // 设置 Content-Type
-        ne_add_request_header(req, "Content-Type", "application/octet-stream");
-        
-        int ret = ne_request_dispatch(req);
-        const ne_status* status = ne_get_status(req);
-        int http_code = status ? status->code : 0;
-        
-        ne_request_destroy(req);
-        
-        if (ret == NE_OK && http_code >= 200 && http_code < 300) {
+        // 目录未知时先创建；已知存在时直接 PUT，省去一次往返
+        ensure_stripe_dir(stripe_id);
+
+        int http_code = put_once(path, data);
+        if (http_code >= 200 && http_code < 300) {
+            remember_dir(stripe_id);
             return true;
         }
-        
-        std::fprintf(stderr, "WebDavChunkStore::write_chunk: %s attempt %d failed, HTTP %d, error: %s\n",
-                     path.c_str(), attempt + 1, http_code, ne_get_error(sess));
+
+        // 409 Conflict / 404：目录实际不存在（被外部删除），下次重新 MKCOL
+        if (http_code == 409 || http_code == 404) {
+            forget_dir(stripe_id);
+        }
     }
     
-    std::fprintf(stderr, "WebDavChunkStore::write_chunk: %s failed after %d retries\n",
-                 path.c_str(), WEBDAV_MAX_RETRIES);
+    LOG_ERROR("WebDavChunkStore::write_chunk: %s failed after %d retries\n",
+              path.c_str(), WEBDAV_MAX_RETRIES);
     return false;
 }
 
-// 删除 chunk
+// 删除 chunk（目录保留，之后覆盖写时无需重建）
 bool WebDavChunkStore::delete_chunk(uint64_t stripe_id, uint32_t chunk_id)
 {
     std::string path = make_path(stripe_id, chunk_id);
 
     for (int attempt = 0; attempt < WEBDAV_MAX_RETRIES; ++attempt) {
         NeonHandle sess(*neon_pool_);
+        if (!sess.get()) continue;
 
         // 创建 DELETE 请求
         ne_request* req = ne_request_create(sess, "DELETE", path.c_str());
@@ -380,8 +528,8 @@ bool WebDavChunkStore::delete_chunk(uint64_t stripe_id, uint32_t chunk_id)
             return true;
         }
 
-        std::fprintf(stderr, "WebDavChunkStore::delete_chunk: %s attempt %d failed, HTTP %d, error: %s\n",
-                     path.c_str(), attempt + 1, http_code, ne_get_error(sess));
+        LOG_WARN("WebDavChunkStore::delete_chunk: %s attempt %d failed, HTTP %d, error: %s\n",
+                 path.c_str(), attempt + 1, http_code, ne_get_error(sess));
     }
 
     return false;
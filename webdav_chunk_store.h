@@ -9,11 +9,26 @@
 #include <neon/ne_uri.h>
 #include <string>
 #include <mutex>
-#include <queue>
+#include <deque>
 #include <unordered_set>
 #include <memory>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+// WebDAV 后端连接配置
+struct WebDavConfig {
+    size_t connections = 16;               // 最大并发请求（连接）数
+    size_t warm_connections = 2;           // 启动时预先建立、空闲时保持的连接数
+    uint64_t keepalive_interval_ms = 15000; // 空闲连接探活间隔（毫秒），0 不探活
+};
 
 // Neon 会话池，避免频繁创建/销毁连接
+// - 同时借出的会话数不超过 connections，超出时 acquire 等待
+// - 归还的会话保持长连接，优先复用最近使用的会话
+// - 后台线程预先建立 warm_connections 个连接，并定期对空闲连接发送 OPTIONS 探活：
+//   失败的连接被丢弃重建，服务器的空闲超时不会让下一次请求重新握手
 class NeonPool {
 public:
     explicit NeonPool(const std::string& scheme,
@@ -21,10 +36,12 @@ public:
                       int port,
                       const std::string& username,
                       const std::string& password,
-                      size_t max_size = 16);
+                      const std::string& probe_path,
+                      const WebDavConfig& config = WebDavConfig());
     
     ~NeonPool();
     
+    // 借出会话，创建失败返回 nullptr
     ne_session* acquire();
     void release(ne_session* sess);
 
@@ -34,11 +51,28 @@ private:
     int port_;
     std::string username_;
     std::string password_;
-    
-    std::queue<ne_session*> pool_;
+    std::string probe_path_;
+    WebDavConfig config_;
+
+    struct Idle {
+        ne_session* sess;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    std::deque<Idle> idle_;        // 尾部为最近归还的会话
+    size_t in_use_ = 0;            // 已借出（含探活中）的会话数
     std::mutex mu_;
-    size_t max_size_;
-    
+    std::condition_variable cv_;
+
+    std::thread keeper_;
+    std::condition_variable stop_cv_;
+    bool stop_ = false;
+
+    void keeper_loop();
+
+    // 发送 OPTIONS 建立 / 检查连接
+    bool probe(ne_session* sess);
+
     ne_session* create_session();
     static int auth_callback(void* userdata, const char* realm, int attempt,
                              char* username, char* password);
@@ -66,7 +100,8 @@ class WebDavChunkStore : public ChunkStore {
 public:
     WebDavChunkStore(const std::string& base_url,
                      const std::string& username = "",
-                     const std::string& password = "");
+                     const std::string& password = "",
+                     const WebDavConfig& config = WebDavConfig());
 
     ~WebDavChunkStore();
 
@@ -74,6 +109,11 @@ public:
                     uint32_t chunk_index,
                     std::string& out) override;
 
+    // HTTP 404 时返回 NOT_FOUND
+    ChunkStatus read_chunk_status(uint64_t stripe_id,
+                                  uint32_t chunk_index,
+                                  std::string& out) override;
+
     bool write_chunk(uint64_t stripe_id,
                      uint32_t chunk_index,
                      const std::string& data) override;
@@ -86,15 +126,24 @@ private:
     std::string base_path_;
     std::string username_;
     std::string password_;
+    WebDavConfig config_;
     
     // 连接池
     std::unique_ptr<NeonPool> neon_pool_;
     
-    // 已创建目录缓存（避免重复 MKCOL）
-    std::unordered_set<uint64_t> created_stripe_dirs_;
+    // 已知存在的条带目录（写入前跳过 MKCOL）
+    // 成功读写 chunk 后登记；超过上限时清空，之后按需重新确认
+    std::unordered_set<uint64_t> known_stripe_dirs_;
     std::mutex dir_cache_mu_;
     bool stripes_dir_created_ = false;
 
+    bool dir_known(uint64_t stripe_id);
+    void remember_dir(uint64_t stripe_id);
+    void forget_dir(uint64_t stripe_id);
+
+    // 发送一次 PUT，返回 HTTP 状态码（连接失败为 0）
+    int put_once(const std::string& path, const std::string& data);
+
     std::string make_path(uint64_t stripe_id, uint32_t chunk_index) const;
     std::string make_dir_path(const std::string& rel_path) const;
     